@@ -65,6 +65,7 @@
 #include "device/include/interop.h"
 #include "osi/include/alarm.h"
 #include "osi/include/allocation_tracker.h"
+#include "osi/include/buffer_pool.h"
 #include "osi/include/log.h"
 #include "osi/include/metrics.h"
 #include "osi/include/osi.h"
@@ -321,6 +322,7 @@ static void dump(int fd, const char** arguments) {
   BTA_HfClientDumpStatistics(fd);
   wakelock_debug_dump(fd);
   osi_allocator_debug_dump(fd);
+  buffer_pool_debug_dump(fd);
   alarm_debug_dump(fd);
   HearingAid::DebugDump(fd);
 #if (BTSNOOP_MEM == TRUE)
@@ -65,6 +65,10 @@ static const char* CONFIG_LEGACY_FILE_PATH =
 #endif  // defined(OS_GENERIC)
 static const period_ms_t CONFIG_SETTLE_PERIOD_MS = 3000;
 
+// Saves only append what changed to the journal of the config file until the
+// journal reaches this size, then the whole file is written again.
+static const size_t CONFIG_JOURNAL_MAX_SIZE = 32 * 1024;
+
 static void timer_config_save_cb(void* data);
 static void btif_config_write(uint16_t event, char* p_param);
 static bool is_factory_reset(void);
@@ -116,6 +120,9 @@ bool btif_get_address_type(const RawAddress& bda, int* p_addr_type) {
 
 static std::mutex config_lock;  // protects operations on |config|.
 static std::unique_ptr<config_t> config;
+// What was last written to |CONFIG_FILE_PATH|, also protected by
+// |config_lock|.
+static std::unique_ptr<config_t> config_saved;
 static alarm_t* config_timer;
 
 // Module lifecycle functions
@@ -221,6 +228,7 @@ static future_t* clean_up(void) {
 
   std::unique_lock<std::mutex> lock(config_lock);
   config.reset();
+  config_saved.reset();
   return future_new_immediate(FUTURE_SUCCESS);
 }
 
@@ -411,6 +419,7 @@ bool btif_config_clear(void) {
   config = config_new_empty();
 
   bool ret = config_save(*config, CONFIG_FILE_PATH);
+  config_saved.reset();
   btif_config_source = RESET;
   return ret;
 }
@@ -428,10 +437,29 @@ static void btif_config_write(UNUSED_ATTR uint16_t event,
   CHECK(config_timer != NULL);
 
   std::unique_lock<std::mutex> lock(config_lock);
-  rename(CONFIG_FILE_PATH, CONFIG_BACKUP_PATH);
   std::unique_ptr<config_t> config_paired = config_new_clone(*config);
   btif_config_remove_unpaired(config_paired.get());
-  config_save(*config_paired, CONFIG_FILE_PATH);
+
+  if (config_saved &&
+      config_journal_size(CONFIG_FILE_PATH) < CONFIG_JOURNAL_MAX_SIZE &&
+      config_save_journal(*config_saved, *config_paired, CONFIG_FILE_PATH)) {
+    config_saved = std::move(config_paired);
+    return;
+  }
+
+  // The backup keeps the journal that goes with it
+  const std::string journal_path =
+      std::string(CONFIG_FILE_PATH) + CONFIG_JOURNAL_SUFFIX;
+  const std::string backup_journal_path =
+      std::string(CONFIG_BACKUP_PATH) + CONFIG_JOURNAL_SUFFIX;
+  unlink(backup_journal_path.c_str());
+  rename(CONFIG_FILE_PATH, CONFIG_BACKUP_PATH);
+  rename(journal_path.c_str(), backup_journal_path.c_str());
+
+  if (config_save(*config_paired, CONFIG_FILE_PATH))
+    config_saved = std::move(config_paired);
+  else
+    config_saved.reset();
 }
 
 static void btif_config_remove_unpaired(config_t* conf) {
@@ -452,7 +480,7 @@ static void btif_config_remove_unpaired(config_t* conf) {
           !config_has_key(*conf, section, "LE_KEY_PCSRK") &&
           !config_has_key(*conf, section, "LE_KEY_LENC") &&
           !config_has_key(*conf, section, "LE_KEY_LCSRK")) {
-        it = conf->sections.erase(it);
+        it = config_remove_section(conf, it);
         continue;
       }
       paired_devices++;
@@ -507,7 +535,7 @@ static void btif_config_remove_restricted(config_t* config) {
         config_has_key(*config, section, "Restricted")) {
       BTIF_TRACE_DEBUG("%s: Removing restricted device %s", __func__,
                        section.c_str());
-      it = config->sections.erase(it);
+      it = config_remove_section(config, it);
       continue;
     }
     it++;
@@ -523,5 +551,7 @@ static bool is_factory_reset(void) {
 static void delete_config_files(void) {
   remove(CONFIG_FILE_PATH);
   remove(CONFIG_BACKUP_PATH);
+  remove((std::string(CONFIG_FILE_PATH) + CONFIG_JOURNAL_SUFFIX).c_str());
+  remove((std::string(CONFIG_BACKUP_PATH) + CONFIG_JOURNAL_SUFFIX).c_str());
   osi_property_set("persist.bluetooth.factoryreset", "false");
 }
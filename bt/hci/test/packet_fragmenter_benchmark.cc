@@ -0,0 +1,127 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <string.h>
+
+#include "bt_target.h"
+#include "device/include/controller.h"
+#include "hci_internals.h"
+#include "osi/include/allocation_tracker.h"
+#include "osi/include/allocator.h"
+#include "osi/include/buffer_pool.h"
+#include "packet_fragmenter.h"
+
+// Test function only, see allocation_tracker.cc
+void allocation_tracker_uninit(void);
+
+// A2DP media packets as produced by the SBC encoder for an L2CAP MTU of 895,
+// sent over 2-DH5 ACL packets of 679 bytes.
+static const uint16_t MEDIA_PAYLOAD_SIZE = 895;
+static const uint16_t ACL_DATA_SIZE = 679;
+static const uint16_t TEST_HANDLE = 0x0042;
+static const uint16_t TEST_CID = 0x0040;
+#define L2CAP_HEADER_SIZE 4
+
+enum { ALLOCATOR_MALLOC, ALLOCATOR_BUFFER_POOL };
+
+static const allocator_t* allocator;
+static const packet_fragmenter_t* fragmenter;
+static size_t reassembled_bytes;
+
+static uint16_t get_acl_data_size(void) { return ACL_DATA_SIZE; }
+
+// The controller loops every outgoing ACL fragment back, as received by the
+// HCI layer in a new buffer.
+static void fragmented_callback(BT_HDR* packet, bool send_complete) {
+  BT_HDR* inbound = (BT_HDR*)allocator->alloc(BT_HDR_SIZE + packet->len);
+  inbound->event = MSG_HC_TO_STACK_HCI_ACL;
+  inbound->len = packet->len;
+  inbound->offset = 0;
+  inbound->layer_specific = 0;
+  memcpy(inbound->data, packet->data + packet->offset, packet->len);
+
+  if (send_complete) allocator->free(packet);
+  fragmenter->reassemble_and_dispatch(inbound);
+}
+
+// Stands in for L2CAP handing the SDU to AVDTP and the sink decoder.
+static void reassembled_callback(BT_HDR* packet) {
+  reassembled_bytes += packet->len;
+  allocator->free(packet);
+}
+
+static void transmit_finished_callback(BT_HDR* packet,
+                                       bool all_fragments_sent) {
+  if (all_fragments_sent) allocator->free(packet);
+}
+
+// Builds an encoded media packet and the L2CAP and ACL headers in front of
+// it, the way the A2DP encoder, AVDTP and L2CAP share a single buffer.
+static BT_HDR* new_media_packet(void) {
+  BT_HDR* packet = (BT_HDR*)allocator->alloc(BT_DEFAULT_BUFFER_SIZE);
+  packet->event = MSG_STACK_TO_HC_HCI_ACL | LOCAL_BR_EDR_CONTROLLER_ID;
+  packet->offset = 0;
+  packet->len = HCI_ACL_PREAMBLE_SIZE + L2CAP_HEADER_SIZE + MEDIA_PAYLOAD_SIZE;
+  packet->layer_specific = 0;
+
+  uint8_t* stream = packet->data;
+  UINT16_TO_STREAM(stream, TEST_HANDLE | 0x2000);
+  UINT16_TO_STREAM(stream, L2CAP_HEADER_SIZE + MEDIA_PAYLOAD_SIZE);
+  UINT16_TO_STREAM(stream, MEDIA_PAYLOAD_SIZE);
+  UINT16_TO_STREAM(stream, TEST_CID);
+  memset(stream, 0x5A, MEDIA_PAYLOAD_SIZE);
+  return packet;
+}
+
+// Arguments are the allocator, and whether allocation tracking is enabled as
+// with BLUEDROID_DEBUG builds.
+static void BM_A2dpStream(benchmark::State& state) {
+  allocator = state.range(0) == ALLOCATOR_MALLOC ? &allocator_malloc
+                                                 : &allocator_buffer_pool;
+  if (state.range(1)) allocation_tracker_init();
+
+  static controller_t controller;
+  controller.get_acl_data_size_classic = get_acl_data_size;
+  controller.get_acl_data_size_ble = get_acl_data_size;
+
+  static packet_fragmenter_callbacks_t callbacks;
+  callbacks.fragmented = fragmented_callback;
+  callbacks.reassembled = reassembled_callback;
+  callbacks.transmit_finished = transmit_finished_callback;
+
+  fragmenter = packet_fragmenter_get_test_interface(&controller, allocator);
+  fragmenter->init(&callbacks);
+
+  reassembled_bytes = 0;
+  while (state.KeepRunning()) {
+    fragmenter->fragment_and_dispatch(new_media_packet());
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.SetBytesProcessed(reassembled_bytes);
+
+  fragmenter->cleanup();
+  if (state.range(1)) allocation_tracker_uninit();
+}
+BENCHMARK(BM_A2dpStream)
+    ->ArgPair(ALLOCATOR_MALLOC, 0)
+    ->ArgPair(ALLOCATOR_BUFFER_POOL, 0)
+    ->ArgPair(ALLOCATOR_MALLOC, 1)
+    ->ArgPair(ALLOCATOR_BUFFER_POOL, 1);
+
+BENCHMARK_MAIN();
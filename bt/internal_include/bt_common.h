@@ -21,4 +21,5 @@
 #include "bt_target.h"
 #include "bt_types.h"
 #include "osi/include/allocator.h"
+#include "osi/include/buffer_pool.h"
 #include "osi/include/compat.h"
@@ -0,0 +1,51 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "osi/include/allocator.h"
+
+// Pool of packet buffers (BT_HDR followed by its payload) for the data path.
+// Buffers are grouped in size classes up to slightly above
+// BT_DEFAULT_BUFFER_SIZE, and each thread keeps a small cache of free buffers
+// of each class so that most allocations and frees don't take any lock.
+// Pool buffers are not seen by the allocation tracker.
+
+// Allocates a buffer of at least |size| bytes. The contents of the buffer are
+// not initialized. Requests that don't fit in any size class, or that come
+// when the pool is exhausted, are served by |osi_malloc|. Either way the
+// buffer is released with |osi_free| or |buffer_pool_free|.
+void* buffer_pool_alloc(size_t size);
+
+// Releases a buffer allocated with |buffer_pool_alloc|. |ptr| may be NULL.
+void buffer_pool_free(void* ptr);
+
+// Returns true if |ptr| is a buffer of the pool, as opposed to one allocated
+// with |osi_malloc|. This function is safe to call before the pool is used.
+bool buffer_pool_contains(const void* ptr);
+
+// allocator_t abstraction for the |buffer_pool_alloc| and |buffer_pool_free|
+// functions.
+extern const allocator_t allocator_buffer_pool;
+
+// Dump the per-size class usage and high-water marks of the pool to the |fd|
+// file descriptor. The caller is responsible for closing the |fd|.
+void buffer_pool_debug_dump(int fd);
@@ -15,28 +15,54 @@
 //   empty sections.
 // - Duplicate keys in a section will overwrite previous values.
 // - All strings are case sensitive.
+// - Sections and keys are indexed by name and keep the order in which they
+//   were added, which is also the order they are saved in.
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <list>
 #include <memory>
 #include <string>
+#include <unordered_map>
 
 // The default section name to use if a key/value pair is not defined within
 // a section.
 #define CONFIG_DEFAULT_SECTION "Global"
 
+// Appended to the name of a config file to get the name of its journal, see
+// |config_save_journal|.
+#define CONFIG_JOURNAL_SUFFIX ".journal"
+
 struct entry_t {
   std::string key;
   std::string value;
 };
 
+// The indexes are maintained by the config_* functions. Sections must only be
+// added and removed through them, but may be iterated over directly.
 struct section_t {
   std::string name;
   std::list<entry_t> entries;
+  std::unordered_map<std::string, std::list<entry_t>::iterator> entry_index;
+
+  section_t() = default;
+  explicit section_t(const std::string& name) : name(name) {}
+  section_t(const section_t& other);
+  section_t(section_t&& other) = default;
+  section_t& operator=(const section_t& other);
+  section_t& operator=(section_t&& other) = default;
 };
 
 struct config_t {
   std::list<section_t> sections;
+  std::unordered_map<std::string, std::list<section_t>::iterator>
+      section_index;
+
+  config_t() = default;
+  config_t(const config_t& other);
+  config_t(config_t&& other) = default;
+  config_t& operator=(const config_t& other);
+  config_t& operator=(config_t&& other) = default;
 };
 
 // Creates a new config object with no entries (i.e. not backed by a file).
@@ -46,7 +72,8 @@ std::unique_ptr<config_t> config_new_empty(void);
 // Loads the specified file and returns a handle to the config file. If there
 // was a problem loading the file, this function returns
 // NULL. |filename| must not be NULL and must point to a readable
-// file on the filesystem.
+// file on the filesystem. Changes saved to the journal of |filename| with
+// |config_save_journal| are applied on top of the file.
 std::unique_ptr<config_t> config_new(const char* filename);
 
 // Clones |src|, including all of it's sections, keys, and values.
@@ -119,6 +146,12 @@ void config_set_string(config_t* config, const std::string& section,
 // |config| may be NULL.
 bool config_remove_section(config_t* config, const std::string& section);
 
+// Removes the section at |section| from |config|, which must not be NULL, and
+// returns the section following it. This is meant for removing sections while
+// iterating over |config->sections|.
+std::list<section_t>::iterator config_remove_section(
+    config_t* config, std::list<section_t>::iterator section);
+
 // Removes one specific |key| residing in |section| of the |config|. Returns
 // true
 // if the section and key were found and the key was removed, false otherwise.
@@ -132,4 +165,21 @@ bool config_remove_key(config_t* config, const std::string& section,
 // file was opened with |config_new| and subsequently overwritten with
 // |config_save|, all comments and special formatting in the original file will
 // be lost. Neither |config| nor |filename| may be NULL.
+// The journal of |filename|, if any, is removed since the file now contains
+// all of its changes.
 bool config_save(const config_t& config, const std::string& filename);
+
+// Appends the changes that turn |saved| into |config| to the journal of
+// |filename|, which is |filename| followed by |CONFIG_JOURNAL_SUFFIX|.
+// |saved| must be the config that |config_new| would load from |filename|,
+// i.e. what was last written with |config_save| or |config_save_journal|.
+// Unlike |config_save| this only writes the sections and keys that changed,
+// at the cost of the journal growing until the next |config_save|.
+// Returns false if the journal could not be written, in which case the
+// caller should fall back to |config_save|.
+bool config_save_journal(const config_t& saved, const config_t& config,
+                         const std::string& filename);
+
+// Returns the size in bytes of the journal of |filename|, or 0 if there is
+// none.
+size_t config_journal_size(const std::string& filename);
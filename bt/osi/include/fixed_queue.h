@@ -36,6 +36,18 @@ typedef void (*fixed_queue_cb)(fixed_queue_t* queue, void* context);
 // the returned queue with |fixed_queue_free|.
 fixed_queue_t* fixed_queue_new(size_t capacity);
 
+// Creates a new fixed queue with the given |capacity| that producers and
+// consumers use without taking a lock. Elements are kept in a ring of
+// |capacity| slots allocated up front, so |capacity| may not be 0 and should
+// be small. The dequeue fd is only signaled when the queue becomes non-empty:
+// a consumer woken up by it must dequeue until the queue is empty, which
+// |fixed_queue_dequeue_batch| and |fixed_queue_register_dequeue| callbacks do.
+// |fixed_queue_try_peek_last|, |fixed_queue_try_remove_from_queue|,
+// |fixed_queue_get_list| and |fixed_queue_get_enqueue_fd| are not supported.
+// Returns NULL on failure. The caller must free the returned queue with
+// |fixed_queue_free|.
+fixed_queue_t* fixed_queue_new_lockfree(size_t capacity);
+
 // Frees a queue and (optionally) the enqueued elements.
 // |queue| is the queue to free. If the |free_cb| callback is not null,
 // it is called on each queue element to free it.
@@ -81,6 +93,13 @@ bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data);
 // immediately. Otherwise, the next element in the queue is returned.
 void* fixed_queue_try_dequeue(fixed_queue_t* queue);
 
+// Dequeues up to |max_count| elements from |queue| into |data| without
+// blocking the caller. Returns the number of elements dequeued. Neither
+// |queue| nor |data| may be NULL. If |max_count| elements are dequeued and
+// more are left, the dequeue fd stays readable.
+size_t fixed_queue_dequeue_batch(fixed_queue_t* queue, void** data,
+                                 size_t max_count);
+
 // Returns the first element from |queue|, if present, without dequeuing it.
 // This function will never block the caller. Returns NULL if there are no
 // elements in the queue or |queue| is NULL.
@@ -36,11 +36,12 @@
 
 #include <hardware/bluetooth.h>
 
+#include <algorithm>
 #include <mutex>
+#include <vector>
 
 #include "osi/include/allocator.h"
 #include "osi/include/fixed_queue.h"
-#include "osi/include/list.h"
 #include "osi/include/log.h"
 #include "osi/include/osi.h"
 #include "osi/include/semaphore.h"
@@ -106,8 +107,14 @@ struct alarm_t {
 
   bool for_msg_loop;  // True, if the alarm should be processed on message loop
   CancelableClosureInStruct closure;  // posted to message loop for processing
+
+  size_t heap_index;  // Position in |alarms|, or ALARM_NOT_PENDING
+  uint64_t sequence;  // Orders alarms with the same deadline by when they were
+                      // set
 };
 
+static const size_t ALARM_NOT_PENDING = SIZE_MAX;
+
 // If the next wakeup time is less than this threshold, we should acquire
 // a wakelock instead of setting a wake alarm so we're not bouncing in
 // and out of suspend frequently. This value is externally visible to allow
@@ -123,9 +130,12 @@ static const clockid_t CLOCK_ID_ALARM = CLOCK_BOOTTIME_ALARM;
 
 // This mutex ensures that the |alarm_set|, |alarm_cancel|, and alarm callback
 // functions execute serially and not concurrently. As a result, this mutex
-// also protects the |alarms| list.
+// also protects |alarms|.
 static std::mutex alarms_mutex;
-static list_t* alarms;
+// Pending alarms as a binary min-heap, earliest deadline first. Setting and
+// cancelling an alarm is O(log n) in the number of pending alarms.
+static std::vector<alarm_t*>* alarms;
+static uint64_t next_alarm_sequence;
 static timer_t timer;
 static timer_t wakeup_timer;
 static bool timer_set;
@@ -160,6 +170,71 @@ static void update_scheduling_stats(alarm_stats_t* stats, period_ms_t now_ms,
 static void alarm_register_processing_queue(fixed_queue_t* queue,
                                             thread_t* thread);
 
+static bool alarm_before(const alarm_t* a, const alarm_t* b) {
+  if (a->deadline != b->deadline) return a->deadline < b->deadline;
+  return a->sequence < b->sequence;
+}
+
+// The caller must hold the |alarms_mutex|
+static alarm_t* alarm_heap_front(void) {
+  return alarms->empty() ? NULL : alarms->front();
+}
+
+static void alarm_heap_place(size_t index, alarm_t* alarm) {
+  (*alarms)[index] = alarm;
+  alarm->heap_index = index;
+}
+
+static void alarm_heap_sift_up(size_t index) {
+  alarm_t* alarm = (*alarms)[index];
+  while (index > 0) {
+    size_t parent = (index - 1) / 2;
+    if (!alarm_before(alarm, (*alarms)[parent])) break;
+    alarm_heap_place(index, (*alarms)[parent]);
+    index = parent;
+  }
+  alarm_heap_place(index, alarm);
+}
+
+static void alarm_heap_sift_down(size_t index) {
+  alarm_t* alarm = (*alarms)[index];
+  size_t size = alarms->size();
+  while (true) {
+    size_t child = 2 * index + 1;
+    if (child >= size) break;
+    if (child + 1 < size && alarm_before((*alarms)[child + 1], (*alarms)[child]))
+      child++;
+    if (!alarm_before((*alarms)[child], alarm)) break;
+    alarm_heap_place(index, (*alarms)[child]);
+    index = child;
+  }
+  alarm_heap_place(index, alarm);
+}
+
+// The caller must hold the |alarms_mutex|
+static void alarm_heap_push(alarm_t* alarm) {
+  alarms->push_back(alarm);
+  alarm_heap_sift_up(alarms->size() - 1);
+}
+
+// The caller must hold the |alarms_mutex|
+static void alarm_heap_remove(alarm_t* alarm) {
+  size_t index = alarm->heap_index;
+  if (index == ALARM_NOT_PENDING) return;
+
+  alarm->heap_index = ALARM_NOT_PENDING;
+  alarm_t* last = alarms->back();
+  alarms->pop_back();
+  if (last == alarm) return;
+
+  alarm_heap_place(index, last);
+  if (index > 0 && alarm_before(last, (*alarms)[(index - 1) / 2])) {
+    alarm_heap_sift_up(index);
+  } else {
+    alarm_heap_sift_down(index);
+  }
+}
+
 static void update_stat(stat_t* stat, period_ms_t delta) {
   if (stat->max_ms < delta) stat->max_ms = delta;
   stat->total_ms += delta;
@@ -189,6 +264,7 @@ static alarm_t* alarm_new_internal(const char* name, bool is_periodic) {
   ret->for_msg_loop = false;
   // placement new
   new (&ret->closure) CancelableClosureInStruct();
+  ret->heap_index = ALARM_NOT_PENDING;
 
   // NOTE: The stats were reset by osi_calloc() above
 
@@ -266,8 +342,7 @@ void alarm_cancel(alarm_t* alarm) {
 // Internal implementation of canceling an alarm.
 // The caller must hold the |alarms_mutex|
 static void alarm_cancel_internal(alarm_t* alarm) {
-  bool needs_reschedule =
-      (!list_is_empty(alarms) && list_front(alarms) == alarm);
+  bool needs_reschedule = (alarm_heap_front() == alarm);
 
   remove_pending_alarm(alarm);
 
@@ -307,7 +382,7 @@ void alarm_cleanup(void) {
   semaphore_free(alarm_expired);
   alarm_expired = NULL;
 
-  list_free(alarms);
+  delete alarms;
   alarms = NULL;
 }
 
@@ -321,11 +396,7 @@ static bool lazy_initialize(void) {
 
   std::lock_guard<std::mutex> lock(alarms_mutex);
 
-  alarms = list_new(NULL);
-  if (!alarms) {
-    LOG_ERROR(LOG_TAG, "%s unable to allocate alarm list.", __func__);
-    goto error;
-  }
+  alarms = new std::vector<alarm_t*>();
 
   if (!timer_create_internal(CLOCK_ID, &timer)) goto error;
   timer_initialized = true;
@@ -384,7 +455,7 @@ error:
 
   if (timer_initialized) timer_delete(timer);
 
-  list_free(alarms);
+  delete alarms;
   alarms = NULL;
 
   return false;
@@ -406,7 +477,7 @@ static period_ms_t now(void) {
 // Remove alarm from internal alarm list and the processing queue
 // The caller must hold the |alarms_mutex|
 static void remove_pending_alarm(alarm_t* alarm) {
-  list_remove(alarms, alarm);
+  alarm_heap_remove(alarm);
 
   if (alarm->for_msg_loop) {
     alarm->closure.i.Cancel();
@@ -421,10 +492,9 @@ static void remove_pending_alarm(alarm_t* alarm) {
 
 // Must be called with |alarms_mutex| held
 static void schedule_next_instance(alarm_t* alarm) {
-  // If the alarm is currently set and it's at the start of the list,
+  // If the alarm is currently set and it's the earliest one,
   // we'll need to re-schedule since we've adjusted the earliest deadline.
-  bool needs_reschedule =
-      (!list_is_empty(alarms) && list_front(alarms) == alarm);
+  bool needs_reschedule = (alarm_heap_front() == alarm);
   if (alarm->callback) remove_pending_alarm(alarm);
 
   // Calculate the next deadline for this alarm
@@ -434,26 +504,14 @@ static void schedule_next_instance(alarm_t* alarm) {
     ms_into_period = ((just_now - alarm->creation_time) % alarm->period);
   alarm->deadline = just_now + (alarm->period - ms_into_period);
 
-  // Add it into the timer list sorted by deadline (earliest deadline first).
-  if (list_is_empty(alarms) ||
-      ((alarm_t*)list_front(alarms))->deadline > alarm->deadline) {
-    list_prepend(alarms, alarm);
-  } else {
-    for (list_node_t* node = list_begin(alarms); node != list_end(alarms);
-         node = list_next(node)) {
-      list_node_t* next = list_next(node);
-      if (next == list_end(alarms) ||
-          ((alarm_t*)list_node(next))->deadline > alarm->deadline) {
-        list_insert_after(alarms, node, alarm);
-        break;
-      }
-    }
-  }
+  // Add it to the pending alarms. Alarms with the same deadline fire in the
+  // order they were set.
+  alarm->sequence = next_alarm_sequence++;
+  alarm_heap_push(alarm);
 
   // If the new alarm has the earliest deadline, we need to re-evaluate our
   // schedule.
-  if (needs_reschedule ||
-      (!list_is_empty(alarms) && list_front(alarms) == alarm)) {
+  if (needs_reschedule || alarm_heap_front() == alarm) {
     reschedule_root_alarm();
   }
 }
@@ -470,9 +528,9 @@ static void reschedule_root_alarm(void) {
   struct itimerspec timer_time;
   memset(&timer_time, 0, sizeof(timer_time));
 
-  if (list_is_empty(alarms)) goto done;
+  if (alarms->empty()) goto done;
 
-  next = static_cast<alarm_t*>(list_front(alarms));
+  next = alarm_heap_front();
   next_expiration = next->deadline - now();
   if (next_expiration < TIMER_INTERVAL_FOR_WAKELOCK_IN_MS) {
     if (!timer_set) {
@@ -619,44 +677,51 @@ static void timer_callback(UNUSED_ATTR void* ptr) {
 //   (2) Dispatches the alarm callback for processing by the corresponding
 // thread for that alarm.
 static void callback_dispatch(UNUSED_ATTR void* context) {
+  // Alarms that expired together, only used by this thread
+  std::vector<alarm_t*> expired;
+
   while (true) {
     semaphore_wait(alarm_expired);
     if (!dispatcher_thread_active) break;
 
     std::lock_guard<std::mutex> lock(alarms_mutex);
-    alarm_t* alarm;
 
     // Take into account that the alarm may get cancelled before we get to it.
-    // We're done here if there are no alarms or the alarm at the front is in
-    // the future. Exit right away since there's nothing left to do.
-    if (list_is_empty(alarms) ||
-        (alarm = static_cast<alarm_t*>(list_front(alarms)))->deadline > now()) {
-      reschedule_root_alarm();
-      continue;
+    // Take every alarm that has expired by now, so the timer is re-armed once
+    // for all of them rather than once per alarm.
+    period_ms_t just_now = now();
+    expired.clear();
+    while (true) {
+      alarm_t* alarm = alarm_heap_front();
+      if (alarm == NULL || alarm->deadline > just_now) break;
+      alarm_heap_remove(alarm);
+      expired.push_back(alarm);
     }
 
-    list_remove(alarms, alarm);
-
-    if (alarm->is_periodic) {
-      alarm->prev_deadline = alarm->deadline;
-      schedule_next_instance(alarm);
-      alarm->stats.rescheduled_count++;
+    for (alarm_t* alarm : expired) {
+      if (alarm->is_periodic) {
+        alarm->prev_deadline = alarm->deadline;
+        schedule_next_instance(alarm);
+        alarm->stats.rescheduled_count++;
+      }
     }
     reschedule_root_alarm();
 
-    // Enqueue the alarm for processing
-    if (alarm->for_msg_loop) {
-      if (!get_message_loop()) {
-        LOG_ERROR(LOG_TAG, "%s: message loop already NULL. Alarm: %s", __func__,
-                  alarm->stats.name);
-        continue;
+    // Enqueue the alarms for processing
+    for (alarm_t* alarm : expired) {
+      if (alarm->for_msg_loop) {
+        if (!get_message_loop()) {
+          LOG_ERROR(LOG_TAG, "%s: message loop already NULL. Alarm: %s",
+                    __func__, alarm->stats.name);
+          continue;
+        }
+
+        alarm->closure.i.Reset(Bind(alarm_ready_mloop, alarm));
+        get_message_loop()->task_runner()->PostTask(
+            FROM_HERE, alarm->closure.i.callback());
+      } else {
+        fixed_queue_enqueue(alarm->queue, alarm);
       }
-
-      alarm->closure.i.Reset(Bind(alarm_ready_mloop, alarm));
-      get_message_loop()->task_runner()->PostTask(FROM_HERE,
-                                                  alarm->closure.i.callback());
-    } else {
-      fixed_queue_enqueue(alarm->queue, alarm);
     }
   }
 
@@ -735,12 +800,12 @@ void alarm_debug_dump(int fd) {
 
   period_ms_t just_now = now();
 
-  dprintf(fd, "  Total Alarms: %zu\n\n", list_length(alarms));
+  dprintf(fd, "  Total Alarms: %zu\n\n", alarms->size());
 
-  // Dump info for each alarm
-  for (list_node_t* node = list_begin(alarms); node != list_end(alarms);
-       node = list_next(node)) {
-    alarm_t* alarm = (alarm_t*)list_node(node);
+  // Dump info for each alarm, earliest deadline first
+  std::vector<alarm_t*> sorted(*alarms);
+  std::sort(sorted.begin(), sorted.end(), alarm_before);
+  for (alarm_t* alarm : sorted) {
     alarm_stats_t* stats = &alarm->stats;
 
     dprintf(fd, "  Alarm : %s (%s)\n", stats->name,
@@ -21,6 +21,7 @@
 
 #include "osi/include/allocation_tracker.h"
 #include "osi/include/allocator.h"
+#include "osi/include/buffer_pool.h"
 
 static const allocator_id_t alloc_allocator_id = 42;
 
@@ -70,6 +71,10 @@ void* osi_calloc(size_t size) {
 }
 
 void osi_free(void* ptr) {
+  if (buffer_pool_contains(ptr)) {
+    buffer_pool_free(ptr);
+    return;
+  }
   free(allocation_tracker_notify_free(alloc_allocator_id, ptr));
 }
 
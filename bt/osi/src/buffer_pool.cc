@@ -0,0 +1,268 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#define LOG_TAG "bt_osi_buffer_pool"
+
+#include "internal_include/bt_target.h"
+
+#include "osi/include/buffer_pool.h"
+
+#include <base/logging.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include <atomic>
+#include <mutex>
+
+#include "osi/include/allocator.h"
+#include "osi/include/log.h"
+#include "osi/include/osi.h"
+
+// Buffers are carved out of slabs of a single virtual memory reservation, so
+// that |buffer_pool_contains| is a range check and the size class of a buffer
+// is found from the slab it is in.
+#define POOL_SLAB_SIZE (64 * 1024)
+#define POOL_MAX_SLABS 256
+#define POOL_ARENA_SIZE (POOL_SLAB_SIZE * POOL_MAX_SLABS)
+
+// Large enough for a BT_DEFAULT_BUFFER_SIZE buffer cloned by L2CAP with the
+// FCS and the ERTM statistics timestamp appended.
+#define POOL_MAX_BUFFER_SIZE ((BT_DEFAULT_BUFFER_SIZE + 64 + 15) & ~15)
+
+// Free buffers kept by each thread for each size class. When a thread cache
+// is empty or full, half of this is moved from or to the shared free list.
+#define THREAD_CACHE_SIZE 32
+
+typedef struct pool_buffer_t { struct pool_buffer_t* next; } pool_buffer_t;
+
+typedef struct {
+  size_t buffer_size;
+
+  // Guarded by |pool_lock|
+  pool_buffer_t* free_list;
+  size_t free_count;
+  size_t slab_count;
+
+  std::atomic<size_t> in_use;
+  std::atomic<size_t> high_water;
+} size_class_t;
+
+typedef struct {
+  pool_buffer_t* free_list;
+  size_t free_count;
+} thread_cache_t;
+
+static size_class_t size_classes[] = {
+    {64},   {128},  {256},  {512},  {1024},
+    {1536}, {2048}, {3072}, {POOL_MAX_BUFFER_SIZE},
+};
+
+#define NUM_SIZE_CLASSES (sizeof(size_classes) / sizeof(size_classes[0]))
+
+static_assert(POOL_MAX_BUFFER_SIZE <= POOL_SLAB_SIZE,
+              "Largest size class does not fit in a slab");
+
+// The thread caches return their buffers to the shared free lists when the
+// thread exits. Buffers freed after that, e.g. by other thread local
+// destructors, go straight to the shared free lists.
+struct thread_caches_t {
+  thread_cache_t classes[NUM_SIZE_CLASSES];
+  bool exited;
+
+  ~thread_caches_t();
+};
+
+static std::once_flag pool_initialized;
+static std::atomic<uintptr_t> arena;
+static std::mutex pool_lock;
+static size_t slab_count;                    // Guarded by |pool_lock|
+static uint8_t slab_classes[POOL_MAX_SLABS];  // Size class of each slab
+static std::atomic<size_t> fallback_count;
+
+static thread_local thread_caches_t thread_caches;
+
+static void pool_init(void) {
+  void* ptr = mmap(NULL, POOL_ARENA_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (ptr == MAP_FAILED) {
+    LOG_ERROR(LOG_TAG, "%s unable to reserve the buffer pool: %s", __func__,
+              strerror(errno));
+    return;
+  }
+  arena.store((uintptr_t)ptr, std::memory_order_release);
+}
+
+static size_t size_class_index(size_t size) {
+  size_t index = 0;
+  while (index < NUM_SIZE_CLASSES && size_classes[index].buffer_size < size)
+    index++;
+  return index;
+}
+
+// Splits a new slab into buffers of the |index| size class.
+// Must be called with |pool_lock| held.
+static bool add_slab(size_t index) {
+  uintptr_t base = arena.load(std::memory_order_relaxed);
+  if (base == 0 || slab_count == POOL_MAX_SLABS) return false;
+
+  size_class_t* size_class = &size_classes[index];
+  uint8_t* slab = (uint8_t*)base + slab_count * POOL_SLAB_SIZE;
+  slab_classes[slab_count++] = index;
+  size_class->slab_count++;
+
+  for (size_t offset = 0;
+       offset + size_class->buffer_size <= POOL_SLAB_SIZE;
+       offset += size_class->buffer_size) {
+    pool_buffer_t* buffer = (pool_buffer_t*)(slab + offset);
+    buffer->next = size_class->free_list;
+    size_class->free_list = buffer;
+    size_class->free_count++;
+  }
+  return true;
+}
+
+// Moves up to |count| buffers from the shared free list to |cache|.
+static bool refill_thread_cache(thread_cache_t* cache, size_t index,
+                                size_t count) {
+  size_class_t* size_class = &size_classes[index];
+
+  std::lock_guard<std::mutex> lock(pool_lock);
+  if (size_class->free_list == NULL && !add_slab(index)) return false;
+
+  while (count-- && size_class->free_list != NULL) {
+    pool_buffer_t* buffer = size_class->free_list;
+    size_class->free_list = buffer->next;
+    size_class->free_count--;
+
+    buffer->next = cache->free_list;
+    cache->free_list = buffer;
+    cache->free_count++;
+  }
+  return true;
+}
+
+// Moves buffers from |cache| to the shared free list until |count| remain.
+static void flush_thread_cache(thread_cache_t* cache, size_t index,
+                               size_t count) {
+  size_class_t* size_class = &size_classes[index];
+
+  std::lock_guard<std::mutex> lock(pool_lock);
+  while (cache->free_count > count) {
+    pool_buffer_t* buffer = cache->free_list;
+    cache->free_list = buffer->next;
+    cache->free_count--;
+
+    buffer->next = size_class->free_list;
+    size_class->free_list = buffer;
+    size_class->free_count++;
+  }
+}
+
+thread_caches_t::~thread_caches_t() {
+  for (size_t i = 0; i < NUM_SIZE_CLASSES; i++)
+    flush_thread_cache(&classes[i], i, 0);
+  exited = true;
+}
+
+void* buffer_pool_alloc(size_t size) {
+  size_t index = size_class_index(size);
+  if (index == NUM_SIZE_CLASSES) {
+    fallback_count.fetch_add(1, std::memory_order_relaxed);
+    return osi_malloc(size);
+  }
+
+  std::call_once(pool_initialized, pool_init);
+
+  thread_cache_t* cache = &thread_caches.classes[index];
+  size_t refill_count = thread_caches.exited ? 1 : THREAD_CACHE_SIZE / 2;
+  if (cache->free_list == NULL &&
+      !refill_thread_cache(cache, index, refill_count)) {
+    fallback_count.fetch_add(1, std::memory_order_relaxed);
+    return osi_malloc(size);
+  }
+
+  pool_buffer_t* buffer = cache->free_list;
+  cache->free_list = buffer->next;
+  cache->free_count--;
+
+  size_class_t* size_class = &size_classes[index];
+  size_t in_use =
+      size_class->in_use.fetch_add(1, std::memory_order_relaxed) + 1;
+  size_t high_water = size_class->high_water.load(std::memory_order_relaxed);
+  while (in_use > high_water &&
+         !size_class->high_water.compare_exchange_weak(
+             high_water, in_use, std::memory_order_relaxed))
+    ;
+
+  return buffer;
+}
+
+void buffer_pool_free(void* ptr) {
+  if (!buffer_pool_contains(ptr)) {
+    osi_free(ptr);
+    return;
+  }
+
+  uintptr_t base = arena.load(std::memory_order_relaxed);
+  size_t index = slab_classes[((uintptr_t)ptr - base) / POOL_SLAB_SIZE];
+  size_classes[index].in_use.fetch_sub(1, std::memory_order_relaxed);
+
+  thread_cache_t* cache = &thread_caches.classes[index];
+  pool_buffer_t* buffer = (pool_buffer_t*)ptr;
+  buffer->next = cache->free_list;
+  cache->free_list = buffer;
+  cache->free_count++;
+
+  if (thread_caches.exited)
+    flush_thread_cache(cache, index, 0);
+  else if (cache->free_count > THREAD_CACHE_SIZE)
+    flush_thread_cache(cache, index, THREAD_CACHE_SIZE / 2);
+}
+
+bool buffer_pool_contains(const void* ptr) {
+  uintptr_t base = arena.load(std::memory_order_acquire);
+  return base != 0 && (uintptr_t)ptr >= base &&
+         (uintptr_t)ptr < base + POOL_ARENA_SIZE;
+}
+
+const allocator_t allocator_buffer_pool = {buffer_pool_alloc,
+                                           buffer_pool_free};
+
+void buffer_pool_debug_dump(int fd) {
+  dprintf(fd, "\nBluetooth Buffer Pool Statistics:\n");
+
+  std::lock_guard<std::mutex> lock(pool_lock);
+
+  dprintf(fd, "  Slabs used/reserved             : %zu / %d (%d KiB each)\n",
+          slab_count, POOL_MAX_SLABS, POOL_SLAB_SIZE / 1024);
+  dprintf(fd, "  Allocations served by osi_malloc : %zu\n",
+          fallback_count.load(std::memory_order_relaxed));
+  dprintf(fd, "  %-8s %-8s %-10s %-10s %-10s %-10s\n", "Size", "Slabs",
+          "Buffers", "Shared", "In use", "High water");
+
+  for (const size_class_t& size_class : size_classes) {
+    dprintf(fd, "  %-8zu %-8zu %-10zu %-10zu %-10zu %-10zu\n",
+            size_class.buffer_size, size_class.slab_count,
+            size_class.slab_count * (POOL_SLAB_SIZE / size_class.buffer_size),
+            size_class.free_count,
+            size_class.in_use.load(std::memory_order_relaxed),
+            size_class.high_water.load(std::memory_order_relaxed));
+  }
+}
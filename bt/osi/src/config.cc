@@ -36,15 +36,23 @@
 // Empty definition; this type is aliased to list_node_t.
 struct config_section_iter_t {};
 
-static bool config_parse(FILE* fp, config_t* config);
+static bool config_parse(FILE* fp, config_t* config, bool is_journal);
 
 template <typename T,
           class = typename std::enable_if<std::is_same<
               config_t, typename std::remove_const<T>::type>::value>>
 static auto section_find(T& config, const std::string& section) {
-  return std::find_if(
-      config.sections.begin(), config.sections.end(),
-      [&section](const section_t& sec) { return sec.name == section; });
+  auto index = config.section_index.find(section);
+  if (index == config.section_index.end()) return config.sections.end();
+  return decltype(config.sections.end())(index->second);
+}
+
+static const entry_t* entry_find(const section_t& section,
+                                 const std::string& key) {
+  auto index = section.entry_index.find(key);
+  if (index == section.entry_index.end()) return nullptr;
+
+  return &*index->second;
 }
 
 static const entry_t* entry_find(const config_t& config,
@@ -53,11 +61,28 @@ static const entry_t* entry_find(const config_t& config,
   auto sec = section_find(config, section);
   if (sec == config.sections.end()) return nullptr;
 
-  for (const entry_t& entry : sec->entries) {
-    if (entry.key == key) return &entry;
-  }
+  return entry_find(*sec, key);
+}
+
+section_t::section_t(const section_t& other)
+    : name(other.name), entries(other.entries) {
+  for (auto entry = entries.begin(); entry != entries.end(); ++entry)
+    entry_index[entry->key] = entry;
+}
 
-  return nullptr;
+section_t& section_t::operator=(const section_t& other) {
+  if (this != &other) *this = section_t(other);
+  return *this;
+}
+
+config_t::config_t(const config_t& other) : sections(other.sections) {
+  for (auto sec = sections.begin(); sec != sections.end(); ++sec)
+    section_index[sec->name] = sec;
+}
+
+config_t& config_t::operator=(const config_t& other) {
+  if (this != &other) *this = config_t(other);
+  return *this;
 }
 
 std::unique_ptr<config_t> config_new_empty(void) {
@@ -76,24 +101,27 @@ std::unique_ptr<config_t> config_new(const char* filename) {
     return nullptr;
   }
 
-  if (!config_parse(fp, config.get())) {
+  if (!config_parse(fp, config.get(), false)) {
     config.reset();
   }
 
   fclose(fp);
+  if (!config) return config;
+
+  // Apply the changes saved since the file was last written as a whole
+  const std::string journal_filename =
+      std::string(filename) + CONFIG_JOURNAL_SUFFIX;
+  fp = fopen(journal_filename.c_str(), "rt");
+  if (fp) {
+    config_parse(fp, config.get(), true);
+    fclose(fp);
+  }
+
   return config;
 }
 
 std::unique_ptr<config_t> config_new_clone(const config_t& src) {
-  std::unique_ptr<config_t> ret = config_new_empty();
-
-  for (const section_t& sec : src.sections) {
-    for (const entry_t& entry : sec.entries) {
-      config_set_string(ret.get(), sec.name, entry.key, entry.value);
-    }
-  }
-
-  return ret;
+  return std::make_unique<config_t>(src);
 }
 
 bool config_has_section(const config_t& config, const std::string& section) {
@@ -167,8 +195,8 @@ void config_set_string(config_t* config, const std::string& section,
 
   auto sec = section_find(*config, section);
   if (sec == config->sections.end()) {
-    config->sections.emplace_back(section_t{.name = section});
-    sec = std::prev(config->sections.end());
+    sec = config->sections.emplace(config->sections.end(), section);
+    config->section_index[section] = sec;
   }
 
   std::string value_no_newline;
@@ -180,14 +208,14 @@ void config_set_string(config_t* config, const std::string& section,
     value_no_newline = value;
   }
 
-  for (entry_t& entry : sec->entries) {
-    if (entry.key == key) {
-      entry.value = value_no_newline;
-      return;
-    }
+  auto entry = sec->entry_index.find(key);
+  if (entry != sec->entry_index.end()) {
+    entry->second->value = value_no_newline;
+    return;
   }
 
-  sec->entries.emplace_back(entry_t{.key = key, .value = value_no_newline});
+  sec->entry_index[key] = sec->entries.emplace(
+      sec->entries.end(), entry_t{.key = key, .value = value_no_newline});
 }
 
 bool config_remove_section(config_t* config, const std::string& section) {
@@ -196,25 +224,30 @@ bool config_remove_section(config_t* config, const std::string& section) {
   auto sec = section_find(*config, section);
   if (sec == config->sections.end()) return false;
 
-  config->sections.erase(sec);
+  config_remove_section(config, sec);
   return true;
 }
 
+std::list<section_t>::iterator config_remove_section(
+    config_t* config, std::list<section_t>::iterator section) {
+  CHECK(config);
+
+  config->section_index.erase(section->name);
+  return config->sections.erase(section);
+}
+
 bool config_remove_key(config_t* config, const std::string& section,
                        const std::string& key) {
   CHECK(config);
   auto sec = section_find(*config, section);
   if (sec == config->sections.end()) return false;
 
-  for (auto entry = sec->entries.begin(); entry != sec->entries.end();
-       ++entry) {
-    if (entry->key == key) {
-      sec->entries.erase(entry);
-      return true;
-    }
-  }
+  auto entry = sec->entry_index.find(key);
+  if (entry == sec->entry_index.end()) return false;
 
-  return false;
+  sec->entries.erase(entry->second);
+  sec->entry_index.erase(entry);
+  return true;
 }
 
 bool config_save(const config_t& config, const std::string& filename) {
@@ -234,6 +267,7 @@ bool config_save(const config_t& config, const std::string& filename) {
 
   // Build temp config file based on config file (e.g. bt_config.conf.new).
   const std::string temp_filename = filename + ".new";
+  const std::string journal_filename = filename + CONFIG_JOURNAL_SUFFIX;
 
   // Extract directory from file path (e.g. /data/misc/bluedroid).
   const std::string directoryname = base::FilePath(filename).DirName().value();
@@ -301,6 +335,14 @@ bool config_save(const config_t& config, const std::string& filename) {
     goto error;
   }
 
+  // The config file now contains all the changes of the journal. Replaying
+  // the journal again would be harmless, so it doesn't matter if this doesn't
+  // make it to disk.
+  if (unlink(journal_filename.c_str()) == -1 && errno != ENOENT) {
+    LOG(WARNING) << __func__ << ": unable to remove journal '"
+                 << journal_filename << "': " << strerror(errno);
+  }
+
   // This should ensure the directory is updated as well.
   if (fsync(dir_fd) < 0) {
     LOG(WARNING) << __func__ << ": unable to fsync dir '" << directoryname
@@ -324,6 +366,106 @@ error:
   return false;
 }
 
+bool config_save_journal(const config_t& saved, const config_t& config,
+                         const std::string& filename) {
+  CHECK(!filename.empty());
+
+  // The journal uses the syntax of the config file, plus lines starting with
+  // '-' for removed keys and sections:
+  //
+  // -[removed section]
+  // [section]
+  // -removed_key
+  // changed_key = value
+  std::stringstream serialized;
+
+  for (const section_t& section : saved.sections) {
+    if (section_find(config, section.name) == config.sections.end())
+      serialized << "-[" << section.name << "]" << std::endl;
+  }
+
+  for (const section_t& section : config.sections) {
+    auto saved_section = section_find(saved, section.name);
+    bool section_serialized = false;
+    auto serialize_section = [&]() {
+      if (section_serialized) return;
+      serialized << "[" << section.name << "]" << std::endl;
+      section_serialized = true;
+    };
+
+    if (saved_section != saved.sections.end()) {
+      for (const entry_t& entry : saved_section->entries) {
+        if (entry_find(section, entry.key)) continue;
+        serialize_section();
+        serialized << "-" << entry.key << std::endl;
+      }
+    }
+
+    for (const entry_t& entry : section.entries) {
+      const entry_t* saved_entry = saved_section != saved.sections.end()
+                                       ? entry_find(*saved_section, entry.key)
+                                       : nullptr;
+      if (saved_entry && saved_entry->value == entry.value) continue;
+      serialize_section();
+      serialized << entry.key << " = " << entry.value << std::endl;
+    }
+  }
+
+  const std::string journal = serialized.str();
+  if (journal.empty()) return true;
+
+  const std::string journal_filename = filename + CONFIG_JOURNAL_SUFFIX;
+  int fd = open(journal_filename.c_str(), O_WRONLY | O_APPEND | O_CREAT,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP);
+  if (fd < 0) {
+    LOG(ERROR) << __func__ << ": unable to open journal '" << journal_filename
+               << "': " << strerror(errno);
+    return false;
+  }
+
+  struct stat journal_stat;
+  bool created = fstat(fd, &journal_stat) == 0 && journal_stat.st_size == 0;
+
+  ssize_t written =
+      TEMP_FAILURE_RETRY(write(fd, journal.c_str(), journal.size()));
+  if (written != (ssize_t)journal.size()) {
+    LOG(ERROR) << __func__ << ": unable to write to journal '"
+               << journal_filename << "': " << strerror(errno);
+    close(fd);
+    return false;
+  }
+
+  if (fsync(fd) < 0) {
+    LOG(WARNING) << __func__ << ": unable to fsync journal '"
+                 << journal_filename << "': " << strerror(errno);
+  }
+  close(fd);
+
+  // Make sure a new journal can be found after a reboot
+  if (created) {
+    const std::string directoryname =
+        base::FilePath(filename).DirName().value();
+    int dir_fd = open(directoryname.c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+      if (fsync(dir_fd) < 0) {
+        LOG(WARNING) << __func__ << ": unable to fsync dir '" << directoryname
+                     << "': " << strerror(errno);
+      }
+      close(dir_fd);
+    }
+  }
+
+  return true;
+}
+
+size_t config_journal_size(const std::string& filename) {
+  const std::string journal_filename = filename + CONFIG_JOURNAL_SUFFIX;
+  struct stat journal_stat;
+  if (stat(journal_filename.c_str(), &journal_stat) == -1) return 0;
+
+  return journal_stat.st_size;
+}
+
 static char* trim(char* str) {
   while (isspace(*str)) ++str;
 
@@ -336,7 +478,11 @@ static char* trim(char* str) {
   return str;
 }
 
-static bool config_parse(FILE* fp, config_t* config) {
+// Parses a config file, or replays the changes of a journal on top of
+// |config| if |is_journal| is true. As the last changes appended to a journal
+// may not have been completely written, replaying stops at the first
+// incomplete or invalid line instead of failing.
+static bool config_parse(FILE* fp, config_t* config, bool is_journal) {
   CHECK(fp != nullptr);
   CHECK(config != nullptr);
 
@@ -346,18 +492,32 @@ static bool config_parse(FILE* fp, config_t* config) {
   strcpy(section, CONFIG_DEFAULT_SECTION);
 
   while (fgets(line, sizeof(line), fp)) {
+    if (is_journal && line[strlen(line) - 1] != '\n') {
+      LOG(WARNING) << __func__ << ": incomplete journal line " << line_num + 1;
+      return true;
+    }
+
     char* line_ptr = trim(line);
     ++line_num;
 
     // Skip blank and comment lines.
     if (*line_ptr == '\0' || *line_ptr == '#') continue;
 
-    if (*line_ptr == '[') {
+    if (is_journal && *line_ptr == '-') {
+      ++line_ptr;
+      size_t len = strlen(line_ptr);
+      if (*line_ptr == '[' && len > 1 && line_ptr[len - 1] == ']') {
+        line_ptr[len - 1] = '\0';
+        config_remove_section(config, line_ptr + 1);
+      } else {
+        config_remove_key(config, section, line_ptr);
+      }
+    } else if (*line_ptr == '[') {
       size_t len = strlen(line_ptr);
       if (line_ptr[len - 1] != ']') {
         VLOG(1) << __func__ << ": unterminated section name on line "
                 << line_num;
-        return false;
+        return is_journal;
       }
       strncpy(section, line_ptr + 1, len - 2);  // NOLINT (len < 1024)
       section[len - 2] = '\0';
@@ -366,7 +526,7 @@ static bool config_parse(FILE* fp, config_t* config) {
       if (!split) {
         VLOG(1) << __func__ << ": no key/value separator found on line "
                 << line_num;
-        return false;
+        return is_journal;
       }
 
       *split = '\0';
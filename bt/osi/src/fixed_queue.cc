@@ -17,8 +17,13 @@
  ******************************************************************************/
 
 #include <base/logging.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <mutex>
 
 #include "osi/include/allocator.h"
@@ -28,6 +33,32 @@
 #include "osi/include/reactor.h"
 #include "osi/include/semaphore.h"
 
+// Bounded multi-producer multi-consumer ring used by the queues created with
+// |fixed_queue_new_lockfree|. Each slot carries a sequence number that tells
+// producers and consumers whose turn it is to use the slot, so neither side
+// takes a lock.
+typedef struct {
+  std::atomic<size_t> sequence;
+  void* data;
+} ring_slot_t;
+
+typedef struct {
+  ring_slot_t* slots;
+  std::atomic<size_t> enqueue_pos;
+  std::atomic<size_t> dequeue_pos;
+
+  // Set when |dequeue_fd| has been signaled and not yet acknowledged by a
+  // consumer. Producers only write to |dequeue_fd| when they set it, that is
+  // when the queue goes from empty to non-empty as far as consumers know.
+  std::atomic<bool> dequeue_signaled;
+  int dequeue_fd;
+
+  // Producers blocked in |fixed_queue_enqueue| on a full queue
+  std::atomic<size_t> space_waiters;
+  std::mutex space_mutex;
+  std::condition_variable space_available;
+} ring_t;
+
 typedef struct fixed_queue_t {
   list_t* list;
   semaphore_t* enqueue_sem;
@@ -35,6 +66,8 @@ typedef struct fixed_queue_t {
   std::mutex* mutex;
   size_t capacity;
 
+  ring_t* ring;  // Used instead of all of the above if not NULL
+
   reactor_object_t* dequeue_object;
   fixed_queue_cb dequeue_ready;
   void* dequeue_context;
@@ -42,6 +75,125 @@ typedef struct fixed_queue_t {
 
 static void internal_dequeue_ready(void* context);
 
+static bool ring_try_enqueue(fixed_queue_t* queue, void* data) {
+  ring_t* ring = queue->ring;
+  size_t pos = ring->enqueue_pos.load(std::memory_order_relaxed);
+  ring_slot_t* slot;
+  while (true) {
+    slot = &ring->slots[pos % queue->capacity];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      if (ring->enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      return false;  // Full
+    } else {
+      pos = ring->enqueue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->data = data;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+
+  if (!ring->dequeue_signaled.exchange(true)) eventfd_write(ring->dequeue_fd, 1);
+  return true;
+}
+
+// Dequeues without waking up producers waiting for space, see
+// |ring_wake_producers|.
+static void* ring_pop(fixed_queue_t* queue) {
+  ring_t* ring = queue->ring;
+  size_t pos = ring->dequeue_pos.load(std::memory_order_relaxed);
+  ring_slot_t* slot;
+  while (true) {
+    slot = &ring->slots[pos % queue->capacity];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (ring->dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                                  std::memory_order_relaxed))
+        break;
+    } else if (diff < 0) {
+      return NULL;  // Empty
+    } else {
+      pos = ring->dequeue_pos.load(std::memory_order_relaxed);
+    }
+  }
+
+  void* data = slot->data;
+  slot->sequence.store(pos + queue->capacity, std::memory_order_release);
+  return data;
+}
+
+// Must be called after dequeuing |count| elements
+static void ring_wake_producers(ring_t* ring, size_t count) {
+  if (count == 0) return;
+
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (ring->space_waiters.load(std::memory_order_relaxed) == 0) return;
+
+  std::lock_guard<std::mutex> lock(ring->space_mutex);
+  if (count == 1)
+    ring->space_available.notify_one();
+  else
+    ring->space_available.notify_all();
+}
+
+static void* ring_try_dequeue(fixed_queue_t* queue) {
+  void* data = ring_pop(queue);
+  if (data) ring_wake_producers(queue->ring, 1);
+  return data;
+}
+
+// Consumes the signal on |dequeue_fd|. Elements enqueued after this signal it
+// again, elements enqueued before are visible to the caller's next dequeue.
+static void ring_acknowledge_signal(ring_t* ring) {
+  eventfd_t value;
+  eventfd_read(ring->dequeue_fd, &value);
+  ring->dequeue_signaled.exchange(false);
+}
+
+// Includes slots claimed by producers that have not published their element
+// yet, so a consumer may still find nothing to dequeue.
+static size_t ring_length(fixed_queue_t* queue) {
+  size_t dequeue_pos = queue->ring->dequeue_pos.load();
+  size_t enqueue_pos = queue->ring->enqueue_pos.load();
+  return enqueue_pos > dequeue_pos ? enqueue_pos - dequeue_pos : 0;
+}
+
+static void ring_free(ring_t* ring) {
+  if (ring->dequeue_fd != INVALID_FD) close(ring->dequeue_fd);
+  delete[] ring->slots;
+  delete ring;
+}
+
+fixed_queue_t* fixed_queue_new_lockfree(size_t capacity) {
+  CHECK(capacity != 0);
+
+  fixed_queue_t* ret =
+      static_cast<fixed_queue_t*>(osi_calloc(sizeof(fixed_queue_t)));
+  ret->capacity = capacity;
+
+  ring_t* ring = new ring_t();
+  ring->slots = new ring_slot_t[capacity];
+  for (size_t i = 0; i < capacity; i++) ring->slots[i].sequence = i;
+  ring->enqueue_pos = 0;
+  ring->dequeue_pos = 0;
+  ring->dequeue_signaled = false;
+  ring->space_waiters = 0;
+  ring->dequeue_fd = eventfd(0, EFD_NONBLOCK);
+  if (ring->dequeue_fd == INVALID_FD) {
+    ring_free(ring);
+    osi_free(ret);
+    return NULL;
+  }
+  ret->ring = ring;
+
+  return ret;
+}
+
 fixed_queue_t* fixed_queue_new(size_t capacity) {
   fixed_queue_t* ret =
       static_cast<fixed_queue_t*>(osi_calloc(sizeof(fixed_queue_t)));
@@ -70,6 +222,15 @@ void fixed_queue_free(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
 
   fixed_queue_unregister_dequeue(queue);
 
+  if (queue->ring) {
+    void* data;
+    while ((data = ring_try_dequeue(queue)) != NULL)
+      if (free_cb) free_cb(data);
+    ring_free(queue->ring);
+    osi_free(queue);
+    return;
+  }
+
   if (free_cb)
     for (const list_node_t* node = list_begin(queue->list);
          node != list_end(queue->list); node = list_next(node))
@@ -85,8 +246,8 @@ void fixed_queue_free(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
 void fixed_queue_flush(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
   if (!queue) return;
 
-  while (!fixed_queue_is_empty(queue)) {
-    void* data = fixed_queue_try_dequeue(queue);
+  void* data;
+  while ((data = fixed_queue_try_dequeue(queue)) != NULL) {
     if (free_cb != NULL) {
       free_cb(data);
     }
@@ -95,6 +256,7 @@ void fixed_queue_flush(fixed_queue_t* queue, fixed_queue_free_cb free_cb) {
 
 bool fixed_queue_is_empty(fixed_queue_t* queue) {
   if (queue == NULL) return true;
+  if (queue->ring) return ring_length(queue) == 0;
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
   return list_is_empty(queue->list);
@@ -102,6 +264,7 @@ bool fixed_queue_is_empty(fixed_queue_t* queue) {
 
 size_t fixed_queue_length(fixed_queue_t* queue) {
   if (queue == NULL) return 0;
+  if (queue->ring) return ring_length(queue);
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
   return list_length(queue->list);
@@ -117,6 +280,18 @@ void fixed_queue_enqueue(fixed_queue_t* queue, void* data) {
   CHECK(queue != NULL);
   CHECK(data != NULL);
 
+  if (queue->ring) {
+    if (ring_try_enqueue(queue, data)) return;
+
+    ring_t* ring = queue->ring;
+    std::unique_lock<std::mutex> lock(ring->space_mutex);
+    ring->space_waiters++;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!ring_try_enqueue(queue, data)) ring->space_available.wait(lock);
+    ring->space_waiters--;
+    return;
+  }
+
   semaphore_wait(queue->enqueue_sem);
 
   {
@@ -130,6 +305,20 @@ void fixed_queue_enqueue(fixed_queue_t* queue, void* data) {
 void* fixed_queue_dequeue(fixed_queue_t* queue) {
   CHECK(queue != NULL);
 
+  if (queue->ring) {
+    while (true) {
+      void* ret = ring_try_dequeue(queue);
+      if (ret) return ret;
+
+      ring_acknowledge_signal(queue->ring);
+      ret = ring_try_dequeue(queue);
+      if (ret) return ret;
+
+      struct pollfd pfd = {queue->ring->dequeue_fd, POLLIN, 0};
+      OSI_NO_INTR(poll(&pfd, 1, -1));
+    }
+  }
+
   semaphore_wait(queue->dequeue_sem);
 
   void* ret = NULL;
@@ -148,6 +337,8 @@ bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data) {
   CHECK(queue != NULL);
   CHECK(data != NULL);
 
+  if (queue->ring) return ring_try_enqueue(queue, data);
+
   if (!semaphore_try_wait(queue->enqueue_sem)) return false;
 
   {
@@ -161,6 +352,7 @@ bool fixed_queue_try_enqueue(fixed_queue_t* queue, void* data) {
 
 void* fixed_queue_try_dequeue(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
+  if (queue->ring) return ring_try_dequeue(queue);
 
   if (!semaphore_try_wait(queue->dequeue_sem)) return NULL;
 
@@ -176,15 +368,51 @@ void* fixed_queue_try_dequeue(fixed_queue_t* queue) {
   return ret;
 }
 
+size_t fixed_queue_dequeue_batch(fixed_queue_t* queue, void** data,
+                                 size_t max_count) {
+  CHECK(queue != NULL);
+  CHECK(data != NULL);
+
+  if (!queue->ring) {
+    size_t count = 0;
+    while (count < max_count &&
+           (data[count] = fixed_queue_try_dequeue(queue)) != NULL)
+      count++;
+    return count;
+  }
+
+  ring_acknowledge_signal(queue->ring);
+
+  size_t count = 0;
+  while (count < max_count && (data[count] = ring_pop(queue)) != NULL)
+    count++;
+  ring_wake_producers(queue->ring, count);
+
+  // Leave the dequeue fd readable for the elements that did not fit
+  if (count == max_count && ring_length(queue) != 0 &&
+      !queue->ring->dequeue_signaled.exchange(true))
+    eventfd_write(queue->ring->dequeue_fd, 1);
+
+  return count;
+}
+
 void* fixed_queue_try_peek_first(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
 
+  if (queue->ring) {
+    size_t pos = queue->ring->dequeue_pos.load(std::memory_order_relaxed);
+    ring_slot_t* slot = &queue->ring->slots[pos % queue->capacity];
+    if (slot->sequence.load(std::memory_order_acquire) != pos + 1) return NULL;
+    return slot->data;
+  }
+
   std::lock_guard<std::mutex> lock(*queue->mutex);
   return list_is_empty(queue->list) ? NULL : list_front(queue->list);
 }
 
 void* fixed_queue_try_peek_last(fixed_queue_t* queue) {
   if (queue == NULL) return NULL;
+  CHECK(queue->ring == NULL) << "not supported by lock-free queues";
 
   std::lock_guard<std::mutex> lock(*queue->mutex);
   return list_is_empty(queue->list) ? NULL : list_back(queue->list);
@@ -192,6 +420,7 @@ void* fixed_queue_try_peek_last(fixed_queue_t* queue) {
 
 void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data) {
   if (queue == NULL) return NULL;
+  CHECK(queue->ring == NULL) << "not supported by lock-free queues";
 
   bool removed = false;
   {
@@ -212,6 +441,7 @@ void* fixed_queue_try_remove_from_queue(fixed_queue_t* queue, void* data) {
 
 list_t* fixed_queue_get_list(fixed_queue_t* queue) {
   CHECK(queue != NULL);
+  CHECK(queue->ring == NULL) << "not supported by lock-free queues";
 
   // NOTE: Using the list in this way is not thread-safe.
   // Using this list in any context where threads can call other functions
@@ -221,11 +451,13 @@ list_t* fixed_queue_get_list(fixed_queue_t* queue) {
 
 int fixed_queue_get_dequeue_fd(const fixed_queue_t* queue) {
   CHECK(queue != NULL);
+  if (queue->ring) return queue->ring->dequeue_fd;
   return semaphore_get_fd(queue->dequeue_sem);
 }
 
 int fixed_queue_get_enqueue_fd(const fixed_queue_t* queue) {
   CHECK(queue != NULL);
+  CHECK(queue->ring == NULL) << "not supported by lock-free queues";
   return semaphore_get_fd(queue->enqueue_sem);
 }
 
@@ -258,5 +490,17 @@ static void internal_dequeue_ready(void* context) {
   CHECK(context != NULL);
 
   fixed_queue_t* queue = static_cast<fixed_queue_t*>(context);
-  queue->dequeue_ready(queue, queue->dequeue_context);
+  if (!queue->ring) {
+    queue->dequeue_ready(queue, queue->dequeue_context);
+    return;
+  }
+
+  // The fd is only signaled when the queue becomes non-empty, so call back
+  // once for each element that is there now. Elements enqueued after the
+  // signal is acknowledged signal the fd again, and so does a producer that
+  // publishes the element at the head after we stopped there.
+  ring_acknowledge_signal(queue->ring);
+  for (size_t count = ring_length(queue);
+       count > 0 && fixed_queue_try_peek_first(queue) != NULL; count--)
+    queue->dequeue_ready(queue, queue->dequeue_context);
 }
@@ -63,6 +63,8 @@ static void* run_thread(void* start_arg);
 static void work_queue_read_cb(void* context);
 
 static const size_t DEFAULT_WORK_QUEUE_CAPACITY = 128;
+// Work items dequeued at once each time the reactor finds the queue readable
+static const size_t WORK_QUEUE_BATCH_SIZE = 16;
 
 thread_t* thread_new_sized(const char* name, size_t work_queue_capacity) {
   CHECK(name != NULL);
@@ -73,7 +75,11 @@ thread_t* thread_new_sized(const char* name, size_t work_queue_capacity) {
   ret->reactor = reactor_new();
   if (!ret->reactor) goto error;
 
-  ret->work_queue = fixed_queue_new(work_queue_capacity);
+  // Unbounded work queues can't use a ring allocated up front.
+  if (work_queue_capacity == SIZE_MAX)
+    ret->work_queue = fixed_queue_new(work_queue_capacity);
+  else
+    ret->work_queue = fixed_queue_new_lockfree(work_queue_capacity);
   if (!ret->work_queue) goto error;
 
   // Start is on the stack, but we use a semaphore, so it's safe
@@ -247,7 +253,11 @@ static void work_queue_read_cb(void* context) {
   CHECK(context != NULL);
 
   fixed_queue_t* queue = (fixed_queue_t*)context;
-  work_item_t* item = static_cast<work_item_t*>(fixed_queue_dequeue(queue));
-  item->func(item->context);
-  osi_free(item);
+  void* items[WORK_QUEUE_BATCH_SIZE];
+  size_t count = fixed_queue_dequeue_batch(queue, items, WORK_QUEUE_BATCH_SIZE);
+  for (size_t i = 0; i < count; i++) {
+    work_item_t* item = static_cast<work_item_t*>(items[i]);
+    item->func(item->context);
+    osi_free(item);
+  }
 }
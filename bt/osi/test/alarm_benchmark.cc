@@ -0,0 +1,142 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <base/message_loop/message_loop.h>
+#include <benchmark/benchmark.h>
+
+#include <hardware/bluetooth.h>
+
+#include "osi/include/alarm.h"
+#include "osi/include/osi.h"
+#include "osi/include/semaphore.h"
+#include "osi/include/wakelock.h"
+
+// Alarms pending in the background while measuring, as with many active
+// connections each running their L2CAP, GATT, BTM and AVDT timers.
+static const int NUM_PENDING_ALARMS = 10000;
+static const period_ms_t PENDING_INTERVAL_MS = 3600 * 1000;
+
+// Alarms fired at once by each iteration of BM_AlarmFire
+static const int FIRE_BATCH = 100;
+
+base::MessageLoop* get_message_loop() { return nullptr; }
+
+static int acquire_wake_lock_cb(UNUSED_ATTR const char* lock_name) {
+  return BT_STATUS_SUCCESS;
+}
+
+static int release_wake_lock_cb(UNUSED_ATTR const char* lock_name) {
+  return BT_STATUS_SUCCESS;
+}
+
+static bt_os_callouts_t bt_wakelock_callouts = {
+    sizeof(bt_os_callouts_t), NULL, acquire_wake_lock_cb, release_wake_lock_cb};
+
+static semaphore_t* semaphore;
+
+static void nop_cb(UNUSED_ATTR void* data) {}
+
+static void post_cb(UNUSED_ATTR void* data) { semaphore_post(semaphore); }
+
+static alarm_t** new_alarms(int count) {
+  alarm_t** alarms = new alarm_t*[count];
+  for (int i = 0; i < count; i++) alarms[i] = alarm_new("alarm_benchmark");
+  return alarms;
+}
+
+static alarm_t** new_pending_alarms(void) {
+  alarm_t** alarms = new_alarms(NUM_PENDING_ALARMS);
+  for (int i = 0; i < NUM_PENDING_ALARMS; i++)
+    alarm_set(alarms[i], PENDING_INTERVAL_MS + i, nop_cb, NULL);
+  return alarms;
+}
+
+static void free_alarms(alarm_t** alarms, int count) {
+  for (int i = 0; i < count; i++) alarm_free(alarms[i]);
+  delete[] alarms;
+}
+
+static void set_up(void) {
+  wakelock_set_os_callouts(&bt_wakelock_callouts);
+  semaphore = semaphore_new(0);
+}
+
+static void tear_down(void) {
+  semaphore_free(semaphore);
+  alarm_cleanup();
+  wakelock_cleanup();
+  wakelock_set_os_callouts(NULL);
+}
+
+// Re-sets pending alarms to new deadlines
+static void BM_AlarmSet(benchmark::State& state) {
+  set_up();
+  alarm_t** alarms = new_pending_alarms();
+
+  int i = 0;
+  while (state.KeepRunning()) {
+    alarm_set(alarms[i], PENDING_INTERVAL_MS + (i * 7919) % NUM_PENDING_ALARMS,
+              nop_cb, NULL);
+    i = (i + 1) % NUM_PENDING_ALARMS;
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  free_alarms(alarms, NUM_PENDING_ALARMS);
+  tear_down();
+}
+BENCHMARK(BM_AlarmSet);
+
+// Sets and cancels an alarm among the pending ones
+static void BM_AlarmSetCancel(benchmark::State& state) {
+  set_up();
+  alarm_t** alarms = new_pending_alarms();
+  alarm_t* alarm = alarm_new("alarm_benchmark");
+
+  int i = 0;
+  while (state.KeepRunning()) {
+    alarm_set(alarm, PENDING_INTERVAL_MS + i++ % NUM_PENDING_ALARMS, nop_cb,
+              NULL);
+    alarm_cancel(alarm);
+  }
+  state.SetItemsProcessed(state.iterations());
+
+  alarm_free(alarm);
+  free_alarms(alarms, NUM_PENDING_ALARMS);
+  tear_down();
+}
+BENCHMARK(BM_AlarmSetCancel);
+
+// Fires batches of alarms that expire together and waits for their callbacks
+static void BM_AlarmFire(benchmark::State& state) {
+  set_up();
+  alarm_t** alarms = new_pending_alarms();
+  alarm_t** batch = new_alarms(FIRE_BATCH);
+
+  while (state.KeepRunning()) {
+    for (int i = 0; i < FIRE_BATCH; i++) alarm_set(batch[i], 0, post_cb, NULL);
+    for (int i = 0; i < FIRE_BATCH; i++) semaphore_wait(semaphore);
+  }
+  state.SetItemsProcessed(state.iterations() * FIRE_BATCH);
+
+  free_alarms(batch, FIRE_BATCH);
+  free_alarms(alarms, NUM_PENDING_ALARMS);
+  tear_down();
+}
+BENCHMARK(BM_AlarmFire);
+
+BENCHMARK_MAIN();
@@ -312,6 +312,37 @@ TEST_F(AlarmTest, test_callback_ordering) {
   EXPECT_FALSE(WakeLockHeld());
 }
 
+// Test whether alarms set out of deadline order, some of them cancelled, are
+// invoked in the order of their deadlines
+TEST_F(AlarmTest, test_callback_ordering_by_deadline) {
+  alarm_t* alarms[100];
+
+  for (int i = 0; i < 100; i++) {
+    const std::string alarm_name =
+        "alarm_test.test_callback_ordering_by_deadline[" + std::to_string(i) +
+        "]";
+    alarms[i] = alarm_new(alarm_name.c_str());
+  }
+
+  for (int i = 99; i >= 0; i--) {
+    alarm_set(alarms[i], 100 + 5 * i, ordered_cb, INT_TO_PTR(i / 2));
+  }
+  for (int i = 1; i < 100; i += 2) {
+    alarm_cancel(alarms[i]);
+  }
+
+  for (int i = 1; i <= 50; i++) {
+    semaphore_wait(semaphore);
+    EXPECT_GE(cb_counter, i);
+  }
+  EXPECT_EQ(cb_counter, 50);
+  EXPECT_EQ(cb_misordered_counter, 0);
+
+  for (int i = 0; i < 100; i++) alarm_free(alarms[i]);
+
+  EXPECT_FALSE(WakeLockHeld());
+}
+
 // Test whether the callbacks are involed in the expected order on a
 // message loop.
 TEST_F(AlarmTest, test_callback_ordering_on_mloop) {
@@ -0,0 +1,124 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <string.h>
+
+#include <set>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "AllocationTestHarness.h"
+
+#include "osi/include/allocator.h"
+#include "osi/include/buffer_pool.h"
+
+#define NUM_BUFFERS 1000
+
+class BufferPoolTest : public AllocationTestHarness {};
+
+TEST_F(BufferPoolTest, test_contains) {
+  EXPECT_FALSE(buffer_pool_contains(NULL));
+
+  void* buffer = osi_malloc(64);
+  EXPECT_FALSE(buffer_pool_contains(buffer));
+  osi_free(buffer);
+
+  buffer = buffer_pool_alloc(64);
+  EXPECT_TRUE(buffer_pool_contains(buffer));
+  buffer_pool_free(buffer);
+}
+
+TEST_F(BufferPoolTest, test_alloc_sizes) {
+  const size_t sizes[] = {1, 8, 64, 65, 660, 1021, 2048, 4096, 4112};
+  std::vector<void*> buffers;
+
+  for (size_t size : sizes) {
+    uint8_t* buffer = (uint8_t*)buffer_pool_alloc(size);
+    ASSERT_TRUE(buffer != NULL);
+    EXPECT_TRUE(buffer_pool_contains(buffer));
+    memset(buffer, (int)size, size);
+    buffers.push_back(buffer);
+  }
+
+  // No buffer overlaps with the others
+  for (size_t i = 0; i < buffers.size(); i++) {
+    uint8_t* buffer = (uint8_t*)buffers[i];
+    for (size_t j = 0; j < sizes[i]; j++)
+      EXPECT_EQ((uint8_t)sizes[i], buffer[j]);
+  }
+
+  for (void* buffer : buffers) osi_free(buffer);
+}
+
+TEST_F(BufferPoolTest, test_oversized_alloc) {
+  void* buffer = buffer_pool_alloc(64 * 1024);
+  ASSERT_TRUE(buffer != NULL);
+  EXPECT_FALSE(buffer_pool_contains(buffer));
+  buffer_pool_free(buffer);
+}
+
+TEST_F(BufferPoolTest, test_free_reuses_buffer) {
+  void* buffer = buffer_pool_alloc(1000);
+  osi_free(buffer);
+  EXPECT_EQ(buffer, buffer_pool_alloc(1000));
+  osi_free(buffer);
+}
+
+TEST_F(BufferPoolTest, test_no_duplicate_buffers) {
+  std::set<void*> buffers;
+  for (int i = 0; i < NUM_BUFFERS; i++) {
+    void* buffer = buffer_pool_alloc(256);
+    EXPECT_TRUE(buffers.insert(buffer).second);
+  }
+  for (void* buffer : buffers) osi_free(buffer);
+}
+
+TEST_F(BufferPoolTest, test_free_on_other_thread) {
+  // Buffers allocated on the HCI thread are usually freed on the stack thread
+  // and the other way around.
+  std::vector<void*> buffers;
+  for (int i = 0; i < NUM_BUFFERS; i++)
+    buffers.push_back(buffer_pool_alloc(1021));
+
+  std::thread freeing_thread([&buffers]() {
+    for (void* buffer : buffers) osi_free(buffer);
+    buffers.clear();
+  });
+  freeing_thread.join();
+
+  std::thread allocating_thread([&buffers]() {
+    for (int i = 0; i < NUM_BUFFERS; i++)
+      buffers.push_back(buffer_pool_alloc(1021));
+  });
+  allocating_thread.join();
+
+  std::set<void*> unique_buffers(buffers.begin(), buffers.end());
+  EXPECT_EQ((size_t)NUM_BUFFERS, unique_buffers.size());
+  for (void* buffer : buffers) {
+    EXPECT_TRUE(buffer_pool_contains(buffer));
+    buffer_pool_free(buffer);
+  }
+}
+
+TEST_F(BufferPoolTest, test_allocator_interface) {
+  void* buffer = allocator_buffer_pool.alloc(128);
+  EXPECT_TRUE(buffer_pool_contains(buffer));
+  allocator_buffer_pool.free(buffer);
+}
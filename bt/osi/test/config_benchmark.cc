@@ -0,0 +1,131 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+#include <string>
+
+#include "osi/include/config.h"
+
+static const char CONFIG_FILE[] = "/data/local/tmp/config_benchmark.conf";
+
+// Same as in btif_config.cc
+static const size_t CONFIG_JOURNAL_MAX_SIZE = 32 * 1024;
+
+enum { SAVE_FULL, SAVE_JOURNAL };
+
+static std::string device_address(int device) {
+  char address[sizeof("00:00:00:00:00:00")];
+  snprintf(address, sizeof(address), "00:11:22:%02x:%02x:%02x",
+           (device >> 16) & 0xff, (device >> 8) & 0xff, device & 0xff);
+  return address;
+}
+
+// The keys btif_storage writes for a bonded BR/EDR device
+static void add_bonded_device(config_t* config, int device) {
+  const std::string section = device_address(device);
+  config_set_string(config, section, "Name", "Headset " + section);
+  config_set_int(config, section, "DevClass", 0x240404);
+  config_set_int(config, section, "DevType", 1);
+  config_set_int(config, section, "AddrType", 0);
+  config_set_int(config, section, "Timestamp", 1520000000 + device);
+  config_set_int(config, section, "Manufacturer", 15);
+  config_set_int(config, section, "LmpVer", 8);
+  config_set_int(config, section, "LmpSubVer", 8716);
+  config_set_string(config, section, "Service",
+                    "0000110b-0000-1000-8000-00805f9b34fb "
+                    "0000110e-0000-1000-8000-00805f9b34fb "
+                    "0000111e-0000-1000-8000-00805f9b34fb");
+  config_set_string(config, section, "LinkKey",
+                    "0123456789abcdef0123456789abcdef");
+  config_set_int(config, section, "LinkKeyType", 5);
+  config_set_int(config, section, "PinLength", 0);
+}
+
+static std::unique_ptr<config_t> new_config(int num_devices) {
+  std::unique_ptr<config_t> config = config_new_empty();
+  config_set_string(config.get(), "Info", "FileSource", "Empty");
+  config_set_string(config.get(), "Adapter", "Address", "00:11:22:33:44:55");
+  for (int i = 0; i < num_devices; i++) add_bonded_device(config.get(), i);
+  return config;
+}
+
+static size_t file_size(const std::string& filename) {
+  struct stat file_stat;
+  if (stat(filename.c_str(), &file_stat) == -1) return 0;
+  return file_stat.st_size;
+}
+
+// Looks up keys of random devices, as done for each connection
+static void BM_ConfigGetString(benchmark::State& state) {
+  const int num_devices = state.range(0);
+  std::unique_ptr<config_t> config = new_config(num_devices);
+
+  int i = 0;
+  while (state.KeepRunning()) {
+    const std::string section = device_address((i++ * 7919) % num_devices);
+    benchmark::DoNotOptimize(
+        config_get_string(*config, section, "LinkKey", nullptr));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_ConfigGetString)->Arg(10)->Arg(100)->Arg(500);
+
+// Bonds a new device and saves the config, either by rewriting it or by
+// appending to its journal and rewriting it when the journal gets too large,
+// as btif_config does.
+static void BM_ConfigSaveBond(benchmark::State& state) {
+  const int num_devices = state.range(0);
+  const bool use_journal = state.range(1) == SAVE_JOURNAL;
+  const std::string journal_file =
+      std::string(CONFIG_FILE) + CONFIG_JOURNAL_SUFFIX;
+
+  std::unique_ptr<config_t> config = new_config(num_devices);
+  config_save(*config, CONFIG_FILE);
+  std::unique_ptr<config_t> saved = config_new_clone(*config);
+
+  size_t bytes_written = 0;
+  int device = num_devices;
+  while (state.KeepRunning()) {
+    add_bonded_device(config.get(), device++);
+
+    size_t journal_size = config_journal_size(CONFIG_FILE);
+    if (use_journal && journal_size < CONFIG_JOURNAL_MAX_SIZE &&
+        config_save_journal(*saved, *config, CONFIG_FILE)) {
+      bytes_written += config_journal_size(CONFIG_FILE) - journal_size;
+    } else {
+      config_save(*config, CONFIG_FILE);
+      bytes_written += file_size(CONFIG_FILE);
+    }
+    saved = config_new_clone(*config);
+  }
+  state.counters["bytes_per_bond"] =
+      benchmark::Counter(bytes_written / state.iterations());
+  state.SetItemsProcessed(state.iterations());
+
+  remove(CONFIG_FILE);
+  remove(journal_file.c_str());
+}
+BENCHMARK(BM_ConfigSaveBond)
+    ->ArgPair(100, SAVE_FULL)
+    ->ArgPair(100, SAVE_JOURNAL)
+    ->ArgPair(500, SAVE_FULL)
+    ->ArgPair(500, SAVE_JOURNAL)
+    ->Iterations(100);
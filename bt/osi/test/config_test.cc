@@ -56,6 +56,7 @@ class ConfigTest : public AllocationTestHarness {
     FILE* fp = fopen(CONFIG_FILE, "wt");
     fwrite(CONFIG_FILE_CONTENT, 1, sizeof(CONFIG_FILE_CONTENT), fp);
     fclose(fp);
+    remove((std::string(CONFIG_FILE) + CONFIG_JOURNAL_SUFFIX).c_str());
   }
 };
 
@@ -173,3 +174,116 @@ TEST_F(ConfigTest, config_save_basic) {
   std::unique_ptr<config_t> config = config_new(CONFIG_FILE);
   EXPECT_TRUE(config_save(*config, CONFIG_FILE));
 }
+
+static std::string config_to_string(const config_t& config) {
+  std::string serialized;
+  for (const section_t& section : config.sections) {
+    serialized += "[" + section.name + "]";
+    for (const entry_t& entry : section.entries)
+      serialized += entry.key + "=" + entry.value + ";";
+  }
+  return serialized;
+}
+
+static const std::string CONFIG_JOURNAL_FILE =
+    std::string(CONFIG_FILE) + CONFIG_JOURNAL_SUFFIX;
+
+TEST_F(ConfigTest, config_keeps_insertion_order) {
+  std::unique_ptr<config_t> config = config_new_empty();
+  config_set_string(config.get(), "b", "2", "x");
+  config_set_string(config.get(), "a", "1", "x");
+  config_set_string(config.get(), "b", "1", "x");
+  config_set_string(config.get(), "c", "1", "x");
+  config_set_string(config.get(), "b", "2", "y");
+  EXPECT_TRUE(config_remove_section(config.get(), "a"));
+  config_set_string(config.get(), "a", "1", "z");
+
+  EXPECT_EQ("[b]2=y;1=x;[c]1=x;[a]1=z;", config_to_string(*config));
+}
+
+TEST_F(ConfigTest, config_new_clone_is_indexed) {
+  std::unique_ptr<config_t> config = config_new(CONFIG_FILE);
+  std::unique_ptr<config_t> clone = config_new_clone(*config);
+
+  EXPECT_TRUE(config_remove_key(clone.get(), "DID", "productId"));
+  EXPECT_TRUE(config_remove_section(clone.get(), CONFIG_DEFAULT_SECTION));
+
+  EXPECT_TRUE(config_has_key(*config, "DID", "productId"));
+  EXPECT_TRUE(config_has_section(*config, CONFIG_DEFAULT_SECTION));
+  EXPECT_FALSE(config_has_key(*clone, "DID", "productId"));
+  EXPECT_FALSE(config_has_section(*clone, CONFIG_DEFAULT_SECTION));
+  EXPECT_EQ(config_get_int(*clone, "DID", "version", 0), 0x1436);
+}
+
+TEST_F(ConfigTest, config_remove_section_while_iterating) {
+  std::unique_ptr<config_t> config = config_new(CONFIG_FILE);
+  for (auto it = config->sections.begin(); it != config->sections.end();) {
+    if (it->name == "DID")
+      it = config_remove_section(config.get(), it);
+    else
+      ++it;
+  }
+
+  EXPECT_FALSE(config_has_section(*config, "DID"));
+  EXPECT_TRUE(config_has_key(*config, CONFIG_DEFAULT_SECTION, "first_key"));
+  config_set_string(config.get(), "DID", "version", "1");
+  EXPECT_EQ(config_get_int(*config, "DID", "version", 0), 1);
+}
+
+TEST_F(ConfigTest, config_save_journal) {
+  std::unique_ptr<config_t> saved = config_new(CONFIG_FILE);
+  EXPECT_TRUE(config_save(*saved, CONFIG_FILE));
+  EXPECT_EQ(0U, config_journal_size(CONFIG_FILE));
+
+  std::unique_ptr<config_t> config = config_new_clone(*saved);
+  config_set_string(config.get(), "DID", "version", "0x1437");
+  config_set_string(config.get(), "DID", "new_key", "new value");
+  EXPECT_TRUE(config_remove_key(config.get(), "DID", "productId"));
+  EXPECT_TRUE(config_remove_section(config.get(), CONFIG_DEFAULT_SECTION));
+  config_set_string(config.get(), "00:11:22:33:44:55", "LinkKey", "0123");
+  EXPECT_TRUE(config_save_journal(*saved, *config, CONFIG_FILE));
+
+  // Nothing changed, nothing written
+  size_t journal_size = config_journal_size(CONFIG_FILE);
+  EXPECT_NE(0U, journal_size);
+  EXPECT_TRUE(config_save_journal(*config, *config, CONFIG_FILE));
+  EXPECT_EQ(journal_size, config_journal_size(CONFIG_FILE));
+
+  std::unique_ptr<config_t> loaded = config_new(CONFIG_FILE);
+  ASSERT_TRUE(loaded != nullptr);
+  EXPECT_FALSE(config_has_section(*loaded, CONFIG_DEFAULT_SECTION));
+  EXPECT_FALSE(config_has_key(*loaded, "DID", "productId"));
+  EXPECT_EQ(config_get_int(*loaded, "DID", "version", 0), 0x1437);
+  EXPECT_EQ(*config_get_string(*loaded, "DID", "new_key", nullptr),
+            "new value");
+  EXPECT_EQ(*config_get_string(*loaded, "00:11:22:33:44:55", "LinkKey",
+                               nullptr),
+            "0123");
+
+  // Saving the whole file removes the journal
+  EXPECT_TRUE(config_save(*loaded, CONFIG_FILE));
+  EXPECT_EQ(0U, config_journal_size(CONFIG_FILE));
+  EXPECT_EQ(config_to_string(*loaded),
+            config_to_string(*config_new(CONFIG_FILE)));
+}
+
+TEST_F(ConfigTest, config_save_journal_incomplete_line) {
+  std::unique_ptr<config_t> saved = config_new(CONFIG_FILE);
+  EXPECT_TRUE(config_save(*saved, CONFIG_FILE));
+
+  std::unique_ptr<config_t> config = config_new_clone(*saved);
+  config_set_string(config.get(), "DID", "version", "1");
+  EXPECT_TRUE(config_save_journal(*saved, *config, CONFIG_FILE));
+
+  // A save interrupted half way through a line
+  FILE* fp = fopen(CONFIG_JOURNAL_FILE.c_str(), "at");
+  fputs("[DID]\nversion = 2\nprimaryRec", fp);
+  fclose(fp);
+
+  std::unique_ptr<config_t> loaded = config_new(CONFIG_FILE);
+  ASSERT_TRUE(loaded != nullptr);
+  EXPECT_EQ(config_get_int(*loaded, "DID", "version", 0), 2);
+  EXPECT_TRUE(config_has_key(*loaded, "DID", "primaryRecord"));
+
+  EXPECT_TRUE(config_save(*loaded, CONFIG_FILE));
+}
@@ -0,0 +1,81 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <thread>
+#include <vector>
+
+#include "osi/include/fixed_queue.h"
+#include "osi/include/osi.h"
+
+// Like the queues packets go through on their way to and from the controller
+static const size_t QUEUE_CAPACITY = 128;
+static const size_t BATCH_SIZE = 16;
+static const int PACKETS_PER_ITERATION = 10000;
+
+enum { LIST_QUEUE, LOCKFREE_QUEUE };
+
+// Pushes packets from state.range(2) producer threads through a queue of the
+// kind in state.range(0), dequeuing them one at a time or, if state.range(1)
+// is set, in batches.
+static void BM_FixedQueueThroughput(benchmark::State& state) {
+  const bool batch = state.range(1);
+  const int num_producers = state.range(2);
+  void* packets[BATCH_SIZE];
+
+  while (state.KeepRunning()) {
+    fixed_queue_t* queue = state.range(0) == LOCKFREE_QUEUE
+                               ? fixed_queue_new_lockfree(QUEUE_CAPACITY)
+                               : fixed_queue_new(QUEUE_CAPACITY);
+
+    std::vector<std::thread> producers;
+    for (int p = 0; p < num_producers; p++) {
+      producers.emplace_back([queue, num_producers]() {
+        for (int i = 0; i < PACKETS_PER_ITERATION / num_producers; i++)
+          fixed_queue_enqueue(queue, INT_TO_PTR(i + 1));
+      });
+    }
+
+    int received = 0;
+    while (received < PACKETS_PER_ITERATION / num_producers * num_producers) {
+      if (batch) {
+        size_t count =
+            fixed_queue_dequeue_batch(queue, packets, BATCH_SIZE);
+        if (count == 0) packets[count++] = fixed_queue_dequeue(queue);
+        received += count;
+      } else {
+        fixed_queue_dequeue(queue);
+        received++;
+      }
+    }
+
+    for (auto& producer : producers) producer.join();
+    fixed_queue_free(queue, NULL);
+  }
+  state.SetItemsProcessed(state.iterations() * PACKETS_PER_ITERATION);
+}
+BENCHMARK(BM_FixedQueueThroughput)
+    ->Args({LIST_QUEUE, false, 1})
+    ->Args({LIST_QUEUE, true, 1})
+    ->Args({LIST_QUEUE, false, 4})
+    ->Args({LOCKFREE_QUEUE, false, 1})
+    ->Args({LOCKFREE_QUEUE, true, 1})
+    ->Args({LOCKFREE_QUEUE, false, 4})
+    ->Args({LOCKFREE_QUEUE, true, 4})
+    ->UseRealTime();
@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 
+#include <atomic>
 #include <climits>
+#include <thread>
+#include <vector>
 
 #include "AllocationTestHarness.h"
 
@@ -43,6 +46,24 @@ static void fixed_queue_ready(fixed_queue_t* queue, UNUSED_ATTR void* context) {
   future_ready(received_message_future, msg);
 }
 
+// Counts of |fixed_queue_ready_counting| calls, |done| is made ready with
+// the |expected|th element
+typedef struct {
+  int received;
+  int empty;
+  int expected;
+  future_t* done;
+} ready_counts_t;
+
+static void fixed_queue_ready_counting(fixed_queue_t* queue, void* context) {
+  ready_counts_t* counts = static_cast<ready_counts_t*>(context);
+  if (fixed_queue_try_dequeue(queue) == NULL) {
+    counts->empty++;
+    return;
+  }
+  if (++counts->received == counts->expected) future_ready(counts->done, NULL);
+}
+
 static void test_queue_entry_free_cb(void* data) {
   // Don't free the data, because we are testing only whether the callback
   // is called.
@@ -348,3 +369,200 @@ TEST_F(FixedQueueTest, test_fixed_queue_register_dequeue) {
   thread_free(worker_thread);
   fixed_queue_free(queue, NULL);
 }
+
+TEST_F(FixedQueueTest, test_fixed_queue_lockfree_enqueue_dequeue) {
+  fixed_queue_t* queue = fixed_queue_new_lockfree(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+  EXPECT_EQ(TEST_QUEUE_SIZE, fixed_queue_capacity(queue));
+
+  int dequeue_fd = fixed_queue_get_dequeue_fd(queue);
+  EXPECT_FALSE(is_fd_readable(dequeue_fd));
+
+  // Test blocking enqueue and blocking dequeue
+  fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING);
+  EXPECT_TRUE(is_fd_readable(dequeue_fd));
+  EXPECT_EQ((size_t)1, fixed_queue_length(queue));
+  EXPECT_EQ(DUMMY_DATA_STRING, fixed_queue_try_peek_first(queue));
+  EXPECT_EQ(DUMMY_DATA_STRING, fixed_queue_dequeue(queue));
+  EXPECT_EQ((size_t)0, fixed_queue_length(queue));
+  EXPECT_TRUE(fixed_queue_is_empty(queue));
+
+  // Test non-blocking enqueue beyond queue capacity, in order
+  for (size_t i = 0; i < TEST_QUEUE_SIZE; i++) {
+    EXPECT_TRUE(fixed_queue_try_enqueue(queue, INT_TO_PTR(i + 1)));
+  }
+  EXPECT_FALSE(fixed_queue_try_enqueue(queue, (void*)DUMMY_DATA_STRING));
+  EXPECT_EQ(TEST_QUEUE_SIZE, fixed_queue_length(queue));
+
+  for (size_t i = 0; i < TEST_QUEUE_SIZE; i++) {
+    EXPECT_EQ(INT_TO_PTR(i + 1), fixed_queue_try_dequeue(queue));
+  }
+  EXPECT_EQ(NULL, fixed_queue_try_dequeue(queue));
+  EXPECT_EQ(NULL, fixed_queue_try_peek_first(queue));
+
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_dequeue_batch) {
+  fixed_queue_t* queues[] = {fixed_queue_new(TEST_QUEUE_SIZE),
+                             fixed_queue_new_lockfree(TEST_QUEUE_SIZE)};
+
+  for (fixed_queue_t* queue : queues) {
+    ASSERT_TRUE(queue != NULL);
+    int dequeue_fd = fixed_queue_get_dequeue_fd(queue);
+    void* data[TEST_QUEUE_SIZE];
+
+    EXPECT_EQ((size_t)0, fixed_queue_dequeue_batch(queue, data, 4));
+
+    for (size_t i = 0; i < 6; i++) {
+      fixed_queue_enqueue(queue, INT_TO_PTR(i + 1));
+    }
+
+    // Elements left over stay readable
+    ASSERT_EQ((size_t)4, fixed_queue_dequeue_batch(queue, data, 4));
+    for (size_t i = 0; i < 4; i++) EXPECT_EQ(INT_TO_PTR(i + 1), data[i]);
+    EXPECT_TRUE(is_fd_readable(dequeue_fd));
+
+    ASSERT_EQ((size_t)2, fixed_queue_dequeue_batch(queue, data, 4));
+    EXPECT_EQ(INT_TO_PTR(5), data[0]);
+    EXPECT_EQ(INT_TO_PTR(6), data[1]);
+    EXPECT_FALSE(is_fd_readable(dequeue_fd));
+
+    // And the queue is readable again once something is enqueued
+    fixed_queue_enqueue(queue, (void*)DUMMY_DATA_STRING);
+    EXPECT_TRUE(is_fd_readable(dequeue_fd));
+    ASSERT_EQ((size_t)1, fixed_queue_dequeue_batch(queue, data, 4));
+    EXPECT_EQ(DUMMY_DATA_STRING, data[0]);
+
+    fixed_queue_free(queue, NULL);
+  }
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_lockfree_producers) {
+  static const int NUM_PRODUCERS = 4;
+  static const int NUM_ELEMENTS = 1000;
+
+  // A small queue, so producers block on it being full
+  fixed_queue_t* queue = fixed_queue_new_lockfree(4);
+  ASSERT_TRUE(queue != NULL);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    producers.emplace_back([queue, p]() {
+      for (int i = 1; i <= NUM_ELEMENTS; i++) {
+        fixed_queue_enqueue(queue, INT_TO_PTR(p * NUM_ELEMENTS + i));
+      }
+    });
+  }
+
+  // Each producer's elements are dequeued in the order they were enqueued
+  int last[NUM_PRODUCERS] = {0};
+  for (int i = 0; i < NUM_PRODUCERS * NUM_ELEMENTS; i++) {
+    int value = PTR_TO_INT(fixed_queue_dequeue(queue));
+    int p = (value - 1) / NUM_ELEMENTS;
+    ASSERT_TRUE(p >= 0 && p < NUM_PRODUCERS);
+    EXPECT_LT(last[p], value);
+    last[p] = value;
+  }
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    EXPECT_EQ((p + 1) * NUM_ELEMENTS, last[p]);
+  }
+
+  for (auto& producer : producers) producer.join();
+  EXPECT_TRUE(fixed_queue_is_empty(queue));
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_lockfree_register_dequeue) {
+  fixed_queue_t* queue = fixed_queue_new_lockfree(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+
+  thread_t* worker_thread = thread_new("test_fixed_queue_worker_thread");
+  ASSERT_TRUE(worker_thread != NULL);
+
+  fixed_queue_register_dequeue(queue, thread_get_reactor(worker_thread),
+                               fixed_queue_ready, NULL);
+
+  // Each message is received, including those enqueued after the first one
+  // signaled the queue
+  const char* messages[] = {DUMMY_DATA_STRING1, DUMMY_DATA_STRING2,
+                            DUMMY_DATA_STRING3};
+  for (const char* message : messages) {
+    received_message_future = future_new();
+    ASSERT_TRUE(received_message_future != NULL);
+    fixed_queue_enqueue(queue, (void*)message);
+    EXPECT_EQ(message, future_await(received_message_future));
+  }
+
+  fixed_queue_unregister_dequeue(queue);
+  thread_free(worker_thread);
+  fixed_queue_free(queue, NULL);
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_lockfree_register_dequeue_producers) {
+  static const int NUM_PRODUCERS = 4;
+  static const int NUM_ELEMENTS = 10000;
+
+  fixed_queue_t* queue = fixed_queue_new_lockfree(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+
+  thread_t* worker_thread = thread_new("test_fixed_queue_worker_thread");
+  ASSERT_TRUE(worker_thread != NULL);
+
+  ready_counts_t counts = {0, 0, NUM_PRODUCERS * NUM_ELEMENTS, future_new()};
+  ASSERT_TRUE(counts.done != NULL);
+  fixed_queue_register_dequeue(queue, thread_get_reactor(worker_thread),
+                               fixed_queue_ready_counting, &counts);
+
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    producers.emplace_back([queue]() {
+      for (int i = 1; i <= NUM_ELEMENTS; i++) {
+        fixed_queue_enqueue(queue, INT_TO_PTR(i));
+      }
+    });
+  }
+  future_await(counts.done);
+  for (auto& producer : producers) producer.join();
+
+  // The callback is not called for slots producers have claimed but not
+  // filled yet
+  EXPECT_EQ(NUM_PRODUCERS * NUM_ELEMENTS, counts.received);
+  EXPECT_EQ(0, counts.empty);
+
+  fixed_queue_unregister_dequeue(queue);
+  thread_free(worker_thread);
+  fixed_queue_free(queue, NULL);
+}
+
+static std::atomic<int> flushed_counter;
+
+static void test_queue_entry_flush_cb(void* data) {
+  EXPECT_TRUE(data != NULL);
+  flushed_counter++;
+}
+
+TEST_F(FixedQueueTest, test_fixed_queue_lockfree_flush_producers) {
+  static const int NUM_PRODUCERS = 4;
+  static const int NUM_ELEMENTS = 10000;
+
+  fixed_queue_t* queue = fixed_queue_new_lockfree(TEST_QUEUE_SIZE);
+  ASSERT_TRUE(queue != NULL);
+
+  flushed_counter = 0;
+  std::vector<std::thread> producers;
+  for (int p = 0; p < NUM_PRODUCERS; p++) {
+    producers.emplace_back([queue]() {
+      for (int i = 1; i <= NUM_ELEMENTS; i++) {
+        fixed_queue_enqueue(queue, INT_TO_PTR(i));
+      }
+    });
+  }
+  while (flushed_counter < NUM_PRODUCERS * NUM_ELEMENTS)
+    fixed_queue_flush(queue, test_queue_entry_flush_cb);
+  for (auto& producer : producers) producer.join();
+
+  EXPECT_EQ(NUM_PRODUCERS * NUM_ELEMENTS, flushed_counter);
+  EXPECT_TRUE(fixed_queue_is_empty(queue));
+  fixed_queue_free(queue, NULL);
+}
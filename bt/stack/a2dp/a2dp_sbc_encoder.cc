@@ -532,7 +532,7 @@ static void a2dp_sbc_encode_frames(uint8_t nb_frame) {
   uint8_t last_frame_len = 0;
 
   while (nb_frame) {
-    BT_HDR* p_buf = (BT_HDR*)osi_malloc(A2DP_SBC_BUFFER_SIZE);
+    BT_HDR* p_buf = (BT_HDR*)buffer_pool_alloc(A2DP_SBC_BUFFER_SIZE);
     uint32_t bytes_read = 0;
 
     p_buf->offset = A2DP_SBC_OFFSET;
@@ -362,7 +362,7 @@ void a2dp_vendor_aptx_hd_send_frames(uint64_t timestamp_us) {
       &a2dp_aptx_hd_encoder_cb.framing_params;
 
   // Prepare the packet to send
-  BT_HDR* p_buf = (BT_HDR*)osi_malloc(BT_DEFAULT_BUFFER_SIZE);
+  BT_HDR* p_buf = (BT_HDR*)buffer_pool_alloc(BT_DEFAULT_BUFFER_SIZE);
   p_buf->offset = A2DP_APTX_HD_OFFSET;
   p_buf->len = 0;
   p_buf->layer_specific = 0;
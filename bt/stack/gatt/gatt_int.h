@@ -29,6 +29,7 @@
 #include <base/strings/stringprintf.h>
 #include <string.h>
 #include <list>
+#include <map>
 #include <unordered_set>
 #include <vector>
 
@@ -175,9 +176,13 @@ typedef struct {
 } tGATT_ATTR;
 
 /* Service Database definition
+ * Attributes are allocated consecutive handles, so the attribute of a handle
+ * is found by its offset from the service declaration. |type_index| lists the
+ * handles of the attributes of each type, in increasing order.
 */
 typedef struct {
   std::vector<tGATT_ATTR> attr_list; /* pointer to the attributes */
+  std::map<bluetooth::Uuid, std::vector<uint16_t>> type_index;
   uint16_t end_handle;       /* Last handle number           */
   uint16_t next_handle;      /* Next usable handle value     */
 } tGATT_SVC_DB;
@@ -583,5 +588,6 @@ extern tGATT_STATUS gatts_read_attr_perm_check(tGATT_SVC_DB* p_db, bool is_long,
                                                tGATT_SEC_FLAG sec_flag,
                                                uint8_t key_size);
 extern bluetooth::Uuid* gatts_get_service_uuid(tGATT_SVC_DB* p_db);
+extern tGATT_ATTR* find_attr_by_handle(tGATT_SVC_DB* p_db, uint16_t handle);
 
 #endif
@@ -527,10 +527,17 @@ static tGATT_STATUS gatt_build_find_info_rsp(tGATT_SRV_LIST_ELEM& el,
 
   uint8_t* p = (uint8_t*)(p_msg + 1) + L2CAP_MIN_OFFSET + p_msg->len;
 
-  for (auto& attr : el.p_db->attr_list) {
-    if (attr.handle > e_hdl) break;
+  /* start from the first attribute in range rather than the service start */
+  auto attr_it = el.p_db->attr_list.begin();
+  if (s_hdl > el.s_hdl) {
+    tGATT_ATTR* p_attr = find_attr_by_handle(el.p_db, s_hdl);
+    if (!p_attr) return GATT_NOT_FOUND;
+    attr_it += p_attr - &el.p_db->attr_list.front();
+  }
 
-    if (attr.handle < s_hdl) continue;
+  for (; attr_it != el.p_db->attr_list.end(); attr_it++) {
+    tGATT_ATTR& attr = *attr_it;
+    if (attr.handle > e_hdl) break;
 
     uint8_t uuid_len = attr.uuid.GetShortestRepresentationSize();
     if (p_msg->offset == 0)
@@ -1035,27 +1042,25 @@ void gatts_process_attribute_req(tGATT_TCB& tcb, uint8_t op_code, uint16_t len,
   if (GATT_HANDLE_IS_VALID(handle)) {
     for (auto& el : *gatt_cb.srv_list_info) {
       if (el.s_hdl <= handle && el.e_hdl >= handle) {
-        for (const auto& attr : el.p_db->attr_list) {
-          if (attr.handle == handle) {
-            switch (op_code) {
-              case GATT_REQ_READ: /* read char/char descriptor value */
-              case GATT_REQ_READ_BLOB:
-                gatts_process_read_req(tcb, el, op_code, handle, len, p);
-                break;
-
-              case GATT_REQ_WRITE: /* write char/char descriptor value */
-              case GATT_CMD_WRITE:
-              case GATT_SIGN_CMD_WRITE:
-              case GATT_REQ_PREPARE_WRITE:
-                gatts_process_write_req(tcb, el, handle, op_code, len, p,
-                                        attr.gatt_type);
-                break;
-              default:
-                break;
-            }
-            status = GATT_SUCCESS;
-            break;
+        const tGATT_ATTR* p_attr = find_attr_by_handle(el.p_db, handle);
+        if (p_attr) {
+          switch (op_code) {
+            case GATT_REQ_READ: /* read char/char descriptor value */
+            case GATT_REQ_READ_BLOB:
+              gatts_process_read_req(tcb, el, op_code, handle, len, p);
+              break;
+
+            case GATT_REQ_WRITE: /* write char/char descriptor value */
+            case GATT_CMD_WRITE:
+            case GATT_SIGN_CMD_WRITE:
+            case GATT_REQ_PREPARE_WRITE:
+              gatts_process_write_req(tcb, el, handle, op_code, len, p,
+                                      p_attr->gatt_type);
+              break;
+            default:
+              break;
           }
+          status = GATT_SUCCESS;
         }
         break;
       }
@@ -353,7 +353,7 @@ BT_HDR* l2c_fcr_clone_buf(BT_HDR* p_buf, uint16_t new_offset,
    */
   buf_size += sizeof(uint32_t);
 #endif
-  BT_HDR* p_buf2 = (BT_HDR*)osi_malloc(buf_size);
+  BT_HDR* p_buf2 = (BT_HDR*)buffer_pool_alloc(buf_size);
 
   p_buf2->offset = new_offset;
   p_buf2->len = no_of_bytes;
@@ -861,7 +861,7 @@ void l2c_lcc_proc_pdu(tL2C_CCB* p_ccb, BT_HDR* p_buf) {
       return;
     }
 
-    p_data = (BT_HDR*)osi_malloc(BT_HDR_SIZE + sdu_length);
+    p_data = (BT_HDR*)buffer_pool_alloc(BT_HDR_SIZE + sdu_length);
     if (p_data == NULL) {
       osi_free(p_buf);
       return;
@@ -1484,7 +1484,7 @@ static bool do_sar_reassembly(tL2C_CCB* p_ccb, BT_HDR* p_buf,
                             p_fcrb->rx_sdu_len, p_fcrb->rx_sdu_len);
         packet_ok = false;
       } else {
-        p_fcrb->p_rx_sdu = (BT_HDR*)osi_malloc(
+        p_fcrb->p_rx_sdu = (BT_HDR*)buffer_pool_alloc(
             BT_HDR_SIZE + OBX_BUF_MIN_OFFSET + p_fcrb->rx_sdu_len);
         p_fcrb->p_rx_sdu->offset = OBX_BUF_MIN_OFFSET;
         p_fcrb->p_rx_sdu->len = 0;
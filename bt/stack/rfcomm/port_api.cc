@@ -1497,7 +1497,7 @@ int PORT_WriteDataCO(uint16_t handle, int* p_len) {
     }
 
     /* continue with rfcomm data write */
-    p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+    p_buf = (BT_HDR*)buffer_pool_alloc(RFCOMM_DATA_BUF_SIZE);
     p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
     p_buf->layer_specific = handle;
 
@@ -1617,7 +1617,7 @@ int PORT_WriteData(uint16_t handle, const char* p_data, uint16_t max_len,
       break;
 
     /* continue with rfcomm data write */
-    p_buf = (BT_HDR*)osi_malloc(RFCOMM_DATA_BUF_SIZE);
+    p_buf = (BT_HDR*)buffer_pool_alloc(RFCOMM_DATA_BUF_SIZE);
     p_buf->offset = L2CAP_MIN_OFFSET + RFCOMM_MIN_OFFSET;
     p_buf->layer_specific = handle;
 
@@ -0,0 +1,166 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <benchmark/benchmark.h>
+
+#include <vector>
+
+#include "osi/include/allocator.h"
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/l2c_api.h"
+
+using bluetooth::Uuid;
+
+// A vendor service of 333 characteristics, each with a Client Characteristic
+// Configuration descriptor, for 1000 attributes with the service declaration.
+static const uint16_t DB_START_HANDLE = GATT_APP_START_HANDLE;
+static const uint16_t DB_NUM_HANDLES = 1000;
+static const uint16_t NUM_CHARACTERISTICS = (DB_NUM_HANDLES - 1) / 3;
+static const uint16_t TEST_MTU = 185;
+static const size_t NUM_REQUESTS = 4096;
+
+static Uuid characteristic_uuid(uint16_t index) {
+  return Uuid::FromString(
+      base::StringPrintf("%08x-0000-1000-8000-00805f9b34fb", 0x10000 + index));
+}
+
+static tGATT_SVC_DB* get_db(void) {
+  static tGATT_SVC_DB* db = nullptr;
+  if (db) return db;
+
+  db = new tGATT_SVC_DB;
+  gatts_init_service_db(*db, Uuid::FromString("0000feed-0000-1000-8000-"
+                                              "00805f9b34fb"),
+                        true, DB_START_HANDLE, DB_NUM_HANDLES);
+  for (uint16_t i = 0; i < NUM_CHARACTERISTICS; i++) {
+    gatts_add_characteristic(
+        *db, GATT_PERM_READ | GATT_PERM_WRITE,
+        GATT_CHAR_PROP_BIT_READ | GATT_CHAR_PROP_BIT_WRITE |
+            GATT_CHAR_PROP_BIT_NOTIFY,
+        characteristic_uuid(i));
+    gatts_add_char_descr(*db, GATT_PERM_READ | GATT_PERM_WRITE,
+                         Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG));
+  }
+  return db;
+}
+
+// Handles of characteristic values and descriptors, in the order a busy
+// central reads, writes and subscribes to them.
+static std::vector<uint16_t> request_handles(void) {
+  std::vector<uint16_t> handles;
+  uint32_t seed = 1;
+  for (size_t i = 0; i < NUM_REQUESTS; i++) {
+    seed = seed * 1103515245 + 12345;
+    uint16_t characteristic = (seed >> 16) % NUM_CHARACTERISTICS;
+    handles.push_back(DB_START_HANDLE + 2 + characteristic * 3 + i % 2);
+  }
+  return handles;
+}
+
+static BT_HDR* new_response(void) {
+  BT_HDR* p_rsp =
+      (BT_HDR*)osi_calloc(sizeof(BT_HDR) + TEST_MTU + L2CAP_MIN_OFFSET);
+  p_rsp->len = 2;
+  return p_rsp;
+}
+
+// Read, Write and Handle Value Notification of single attributes, as checked
+// against the database by gatt_sr.cc before they reach the application.
+static void BM_GattAttributeRequests(benchmark::State& state) {
+  tGATT_SVC_DB* db = get_db();
+  std::vector<uint16_t> handles = request_handles();
+  uint8_t value[2] = {0x01, 0x00};
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    uint16_t handle = handles[i++ % NUM_REQUESTS];
+    switch (i % 3) {
+      case 0:
+        benchmark::DoNotOptimize(gatts_read_attr_perm_check(
+            db, false, handle, GATT_SEC_FLAG_ENCRYPTED, 16));
+        break;
+      case 1:
+        benchmark::DoNotOptimize(gatts_write_attr_perm_check(
+            db, GATT_REQ_WRITE, handle, 0, value, sizeof(value),
+            GATT_SEC_FLAG_ENCRYPTED, 16));
+        break;
+      default:
+        benchmark::DoNotOptimize(find_attr_by_handle(db, handle));
+        break;
+    }
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GattAttributeRequests);
+
+// Discover All Characteristics of a Service: Read By Type requests for the
+// characteristic declarations, each starting after the last handle returned.
+static void BM_GattDiscoverCharacteristics(benchmark::State& state) {
+  tGATT_SVC_DB* db = get_db();
+  tGATT_TCB tcb;
+  Uuid type = Uuid::From16Bit(GATT_UUID_CHAR_DECLARE);
+
+  size_t requests = 0;
+  while (state.KeepRunning()) {
+    uint16_t s_handle = DB_START_HANDLE;
+    while (true) {
+      BT_HDR* p_rsp = new_response();
+      uint16_t len = TEST_MTU - 2, err_handle = 0;
+      tGATT_STATUS status = gatts_db_read_attr_value_by_type(
+          tcb, db, GATT_REQ_READ_BY_TYPE, p_rsp, s_handle, 0xFFFF, type, &len,
+          GATT_SEC_FLAG_ENCRYPTED, 16, 0, &err_handle);
+      requests++;
+
+      uint8_t* p = (uint8_t*)(p_rsp + 1) + L2CAP_MIN_OFFSET + p_rsp->len -
+                   p_rsp->offset;
+      uint16_t last_handle = 0;
+      STREAM_TO_UINT16(last_handle, p);
+      osi_free(p_rsp);
+
+      if (status == GATT_NOT_FOUND || last_handle < s_handle) break;
+      s_handle = last_handle + 1;
+    }
+  }
+  state.SetItemsProcessed(requests);
+}
+BENCHMARK(BM_GattDiscoverCharacteristics);
+
+// Read Using Characteristic UUID over the whole handle range, as done for
+// well-known characteristics without discovering the database first.
+static void BM_GattReadUsingCharacteristicUuid(benchmark::State& state) {
+  tGATT_SVC_DB* db = get_db();
+  tGATT_TCB tcb;
+  std::vector<Uuid> types;
+  for (uint16_t handle : request_handles())
+    types.push_back(characteristic_uuid((handle - DB_START_HANDLE - 2) / 3));
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    BT_HDR* p_rsp = new_response();
+    uint16_t len = TEST_MTU - 2, err_handle = 0;
+    benchmark::DoNotOptimize(gatts_db_read_attr_value_by_type(
+        tcb, db, GATT_REQ_READ_BY_TYPE, p_rsp, 0x0001, 0xFFFF,
+        types[i++ % NUM_REQUESTS], &len,
+        GATT_SEC_FLAG_ENCRYPTED, 16, 0, &err_handle));
+    osi_free(p_rsp);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_GattReadUsingCharacteristicUuid);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,64 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <list>
+
+#include "stack/gatt/gatt_int.h"
+
+using bluetooth::Uuid;
+
+// Stand-ins for the parts of gatt_sr.cc and gatt_utils.cc that gatt_db.cc
+// calls, for the GATT database tests and benchmarks. Reads handed to the
+// application are not answered, only their handle is remembered.
+static std::list<tGATT_SRV_LIST_ELEM> srv_list(1);
+uint16_t app_read_handle;
+
+std::list<tGATT_SRV_LIST_ELEM>::iterator gatt_sr_find_i_rcb_by_handle(
+    uint16_t handle) {
+  return srv_list.begin();
+}
+
+uint32_t gatt_sr_enqueue_cmd(tGATT_TCB& tcb, uint8_t op_code,
+                             uint16_t handle) {
+  return 1;
+}
+
+void gatt_sr_update_cback_cnt(tGATT_TCB& tcb, tGATT_IF gatt_if, bool is_inc,
+                              bool is_reset_first) {}
+
+void gatt_sr_send_req_callback(uint16_t conn_id, uint32_t trans_id,
+                               uint8_t type, tGATTS_DATA* p_data) {
+  app_read_handle = p_data->read_req.handle;
+}
+
+uint8_t gatt_build_uuid_to_stream_len(const Uuid& uuid) {
+  size_t len = uuid.GetShortestRepresentationSize();
+  return len == Uuid::kNumBytes32 ? Uuid::kNumBytes128 : len;
+}
+
+uint8_t gatt_build_uuid_to_stream(uint8_t** p_dst, const Uuid& uuid) {
+  uint8_t* p = *p_dst;
+  size_t len = gatt_build_uuid_to_stream_len(uuid);
+  if (len == Uuid::kNumBytes16) {
+    UINT16_TO_STREAM(p, uuid.As16Bit());
+  } else {
+    ARRAY_TO_STREAM(p, uuid.To128BitLE(), (int)Uuid::kNumBytes128);
+  }
+  *p_dst = p;
+  return len;
+}
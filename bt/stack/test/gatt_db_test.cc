@@ -0,0 +1,208 @@
+/******************************************************************************
+ *
+ *  Copyright 2018 The Android Open Source Project
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at:
+ *
+ *  http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "osi/include/allocator.h"
+#include "stack/gatt/gatt_int.h"
+#include "stack/include/l2c_api.h"
+
+using bluetooth::Uuid;
+
+// Handle of the last read handed to the application, see gatt_db_stubs.cc
+extern uint16_t app_read_handle;
+
+static const uint16_t S_HANDLE = GATT_APP_START_HANDLE;
+static const uint16_t NUM_HANDLES = 9;
+static const uint16_t TEST_MTU = 185;
+static const uint16_t UUID_HEART_RATE = 0x180D;
+static const uint16_t UUID_MEASUREMENT = 0x2A37;
+static const uint16_t UUID_LOCATION = 0x2A38;
+
+class GattDbTest : public ::testing::Test {
+ protected:
+  // S_HANDLE      Heart Rate service declaration
+  // S_HANDLE + 1  Heart Rate Measurement declaration
+  // S_HANDLE + 2    value
+  // S_HANDLE + 3    Client Characteristic Configuration
+  // S_HANDLE + 4  Body Sensor Location declaration
+  // S_HANDLE + 5    value
+  // S_HANDLE + 6  Heart Rate Measurement declaration, a second one
+  // S_HANDLE + 7    value
+  // S_HANDLE + 8    Client Characteristic Configuration
+  void SetUp() override {
+    gatts_init_service_db(db_, Uuid::From16Bit(UUID_HEART_RATE), true,
+                          S_HANDLE, NUM_HANDLES);
+    AddCharacteristic(UUID_MEASUREMENT, true);
+    AddCharacteristic(UUID_LOCATION, false);
+    AddCharacteristic(UUID_MEASUREMENT, true);
+    app_read_handle = 0;
+  }
+
+  void AddCharacteristic(uint16_t uuid, bool notify) {
+    tGATT_CHAR_PROP property = GATT_CHAR_PROP_BIT_READ;
+    if (notify) property |= GATT_CHAR_PROP_BIT_NOTIFY;
+    gatts_add_characteristic(db_, GATT_PERM_READ, property,
+                             Uuid::From16Bit(uuid));
+    if (notify) {
+      gatts_add_char_descr(db_, GATT_PERM_READ | GATT_PERM_WRITE,
+                           Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG));
+    }
+  }
+
+  // Issues a Read By Type request for type in [s_handle, e_handle]. Handles
+  // of the attributes in the response are appended to handles.
+  tGATT_STATUS ReadByType(uint16_t s_handle, uint16_t e_handle, uint16_t type,
+                          std::vector<uint16_t>* handles) {
+    BT_HDR* p_rsp =
+        (BT_HDR*)osi_calloc(sizeof(BT_HDR) + TEST_MTU + L2CAP_MIN_OFFSET);
+    p_rsp->len = 2;
+    uint16_t len = TEST_MTU - 2, err_handle = 0;
+    tGATT_STATUS status = gatts_db_read_attr_value_by_type(
+        tcb_, &db_, GATT_REQ_READ_BY_TYPE, p_rsp, s_handle, e_handle,
+        Uuid::From16Bit(type), &len, GATT_SEC_FLAG_ENCRYPTED, 16, 0,
+        &err_handle);
+
+    uint8_t* p = (uint8_t*)(p_rsp + 1) + L2CAP_MIN_OFFSET + 2;
+    for (uint16_t i = 2; p_rsp->offset && i < p_rsp->len; i += p_rsp->offset) {
+      uint8_t* entry = p + i - 2;
+      uint16_t handle;
+      STREAM_TO_UINT16(handle, entry);
+      handles->push_back(handle);
+    }
+    osi_free(p_rsp);
+    return status;
+  }
+
+  tGATT_SVC_DB db_;
+  tGATT_TCB tcb_;
+};
+
+TEST_F(GattDbTest, find_attr_by_handle) {
+  tGATT_ATTR* attr = find_attr_by_handle(&db_, S_HANDLE);
+  ASSERT_NE(nullptr, attr);
+  EXPECT_EQ(S_HANDLE, attr->handle);
+  EXPECT_EQ(Uuid::From16Bit(GATT_UUID_PRI_SERVICE), attr->uuid);
+
+  for (uint16_t handle = S_HANDLE; handle < S_HANDLE + NUM_HANDLES; handle++) {
+    attr = find_attr_by_handle(&db_, handle);
+    ASSERT_NE(nullptr, attr) << "handle " << handle;
+    EXPECT_EQ(handle, attr->handle);
+  }
+
+  attr = find_attr_by_handle(&db_, S_HANDLE + NUM_HANDLES - 1);
+  ASSERT_NE(nullptr, attr);
+  EXPECT_EQ(Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG), attr->uuid);
+
+  EXPECT_EQ(nullptr, find_attr_by_handle(&db_, S_HANDLE - 1));
+  EXPECT_EQ(nullptr, find_attr_by_handle(&db_, S_HANDLE + NUM_HANDLES));
+  EXPECT_EQ(nullptr, find_attr_by_handle(&db_, 0));
+  EXPECT_EQ(nullptr, find_attr_by_handle(&db_, 0xFFFF));
+  EXPECT_EQ(nullptr, find_attr_by_handle(nullptr, S_HANDLE));
+
+  tGATT_SVC_DB empty;
+  EXPECT_EQ(nullptr, find_attr_by_handle(&empty, S_HANDLE));
+}
+
+TEST_F(GattDbTest, type_index) {
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 1, S_HANDLE + 4, S_HANDLE + 6}),
+            db_.type_index[Uuid::From16Bit(GATT_UUID_CHAR_DECLARE)]);
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 2, S_HANDLE + 7}),
+            db_.type_index[Uuid::From16Bit(UUID_MEASUREMENT)]);
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 3, S_HANDLE + 8}),
+            db_.type_index[Uuid::From16Bit(GATT_UUID_CHAR_CLIENT_CONFIG)]);
+}
+
+TEST_F(GattDbTest, read_by_type_range) {
+  std::vector<uint16_t> handles;
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(0x0001, 0xFFFF, GATT_UUID_CHAR_DECLARE, &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 1, S_HANDLE + 4, S_HANDLE + 6}),
+            handles);
+
+  // the end handle is included, anything past it is not
+  handles.clear();
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(S_HANDLE, S_HANDLE + 4, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 1, S_HANDLE + 4}), handles);
+
+  handles.clear();
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(S_HANDLE, S_HANDLE + 3, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 1}), handles);
+
+  // as is the start handle
+  handles.clear();
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(S_HANDLE + 4, 0xFFFF, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 4, S_HANDLE + 6}), handles);
+
+  handles.clear();
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(S_HANDLE + 6, S_HANDLE + 6, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE + 6}), handles);
+
+  // nothing in range
+  handles.clear();
+  EXPECT_EQ(GATT_NOT_FOUND,
+            ReadByType(S_HANDLE + 2, S_HANDLE + 3, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(GATT_NOT_FOUND,
+            ReadByType(S_HANDLE + 7, 0xFFFF, GATT_UUID_CHAR_DECLARE,
+                       &handles));
+  EXPECT_EQ(GATT_NOT_FOUND,
+            ReadByType(0x0001, S_HANDLE - 1, GATT_UUID_PRI_SERVICE, &handles));
+  EXPECT_EQ(GATT_NOT_FOUND,
+            ReadByType(0x0001, 0xFFFF, GATT_UUID_INCLUDE_SERVICE, &handles));
+  EXPECT_TRUE(handles.empty());
+
+  EXPECT_EQ(GATT_SUCCESS,
+            ReadByType(S_HANDLE, S_HANDLE, GATT_UUID_PRI_SERVICE, &handles));
+  EXPECT_EQ(std::vector<uint16_t>({S_HANDLE}), handles);
+}
+
+TEST_F(GattDbTest, read_by_type_same_uuid) {
+  // Values are read by the application, one at a time, the first in range.
+  std::vector<uint16_t> handles;
+  EXPECT_EQ(GATT_PENDING,
+            ReadByType(0x0001, 0xFFFF, UUID_MEASUREMENT, &handles));
+  EXPECT_EQ(S_HANDLE + 2, app_read_handle);
+
+  EXPECT_EQ(GATT_PENDING,
+            ReadByType(S_HANDLE + 3, 0xFFFF, UUID_MEASUREMENT, &handles));
+  EXPECT_EQ(S_HANDLE + 7, app_read_handle);
+
+  app_read_handle = 0;
+  EXPECT_EQ(GATT_NOT_FOUND,
+            ReadByType(S_HANDLE + 3, S_HANDLE + 6, UUID_MEASUREMENT, &handles));
+  EXPECT_EQ(0, app_read_handle);
+
+  EXPECT_EQ(GATT_PENDING, ReadByType(S_HANDLE + 4, S_HANDLE + 8,
+                                     GATT_UUID_CHAR_CLIENT_CONFIG, &handles));
+  EXPECT_EQ(S_HANDLE + 8, app_read_handle);
+
+  EXPECT_EQ(GATT_PENDING,
+            ReadByType(S_HANDLE + 5, S_HANDLE + 5, UUID_LOCATION, &handles));
+  EXPECT_EQ(S_HANDLE + 5, app_read_handle);
+}
@@ -299,6 +299,7 @@ LOCAL_STATIC_LIBRARIES := \
     liblog \
     libmdnssd \
     libusb \
+    libz \
 
 # Don't use libcutils on Windows.
 LOCAL_STATIC_LIBRARIES_darwin := libcutils
@@ -377,6 +378,7 @@ LOCAL_STATIC_LIBRARIES := \
     libminijail \
     libmdnssd \
     libdebuggerd_handler \
+    libz \
 
 include $(BUILD_EXECUTABLE)
 
@@ -18,6 +18,11 @@
 
 #include <gtest/gtest.h>
 
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+#include <chrono>
 #include <limits>
 #include <queue>
 #include <string>
@@ -137,6 +142,81 @@ TEST_F(FdeventTest, smoke) {
     ASSERT_EQ(0, adb_close(reader));
 }
 
+static void IdleFdEventCallback(int fd, unsigned, void*) {
+    FAIL() << "idle fd " << fd << " got an event";
+}
+
+static void IdleFdThreadFunc(ThreadArg* arg, std::vector<int>* idle_fds) {
+    std::vector<fdevent> idle_fdes(idle_fds->size());
+    for (size_t i = 0; i < idle_fds->size(); ++i) {
+        fdevent_install(&idle_fdes[i], (*idle_fds)[i], IdleFdEventCallback, nullptr);
+        fdevent_add(&idle_fdes[i], FDE_READ);
+    }
+
+    {
+        FdHandler handler(arg->first_read_fd, arg->last_write_fd);
+        fdevent_loop();
+    }
+
+    for (fdevent& fde : idle_fdes) {
+        fdevent_remove(&fde);
+    }
+}
+
+// Reports the time for a byte to go through the loop and back while many other fds are
+// installed but idle, which is what each wait of the loop has to scale with.
+TEST_F(FdeventTest, dispatch_latency_with_idle_fds) {
+    const size_t IDLE_FD_COUNT = 1000;
+    const size_t ROUND_TRIP_COUNT = 10000;
+
+#if !defined(_WIN32)
+    rlimit rl;
+    ASSERT_EQ(0, getrlimit(RLIMIT_NOFILE, &rl));
+    if (rl.rlim_cur < IDLE_FD_COUNT + 64 && rl.rlim_max >= IDLE_FD_COUNT + 64) {
+        rl.rlim_cur = IDLE_FD_COUNT + 64;
+        ASSERT_EQ(0, setrlimit(RLIMIT_NOFILE, &rl));
+    }
+#endif
+
+    // Both ends of each pair are installed, and nothing is ever written to them.
+    std::vector<int> idle_fds;
+    for (size_t i = 0; i < IDLE_FD_COUNT / 2; ++i) {
+        int fds[2];
+        ASSERT_EQ(0, adb_socketpair(fds));
+        idle_fds.push_back(fds[0]);
+        idle_fds.push_back(fds[1]);
+    }
+
+    int fd_pair1[2];
+    int fd_pair2[2];
+    ASSERT_EQ(0, adb_socketpair(fd_pair1));
+    ASSERT_EQ(0, adb_socketpair(fd_pair2));
+    ThreadArg thread_arg;
+    thread_arg.first_read_fd = fd_pair1[0];
+    thread_arg.last_write_fd = fd_pair2[1];
+    thread_arg.middle_pipe_count = 0;
+    int writer = fd_pair1[1];
+    int reader = fd_pair2[0];
+
+    PrepareThread();
+    std::thread thread(IdleFdThreadFunc, &thread_arg, &idle_fds);
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < ROUND_TRIP_COUNT; ++i) {
+        char c = 'a';
+        ASSERT_TRUE(WriteFdExactly(writer, &c, 1));
+        ASSERT_TRUE(ReadFdExactly(reader, &c, 1));
+        ASSERT_EQ('a', c);
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    printf("%zu idle fds: %.1f us per round trip\n", IDLE_FD_COUNT,
+           elapsed.count() / ROUND_TRIP_COUNT);
+
+    TerminateThread(thread);
+    ASSERT_EQ(0, adb_close(writer));
+    ASSERT_EQ(0, adb_close(reader));
+}
+
 struct InvalidFdArg {
     fdevent fde;
     unsigned expected_events;
@@ -27,6 +27,7 @@
 #include <utime.h>
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <sstream>
@@ -48,11 +49,12 @@
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 
-struct syncsendbuf {
-    unsigned id;
-    unsigned size;
-    char data[SYNC_DATA_MAX];
-};
+#include <zlib.h>
+
+// With kFeatureSendRecv2, the number of pushed files whose OKAY hasn't been read yet,
+// and the number of RECV requests queued ahead of the file being pulled.
+static constexpr size_t kMaxDeferredAcks = 64;
+static constexpr size_t kMaxPendingRecvs = 16;
 
 static void ensure_trailing_separators(std::string& local_path, std::string& remote_path) {
     if (!adb_is_separator(local_path.back())) {
@@ -198,8 +200,8 @@ struct TransferLedger {
 
 class SyncConnection {
   public:
-    SyncConnection() : expect_done_(false) {
-        max = SYNC_DATA_MAX; // TODO: decide at runtime.
+    SyncConnection() : expect_done_(0), have_sendrecv_v2_(false), compress_(false) {
+        max = SYNC_DATA_MAX;
 
         std::string error;
         FeatureSet features;
@@ -208,6 +210,9 @@ class SyncConnection {
             Error("failed to get feature set: %s", error.c_str());
         } else {
             have_stat_v2_ = CanUseFeature(features, kFeatureStat2);
+            have_sendrecv_v2_ = CanUseFeature(features, kFeatureSendRecv2);
+            if (have_sendrecv_v2_) max = SYNC_DATA_MAX_V2;
+            buffer.resize(sizeof(SyncRequest) + max);
             fd = adb_connect("sync:", &error);
             if (fd < 0) {
                 Error("connect failed: %s", error.c_str());
@@ -234,6 +239,17 @@ class SyncConnection {
 
     bool IsValid() { return fd >= 0; }
 
+    bool HaveSendRecv2() const { return have_sendrecv_v2_; }
+
+    // Asks the device to deflate pulled files. Needs kFeatureSendRecv2.
+    bool SetCompression(bool compress) {
+        if (compress && !have_sendrecv_v2_) return false;
+        compress_ = compress;
+        return true;
+    }
+
+    bool Compressing() const { return compress_; }
+
     bool ReceivedError(const char* from, const char* to) {
         adb_pollfd pfd = {.fd = fd, .events = POLLIN};
         int rc = adb_poll(&pfd, 1, 0);
@@ -298,6 +314,32 @@ class SyncConnection {
         return WriteFdExactly(fd, &buf[0], buf.size());
     }
 
+    // Requests the contents of |path|, as ID_RECV_V2 if the device supports it.
+    bool SendRecv(const char* path) {
+        if (!have_sendrecv_v2_) return SendRequest(ID_RECV, path);
+
+        size_t path_length = strlen(path);
+        if (path_length > 1024) {
+            Error("SendRecv failed: path too long: %zu", path_length);
+            errno = ENAMETOOLONG;
+            return false;
+        }
+
+        syncmsg msg;
+        msg.recv_v2.id = ID_RECV_V2;
+        msg.recv_v2.flags = compress_ ? kSyncFlagDeflate : kSyncFlagNone;
+
+        std::vector<char> buf(sizeof(SyncRequest) + path_length + sizeof(msg.recv_v2));
+        SyncRequest* req = reinterpret_cast<SyncRequest*>(&buf[0]);
+        req->id = ID_RECV_V2;
+        req->path_length = path_length;
+        char* data = reinterpret_cast<char*>(req + 1);
+        memcpy(data, path, path_length);
+        memcpy(data + path_length, &msg.recv_v2, sizeof(msg.recv_v2));
+
+        return WriteFdExactly(fd, &buf[0], buf.size());
+    }
+
     bool SendStat(const char* path_and_mode) {
         if (!have_stat_v2_) {
             errno = ENOTSUP;
@@ -407,7 +449,7 @@ class SyncConnection {
         p += sizeof(SyncRequest);
 
         WriteOrDie(lpath, rpath, &buf[0], (p - &buf[0]));
-        expect_done_ = true;
+        expect_done_++;
 
         // RecordFilesTransferred gets called in CopyDone.
         RecordBytesTransferred(data_length);
@@ -418,6 +460,9 @@ class SyncConnection {
     bool SendLargeFile(const char* path_and_mode,
                        const char* lpath, const char* rpath,
                        unsigned mtime) {
+        // ReceivedError can't tell an early failure from the replies to earlier files.
+        if (!ReadDeferredAcks()) return false;
+
         if (!SendRequest(ID_SEND, path_and_mode)) {
             Error("failed to send ID_SEND message '%s': %s", path_and_mode, strerror(errno));
             return false;
@@ -438,10 +483,10 @@ class SyncConnection {
             return false;
         }
 
-        syncsendbuf sbuf;
-        sbuf.id = ID_DATA;
+        SyncRequest* req = reinterpret_cast<SyncRequest*>(&buffer[0]);
+        req->id = ID_DATA;
         while (true) {
-            int bytes_read = adb_read(lfd, sbuf.data, max - sizeof(SyncRequest));
+            int bytes_read = adb_read(lfd, req + 1, max - sizeof(SyncRequest));
             if (bytes_read == -1) {
                 Error("reading '%s' locally failed: %s", lpath, strerror(errno));
                 adb_close(lfd);
@@ -450,8 +495,8 @@ class SyncConnection {
                 break;
             }
 
-            sbuf.size = bytes_read;
-            WriteOrDie(lpath, rpath, &sbuf, sizeof(SyncRequest) + bytes_read);
+            req->path_length = bytes_read;
+            WriteOrDie(lpath, rpath, req, sizeof(SyncRequest) + bytes_read);
 
             RecordBytesTransferred(bytes_read);
             bytes_copied += bytes_read;
@@ -469,7 +514,7 @@ class SyncConnection {
         syncmsg msg;
         msg.data.id = ID_DONE;
         msg.data.size = mtime;
-        expect_done_ = true;
+        expect_done_++;
 
         // RecordFilesTransferred gets called in CopyDone.
         return WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
@@ -482,8 +527,8 @@ class SyncConnection {
             return false;
         }
         if (msg.status.id == ID_OKAY) {
-            if (expect_done_) {
-                expect_done_ = false;
+            if (expect_done_ > 0) {
+                expect_done_--;
                 RecordFilesTransferred(1);
                 return true;
             } else {
@@ -498,6 +543,27 @@ class SyncConnection {
         return ReportCopyFailure(from, to, msg);
     }
 
+    // Completes a push. Without kFeatureSendRecv2 this waits for the device's reply;
+    // otherwise the reply is read later, so that the next file can be sent straight
+    // away, and only when more than kMaxDeferredAcks replies are outstanding.
+    bool FinishSend(const char* from, const char* to) {
+        if (!have_sendrecv_v2_) return CopyDone(from, to);
+
+        deferred_acks_.emplace_back(from, to);
+        while (deferred_acks_.size() > kMaxDeferredAcks) {
+            if (!ReadDeferredAck()) return false;
+        }
+        return true;
+    }
+
+    // Reads the replies to all pushes completed by FinishSend.
+    bool ReadDeferredAcks() {
+        while (!deferred_acks_.empty()) {
+            if (!ReadDeferredAck()) return false;
+        }
+        return true;
+    }
+
     bool ReportCopyFailure(const char* from, const char* to, const syncmsg& msg) {
         std::vector<char> buf(msg.status.msglen + 1);
         if (!ReadFdExactly(fd, &buf[0], msg.status.msglen)) {
@@ -571,13 +637,18 @@ class SyncConnection {
         current_ledger_.expect_multiple_files = false;
     }
 
-    // TODO: add a char[max] buffer here, to replace syncsendbuf...
     int fd;
     size_t max;
+    // sizeof(SyncRequest) + max bytes, for building DATA requests.
+    std::vector<char> buffer;
 
   private:
-    bool expect_done_;
+    size_t expect_done_;
     bool have_stat_v2_;
+    bool have_sendrecv_v2_;
+    bool compress_;
+    // Local and remote paths of the files passed to FinishSend, oldest first.
+    std::deque<std::pair<std::string, std::string>> deferred_acks_;
 
     TransferLedger global_ledger_;
     TransferLedger current_ledger_;
@@ -587,9 +658,20 @@ class SyncConnection {
         return SendRequest(ID_QUIT, ""); // TODO: add a SendResponse?
     }
 
+    bool ReadDeferredAck() {
+        std::pair<std::string, std::string> paths = std::move(deferred_acks_.front());
+        deferred_acks_.pop_front();
+        return CopyDone(paths.first.c_str(), paths.second.c_str());
+    }
+
     bool WriteOrDie(const char* from, const char* to, const void* data, size_t data_length) {
         if (!WriteFdExactly(fd, data, data_length)) {
             if (errno == ECONNRESET) {
+                // The replies to earlier files come first, and may be the failure.
+                while (!deferred_acks_.empty()) {
+                    if (!ReadDeferredAck()) _exit(1);
+                }
+
                 // Assume adbd told us why it was closing the connection, and
                 // try to read failure reason from adbd.
                 syncmsg msg;
@@ -703,7 +785,7 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
         if (!sc.SendSmallFile(path_and_mode.c_str(), lpath, rpath, mtime, buf, data_length)) {
             return false;
         }
-        return sc.CopyDone(lpath, rpath);
+        return sc.FinishSend(lpath, rpath);
 #endif
     }
 
@@ -712,7 +794,7 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
         sc.Error("failed to stat local file '%s': %s", lpath, strerror(errno));
         return false;
     }
-    if (st.st_size < SYNC_DATA_MAX) {
+    if (static_cast<uint64_t>(st.st_size) < sc.max) {
         std::string data;
         if (!android::base::ReadFileToString(lpath, &data, true)) {
             sc.Error("failed to read all of '%s': %s", lpath, strerror(errno));
@@ -727,13 +809,12 @@ static bool sync_send(SyncConnection& sc, const char* lpath, const char* rpath,
             return false;
         }
     }
-    return sc.CopyDone(lpath, rpath);
+    return sc.FinishSend(lpath, rpath);
 }
 
-static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
-                      const char* name, uint64_t expected_size) {
-    if (!sc.SendRequest(ID_RECV, rpath)) return false;
-
+// Reads the reply to a request sent by SyncConnection::SendRecv into |lpath|.
+static bool sync_finish_recv(SyncConnection& sc, const char* rpath, const char* lpath,
+                             const char* name, uint64_t expected_size) {
     adb_unlink(lpath);
     int lfd = adb_creat(lpath, 0644);
     if (lfd < 0) {
@@ -741,56 +822,105 @@ static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
         return false;
     }
 
-    uint64_t bytes_copied = 0;
-    while (true) {
-        syncmsg msg;
-        if (!ReadFdExactly(sc.fd, &msg.data, sizeof(msg.data))) {
+    std::vector<char> inflated;
+    z_stream zs = {};
+    if (sc.Compressing()) {
+        if (inflateInit(&zs) != Z_OK) {
+            sc.Error("inflateInit failed");
             adb_close(lfd);
             adb_unlink(lpath);
             return false;
         }
+        inflated.resize(sc.max);
+    }
+
+    bool ok = false;
+    int zrc = Z_OK;
+    uint64_t bytes_copied = 0;
+    while (true) {
+        syncmsg msg;
+        if (!ReadFdExactly(sc.fd, &msg.data, sizeof(msg.data))) break;
 
-        if (msg.data.id == ID_DONE) break;
+        if (msg.data.id == ID_DONE) {
+            if (sc.Compressing() && zrc != Z_STREAM_END) {
+                sc.Error("compressed data for '%s' is truncated", rpath);
+                break;
+            }
+            ok = true;
+            break;
+        }
 
         if (msg.data.id != ID_DATA) {
-            adb_close(lfd);
-            adb_unlink(lpath);
             sc.ReportCopyFailure(rpath, lpath, msg);
-            return false;
+            break;
         }
 
         if (msg.data.size > sc.max) {
             sc.Error("msg.data.size too large: %u (max %zu)", msg.data.size, sc.max);
-            adb_close(lfd);
-            adb_unlink(lpath);
-            return false;
+            break;
         }
 
-        char buffer[SYNC_DATA_MAX];
-        if (!ReadFdExactly(sc.fd, buffer, msg.data.size)) {
-            adb_close(lfd);
-            adb_unlink(lpath);
-            return false;
-        }
+        char* buffer = &sc.buffer[0];
+        if (!ReadFdExactly(sc.fd, buffer, msg.data.size)) break;
 
-        if (!WriteFdExactly(lfd, buffer, msg.data.size)) {
-            sc.Error("cannot write '%s': %s", lpath, strerror(errno));
-            adb_close(lfd);
-            adb_unlink(lpath);
-            return false;
-        }
+        if (!sc.Compressing()) {
+            if (!WriteFdExactly(lfd, buffer, msg.data.size)) {
+                sc.Error("cannot write '%s': %s", lpath, strerror(errno));
+                break;
+            }
+            bytes_copied += msg.data.size;
+            sc.RecordBytesTransferred(msg.data.size);
+        } else {
+            zs.next_in = reinterpret_cast<Bytef*>(buffer);
+            zs.avail_in = msg.data.size;
+            bool write_failed = false;
+            do {
+                zs.next_out = reinterpret_cast<Bytef*>(&inflated[0]);
+                zs.avail_out = inflated.size();
+                zrc = inflate(&zs, Z_NO_FLUSH);
+                if (zrc != Z_OK && zrc != Z_STREAM_END && zrc != Z_BUF_ERROR) break;
+
+                size_t have = inflated.size() - zs.avail_out;
+                if (!WriteFdExactly(lfd, &inflated[0], have)) {
+                    write_failed = true;
+                    break;
+                }
+                bytes_copied += have;
+                sc.RecordBytesTransferred(have);
+            } while (zs.avail_out == 0 && zrc != Z_STREAM_END);
 
-        bytes_copied += msg.data.size;
+            if (write_failed) {
+                sc.Error("cannot write '%s': %s", lpath, strerror(errno));
+                break;
+            }
+            if (zrc == Z_BUF_ERROR) {
+                // No progress was possible, the rest of the stream is in the next chunk.
+                zrc = Z_OK;
+            } else if (zrc != Z_OK && zrc != Z_STREAM_END) {
+                sc.Error("failed to inflate '%s': %s", rpath, zs.msg ? zs.msg : "corrupt data");
+                break;
+            }
+        }
 
-        sc.RecordBytesTransferred(msg.data.size);
         sc.ReportProgress(name != nullptr ? name : rpath, bytes_copied, expected_size);
     }
 
-    sc.RecordFilesTransferred(1);
+    if (sc.Compressing()) inflateEnd(&zs);
     adb_close(lfd);
+    if (!ok) {
+        adb_unlink(lpath);
+        return false;
+    }
+
+    sc.RecordFilesTransferred(1);
     return true;
 }
 
+static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath,
+                      const char* name, uint64_t expected_size) {
+    return sc.SendRecv(rpath) && sync_finish_recv(sc, rpath, lpath, name, expected_size);
+}
+
 bool do_sync_ls(const char* path) {
     SyncConnection sc;
     if (!sc.IsValid()) return false;
@@ -922,6 +1052,10 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath,
         }
     }
 
+    if (!sc.ReadDeferredAcks()) {
+        return false;
+    }
+
     sc.RecordFilesSkipped(skipped);
     sc.ReportTransferRate(lpath, TransferDirection::push);
     return true;
@@ -1013,7 +1147,8 @@ bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sy
 
         sc.NewTransfer();
         sc.SetExpectedTotalBytes(st.st_size);
-        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync);
+        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync) &&
+                   sc.ReadDeferredAcks();
         sc.ReportTransferRate(src_path, TransferDirection::push);
     }
 
@@ -1115,6 +1250,7 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath,
     sc.ComputeExpectedTotalBytes(file_list);
 
     int skipped = 0;
+    std::vector<const copyinfo*> files;
     for (const copyinfo &ci : file_list) {
         if (!ci.skip) {
             if (S_ISDIR(ci.mode)) {
@@ -1127,16 +1263,30 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath,
                 }
                 continue;
             }
+            files.push_back(&ci);
+        } else {
+            skipped++;
+        }
+    }
 
-            if (!sync_recv(sc, ci.rpath.c_str(), ci.lpath.c_str(), nullptr, ci.size)) {
+    // With kFeatureSendRecv2, keep requests for the next few files queued so that
+    // the device can start on each one without waiting for a round trip.
+    size_t window = sc.HaveSendRecv2() ? kMaxPendingRecvs : 1;
+    size_t requested = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (; requested < files.size() && requested < i + window; ++requested) {
+            if (!sc.SendRecv(files[requested]->rpath.c_str())) {
                 return false;
             }
+        }
 
-            if (copy_attrs && set_time_and_mode(ci.lpath, ci.time, ci.mode)) {
-                return false;
-            }
-        } else {
-            skipped++;
+        const copyinfo& ci = *files[i];
+        if (!sync_finish_recv(sc, ci.rpath.c_str(), ci.lpath.c_str(), nullptr, ci.size)) {
+            return false;
+        }
+
+        if (copy_attrs && set_time_and_mode(ci.lpath, ci.time, ci.mode)) {
+            return false;
         }
     }
 
@@ -1146,10 +1296,14 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath,
 }
 
 bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst,
-                  bool copy_attrs, const char* name) {
+                  bool copy_attrs, const char* name, bool compress) {
     SyncConnection sc;
     if (!sc.IsValid()) return false;
 
+    if (!sc.SetCompression(compress)) {
+        sc.Warning("device doesn't support compression, pulling uncompressed");
+    }
+
     bool success = true;
     struct stat st;
     bool dst_exists = true;
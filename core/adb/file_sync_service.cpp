@@ -30,6 +30,7 @@
 #include <sys/xattr.h>
 #include <unistd.h>
 #include <utime.h>
+#include <zlib.h>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
@@ -408,7 +409,10 @@ static bool do_send(int s, const std::string& spec, std::vector<char>& buffer) {
     return handle_send_file(s, path.c_str(), uid, gid, capabilities, mode, buffer, do_unlink);
 }
 
-static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
+// Sends the file at |path| as DATA chunks of at most |chunk_size| bytes, compressed into a
+// single zlib stream if |compressed| is set, followed by DONE.
+static bool send_file(int s, const char* path, std::vector<char>& buffer, size_t chunk_size,
+                      bool compressed) {
     __android_log_security_bswrite(SEC_TAG_ADB_RECV_FILE, path);
 
     int fd = adb_open(path, O_RDONLY | O_CLOEXEC);
@@ -421,30 +425,85 @@ static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
         D("[ Failed to fadvise: %d ]", errno);
     }
 
+    // When compressing, the file is read into |input| and deflated into |buffer|.
+    std::vector<char> input;
+    z_stream zs = {};
+    if (compressed) {
+        if (deflateInit(&zs, Z_BEST_SPEED) != Z_OK) {
+            SendSyncFail(s, "deflateInit failed");
+            adb_close(fd);
+            return false;
+        }
+        input.resize(chunk_size);
+    }
+
     syncmsg msg;
     msg.data.id = ID_DATA;
-    while (true) {
-        int r = adb_read(fd, &buffer[0], buffer.size() - sizeof(msg.data));
-        if (r <= 0) {
-            if (r == 0) break;
+    bool ok = true;
+    while (ok) {
+        char* read_buffer = compressed ? &input[0] : &buffer[0];
+        int r = adb_read(fd, read_buffer, chunk_size);
+        if (r < 0) {
             SendSyncFailErrno(s, "read failed");
-            adb_close(fd);
-            return false;
+            ok = false;
+            break;
         }
-        msg.data.size = r;
-        if (!WriteFdExactly(s, &msg.data, sizeof(msg.data)) || !WriteFdExactly(s, &buffer[0], r)) {
-            adb_close(fd);
-            return false;
+
+        if (!compressed) {
+            if (r == 0) break;
+            msg.data.size = r;
+            ok = WriteFdExactly(s, &msg.data, sizeof(msg.data)) &&
+                 WriteFdExactly(s, &buffer[0], r);
+            continue;
         }
+
+        zs.next_in = reinterpret_cast<Bytef*>(read_buffer);
+        zs.avail_in = r;
+        do {
+            zs.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+            zs.avail_out = chunk_size;
+            deflate(&zs, r == 0 ? Z_FINISH : Z_NO_FLUSH);
+            msg.data.size = chunk_size - zs.avail_out;
+            if (msg.data.size != 0) {
+                ok = WriteFdExactly(s, &msg.data, sizeof(msg.data)) &&
+                     WriteFdExactly(s, &buffer[0], msg.data.size);
+            }
+        } while (ok && zs.avail_out == 0);
+        if (r == 0) break;
     }
 
+    if (compressed) deflateEnd(&zs);
     adb_close(fd);
+    if (!ok) return false;
 
     msg.data.id = ID_DONE;
     msg.data.size = 0;
     return WriteFdExactly(s, &msg.data, sizeof(msg.data));
 }
 
+static bool do_recv(int s, const char* path, std::vector<char>& buffer) {
+    // Old clients reject chunks larger than SYNC_DATA_MAX.
+    return send_file(s, path, buffer, SYNC_DATA_MAX - sizeof(syncmsg::data), false);
+}
+
+static bool do_recv_v2(int s, const char* path, std::vector<char>& buffer) {
+    syncmsg msg;
+    if (!ReadFdExactly(s, &msg.recv_v2, sizeof(msg.recv_v2))) {
+        SendSyncFail(s, "recv_v2 read failure");
+        return false;
+    }
+    if (msg.recv_v2.id != ID_RECV_V2) {
+        SendSyncFail(s, "invalid recv_v2 message");
+        return false;
+    }
+    if ((msg.recv_v2.flags & ~kSyncFlagDeflate) != 0) {
+        SendSyncFail(s, StringPrintf("unknown recv_v2 flags %08x", msg.recv_v2.flags));
+        return false;
+    }
+    bool compressed = (msg.recv_v2.flags & kSyncFlagDeflate) != 0;
+    return send_file(s, path, buffer, SYNC_DATA_MAX_V2, compressed);
+}
+
 static const char* sync_id_to_name(uint32_t id) {
   switch (id) {
     case ID_LSTAT_V1:
@@ -459,6 +518,8 @@ static const char* sync_id_to_name(uint32_t id) {
       return "send";
     case ID_RECV:
       return "recv";
+    case ID_RECV_V2:
+      return "recv_v2";
     case ID_QUIT:
         return "quit";
     default:
@@ -509,6 +570,9 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
         case ID_RECV:
             if (!do_recv(fd, name, buffer)) return false;
             break;
+        case ID_RECV_V2:
+            if (!do_recv_v2(fd, name, buffer)) return false;
+            break;
         case ID_QUIT:
             return false;
         default:
@@ -520,7 +584,8 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
 }
 
 void file_sync_service(int fd, void*) {
-    std::vector<char> buffer(SYNC_DATA_MAX);
+    // Clients that have kFeatureSendRecv2 may send DATA chunks up to SYNC_DATA_MAX_V2.
+    std::vector<char> buffer(SYNC_DATA_MAX_V2);
 
     while (handle_sync_command(fd, buffer)) {
     }
@@ -28,6 +28,7 @@
 #define ID_LIST MKID('L','I','S','T')
 #define ID_SEND MKID('S','E','N','D')
 #define ID_RECV MKID('R','E','C','V')
+#define ID_RECV_V2 MKID('R','C','V','2')
 #define ID_DENT MKID('D','E','N','T')
 #define ID_DONE MKID('D','O','N','E')
 #define ID_DATA MKID('D','A','T','A')
@@ -77,16 +78,30 @@ union syncmsg {
         uint32_t id;
         uint32_t msglen;
     } status;
+    struct __attribute__((packed)) {
+        uint32_t id;
+        uint32_t flags;
+    } recv_v2;
+};
+
+// Flags for ID_RECV_V2.
+enum SyncFlag : uint32_t {
+    kSyncFlagNone = 0,
+    // The DATA chunks together carry a zlib stream rather than the raw file.
+    kSyncFlagDeflate = 1,
 };
 
 void file_sync_service(int fd, void* cookie);
 bool do_sync_ls(const char* path);
 bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sync);
 bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst,
-                  bool copy_attrs, const char* name=nullptr);
+                  bool copy_attrs, const char* name=nullptr, bool compress=false);
 
 bool do_sync_sync(const std::string& lpath, const std::string& rpath, bool list_only);
 
 #define SYNC_DATA_MAX (64*1024)
 
+// The largest DATA chunk when both sides support kFeatureSendRecv2.
+#define SYNC_DATA_MAX_V2 (256*1024)
+
 #endif
@@ -930,6 +930,37 @@ class FileOperationsTest(DeviceTest):
             if host_dir is not None:
                 shutil.rmtree(host_dir)
 
+    def test_pull_dir_compressed(self):
+        """Pull a directory of files with on-device compression."""
+        try:
+            host_dir = tempfile.mkdtemp()
+
+            self.device.shell(['rm', '-rf', self.DEVICE_TEMP_DIR])
+            self.device.shell(['mkdir', '-p', self.DEVICE_TEMP_DIR])
+
+            # Random files don't compress, add one that does and spans several chunks.
+            temp_files = make_random_device_files(
+                self.device, in_dir=self.DEVICE_TEMP_DIR, num_files=32)
+            zero_path = posixpath.join(self.DEVICE_TEMP_DIR, 'zeroes')
+            self.device.shell(['dd', 'if=/dev/zero', 'of={}'.format(zero_path),
+                               'bs=1048576', 'count=4'])
+            zero_md5, _ = self.device.shell(
+                [get_md5_prog(self.device), zero_path])[0].split()
+            temp_files.append(DeviceFile(zero_md5, zero_path))
+
+            self.device._simple_call(['pull', '-z', self.DEVICE_TEMP_DIR, host_dir])
+
+            for temp_file in temp_files:
+                host_path = os.path.join(
+                    host_dir, posixpath.basename(self.DEVICE_TEMP_DIR),
+                    temp_file.base_name)
+                self._verify_local(temp_file.checksum, host_path)
+
+            self.device.shell(['rm', '-rf', self.DEVICE_TEMP_DIR])
+        finally:
+            if host_dir is not None:
+                shutil.rmtree(host_dir)
+
     def test_pull_dir_symlink(self):
         """Pull a directory into a symlink to a directory.
 
@@ -54,6 +54,8 @@ extern const char* const kFeatureStat2;
 extern const char* const kFeatureLibusb;
 // The server supports `push --sync`.
 extern const char* const kFeaturePushSync;
+// The sync service accepts larger DATA chunks, ID_RECV_V2 and pipelined requests.
+extern const char* const kFeatureSendRecv2;
 
 TransportId NextTransportId();
 
@@ -73,6 +73,10 @@ class Action {
     void DumpState() const;
 
     bool oneshot() const { return oneshot_; }
+    const std::string& event_trigger() const { return event_trigger_; }
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
     const std::string& filename() const { return filename_; }
     int line() const { return line_; }
     static void set_function_map(const KeywordFunctionMap* function_map) {
@@ -21,7 +21,7 @@
 namespace android {
 namespace init {
 
-ActionManager::ActionManager() : current_command_(0) {}
+ActionManager::ActionManager() : next_action_order_(0), current_command_(0) {}
 
 ActionManager& ActionManager::GetInstance() {
     static ActionManager instance;
@@ -29,9 +29,46 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::IndexAction(Action* action) {
+    auto entry = std::make_pair(next_action_order_++, action);
+
+    if (!action->event_trigger().empty()) {
+        event_trigger_index_[action->event_trigger()].emplace_back(entry);
+    } else if (!action->property_triggers().empty()) {
+        for (const auto& [name, value] : action->property_triggers()) {
+            property_index_[name].emplace_back(entry);
+        }
+    } else {
+        untriggered_actions_.emplace_back(entry);
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    auto remove_from = [action](IndexedActions* actions) {
+        auto is_action = [action](const auto& entry) { return entry.second == action; };
+        actions->erase(std::remove_if(actions->begin(), actions->end(), is_action),
+                       actions->end());
+    };
+
+    if (!action->event_trigger().empty()) {
+        auto it = event_trigger_index_.find(action->event_trigger());
+        remove_from(&it->second);
+        if (it->second.empty()) event_trigger_index_.erase(it);
+    } else if (!action->property_triggers().empty()) {
+        for (const auto& [name, value] : action->property_triggers()) {
+            auto it = property_index_.find(name);
+            remove_from(&it->second);
+            if (it->second.empty()) property_index_.erase(it);
+        }
+    } else {
+        remove_from(&untriggered_actions_);
+    }
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     event_queue_.emplace(trigger);
 }
@@ -52,18 +89,67 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
     action->AddCommand(func, name_vector, 0);
 
     event_queue_.emplace(action.get());
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
-void ActionManager::ExecuteOneCommand() {
-    // Loop through the event queue until we have an action to execute
-    while (current_executing_actions_.empty() && !event_queue_.empty()) {
+void ActionManager::QueueMatchingActions(const EventTrigger& event_trigger) {
+    auto it = event_trigger_index_.find(event_trigger);
+    if (it == event_trigger_index_.end()) return;
+
+    for (const auto& [order, action] : it->second) {
+        if (action->CheckEvent(event_trigger)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const PropertyChange& property_change) {
+    const auto& name = property_change.first;
+
+    // QueueAllPropertyActions() matches every action without an event trigger.
+    if (name.empty()) {
         for (const auto& action : actions_) {
-            if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                           event_queue_.front())) {
+            if (action->CheckEvent(property_change)) {
                 current_executing_actions_.emplace(action.get());
             }
         }
+        return;
+    }
+
+    static const IndexedActions kNoActions;
+    auto it = property_index_.find(name);
+    const auto& property_actions = it == property_index_.end() ? kNoActions : it->second;
+
+    // Both lists are in the order the actions were added, merge them to keep that order.
+    auto property_action = property_actions.begin();
+    auto untriggered_action = untriggered_actions_.begin();
+    while (property_action != property_actions.end() ||
+           untriggered_action != untriggered_actions_.end()) {
+        Action* action;
+        if (untriggered_action == untriggered_actions_.end() ||
+            (property_action != property_actions.end() &&
+             property_action->first < untriggered_action->first)) {
+            action = (property_action++)->second;
+        } else {
+            action = (untriggered_action++)->second;
+        }
+        if (action->CheckEvent(property_change)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const BuiltinAction& builtin_action) {
+    // Only the action itself matches, and it stays in actions_ until it has run.
+    current_executing_actions_.emplace(builtin_action);
+}
+
+void ActionManager::ExecuteOneCommand() {
+    // Loop through the event queue until we have an action to execute
+    while (current_executing_actions_.empty() && !event_queue_.empty()) {
+        std::visit([this](const auto& event) { QueueMatchingActions(event); },
+                   event_queue_.front());
         event_queue_.pop();
     }
 
@@ -89,6 +175,7 @@ void ActionManager::ExecuteOneCommand() {
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser));
         }
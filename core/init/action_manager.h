@@ -18,6 +18,7 @@
 #define _INIT_ACTION_MANAGER_H
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "action.h"
@@ -47,7 +48,24 @@ class ActionManager {
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    // Actions that may match an event, tagged with the order they were added in, which is
+    // the order matching actions execute in.
+    using IndexedActions = std::vector<std::pair<std::size_t, Action*>>;
+
+    void IndexAction(Action* action);
+    void UnindexAction(const Action* action);
+    void QueueMatchingActions(const EventTrigger& event_trigger);
+    void QueueMatchingActions(const PropertyChange& property_change);
+    void QueueMatchingActions(const BuiltinAction& builtin_action);
+
     std::vector<std::unique_ptr<Action>> actions_;
+    std::size_t next_action_order_;
+    // Actions by their event trigger
+    std::unordered_map<std::string, IndexedActions> event_trigger_index_;
+    // Actions with only property triggers, under each of their property names
+    std::unordered_map<std::string, IndexedActions> property_index_;
+    // Actions without any trigger, which match every property change
+    IndexedActions untriggered_actions_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
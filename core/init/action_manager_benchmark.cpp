@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "action_manager.h"
+
+#include <benchmark/benchmark.h>
+
+#include "test_function_map.h"
+
+namespace android {
+namespace init {
+
+// Roughly what a device's .rc files add up to: a few hundred event triggers, and property
+// triggers on a couple of thousand distinct properties.
+static constexpr int kNumEventTriggers = 300;
+static constexpr int kNumProperties = 2000;
+
+static void AddSyntheticActions(ActionManager* am, int num_actions) {
+    for (int i = 0; i < num_actions; ++i) {
+        std::string event_trigger;
+        std::map<std::string, std::string> property_triggers;
+        if (i % 4 == 0) {
+            event_trigger = "event" + std::to_string(i % kNumEventTriggers);
+        } else {
+            property_triggers.emplace("bench.prop" + std::to_string(i % kNumProperties),
+                                      i % 3 ? "1" : "*");
+        }
+        auto action = std::make_unique<Action>(false, nullptr, "bench.rc", i, event_trigger,
+                                               property_triggers);
+        action->AddCommand({"nop"}, i);
+        am->AddAction(std::move(action));
+    }
+}
+
+static void BenchmarkPropertyChanges(benchmark::State& state) {
+    TestFunctionMap test_function_map;
+    test_function_map.Add("nop", []() {});
+    Action::set_function_map(&test_function_map);
+
+    ActionManager am;
+    AddSyntheticActions(&am, state.range(0));
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        for (int j = 0; j < 100; ++j, ++i) {
+            am.QueuePropertyChange("bench.prop" + std::to_string(i % kNumProperties), "1");
+        }
+        while (am.HasMoreCommands()) {
+            am.ExecuteOneCommand();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 100);
+}
+
+BENCHMARK(BenchmarkPropertyChanges)->Arg(500)->Arg(5000)->Arg(20000);
+
+static void BenchmarkEventTriggers(benchmark::State& state) {
+    TestFunctionMap test_function_map;
+    test_function_map.Add("nop", []() {});
+    Action::set_function_map(&test_function_map);
+
+    ActionManager am;
+    AddSyntheticActions(&am, state.range(0));
+
+    int i = 0;
+    while (state.KeepRunning()) {
+        for (int j = 0; j < 100; ++j, ++i) {
+            am.QueueEventTrigger("event" + std::to_string(i % kNumEventTriggers));
+        }
+        while (am.HasMoreCommands()) {
+            am.ExecuteOneCommand();
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * 100);
+}
+
+BENCHMARK(BenchmarkEventTriggers)->Arg(500)->Arg(5000)->Arg(20000);
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "coldboot_manifest.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+#include "system/core/init/coldboot_manifest.pb.h"
+#include "util.h"
+
+using android::base::WriteStringToFd;
+using android::base::unique_fd;
+
+namespace android {
+namespace init {
+
+Result<std::vector<DeviceNode>> ReadColdbootManifest(const std::string& path,
+                                                     const std::string& fingerprint) {
+    // ReadFile() refuses group or world writable files, a manifest decides the permissions of
+    // device nodes so it must not be writable by anyone but ueventd.
+    auto file_contents = ReadFile(path);
+    if (!file_contents) {
+        return Error() << "Unable to read coldboot manifest: " << file_contents.error();
+    }
+
+    ColdbootManifest manifest;
+    if (!manifest.ParseFromString(*file_contents)) {
+        return Error() << "Unable to parse coldboot manifest";
+    }
+    if (manifest.fingerprint() != fingerprint) {
+        return Error() << "Coldboot manifest is for '" << manifest.fingerprint() << "'";
+    }
+
+    std::vector<DeviceNode> device_nodes;
+    device_nodes.reserve(manifest.device_nodes_size());
+    for (const auto& record : manifest.device_nodes()) {
+        if (!S_ISBLK(record.mode()) && !S_ISCHR(record.mode())) {
+            return Error() << "Invalid mode " << record.mode() << " for '" << record.path() << "'";
+        }
+        DeviceNode node;
+        node.sysfs_path = record.sysfs_path();
+        node.subsystem = record.subsystem();
+        node.device_name = record.device_name();
+        node.partition_name = record.partition_name();
+        node.major = record.major();
+        node.minor = record.minor();
+        node.path = record.path();
+        node.mode = record.mode();
+        node.uid = record.uid();
+        node.gid = record.gid();
+        node.secontext = record.secontext();
+        node.links.assign(record.links().begin(), record.links().end());
+        device_nodes.emplace_back(std::move(node));
+    }
+    return device_nodes;
+}
+
+Result<Success> WriteColdbootManifest(const std::string& path, const std::string& fingerprint,
+                                      const std::vector<DeviceNode>& device_nodes) {
+    ColdbootManifest manifest;
+    manifest.set_fingerprint(fingerprint);
+    for (const auto& node : device_nodes) {
+        auto record = manifest.add_device_nodes();
+        record->set_sysfs_path(node.sysfs_path);
+        record->set_subsystem(node.subsystem);
+        record->set_device_name(node.device_name);
+        record->set_partition_name(node.partition_name);
+        record->set_major(node.major);
+        record->set_minor(node.minor);
+        record->set_path(node.path);
+        record->set_mode(node.mode);
+        record->set_uid(node.uid);
+        record->set_gid(node.gid);
+        record->set_secontext(node.secontext);
+        for (const auto& link : node.links) {
+            record->add_links(link);
+        }
+    }
+
+    std::string serialized_string;
+    if (!manifest.SerializeToString(&serialized_string)) {
+        return Error() << "Unable to serialize coldboot manifest";
+    }
+
+    const std::string temp_path = path + ".tmp";
+    unique_fd fd(TEMP_FAILURE_RETRY(
+        open(temp_path.c_str(), O_WRONLY | O_CREAT | O_NOFOLLOW | O_TRUNC | O_CLOEXEC, 0600)));
+    if (fd == -1) {
+        return ErrnoError() << "Could not open temporary coldboot manifest";
+    }
+    if (!WriteStringToFd(serialized_string, fd)) {
+        return ErrnoError() << "Unable to write coldboot manifest";
+    }
+    fsync(fd);
+    fd.reset();
+
+    if (rename(temp_path.c_str(), path.c_str())) {
+        int saved_errno = errno;
+        unlink(temp_path.c_str());
+        return Error(saved_errno) << "Unable to rename coldboot manifest";
+    }
+    return Success();
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _INIT_COLDBOOT_MANIFEST_H
+#define _INIT_COLDBOOT_MANIFEST_H
+
+#include <string>
+#include <vector>
+
+#include "devices.h"
+#include "result.h"
+
+// ueventd can keep a manifest of the device nodes it creates during coldboot, with their
+// permissions, SELinux labels and links. On the next boot the nodes are created straight from the
+// manifest while /sys is walked to regenerate uevents, after which only the uevents that the
+// manifest did not account for need to be handled in full.
+//
+// A manifest is only used if it was written for the same fingerprint, which identifies the build,
+// kernel and boot devices, since any of these can change the nodes that are created.
+
+namespace android {
+namespace init {
+
+Result<std::vector<DeviceNode>> ReadColdbootManifest(const std::string& path,
+                                                     const std::string& fingerprint);
+Result<Success> WriteColdbootManifest(const std::string& path, const std::string& fingerprint,
+                                      const std::vector<DeviceNode>& device_nodes);
+
+}  // namespace init
+}  // namespace android
+
+#endif
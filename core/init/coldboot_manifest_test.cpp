@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "coldboot_manifest.h"
+
+#include <sys/stat.h>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+
+using namespace std::string_literals;
+
+namespace android {
+namespace init {
+
+static DeviceNode MakeTestNode(const std::string& name, int minor) {
+    DeviceNode node;
+    node.sysfs_path = "/devices/platform/soc/" + name;
+    node.subsystem = "block";
+    node.device_name = name;
+    node.partition_name = "part" + std::to_string(minor);
+    node.major = 259;
+    node.minor = minor;
+    node.path = "/dev/block/" + name;
+    node.mode = S_IFBLK | 0660;
+    node.uid = 0;
+    node.gid = 1006;
+    node.secontext = "u:object_r:block_device:s0";
+    node.links = {"/dev/block/platform/soc/by-name/" + node.partition_name,
+                  "/dev/block/platform/soc/" + name};
+    return node;
+}
+
+static void ExpectNodesEqual(const DeviceNode& expected, const DeviceNode& actual) {
+    EXPECT_EQ(expected.sysfs_path, actual.sysfs_path);
+    EXPECT_EQ(expected.subsystem, actual.subsystem);
+    EXPECT_EQ(expected.device_name, actual.device_name);
+    EXPECT_EQ(expected.partition_name, actual.partition_name);
+    EXPECT_EQ(expected.major, actual.major);
+    EXPECT_EQ(expected.minor, actual.minor);
+    EXPECT_EQ(expected.path, actual.path);
+    EXPECT_EQ(expected.mode, actual.mode);
+    EXPECT_EQ(expected.uid, actual.uid);
+    EXPECT_EQ(expected.gid, actual.gid);
+    EXPECT_EQ(expected.secontext, actual.secontext);
+    EXPECT_EQ(expected.links, actual.links);
+}
+
+TEST(coldboot_manifest, EndToEnd) {
+    TemporaryDir dir;
+    std::string path = dir.path + "/manifest"s;
+
+    std::vector<DeviceNode> device_nodes = {MakeTestNode("mmcblk0p1", 1),
+                                            MakeTestNode("mmcblk0p2", 2)};
+    device_nodes.back().links.clear();
+    ASSERT_TRUE(WriteColdbootManifest(path, "fingerprint", device_nodes));
+
+    auto result = ReadColdbootManifest(path, "fingerprint");
+    ASSERT_TRUE(result) << result.error();
+    ASSERT_EQ(device_nodes.size(), result->size());
+    for (size_t i = 0; i < device_nodes.size(); ++i) {
+        ExpectNodesEqual(device_nodes[i], (*result)[i]);
+    }
+}
+
+TEST(coldboot_manifest, FingerprintMismatch) {
+    TemporaryDir dir;
+    std::string path = dir.path + "/manifest"s;
+
+    ASSERT_TRUE(WriteColdbootManifest(path, "old fingerprint", {MakeTestNode("mmcblk0p1", 1)}));
+    EXPECT_FALSE(ReadColdbootManifest(path, "new fingerprint"));
+}
+
+TEST(coldboot_manifest, RejectsWritableFile) {
+    TemporaryDir dir;
+    std::string path = dir.path + "/manifest"s;
+
+    ASSERT_TRUE(WriteColdbootManifest(path, "fingerprint", {MakeTestNode("mmcblk0p1", 1)}));
+    ASSERT_EQ(0, chmod(path.c_str(), 0666));
+    EXPECT_FALSE(ReadColdbootManifest(path, "fingerprint"));
+}
+
+TEST(coldboot_manifest, Matches) {
+    auto node = MakeTestNode("mmcblk0p1", 1);
+
+    Uevent uevent;
+    uevent.action = "add";
+    uevent.path = node.sysfs_path;
+    uevent.subsystem = node.subsystem;
+    uevent.device_name = node.device_name;
+    uevent.partition_name = node.partition_name;
+    uevent.major = node.major;
+    uevent.minor = node.minor;
+    EXPECT_TRUE(node.Matches(uevent));
+
+    uevent.minor = 2;
+    EXPECT_FALSE(node.Matches(uevent));
+    uevent.minor = node.minor;
+
+    uevent.partition_name = "renamed";
+    EXPECT_FALSE(node.Matches(uevent));
+}
+
+}  // namespace init
+}  // namespace android
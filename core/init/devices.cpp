@@ -220,21 +220,12 @@ std::tuple<mode_t, uid_t, gid_t> DeviceHandler::GetDevicePermissions(
     return {0600, 0, 0};
 }
 
-void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, int minor,
-                               const std::vector<std::string>& links) const {
-    auto[mode, uid, gid] = GetDevicePermissions(path, links);
-    mode |= (block ? S_IFBLK : S_IFCHR);
-
-    std::string secontext;
-    if (!SelabelLookupFileContextBestMatch(path, links, mode, &secontext)) {
-        PLOG(ERROR) << "Device '" << path << "' not created; cannot find SELinux label";
-        return;
-    }
+static void CreateDeviceNode(const std::string& path, mode_t mode, dev_t dev, uid_t uid,
+                             gid_t gid, const std::string& secontext) {
     if (!secontext.empty()) {
         setfscreatecon(secontext.c_str());
     }
 
-    dev_t dev = makedev(major, minor);
     /* Temporarily change egid to avoid race condition setting the gid of the
      * device node. Unforunately changing the euid would prevent creation of
      * some device nodes, so the uid has to be set with chown() and is still
@@ -274,6 +265,20 @@ out:
     }
 }
 
+void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, int minor,
+                               const std::vector<std::string>& links) const {
+    auto[mode, uid, gid] = GetDevicePermissions(path, links);
+    mode |= (block ? S_IFBLK : S_IFCHR);
+
+    std::string secontext;
+    if (!SelabelLookupFileContextBestMatch(path, links, mode, &secontext)) {
+        PLOG(ERROR) << "Device '" << path << "' not created; cannot find SELinux label";
+        return;
+    }
+
+    CreateDeviceNode(path, mode, makedev(major, minor), uid, gid, secontext);
+}
+
 // replaces any unacceptable characters with '_', the
 // length of the resulting string is equal to the input string
 void SanitizePartitionName(std::string* string) {
@@ -341,25 +346,30 @@ std::vector<std::string> DeviceHandler::GetBlockDeviceSymlinks(const Uevent& uev
     return links;
 }
 
+void DeviceHandler::MakeLinks(const std::string& devpath,
+                              const std::vector<std::string>& links) const {
+    for (const auto& link : links) {
+        if (!mkdir_recursive(Dirname(link), 0755)) {
+            PLOG(ERROR) << "Failed to create directory " << Dirname(link);
+        }
+
+        if (symlink(devpath.c_str(), link.c_str())) {
+            if (errno != EEXIST) {
+                PLOG(ERROR) << "Failed to symlink " << devpath << " to " << link;
+            } else if (std::string link_path;
+                       Readlink(link, &link_path) && link_path != devpath) {
+                PLOG(ERROR) << "Failed to symlink " << devpath << " to " << link
+                            << ", which already links to: " << link_path;
+            }
+        }
+    }
+}
+
 void DeviceHandler::HandleDevice(const std::string& action, const std::string& devpath, bool block,
                                  int major, int minor, const std::vector<std::string>& links) const {
     if (action == "add") {
         MakeDevice(devpath, block, major, minor, links);
-        for (const auto& link : links) {
-            if (!mkdir_recursive(Dirname(link), 0755)) {
-                PLOG(ERROR) << "Failed to create directory " << Dirname(link);
-            }
-
-            if (symlink(devpath.c_str(), link.c_str())) {
-                if (errno != EEXIST) {
-                    PLOG(ERROR) << "Failed to symlink " << devpath << " to " << link;
-                } else if (std::string link_path;
-                           Readlink(link, &link_path) && link_path != devpath) {
-                    PLOG(ERROR) << "Failed to symlink " << devpath << " to " << link
-                                << ", which already links to: " << link_path;
-                }
-            }
-        }
+        MakeLinks(devpath, links);
     }
 
     if (action == "remove") {
@@ -373,52 +383,96 @@ void DeviceHandler::HandleDevice(const std::string& action, const std::string& d
     }
 }
 
-void DeviceHandler::HandleDeviceEvent(const Uevent& uevent) {
-    if (uevent.action == "add" || uevent.action == "change" || uevent.action == "online") {
-        FixupSysPermissions(uevent.path, uevent.subsystem);
-    }
-
+bool DeviceHandler::GetDevicePath(const Uevent& uevent, std::string* devpath, bool* block,
+                                  std::vector<std::string>* links) const {
     // if it's not a /dev device, nothing to do
-    if (uevent.major < 0 || uevent.minor < 0) return;
+    if (uevent.major < 0 || uevent.minor < 0) return false;
 
-    std::string devpath;
-    std::vector<std::string> links;
-    bool block = false;
+    *block = false;
 
     if (uevent.subsystem == "block") {
-        block = true;
-        devpath = "/dev/block/" + Basename(uevent.path);
+        *block = true;
+        *devpath = "/dev/block/" + Basename(uevent.path);
 
         if (StartsWith(uevent.path, "/devices")) {
-            links = GetBlockDeviceSymlinks(uevent);
+            *links = GetBlockDeviceSymlinks(uevent);
         }
     } else if (const auto subsystem =
                    std::find(subsystems_.cbegin(), subsystems_.cend(), uevent.subsystem);
                subsystem != subsystems_.cend()) {
-        devpath = subsystem->ParseDevPath(uevent);
+        *devpath = subsystem->ParseDevPath(uevent);
     } else if (uevent.subsystem == "usb") {
         if (!uevent.device_name.empty()) {
-            devpath = "/dev/" + uevent.device_name;
+            *devpath = "/dev/" + uevent.device_name;
         } else {
             // This imitates the file system that would be created
             // if we were using devfs instead.
             // Minors are broken up into groups of 128, starting at "001"
             int bus_id = uevent.minor / 128 + 1;
             int device_id = uevent.minor % 128 + 1;
-            devpath = StringPrintf("/dev/bus/usb/%03d/%03d", bus_id, device_id);
+            *devpath = StringPrintf("/dev/bus/usb/%03d/%03d", bus_id, device_id);
         }
     } else if (StartsWith(uevent.subsystem, "usb")) {
         // ignore other USB events
-        return;
+        return false;
     } else {
-        devpath = "/dev/" + Basename(uevent.path);
+        *devpath = "/dev/" + Basename(uevent.path);
+    }
+
+    return true;
+}
+
+void DeviceHandler::HandleDeviceEvent(const Uevent& uevent) {
+    if (uevent.action == "add" || uevent.action == "change" || uevent.action == "online") {
+        FixupSysPermissions(uevent.path, uevent.subsystem);
     }
 
+    std::string devpath;
+    std::vector<std::string> links;
+    bool block;
+    if (!GetDevicePath(uevent, &devpath, &block, &links)) return;
+
     mkdir_recursive(Dirname(devpath), 0755);
 
     HandleDevice(uevent.action, devpath, block, uevent.major, uevent.minor, links);
 }
 
+void DeviceHandler::HandleSysfsEvent(const Uevent& uevent) const {
+    FixupSysPermissions(uevent.path, uevent.subsystem);
+}
+
+bool DeviceHandler::GetDeviceNode(const Uevent& uevent, DeviceNode* node) const {
+    bool block;
+    node->links.clear();
+    if (!GetDevicePath(uevent, &node->path, &block, &node->links)) return false;
+
+    std::tie(node->mode, node->uid, node->gid) = GetDevicePermissions(node->path, node->links);
+    node->mode |= (block ? S_IFBLK : S_IFCHR);
+    if (!SelabelLookupFileContextBestMatch(node->path, node->links, node->mode,
+                                           &node->secontext)) {
+        return false;
+    }
+
+    node->sysfs_path = uevent.path;
+    node->subsystem = uevent.subsystem;
+    node->device_name = uevent.device_name;
+    node->partition_name = uevent.partition_name;
+    node->major = uevent.major;
+    node->minor = uevent.minor;
+    return true;
+}
+
+void DeviceHandler::MakeDeviceNode(const DeviceNode& node) const {
+    mkdir_recursive(Dirname(node.path), 0755);
+    CreateDeviceNode(node.path, node.mode, makedev(node.major, node.minor), node.uid, node.gid,
+                     node.secontext);
+    MakeLinks(node.path, node.links);
+}
+
+void DeviceHandler::RemoveDeviceNode(const DeviceNode& node) const {
+    HandleDevice("remove", node.path, S_ISBLK(node.mode), node.major, node.minor, node.links);
+}
+
 DeviceHandler::DeviceHandler(std::vector<Permissions> dev_permissions,
                              std::vector<SysfsPermissions> sysfs_permissions,
                              std::vector<Subsystem> subsystems, std::set<std::string> boot_devices,
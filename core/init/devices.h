@@ -98,6 +98,31 @@ class Subsystem {
     DevnameSource devname_source_;
 };
 
+// A device node as created for an "add" uevent, with its permissions and SELinux label already
+// looked up, so that it can be created again on a later boot without consulting ueventd.rc.
+struct DeviceNode {
+    // The uevent that the node is created for
+    std::string sysfs_path;
+    std::string subsystem;
+    std::string device_name;
+    std::string partition_name;
+    int major;
+    int minor;
+
+    std::string path;
+    mode_t mode;  // including S_IFBLK or S_IFCHR
+    uid_t uid;
+    gid_t gid;
+    std::string secontext;
+    std::vector<std::string> links;
+
+    bool Matches(const Uevent& uevent) const {
+        return uevent.path == sysfs_path && uevent.subsystem == subsystem &&
+               uevent.device_name == device_name && uevent.partition_name == partition_name &&
+               uevent.major == major && uevent.minor == minor;
+    }
+};
+
 class DeviceHandler {
   public:
     friend class DeviceHandlerTester;
@@ -109,15 +134,26 @@ class DeviceHandler {
 
     void HandleDeviceEvent(const Uevent& uevent);
 
+    // Handles only the sysfs side of an "add" uevent, for a device whose node already exists.
+    void HandleSysfsEvent(const Uevent& uevent) const;
+
+    // Looks up the node that an "add" uevent creates, returns false if it creates none.
+    bool GetDeviceNode(const Uevent& uevent, DeviceNode* node) const;
+    void MakeDeviceNode(const DeviceNode& node) const;
+    void RemoveDeviceNode(const DeviceNode& node) const;
+
     std::vector<std::string> GetBlockDeviceSymlinks(const Uevent& uevent) const;
     void set_skip_restorecon(bool value) { skip_restorecon_ = value; }
 
   private:
     bool FindPlatformDevice(std::string path, std::string* platform_device_path) const;
+    bool GetDevicePath(const Uevent& uevent, std::string* devpath, bool* block,
+                       std::vector<std::string>* links) const;
     std::tuple<mode_t, uid_t, gid_t> GetDevicePermissions(
         const std::string& path, const std::vector<std::string>& links) const;
     void MakeDevice(const std::string& path, bool block, int major, int minor,
                     const std::vector<std::string>& links) const;
+    void MakeLinks(const std::string& devpath, const std::vector<std::string>& links) const;
     void HandleDevice(const std::string& action, const std::string& devpath, bool block, int major,
                       int minor, const std::vector<std::string>& links) const;
     void FixupSysPermissions(const std::string& upath, const std::string& subsystem) const;
@@ -109,6 +109,7 @@ Parser CreateParser(ActionManager& action_manager, ServiceList& service_list) {
 
 static void LoadBootScripts(ActionManager& action_manager, ServiceList& service_list) {
     Parser parser = CreateParser(action_manager, service_list);
+    Timer t;
 
     std::string bootscript = GetProperty("ro.boot.init_rc", "");
     if (bootscript.empty()) {
@@ -128,6 +129,9 @@ static void LoadBootScripts(ActionManager& action_manager, ServiceList& service_
     } else {
         parser.ParseConfig(bootscript);
     }
+
+    LOG(INFO) << "Parsing boot scripts took " << t;
+    property_set("ro.boottime.init.parse_config", std::to_string(t.duration().count()));
 }
 
 void register_epoll_handler(int fd, void (*fn)()) {
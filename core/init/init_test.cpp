@@ -17,6 +17,7 @@
 #include <functional>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
@@ -113,6 +114,42 @@ execute_third
     TestInitText(init_script, test_function_map, commands, &service_list);
 }
 
+TEST(init, PropertyTriggerOrder) {
+    std::string init_script =
+        R"init(
+on property:init.test.a=1
+execute_first
+
+on property:init.test.b=1
+execute_never
+
+on boot
+execute_never
+
+on property:init.test.a=*
+execute_second
+
+on property:init.test.a=2
+execute_never
+
+)init";
+
+    int num_executed = 0;
+    TestFunctionMap test_function_map;
+    test_function_map.Add("execute_first", [&num_executed]() { EXPECT_EQ(0, num_executed++); });
+    test_function_map.Add("execute_second", [&num_executed]() { EXPECT_EQ(1, num_executed++); });
+    test_function_map.Add("execute_never", []() { FAIL(); });
+
+    ActionManagerCommand change_property = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.a", "1");
+    };
+    std::vector<ActionManagerCommand> commands{change_property};
+
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &service_list);
+    EXPECT_EQ(2, num_executed);
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
@@ -197,5 +234,40 @@ TEST(init, EventTriggerOrderMultipleFiles) {
     EXPECT_EQ(6, num_executed);
 }
 
+TEST(init, EventTriggerOrderManyFilesInDir) {
+    // Files in a directory are read concurrently, but their actions must still be added in the
+    // sorted order of the file names.
+    constexpr int kNumFiles = 32;
+
+    TemporaryDir dir;
+    for (int i = kNumFiles; i > 0; --i) {
+        std::string script;
+        for (int j = 0; j < 10; ++j) {
+            script += "on boot\nexecute " + std::to_string(i) + "\n\n";
+        }
+        auto path = android::base::StringPrintf("%s/%02d.rc", dir.path, i);
+        ASSERT_TRUE(WriteFile(path, script));
+    }
+
+    int num_executed = 0;
+    auto execute_command = [&num_executed](const BuiltinArguments& args) {
+        EXPECT_EQ(2U, args.size());
+        EXPECT_EQ(num_executed++ / 10 + 1, std::stoi(args[1]));
+        return Success();
+    };
+
+    TestFunctionMap test_function_map;
+    test_function_map.Add("execute", 1, 1, false, execute_command);
+
+    ActionManagerCommand trigger_boot = [](ActionManager& am) { am.QueueEventTrigger("boot"); };
+    std::vector<ActionManagerCommand> commands{trigger_boot};
+
+    ServiceList service_list;
+
+    TestInit(dir.path, test_function_map, commands, &service_list);
+
+    EXPECT_EQ(kNumFiles * 10, num_executed);
+}
+
 }  // namespace init
 }  // namespace android
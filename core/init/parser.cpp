@@ -18,6 +18,9 @@
 
 #include <dirent.h>
 
+#include <atomic>
+#include <thread>
+
 #include <android-base/chrono_utils.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
@@ -39,7 +42,7 @@ void Parser::AddSingleLineParser(const std::string& prefix, LineCallback callbac
     line_callbacks_.emplace_back(prefix, callback);
 }
 
-void Parser::ParseData(const std::string& filename, const std::string& data, size_t* parse_errors) {
+Parser::TokenizedLines Parser::TokenizeData(const std::string& data) {
     // TODO: Use a parser with const input and remove this copy
     std::vector<char> data_copy(data.begin(), data.end());
     data_copy.push_back('\0');
@@ -49,9 +52,34 @@ void Parser::ParseData(const std::string& filename, const std::string& data, siz
     state.ptr = &data_copy[0];
     state.nexttoken = 0;
 
+    TokenizedLines lines;
+    std::vector<std::string> args;
+
+    for (;;) {
+        switch (next_token(&state)) {
+            case T_EOF:
+                return lines;
+            case T_NEWLINE:
+                state.line++;
+                if (args.empty()) break;
+                lines.emplace_back(state.line, std::move(args));
+                args.clear();
+                break;
+            case T_TEXT:
+                args.emplace_back(state.text);
+                break;
+        }
+    }
+}
+
+void Parser::ParseData(const std::string& filename, const std::string& data, size_t* parse_errors) {
+    auto lines = TokenizeData(data);
+    ParseLines(filename, &lines, parse_errors);
+}
+
+void Parser::ParseLines(const std::string& filename, TokenizedLines* lines, size_t* parse_errors) {
     SectionParser* section_parser = nullptr;
     int section_start_line = -1;
-    std::vector<std::string> args;
 
     auto end_section = [&] {
         if (section_parser == nullptr) return;
@@ -65,74 +93,104 @@ void Parser::ParseData(const std::string& filename, const std::string& data, siz
         section_start_line = -1;
     };
 
-    for (;;) {
-        switch (next_token(&state)) {
-            case T_EOF:
+    for (auto& [line, args] : *lines) {
+        // If we have a line matching a prefix we recognize, call its callback and unset any
+        // current section parsers.  This is meant for /sys/ and /dev/ line entries for
+        // uevent.
+        for (const auto& [prefix, callback] : line_callbacks_) {
+            if (android::base::StartsWith(args[0], prefix)) {
                 end_section();
-                return;
-            case T_NEWLINE:
-                state.line++;
-                if (args.empty()) break;
-                // If we have a line matching a prefix we recognize, call its callback and unset any
-                // current section parsers.  This is meant for /sys/ and /dev/ line entries for
-                // uevent.
-                for (const auto& [prefix, callback] : line_callbacks_) {
-                    if (android::base::StartsWith(args[0], prefix)) {
-                        end_section();
-
-                        if (auto result = callback(std::move(args)); !result) {
-                            (*parse_errors)++;
-                            LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        }
-                        break;
-                    }
-                }
-                if (section_parsers_.count(args[0])) {
-                    end_section();
-                    section_parser = section_parsers_[args[0]].get();
-                    section_start_line = state.line;
-                    if (auto result =
-                            section_parser->ParseSection(std::move(args), filename, state.line);
-                        !result) {
-                        (*parse_errors)++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        section_parser = nullptr;
-                    }
-                } else if (section_parser) {
-                    if (auto result = section_parser->ParseLineSection(std::move(args), state.line);
-                        !result) {
-                        (*parse_errors)++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
+
+                if (auto result = callback(std::move(args)); !result) {
+                    (*parse_errors)++;
+                    LOG(ERROR) << filename << ": " << line << ": " << result.error();
                 }
-                args.clear();
-                break;
-            case T_TEXT:
-                args.emplace_back(state.text);
                 break;
+            }
+        }
+        if (section_parsers_.count(args[0])) {
+            end_section();
+            section_parser = section_parsers_[args[0]].get();
+            section_start_line = line;
+            if (auto result = section_parser->ParseSection(std::move(args), filename, line);
+                !result) {
+                (*parse_errors)++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+                section_parser = nullptr;
+            }
+        } else if (section_parser) {
+            if (auto result = section_parser->ParseLineSection(std::move(args), line); !result) {
+                (*parse_errors)++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+            }
         }
     }
+    end_section();
 }
 
-bool Parser::ParseConfigFile(const std::string& path, size_t* parse_errors) {
-    LOG(INFO) << "Parsing file " << path << "...";
+Parser::TokenizedFile Parser::TokenizeFile(const std::string& path) {
     android::base::Timer t;
+    TokenizedFile file;
+    file.path = path;
+
     auto config_contents = ReadFile(path);
     if (!config_contents) {
-        LOG(ERROR) << "Unable to read config file '" << path << "': " << config_contents.error();
+        file.read_result = config_contents.error();
+    } else {
+        config_contents->push_back('\n');  // TODO: fix parse_config.
+        file.read_result = Success();
+        file.lines = TokenizeData(*config_contents);
+    }
+    file.duration = t.duration();
+    return file;
+}
+
+std::vector<Parser::TokenizedFile> Parser::TokenizeFiles(const std::vector<std::string>& paths) {
+    std::vector<TokenizedFile> files(paths.size());
+    std::atomic<size_t> next_file(0);
+    auto tokenize_files = [&paths, &files, &next_file] {
+        for (size_t i; (i = next_file++) < paths.size();) {
+            files[i] = TokenizeFile(paths[i]);
+        }
+    };
+
+    // The calling thread takes part too, so a single file needs no other thread.
+    size_t num_threads = std::min<size_t>(paths.size(), std::thread::hardware_concurrency() ?: 4);
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(tokenize_files);
+    }
+    tokenize_files();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return files;
+}
+
+bool Parser::ParseTokenizedFile(TokenizedFile* file, size_t* parse_errors) {
+    LOG(INFO) << "Parsing file " << file->path << "...";
+    if (!file->read_result) {
+        LOG(ERROR) << "Unable to read config file '" << file->path
+                   << "': " << file->read_result.error();
         return false;
     }
 
-    config_contents->push_back('\n');  // TODO: fix parse_config.
-    ParseData(path, *config_contents, parse_errors);
+    android::base::Timer t;
+    ParseLines(file->path, &file->lines, parse_errors);
     for (const auto& [section_name, section_parser] : section_parsers_) {
         section_parser->EndFile();
     }
 
-    LOG(VERBOSE) << "(Parsing " << path << " took " << t << ".)";
+    LOG(INFO) << "(Parsing " << file->path << " took " << file->duration.count()
+              << "ms to read and tokenize, " << t << " to parse.)";
     return true;
 }
 
+bool Parser::ParseConfigFile(const std::string& path, size_t* parse_errors) {
+    auto file = TokenizeFile(path);
+    return ParseTokenizedFile(&file, parse_errors);
+}
+
 bool Parser::ParseConfigDir(const std::string& path, size_t* parse_errors) {
     LOG(INFO) << "Parsing directory " << path << "...";
     std::unique_ptr<DIR, decltype(&closedir)> config_dir(opendir(path.c_str()), closedir);
@@ -152,9 +210,12 @@ bool Parser::ParseConfigDir(const std::string& path, size_t* parse_errors) {
     }
     // Sort first so we load files in a consistent order (bug 31996208)
     std::sort(files.begin(), files.end());
-    for (const auto& file : files) {
-        if (!ParseConfigFile(file, parse_errors)) {
-            LOG(ERROR) << "could not import file '" << file << "'";
+    // Files are read and tokenized concurrently, but handed to the section parsers one at a time
+    // in the sorted order, so that actions and services are added just as if parsed in series.
+    auto tokenized_files = TokenizeFiles(files);
+    for (auto& file : tokenized_files) {
+        if (!ParseTokenizedFile(&file, parse_errors)) {
+            LOG(ERROR) << "could not import file '" << file.path << "'";
         }
     }
     return true;
@@ -17,6 +17,7 @@
 #ifndef _INIT_PARSER_H_
 #define _INIT_PARSER_H_
 
+#include <chrono>
 #include <map>
 #include <memory>
 #include <string>
@@ -77,7 +78,25 @@ class Parser {
     void AddSingleLineParser(const std::string& prefix, LineCallback callback);
 
   private:
+    // Lines of tokens with their line numbers, empty lines left out.
+    using TokenizedLines = std::vector<std::pair<int, std::vector<std::string>>>;
+
+    // A config file that has been read and tokenized, which does not involve any of the section
+    // parsers, so that the files of a directory can be prepared concurrently.
+    struct TokenizedFile {
+        std::string path;
+        Result<Success> read_result;
+        TokenizedLines lines;
+        std::chrono::milliseconds duration;
+    };
+
+    static TokenizedLines TokenizeData(const std::string& data);
+    static TokenizedFile TokenizeFile(const std::string& path);
+    static std::vector<TokenizedFile> TokenizeFiles(const std::vector<std::string>& paths);
+
     void ParseData(const std::string& filename, const std::string& data, size_t* parse_errors);
+    void ParseLines(const std::string& filename, TokenizedLines* lines, size_t* parse_errors);
+    bool ParseTokenizedFile(TokenizedFile* file, size_t* parse_errors);
     bool ParseConfigFile(const std::string& path, size_t* parse_errors);
     bool ParseConfigDir(const std::string& path, size_t* parse_errors);
 
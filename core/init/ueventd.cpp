@@ -22,18 +22,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/utsname.h>
 #include <sys/wait.h>
 
 #include <set>
 #include <thread>
+#include <unordered_map>
 
 #include <android-base/chrono_utils.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
+#include <android-base/strings.h>
 #include <fstab/fstab.h>
 #include <selinux/android.h>
 #include <selinux/selinux.h>
 
+#include "coldboot_manifest.h"
 #include "devices.h"
 #include "firmware_handler.h"
 #include "log.h"
@@ -96,6 +100,12 @@
 //
 // At this point, ueventd is single threaded, poll()'s and then handles any future uevents.
 
+// If ueventd.rc names a coldboot manifest (see coldboot_manifest.h), the device nodes recorded in
+// it are created by the subprocesses while the main thread does the /sys traversal of step 1.
+// The subprocesses of step 2 then only fix up sysfs permissions for the uevents that match a
+// recorded node, and handle the rest as usual.  Recorded nodes that no uevent matched are removed
+// before coldboot completes, and the manifest is rewritten after coldboot if anything changed.
+
 // Lastly, it should be noted that uevents that occur during the coldboot process are handled
 // without issue after the coldboot process completes.  This is because the uevent listener is
 // paused while the uevent handler and restorecon actions take place.  Once coldboot completes,
@@ -107,19 +117,28 @@ namespace init {
 
 class ColdBoot {
   public:
-    ColdBoot(UeventListener& uevent_listener, DeviceHandler& device_handler)
+    ColdBoot(UeventListener& uevent_listener, DeviceHandler& device_handler,
+             const std::string& manifest_path, const std::string& manifest_fingerprint)
         : uevent_listener_(uevent_listener),
           device_handler_(device_handler),
-          num_handler_subprocesses_(std::thread::hardware_concurrency() ?: 4) {}
+          num_handler_subprocesses_(std::thread::hardware_concurrency() ?: 4),
+          manifest_path_(manifest_path),
+          manifest_fingerprint_(manifest_fingerprint) {}
 
     void Run();
 
   private:
+    using SubProcessMain = void (ColdBoot::*)(unsigned int, unsigned int);
+
     void UeventHandlerMain(unsigned int process_num, unsigned int total_processes);
+    void ManifestHandlerMain(unsigned int process_num, unsigned int total_processes);
+    void ReadManifest();
     void RegenerateUevents();
-    void ForkSubProcesses();
+    void ReconcileManifest();
+    void ForkSubProcesses(SubProcessMain subprocess_main);
     void DoRestoreCon();
     void WaitForSubProcesses();
+    void UpdateManifest();
 
     UeventListener& uevent_listener_;
     DeviceHandler& device_handler_;
@@ -128,16 +147,47 @@ class ColdBoot {
     std::vector<Uevent> uevent_queue_;
 
     std::set<pid_t> subprocess_pids_;
+
+    std::string manifest_path_;
+    std::string manifest_fingerprint_;
+    std::vector<DeviceNode> manifest_nodes_;
+    // Whether each uevent in uevent_queue_ matches one of manifest_nodes_
+    std::vector<bool> uevent_in_manifest_;
+    bool manifest_changed_ = false;
 };
 
 void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_processes) {
     for (unsigned int i = process_num; i < uevent_queue_.size(); i += total_processes) {
         auto& uevent = uevent_queue_[i];
-        device_handler_.HandleDeviceEvent(uevent);
+        if (uevent_in_manifest_[i]) {
+            device_handler_.HandleSysfsEvent(uevent);
+        } else {
+            device_handler_.HandleDeviceEvent(uevent);
+        }
     }
     _exit(EXIT_SUCCESS);
 }
 
+void ColdBoot::ManifestHandlerMain(unsigned int process_num, unsigned int total_processes) {
+    for (unsigned int i = process_num; i < manifest_nodes_.size(); i += total_processes) {
+        device_handler_.MakeDeviceNode(manifest_nodes_[i]);
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+void ColdBoot::ReadManifest() {
+    if (manifest_path_.empty()) return;
+
+    if (auto result = ReadColdbootManifest(manifest_path_, manifest_fingerprint_); result) {
+        manifest_nodes_ = std::move(*result);
+        LOG(INFO) << "Creating " << manifest_nodes_.size() << " device nodes from "
+                  << manifest_path_;
+    } else {
+        LOG(INFO) << "Not using coldboot manifest: " << result.error();
+        manifest_changed_ = true;
+    }
+}
+
 void ColdBoot::RegenerateUevents() {
     uevent_listener_.RegenerateUevents([this](const Uevent& uevent) {
         HandleFirmwareEvent(uevent);
@@ -147,7 +197,45 @@ void ColdBoot::RegenerateUevents() {
     });
 }
 
-void ColdBoot::ForkSubProcesses() {
+void ColdBoot::ReconcileManifest() {
+    uevent_in_manifest_.assign(uevent_queue_.size(), false);
+    if (manifest_nodes_.empty()) return;
+
+    std::unordered_map<std::string, size_t> nodes_by_sysfs_path;
+    for (size_t i = 0; i < manifest_nodes_.size(); ++i) {
+        nodes_by_sysfs_path.emplace(manifest_nodes_[i].sysfs_path, i);
+    }
+
+    std::vector<bool> node_matched(manifest_nodes_.size(), false);
+    for (size_t i = 0; i < uevent_queue_.size(); ++i) {
+        const auto& uevent = uevent_queue_[i];
+        auto it = nodes_by_sysfs_path.find(uevent.path);
+        if (it != nodes_by_sysfs_path.end() && uevent.action == "add" &&
+            manifest_nodes_[it->second].Matches(uevent)) {
+            uevent_in_manifest_[i] = true;
+            node_matched[it->second] = true;
+        }
+    }
+
+    // Remove the nodes of devices that have gone since the manifest was written, before any
+    // uevent handler could create a node of the same name for another device.
+    std::vector<DeviceNode> matched_nodes;
+    for (size_t i = 0; i < manifest_nodes_.size(); ++i) {
+        if (node_matched[i]) {
+            matched_nodes.emplace_back(std::move(manifest_nodes_[i]));
+        } else {
+            device_handler_.RemoveDeviceNode(manifest_nodes_[i]);
+        }
+    }
+    if (matched_nodes.size() != manifest_nodes_.size()) {
+        LOG(INFO) << "Removed " << manifest_nodes_.size() - matched_nodes.size()
+                  << " device nodes no longer in /sys";
+        manifest_changed_ = true;
+    }
+    manifest_nodes_ = std::move(matched_nodes);
+}
+
+void ColdBoot::ForkSubProcesses(SubProcessMain subprocess_main) {
     for (unsigned int i = 0; i < num_handler_subprocesses_; ++i) {
         auto pid = fork();
         if (pid < 0) {
@@ -155,7 +243,7 @@ void ColdBoot::ForkSubProcesses() {
         }
 
         if (pid == 0) {
-            UeventHandlerMain(i, num_handler_subprocesses_);
+            (this->*subprocess_main)(i, num_handler_subprocesses_);
         }
 
         subprocess_pids_.emplace(pid);
@@ -200,12 +288,47 @@ void ColdBoot::WaitForSubProcesses() {
     }
 }
 
+void ColdBoot::UpdateManifest() {
+    // Only the nodes of uevents that the manifest did not account for need to be looked up.
+    std::vector<DeviceNode> device_nodes;
+    for (size_t i = 0; i < uevent_queue_.size(); ++i) {
+        const auto& uevent = uevent_queue_[i];
+        if (uevent_in_manifest_[i] || uevent.action != "add") continue;
+
+        DeviceNode node;
+        if (device_handler_.GetDeviceNode(uevent, &node)) {
+            device_nodes.emplace_back(std::move(node));
+            manifest_changed_ = true;
+        }
+    }
+    if (!manifest_changed_) return;
+
+    std::move(manifest_nodes_.begin(), manifest_nodes_.end(), std::back_inserter(device_nodes));
+
+    if (auto result = WriteColdbootManifest(manifest_path_, manifest_fingerprint_, device_nodes);
+        !result) {
+        LOG(ERROR) << "Could not write coldboot manifest: " << result.error();
+        return;
+    }
+    LOG(INFO) << "Wrote " << device_nodes.size() << " device nodes to " << manifest_path_;
+}
+
 void ColdBoot::Run() {
     android::base::Timer cold_boot_timer;
 
+    ReadManifest();
+
+    if (!manifest_nodes_.empty()) {
+        ForkSubProcesses(&ColdBoot::ManifestHandlerMain);
+    }
+
     RegenerateUevents();
 
-    ForkSubProcesses();
+    WaitForSubProcesses();
+
+    ReconcileManifest();
+
+    ForkSubProcesses(&ColdBoot::UeventHandlerMain);
 
     DoRestoreCon();
 
@@ -213,6 +336,24 @@ void ColdBoot::Run() {
 
     close(open(COLDBOOT_DONE, O_WRONLY | O_CREAT | O_CLOEXEC, 0000));
     LOG(INFO) << "Coldboot took " << cold_boot_timer.duration().count() / 1000.0f << " seconds";
+
+    // init is no longer waiting, so the labels of new nodes can be looked up again for the
+    // manifest without delaying boot.
+    if (!manifest_path_.empty()) {
+        UpdateManifest();
+    }
+}
+
+// The nodes that ueventd creates depend on its configuration and the SELinux policy, which come
+// with the build, on the kernel, and on the boot devices that get by-name links.
+static std::string ColdbootManifestFingerprint(const std::set<std::string>& boot_devices) {
+    utsname uts;
+    if (uname(&uts) == -1) {
+        PLOG(ERROR) << "uname() failed";
+        return "";
+    }
+    return android::base::GetProperty("ro.build.fingerprint", "") + " " + uts.release + " " +
+           android::base::Join(boot_devices, ',');
 }
 
 int ueventd_main(int argc, char** argv) {
@@ -232,6 +373,8 @@ int ueventd_main(int argc, char** argv) {
 
     DeviceHandler device_handler;
     UeventListener uevent_listener;
+    std::string coldboot_manifest;
+    std::string coldboot_manifest_fingerprint;
 
     {
         // Keep the current product name base configuration so we remain backwards compatible and
@@ -243,16 +386,22 @@ int ueventd_main(int argc, char** argv) {
                 ParseConfig({"/ueventd.rc", "/vendor/ueventd.rc", "/odm/ueventd.rc",
                              "/ueventd." + hardware + ".rc"});
 
+        auto boot_devices = fs_mgr_get_boot_devices();
         device_handler = DeviceHandler{std::move(ueventd_configuration.dev_permissions),
                                        std::move(ueventd_configuration.sysfs_permissions),
                                        std::move(ueventd_configuration.subsystems),
-                                       fs_mgr_get_boot_devices(), true};
+                                       boot_devices, true};
 
         firmware_directories = ueventd_configuration.firmware_directories;
+        coldboot_manifest = ueventd_configuration.coldboot_manifest;
+        if (!coldboot_manifest.empty()) {
+            coldboot_manifest_fingerprint = ColdbootManifestFingerprint(boot_devices);
+        }
     }
 
     if (access(COLDBOOT_DONE, F_OK) != 0) {
-        ColdBoot cold_boot(uevent_listener, device_handler);
+        ColdBoot cold_boot(uevent_listener, device_handler, coldboot_manifest,
+                           coldboot_manifest_fingerprint);
         cold_boot.Run();
     }
 
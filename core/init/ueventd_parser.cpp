@@ -84,6 +84,20 @@ Result<Success> ParseFirmwareDirectoriesLine(std::vector<std::string>&& args,
     return Success();
 }
 
+Result<Success> ParseColdbootManifestLine(std::vector<std::string>&& args,
+                                          std::string* coldboot_manifest) {
+    if (args.size() != 2) {
+        return Error() << "coldboot_manifest must have exactly one path";
+    }
+    if (args[1].front() != '/') {
+        return Error() << "coldboot_manifest '" << args[1] << "' does not start with '/'";
+    }
+
+    *coldboot_manifest = std::move(args[1]);
+
+    return Success();
+}
+
 class SubsystemParser : public SectionParser {
   public:
     SubsystemParser(std::vector<Subsystem>* subsystems) : subsystems_(subsystems) {}
@@ -182,6 +196,9 @@ UeventdConfiguration ParseConfig(const std::vector<std::string>& configs) {
     parser.AddSingleLineParser("firmware_directories",
                                std::bind(ParseFirmwareDirectoriesLine, _1,
                                          &ueventd_configuration.firmware_directories));
+    parser.AddSingleLineParser("coldboot_manifest",
+                               std::bind(ParseColdbootManifestLine, _1,
+                                         &ueventd_configuration.coldboot_manifest));
 
     for (const auto& config : configs) {
         parser.ParseConfig(config);
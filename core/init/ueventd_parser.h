@@ -30,6 +30,7 @@ struct UeventdConfiguration {
     std::vector<SysfsPermissions> sysfs_permissions;
     std::vector<Permissions> dev_permissions;
     std::vector<std::string> firmware_directories;
+    std::string coldboot_manifest;
 };
 
 UeventdConfiguration ParseConfig(const std::vector<std::string>& configs);
@@ -62,7 +62,7 @@ LIBLOG_HIDDEN void __android_log_config_read() {
   }
 
 #if (FAKE_LOG_DEVICE == 0)
-  if ((__android_log_transport == LOGGER_DEFAULT) ||
+  if (((__android_log_transport & ~LOGGER_BATCH) == LOGGER_DEFAULT) ||
       (__android_log_transport & LOGGER_LOGD)) {
     extern struct android_log_transport_read logdLoggerRead;
     extern struct android_log_transport_read pmsgLoggerRead;
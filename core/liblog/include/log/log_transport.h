@@ -24,12 +24,20 @@ extern "C" {
 #define LOGGER_NULL    0x04 /* Does not release resources of other selections */
 #define LOGGER_LOCAL   0x08 /* logs sent to local memory */
 #define LOGGER_STDERR  0x10 /* logs sent to stderr */
+#define LOGGER_BATCH   0x20 /* logd writes batched per thread */
 /* clang-format on */
 
 /* Both return the selected transport flag mask, or negative errno */
 int android_set_log_transport(int transport_flag);
 int android_get_log_transport();
 
+/*
+ * Sends whatever LOGGER_BATCH holds back, for every thread, to logd. For a
+ * process about to _exit() or to handle a crash itself, neither of which
+ * liblog sees. Not async-signal-safe. Returns 0, or negative errno.
+ */
+int android_flush_log_transport();
+
 #ifdef __cplusplus
 }
 #endif
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdatomic.h>
 #include <stdio.h>
@@ -31,7 +32,9 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <cutils/list.h>
 #include <cutils/sockets.h>
+#include <log/log_transport.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
 
@@ -47,6 +50,11 @@ static int logdOpen();
 static void logdClose();
 static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
                      size_t nr);
+static int logdBatchWrite(log_id_t logId, struct timespec* ts,
+                          struct iovec* vec, size_t nr);
+
+static atomic_int_fast32_t dropped;
+static atomic_int_fast32_t droppedSecurity;
 
 LIBLOG_HIDDEN struct android_log_transport_write logdLoggerWrite = {
   .node = { &logdLoggerWrite.node, &logdLoggerWrite.node },
@@ -124,6 +132,48 @@ static int logdAvailable(log_id_t logId) {
   return 1;
 }
 
+/* Tell logd how many messages it missed since the last time we could */
+static void logdSendDropped(int sock, android_log_header_t* header) {
+  struct iovec newVec[2];
+  android_log_event_int_t buffer;
+  ssize_t ret;
+  int32_t snapshot;
+
+  newVec[0].iov_base = (unsigned char*)header;
+  newVec[0].iov_len = sizeof(*header);
+  newVec[1].iov_base = &buffer;
+  newVec[1].iov_len = sizeof(buffer);
+
+  snapshot =
+      atomic_exchange_explicit(&droppedSecurity, 0, memory_order_relaxed);
+  if (snapshot) {
+    header->id = LOG_ID_SECURITY;
+    buffer.header.tag = htole32(LIBLOG_LOG_TAG);
+    buffer.payload.type = EVENT_TYPE_INT;
+    buffer.payload.data = htole32(snapshot);
+
+    ret = TEMP_FAILURE_RETRY(writev(sock, newVec, 2));
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
+      atomic_fetch_add_explicit(&droppedSecurity, snapshot,
+                                memory_order_relaxed);
+    }
+  }
+  snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+  if (snapshot &&
+      __android_log_is_loggable_len(ANDROID_LOG_INFO, "liblog",
+                                    strlen("liblog"), ANDROID_LOG_VERBOSE)) {
+    header->id = LOG_ID_EVENTS;
+    buffer.header.tag = htole32(LIBLOG_LOG_TAG);
+    buffer.payload.type = EVENT_TYPE_INT;
+    buffer.payload.data = htole32(snapshot);
+
+    ret = TEMP_FAILURE_RETRY(writev(sock, newVec, 2));
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
+      atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
+    }
+  }
+}
+
 static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
                      size_t nr) {
   ssize_t ret;
@@ -132,8 +182,6 @@ static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
   struct iovec newVec[nr + headerLength];
   android_log_header_t header;
   size_t i, payloadSize;
-  static atomic_int_fast32_t dropped;
-  static atomic_int_fast32_t droppedSecurity;
 
   sock = atomic_load(&logdLoggerWrite.context.sock);
   if (sock < 0) switch (sock) {
@@ -155,6 +203,14 @@ static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
     return 0;
   }
 
+  if ((__android_log_transport & LOGGER_BATCH) && (logId != LOG_ID_SECURITY)) {
+    ret = logdBatchWrite(logId, ts, vec, nr);
+    if (ret != -EBUSY) {
+      return ret;
+    }
+    /* no batch to be had, write it directly */
+  }
+
   /*
    *  struct {
    *      // what we provide to socket
@@ -181,44 +237,7 @@ static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
   newVec[0].iov_len = sizeof(header);
 
   if (sock >= 0) {
-    int32_t snapshot =
-        atomic_exchange_explicit(&droppedSecurity, 0, memory_order_relaxed);
-    if (snapshot) {
-      android_log_event_int_t buffer;
-
-      header.id = LOG_ID_SECURITY;
-      buffer.header.tag = htole32(LIBLOG_LOG_TAG);
-      buffer.payload.type = EVENT_TYPE_INT;
-      buffer.payload.data = htole32(snapshot);
-
-      newVec[headerLength].iov_base = &buffer;
-      newVec[headerLength].iov_len = sizeof(buffer);
-
-      ret = TEMP_FAILURE_RETRY(writev(sock, newVec, 2));
-      if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
-        atomic_fetch_add_explicit(&droppedSecurity, snapshot,
-                                  memory_order_relaxed);
-      }
-    }
-    snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
-    if (snapshot &&
-        __android_log_is_loggable_len(ANDROID_LOG_INFO, "liblog",
-                                      strlen("liblog"), ANDROID_LOG_VERBOSE)) {
-      android_log_event_int_t buffer;
-
-      header.id = LOG_ID_EVENTS;
-      buffer.header.tag = htole32(LIBLOG_LOG_TAG);
-      buffer.payload.type = EVENT_TYPE_INT;
-      buffer.payload.data = htole32(snapshot);
-
-      newVec[headerLength].iov_base = &buffer;
-      newVec[headerLength].iov_len = sizeof(buffer);
-
-      ret = TEMP_FAILURE_RETRY(writev(sock, newVec, 2));
-      if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
-        atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
-      }
-    }
+    logdSendDropped(sock, &header);
   }
 
   header.id = logId;
@@ -288,3 +307,453 @@ static int logdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec,
 
   return ret;
 }
+
+/*
+ * Batched writes, opted into with LOGGER_BATCH. Each thread stages its
+ * records, header included, in a private arena and hands them to logd
+ * several datagrams per sendmmsg(). The socket is SOCK_DGRAM, so records
+ * can not be coalesced into a single writev(). A batch goes out when full,
+ * once its oldest record has waited batchLatencyMs, on a fatal message
+ * (every thread's batch, so nothing is lost to the abort that follows), at
+ * thread exit, at process exit and on android_flush_log_transport(). A
+ * thread's records stay in order and carry the timestamp taken at the
+ * call, logd sorts across threads. Crash signals are left to debuggerd, a
+ * process about to _exit() or to take a crash its own way should call
+ * android_flush_log_transport() first, or it leaves at most
+ * batchLatencyMs worth of records behind.
+ *
+ * Lock order is batchListLock, then a batch lock. A batch lock is only
+ * ever taken by its own thread, or by another one holding batchListLock.
+ */
+
+#define BATCH_RECORDS 32
+#define BATCH_BYTES (16 * 1024)
+
+static const unsigned batchLatencyMs = 100;
+
+struct logdBatch {
+  struct listnode node; /* on batchList */
+  pthread_mutex_t lock;
+  atomic_int owner;  /* tid holding lock, so a signal handler can tell */
+  bool flushing;     /* records [sent, count) are on their way to logd */
+  struct timespec oldest; /* CLOCK_MONOTONIC of the first pending record */
+  size_t sent;
+  size_t count;
+  size_t used;
+  struct iovec record[BATCH_RECORDS]; /* into data, header and payload */
+  char data[BATCH_BYTES];
+};
+
+static pthread_once_t batchOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t batchKey;
+static bool batchKeyValid;
+static pthread_mutex_t batchListLock = PTHREAD_MUTEX_INITIALIZER;
+static list_declare(batchList);
+static pthread_cond_t batchWakeup;
+static bool batchFlusherRunning;
+static atomic_bool batchFlusherIdle = ATOMIC_VAR_INIT(true);
+
+/*
+ * Returns 0 with the lock held, or -EBUSY if it is held by this very
+ * thread, which means we are in a signal handler that interrupted it.
+ */
+static int logdBatchLock(struct logdBatch* batch, bool wait) {
+  pid_t tid = gettid();
+
+  if (pthread_mutex_trylock(&batch->lock)) {
+    if (!wait ||
+        (atomic_load_explicit(&batch->owner, memory_order_relaxed) == tid)) {
+      return -EBUSY;
+    }
+    pthread_mutex_lock(&batch->lock);
+  }
+  atomic_store_explicit(&batch->owner, tid, memory_order_relaxed);
+  return 0;
+}
+
+static void logdBatchUnlock(struct logdBatch* batch) {
+  atomic_store_explicit(&batch->owner, 0, memory_order_relaxed);
+  pthread_mutex_unlock(&batch->lock);
+}
+
+/*
+ * Hands records [sent, end) to logd, sent follows. Safe to call from a
+ * signal handler that interrupted the batch owner outside of a flush.
+ */
+static void logdBatchSend(struct logdBatch* batch, size_t end) {
+  struct mmsghdr msgs[BATCH_RECORDS];
+  android_log_header_t header;
+  size_t i, sent = batch->sent;
+  bool reconnected = false;
+  int sock, ret;
+
+  if (sent >= end) {
+    return;
+  }
+
+  memset(msgs, 0, sizeof(msgs));
+  for (i = sent; i < end; ++i) {
+    msgs[i].msg_hdr.msg_iov = &batch->record[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  sock = atomic_load(&logdLoggerWrite.context.sock);
+  if (sock >= 0) {
+    memcpy(&header, batch->record[sent].iov_base, sizeof(header));
+    logdSendDropped(sock, &header);
+  }
+
+  /* Same recovery as logdWrite(), a partial send just means resume */
+  while (sent < end) {
+    if (sock < 0) {
+      ret = sock;
+    } else {
+      ret = TEMP_FAILURE_RETRY(sendmmsg(sock, msgs + sent, end - sent, 0));
+      if (ret < 0) {
+        ret = -errno;
+      }
+    }
+    if (ret > 0) {
+      sent += ret;
+      continue;
+    }
+    if (reconnected) {
+      break;
+    }
+    switch (ret) {
+      case -ENOTCONN:
+      case -ECONNREFUSED:
+      case -ENOENT:
+        break;
+      default:
+        goto done;
+    }
+    if (__android_log_trylock()) {
+      break;
+    }
+    __logdClose(ret);
+    ret = logdOpen();
+    __android_log_unlock();
+    if (ret < 0) {
+      break;
+    }
+    sock = atomic_load(&logdLoggerWrite.context.sock);
+    reconnected = true;
+  }
+
+done:
+  if (sent < end) {
+    atomic_fetch_add_explicit(&dropped, end - sent, memory_order_relaxed);
+  }
+  batch->sent = end;
+  atomic_signal_fence(memory_order_seq_cst);
+}
+
+/* batch->lock held */
+static void logdBatchFlushLocked(struct logdBatch* batch) {
+  batch->flushing = true;
+  atomic_signal_fence(memory_order_seq_cst);
+  logdBatchSend(batch, batch->count);
+  batch->sent = 0;
+  batch->count = 0;
+  batch->used = 0;
+  atomic_signal_fence(memory_order_seq_cst);
+  batch->flushing = false;
+}
+
+/*
+ * We are in a signal handler that interrupted the owner of batch, whose
+ * complete records have to go out ahead of anything we log directly. If
+ * the owner was flushing them itself there is nothing better to do than
+ * leave them to it.
+ */
+static void logdBatchFlushInterrupted(struct logdBatch* batch) {
+  if (!batch->flushing) {
+    logdBatchSend(batch, batch->count);
+  }
+}
+
+static void logdBatchFlushAll() {
+  struct listnode* node;
+
+  pthread_mutex_lock(&batchListLock);
+  list_for_each(node, &batchList) {
+    struct logdBatch* batch = node_to_item(node, struct logdBatch, node);
+    if (logdBatchLock(batch, true)) {
+      logdBatchFlushInterrupted(batch);
+      continue;
+    }
+    logdBatchFlushLocked(batch);
+    logdBatchUnlock(batch);
+  }
+  pthread_mutex_unlock(&batchListLock);
+}
+
+/* The list is empty, so this costs nothing, unless LOGGER_BATCH was used */
+LIBLOG_HIDDEN void __android_log_logd_flush() {
+  logdBatchFlushAll();
+}
+
+static uint64_t logdBatchAge(const struct timespec* then,
+                             const struct timespec* now) {
+  return (now->tv_sec - then->tv_sec) * NS_PER_SEC + now->tv_nsec -
+         then->tv_nsec;
+}
+
+static void* logdBatchFlusher(void* arg __unused) {
+  static const uint64_t latency = batchLatencyMs * (NS_PER_SEC / 1000);
+
+  pthread_mutex_lock(&batchListLock);
+  for (;;) {
+    struct listnode* node;
+    struct timespec now;
+    uint64_t wait = latency;
+    bool pending = false;
+
+    /*
+     * Idle goes up before the scan, so a writer that sees it down knows
+     * this scan will find its record.
+     */
+    atomic_store(&batchFlusherIdle, true);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    list_for_each(node, &batchList) {
+      struct logdBatch* batch = node_to_item(node, struct logdBatch, node);
+      if (logdBatchLock(batch, false)) {
+        pending = true; /* owner is busy, look again next round */
+        continue;
+      }
+      if (batch->count) {
+        uint64_t age = logdBatchAge(&batch->oldest, &now);
+        if (age >= latency) {
+          logdBatchFlushLocked(batch);
+        } else {
+          pending = true;
+          if ((latency - age) < wait) {
+            wait = latency - age;
+          }
+        }
+      }
+      logdBatchUnlock(batch);
+    }
+
+    if (!pending) {
+      pthread_cond_wait(&batchWakeup, &batchListLock);
+      continue;
+    }
+    atomic_store(&batchFlusherIdle, false);
+    now.tv_sec += wait / NS_PER_SEC;
+    now.tv_nsec += wait % NS_PER_SEC;
+    if (now.tv_nsec >= (long)NS_PER_SEC) {
+      now.tv_nsec -= NS_PER_SEC;
+      ++now.tv_sec;
+    }
+    pthread_cond_timedwait(&batchWakeup, &batchListLock, &now);
+  }
+  return NULL;
+}
+
+/* batchListLock held */
+static bool logdBatchStartFlusher() {
+  pthread_attr_t attr;
+  pthread_t thread;
+  int ret;
+
+  if (batchFlusherRunning) {
+    return true;
+  }
+  if (pthread_attr_init(&attr)) {
+    return false;
+  }
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  ret = pthread_create(&thread, &attr, logdBatchFlusher, NULL);
+  pthread_attr_destroy(&attr);
+  if (ret) {
+    return false;
+  }
+  batchFlusherRunning = true;
+  return true;
+}
+
+static void logdBatchInitWakeup() {
+  pthread_condattr_t attr;
+
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&batchWakeup, &attr);
+  pthread_condattr_destroy(&attr);
+}
+
+static void logdBatchThreadExit(void* arg) {
+  struct logdBatch* batch = arg;
+
+  pthread_mutex_lock(&batchListLock);
+  list_remove(&batch->node);
+  pthread_mutex_unlock(&batchListLock);
+
+  logdBatchLock(batch, true);
+  logdBatchFlushLocked(batch);
+  logdBatchUnlock(batch);
+  pthread_mutex_destroy(&batch->lock);
+  free(batch);
+}
+
+static void logdBatchAtforkPrepare() {
+  pthread_mutex_lock(&batchListLock);
+}
+
+static void logdBatchAtforkParent() {
+  pthread_mutex_unlock(&batchListLock);
+}
+
+/*
+ * The parent still sends whatever was pending at the fork, so the child
+ * starts empty rather than send it a second time. Batches of the threads
+ * that did not follow us are freed, their locks may have been held.
+ */
+static void logdBatchAtforkChild() {
+  struct listnode *node, *n;
+  struct logdBatch* self =
+      batchKeyValid ? pthread_getspecific(batchKey) : NULL;
+
+  list_for_each_safe(node, n, &batchList) {
+    struct logdBatch* batch = node_to_item(node, struct logdBatch, node);
+    list_remove(node);
+    if (batch != self) {
+      free(batch);
+    }
+  }
+  if (self) {
+    pthread_mutex_init(&self->lock, NULL);
+    atomic_store(&self->owner, 0);
+    self->flushing = false;
+    self->sent = 0;
+    self->count = 0;
+    self->used = 0;
+    list_add_tail(&batchList, &self->node);
+  }
+  batchFlusherRunning = false;
+  atomic_store(&batchFlusherIdle, true);
+  logdBatchInitWakeup();
+  pthread_mutex_init(&batchListLock, NULL);
+}
+
+static void logdBatchInit() {
+  logdBatchInitWakeup();
+  if (pthread_key_create(&batchKey, logdBatchThreadExit)) {
+    return;
+  }
+  pthread_atfork(logdBatchAtforkPrepare, logdBatchAtforkParent,
+                 logdBatchAtforkChild);
+  atexit(logdBatchFlushAll);
+  batchKeyValid = true;
+}
+
+static struct logdBatch* logdBatchGet() {
+  struct logdBatch* batch;
+
+  pthread_once(&batchOnce, logdBatchInit);
+  if (!batchKeyValid) {
+    return NULL;
+  }
+  batch = pthread_getspecific(batchKey);
+  if (batch) {
+    return batch;
+  }
+
+  batch = calloc(1, sizeof(*batch));
+  if (!batch) {
+    return NULL;
+  }
+  pthread_mutex_init(&batch->lock, NULL);
+  pthread_mutex_lock(&batchListLock);
+  if (!logdBatchStartFlusher()) {
+    pthread_mutex_unlock(&batchListLock);
+    pthread_mutex_destroy(&batch->lock);
+    free(batch);
+    return NULL;
+  }
+  list_add_tail(&batchList, &batch->node);
+  pthread_mutex_unlock(&batchListLock);
+  pthread_setspecific(batchKey, batch);
+  return batch;
+}
+
+/*
+ * Returns the payload size queued, or -EBUSY if the record has to be
+ * written directly: no batch could be had, or we are reentering our own
+ * from a signal handler. In the latter case what the batch already holds
+ * is sent first, so the direct write does not overtake it.
+ */
+static int logdBatchWrite(log_id_t logId, struct timespec* ts,
+                          struct iovec* vec, size_t nr) {
+  struct logdBatch* batch;
+  android_log_header_t header;
+  size_t i, payloadSize, len;
+  char* record;
+  bool fatal, wake = false;
+
+  batch = logdBatchGet();
+  if (!batch) {
+    return -EBUSY;
+  }
+  /* Anyone else holds it only for as long as a flush */
+  if (logdBatchLock(batch, true)) {
+    logdBatchFlushInterrupted(batch);
+    return -EBUSY;
+  }
+
+  for (payloadSize = 0, i = 0; i < nr; i++) {
+    payloadSize += vec[i].iov_len;
+  }
+  if (payloadSize > LOGGER_ENTRY_MAX_PAYLOAD) {
+    payloadSize = LOGGER_ENTRY_MAX_PAYLOAD;
+  }
+
+  if ((batch->count >= BATCH_RECORDS) ||
+      ((batch->used + sizeof(header) + payloadSize) > BATCH_BYTES)) {
+    logdBatchFlushLocked(batch);
+  }
+
+  header.id = logId;
+  header.tid = gettid();
+  header.realtime.tv_sec = ts->tv_sec;
+  header.realtime.tv_nsec = ts->tv_nsec;
+
+  record = batch->data + batch->used;
+  memcpy(record, &header, sizeof(header));
+  len = sizeof(header);
+  for (i = 0; (i < nr) && (len < sizeof(header) + payloadSize); i++) {
+    size_t chunk = min(vec[i].iov_len, sizeof(header) + payloadSize - len);
+    memcpy(record + len, vec[i].iov_base, chunk);
+    len += chunk;
+  }
+  batch->record[batch->count].iov_base = record;
+  batch->record[batch->count].iov_len = len;
+  batch->used += len;
+  /* A signal handler only ever looks at complete records */
+  atomic_signal_fence(memory_order_seq_cst);
+
+  if (!batch->count++) {
+    clock_gettime(CLOCK_MONOTONIC, &batch->oldest);
+    wake = atomic_exchange(&batchFlusherIdle, false);
+  }
+
+  /* Binary buffers lead with a tag, the others with a priority */
+  fatal = (logId != LOG_ID_EVENTS) && (logId != LOG_ID_STATS) && nr &&
+          vec[0].iov_len &&
+          (*(const unsigned char*)vec[0].iov_base >= ANDROID_LOG_FATAL);
+  logdBatchUnlock(batch);
+
+  if (fatal) {
+    logdBatchFlushAll();
+  } else if (wake) {
+    /* Under the list lock, so the flusher is either waiting or to scan */
+    pthread_mutex_lock(&batchListLock);
+    if (logdBatchStartFlusher()) {
+      pthread_cond_signal(&batchWakeup);
+    }
+    pthread_mutex_unlock(&batchListLock);
+  }
+
+  return payloadSize;
+}
@@ -195,6 +195,11 @@ LIBLOG_HIDDEN void __android_log_unlock();
 
 LIBLOG_HIDDEN int __android_log_transport;
 
+#if (FAKE_LOG_DEVICE == 0)
+/* Sends the records held back by LOGGER_BATCH */
+LIBLOG_HIDDEN void __android_log_logd_flush();
+#endif
+
 __END_DECLS
 
 #endif /* _LIBLOG_LOGGER_H__ */
@@ -68,6 +68,7 @@ cts_src_files := \
 
 test_src_files := \
     $(cts_src_files) \
+    log_batch_test.cpp
 
 # Build tests for the device (with .so). Run with:
 #   adb shell /data/nativetest/liblog-unit-tests/liblog-unit-tests
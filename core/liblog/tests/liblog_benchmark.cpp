@@ -16,6 +16,7 @@
 
 #include <fcntl.h>
 #include <inttypes.h>
+#include <linux/perf_event.h>
 #include <poll.h>
 #include <sys/endian.h>
 #include <sys/socket.h>
@@ -89,6 +90,67 @@ static void BM_log_maximum_null(benchmark::State& state) {
 }
 BENCHMARK(BM_log_maximum_null);
 
+/*
+ *	Count the syscalls this thread enters, through the raw_syscalls
+ * tracepoint. Returns -1 if tracefs or perf events are not available to us.
+ */
+static int syscall_counter_open() {
+  static const char* const paths[] = {
+    "/sys/kernel/tracing/events/raw_syscalls/sys_enter/id",
+    "/sys/kernel/debug/tracing/events/raw_syscalls/sys_enter/id",
+  };
+
+  for (const char* path : paths) {
+    std::string id;
+    if (!android::base::ReadFileToString(path, &id)) continue;
+
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_TRACEPOINT;
+    attr.size = sizeof(attr);
+    attr.config = strtoull(id.c_str(), nullptr, 10);
+    return syscall(__NR_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+  }
+  return -1;
+}
+
+/*
+ *	Measure the per call cost of print messages into the log with the
+ * given transport, and the syscalls spent per message. LOGGER_BATCH queues
+ * into a per-thread batch and sends it whole with sendmmsg, the default
+ * issues a writev per message. Time based flushes happen on the flusher
+ * thread and are not counted.
+ */
+static void BM_log_transport(benchmark::State& state) {
+  android_set_log_transport(state.range(0));
+
+  int fd = syscall_counter_open();
+  uint64_t before = 0;
+  if ((fd >= 0) && (read(fd, &before, sizeof(before)) != sizeof(before))) {
+    close(fd);
+    fd = -1;
+  }
+
+  while (state.KeepRunning()) {
+    __android_log_print(ANDROID_LOG_INFO, "BM_log_transport", "%zu",
+                        state.iterations());
+  }
+
+  uint64_t after = 0;
+  if ((fd >= 0) && (read(fd, &after, sizeof(after)) == sizeof(after)) &&
+      state.iterations()) {
+    char label[32];
+    snprintf(label, sizeof(label), "%.3f syscalls/msg",
+             double(after - before) / state.iterations());
+    state.SetLabel(label);
+  }
+  if (fd >= 0) close(fd);
+
+  set_log_default();
+}
+BENCHMARK(BM_log_transport)->Arg(LOGGER_DEFAULT)->Arg(LOGGER_BATCH);
+
 /*
  *	Measure the time it takes to collect the time using
  * discrete acquisition (state.PauseTiming() to state.ResumeTiming())
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android/log.h>
+#include <gtest/gtest.h>
+#include <log/log_read.h>
+#include <log/log_time.h>
+#include <log/log_transport.h>
+#include <private/android_logger.h>
+
+#ifdef __ANDROID__
+static const char kTag[] = "TEST__log_batch";
+// Several full batches, and then some left pending in the last one.
+static const int kRecords = 100;
+
+static void logRecords(const char* what, int count,
+                       int lastPrio = ANDROID_LOG_INFO) {
+  for (int i = 0; i < count; ++i) {
+    __android_log_buf_print(LOG_ID_MAIN,
+                            (i + 1 < count) ? ANDROID_LOG_INFO : lastPrio,
+                            kTag, "%s %d", what, i);
+  }
+}
+
+// The sequence numbers of the records "what" pid logged since start, in
+// the order logd returns them. logd takes a moment to have them all.
+static std::vector<int> readRecords(pid_t pid, const log_time& start,
+                                    const char* what) {
+  std::string prefix = std::string(what) + " ";
+  std::vector<int> records;
+  for (int tries = 0; tries < 20; ++tries) {
+    records.clear();
+    struct logger_list* logger_list = android_logger_list_alloc_time(
+        ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, start, pid);
+    if (!logger_list) break;
+    if (!android_logger_open(logger_list, LOG_ID_MAIN)) {
+      android_logger_list_free(logger_list);
+      break;
+    }
+    log_msg log_msg;
+    while (android_logger_list_read(logger_list, &log_msg) > 0) {
+      if ((log_msg.id() != LOG_ID_MAIN) || (log_msg.entry.pid != pid)) {
+        continue;
+      }
+      // prio, tag and message, each of the latter terminated
+      const char* tag = log_msg.msg() + 1;
+      size_t len = log_msg.entry.len;
+      if ((len < sizeof(kTag) + 1) || strcmp(tag, kTag)) continue;
+      const char* msg = tag + sizeof(kTag);
+      if (strncmp(msg, prefix.c_str(), prefix.size())) continue;
+      records.push_back(atoi(msg + prefix.size()));
+    }
+    android_logger_list_free(logger_list);
+    if (records.size() >= kRecords) break;
+    usleep(100000);
+  }
+  return records;
+}
+
+static std::vector<int> allRecords(int count) {
+  std::vector<int> records;
+  for (int i = 0; i < count; ++i) records.push_back(i);
+  return records;
+}
+
+// Runs child in a process of its own, which has to exit on its own
+// account, and returns what it got to logd.
+static std::vector<int> childRecords(void (*child)(const char*),
+                                     const char* what) {
+  log_time start(android_log_clockid());
+  pid_t pid = fork();
+  if (!pid) {
+    android_set_log_transport(LOGGER_LOGD | LOGGER_BATCH);
+    child(what);
+    _exit(1);
+  }
+  int status = 0;
+  EXPECT_EQ(pid, waitpid(pid, &status, 0));
+  EXPECT_TRUE(WIFEXITED(status));
+  return readRecords(pid, start, what);
+}
+#endif
+
+TEST(liblog, batch_flush) {
+#ifdef __ANDROID__
+  int logger = android_get_log_transport();
+  log_time start(android_log_clockid());
+
+  ASSERT_EQ(LOGGER_LOGD | LOGGER_BATCH,
+            android_set_log_transport(LOGGER_LOGD | LOGGER_BATCH));
+  logRecords("batch_flush", kRecords);
+  EXPECT_EQ(0, android_flush_log_transport());
+  EXPECT_EQ(logger, android_set_log_transport(logger));
+
+  EXPECT_EQ(allRecords(kRecords),
+            readRecords(getpid(), start, "batch_flush"));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, batch_flush_before__exit) {
+#ifdef __ANDROID__
+  EXPECT_EQ(allRecords(kRecords),
+            childRecords(
+                [](const char* what) {
+                  logRecords(what, kRecords);
+                  android_flush_log_transport();
+                  _exit(0);
+                },
+                "batch_flush_before__exit"));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, batch_exit) {
+#ifdef __ANDROID__
+  EXPECT_EQ(allRecords(kRecords), childRecords(
+                                      [](const char* what) {
+                                        logRecords(what, kRecords);
+                                        exit(0);
+                                      },
+                                      "batch_exit"));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, batch_fatal) {
+#ifdef __ANDROID__
+  // A fatal message sends everything ahead of the abort that follows
+  EXPECT_EQ(allRecords(kRecords),
+            childRecords(
+                [](const char* what) {
+                  logRecords(what, kRecords, ANDROID_LOG_FATAL);
+                  _exit(0);
+                },
+                "batch_fatal"));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, batch_thread_exit) {
+#ifdef __ANDROID__
+  EXPECT_EQ(allRecords(kRecords),
+            childRecords(
+                [](const char* what) {
+                  std::thread([what] { logRecords(what, kRecords); }).join();
+                  _exit(0);
+                },
+                "batch_thread_exit"));
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
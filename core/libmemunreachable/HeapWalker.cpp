@@ -16,16 +16,23 @@
 
 #include <errno.h>
 #include <inttypes.h>
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <map>
+#include <mutex>
 #include <utility>
 
 #include "Allocator.h"
 #include "HeapWalker.h"
 #include "LeakFolding.h"
 #include "ScopedSignalHandler.h"
+#include "Stack.h"
 #include "log.h"
 
 namespace android {
@@ -40,6 +47,7 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
     valid_allocations_range_.begin = std::min(valid_allocations_range_.begin, begin);
     valid_allocations_range_.end = std::max(valid_allocations_range_.end, end);
     allocation_bytes_ += range.size();
+    index_valid_ = false;
     return true;
   } else {
     Range overlap = inserted.first->first;
@@ -52,36 +60,260 @@ bool HeapWalker::Allocation(uintptr_t begin, uintptr_t end) {
   }
 }
 
-bool HeapWalker::WordContainsAllocationPtr(uintptr_t word_ptr, Range* range, AllocationInfo** info) {
-  walking_ptr_ = word_ptr;
-  // This access may segfault if the process under test has done something strange,
-  // for example mprotect(PROT_NONE) on a native heap page.  If so, it will be
-  // caught and handled by mmaping a zero page over the faulting page.
-  uintptr_t value = *reinterpret_cast<uintptr_t*>(word_ptr);
-  walking_ptr_ = 0;
-  if (value >= valid_allocations_range_.begin && value < valid_allocations_range_.end) {
-    AllocationMap::iterator it = allocations_.find(Range{value, value + 1});
-    if (it != allocations_.end()) {
-      *range = it->first;
-      *info = &it->second;
-      return true;
+void HeapWalker::BuildIndex() {
+  index_ranges_.clear();
+  index_infos_.clear();
+  index_buckets_.clear();
+  index_ranges_.reserve(allocations_.size());
+  index_infos_.reserve(allocations_.size());
+  for (auto& it : allocations_) {
+    index_ranges_.push_back(it.first);
+    index_infos_.push_back(&it.second);
+  }
+  index_valid_ = true;
+  if (index_ranges_.empty()) {
+    return;
+  }
+
+  // Use page sized buckets, or larger ones if the heap is sparse, so that there are no more than
+  // about two buckets per allocation.
+  const uintptr_t heap_size = valid_allocations_range_.end - valid_allocations_range_.begin;
+  index_bucket_shift_ = 12;
+  while ((heap_size >> index_bucket_shift_) > 2 * index_ranges_.size()) {
+    index_bucket_shift_++;
+  }
+
+  size_t num_buckets = (heap_size >> index_bucket_shift_) + 1;
+  index_buckets_.reserve(num_buckets + 1);
+  uint32_t first = 0;
+  for (size_t bucket = 0; bucket <= num_buckets; bucket++) {
+    uintptr_t bucket_begin = valid_allocations_range_.begin + (bucket << index_bucket_shift_);
+    while (first < index_ranges_.size() && index_ranges_[first].end <= bucket_begin) {
+      first++;
     }
+    index_buckets_.push_back(first);
+  }
+}
+
+bool HeapWalker::WordContainsAllocationPtr(uintptr_t value, Range* range, AllocationInfo** info) {
+  if (value < valid_allocations_range_.begin || value >= valid_allocations_range_.end) {
+    return false;
+  }
+  if (!index_valid_) {
+    BuildIndex();
+  }
+
+  // Allocations are sorted and do not overlap, so the first one that ends after value is the
+  // only one that may contain it, and it is at most the first allocation of the next bucket.
+  size_t bucket = (value - valid_allocations_range_.begin) >> index_bucket_shift_;
+  auto begin = index_ranges_.begin() + index_buckets_[bucket];
+  auto end = index_ranges_.begin() + std::min<size_t>(index_buckets_[bucket + 1] + 1,
+                                                      index_ranges_.size());
+  auto it = std::upper_bound(begin, end, value,
+                             [](uintptr_t value, const Range& range) { return value < range.end; });
+  if (it != end && it->begin <= value) {
+    *range = *it;
+    *info = index_infos_[it - index_ranges_.begin()];
+    return true;
   }
   return false;
 }
 
-void HeapWalker::RecurseRoot(const Range& root) {
-  allocator::vector<Range> to_do(1, root, allocator_);
-  while (!to_do.empty()) {
-    Range range = to_do.back();
-    to_do.pop_back();
+// Large ranges are split so that marking threads can share the work of scanning them.
+static constexpr size_t kMarkChunkSize = 64 * 1024;
+
+// Enough for scanning, and for HandleSegFault to log from.
+static constexpr size_t kMarkThreadStackSize = 64 * 1024;
+
+// Ranges still to be scanned by one marking thread.  Other threads steal from it when their own
+// stack runs dry.
+struct HeapWalker::MarkStack {
+  explicit MarkStack(Allocator<Range> allocator) : ranges(allocator) {}
+
+  bool Pop(Range* range) {
+    std::lock_guard<std::mutex> lk(lock);
+    if (ranges.empty()) {
+      return false;
+    }
+    *range = ranges.back();
+    ranges.pop_back();
+    return true;
+  }
+
+  std::mutex lock;
+  allocator::vector<Range> ranges;
+};
+
+// HeapWalker runs in a process forked from the PtracerThread, which has no TLS of its own, so
+// bionic's thread list and TLS there belong to another thread, and the threads frozen by the fork
+// may have held its locks.  On bionic the marking threads are raw clones like PtracerThread, with
+// a stack and nothing else.  glibc's locks skip futex wakes for as long as it thinks the process
+// is single threaded, which only pthread_create changes, so on the host they are pthreads.
+#if defined(__BIONIC__)
+class MarkWorker {
+ public:
+  MarkWorker() : stack_(kMarkThreadStackSize), tid_(0) {}
+
+  bool Start(int (*fn)(void*), void* arg) {
+    const int flags = CLONE_VM | CLONE_FS | CLONE_FILES | CLONE_SIGHAND | CLONE_THREAD |
+                      CLONE_SYSVSEM | CLONE_PARENT_SETTID | CLONE_CHILD_CLEARTID;
+    if (stack_.top() == nullptr) {
+      return false;
+    }
+    return clone(fn, stack_.top(), flags, arg, &tid_, nullptr, &tid_) >= 0;
+  }
+
+  // The kernel clears tid_ and wakes it as the thread exits.
+  void Join() {
+    pid_t tid;
+    while ((tid = __atomic_load_n(&tid_, __ATOMIC_ACQUIRE)) != 0) {
+      syscall(SYS_futex, &tid_, FUTEX_WAIT, tid, nullptr, nullptr, 0);
+    }
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MarkWorker);
+  Stack stack_;
+  pid_t tid_;
+};
+#else
+class MarkWorker {
+ public:
+  MarkWorker() = default;
+
+  bool Start(int (*fn)(void*), void* arg) {
+    fn_ = fn;
+    arg_ = arg;
+    auto proxy = [](void* worker) -> void* {
+      auto self = reinterpret_cast<MarkWorker*>(worker);
+      self->fn_(self->arg_);
+      return nullptr;
+    };
+    errno = pthread_create(&thread_, nullptr, proxy, this);
+    return errno == 0;
+  }
+
+  void Join() { pthread_join(thread_, nullptr); }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(MarkWorker);
+  int (*fn_)(void*);
+  void* arg_;
+  pthread_t thread_;
+};
+#endif
 
-    ForEachPtrInRange(range, [&](Range& ref_range, AllocationInfo* ref_info) {
-      if (!ref_info->referenced_from_root) {
-        ref_info->referenced_from_root = true;
-        to_do.push_back(ref_range);
+struct HeapWalker::MarkState {
+  // Splits range at word aligned addresses, so the chunks hold the same words as the whole range.
+  void Push(size_t thread, const Range& range) {
+    uintptr_t begin = range.begin;
+    while (begin < range.end) {
+      uintptr_t aligned_begin = (begin + (sizeof(uintptr_t) - 1)) & ~(sizeof(uintptr_t) - 1);
+      uintptr_t end = range.end;
+      if (aligned_begin < range.end && range.end - aligned_begin > kMarkChunkSize) {
+        end = aligned_begin + kMarkChunkSize;
+      }
+      pending.fetch_add(1, std::memory_order_relaxed);
+      {
+        std::lock_guard<std::mutex> lk(stacks[thread]->lock);
+        stacks[thread]->ranges.push_back(Range{begin, end});
+      }
+      begin = end;
+    }
+  }
+
+  HeapWalker* walker;
+  MarkStack* stacks[kMaxMarkingThreads];
+  size_t num_threads;
+  // Ranges pushed and not scanned yet, marking is done once this drops to 0
+  std::atomic<size_t> pending;
+};
+
+std::atomic<size_t> HeapWalker::default_num_threads_;
+
+size_t HeapWalker::MarkingThreads() {
+  if (num_threads_ != 0) {
+    return std::min(num_threads_, kMaxMarkingThreads);
+  }
+  if (default_num_threads_ != 0) {
+    return std::min<size_t>(default_num_threads_, kMaxMarkingThreads);
+  }
+  // Each thread should have a good amount of the heap to scan to make up for starting it.
+  constexpr size_t kMinBytesPerThread = 16 * 1024 * 1024;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = cpus > 0 ? cpus : 1;
+  threads = std::min(threads, 1 + allocation_bytes_ / kMinBytesPerThread);
+  return std::min(threads, kMaxMarkingThreads);
+}
+
+void HeapWalker::Mark(const allocator::vector<Range>& roots) {
+  if (!index_valid_) {
+    BuildIndex();
+  }
+
+  allocator::list<MarkStack> stacks(allocator_);
+  MarkState state;
+  state.walker = this;
+  state.num_threads = MarkingThreads();
+  state.pending = 0;
+  for (size_t i = 0; i < state.num_threads; i++) {
+    stacks.emplace_back(allocator_);
+    state.stacks[i] = &stacks.back();
+  }
+
+  for (size_t i = 0; i < roots.size(); i++) {
+    state.Push(i % state.num_threads, roots[i]);
+  }
+
+  allocator::list<MarkWorker> workers(allocator_);
+  std::pair<MarkState*, size_t> args[kMaxMarkingThreads];
+  for (size_t i = 1; i < state.num_threads; i++) {
+    args[i] = std::make_pair(&state, i);
+    workers.emplace_back();
+    if (!workers.back().Start(MarkThreadMain, &args[i])) {
+      // The ranges on the stacks of threads that did not start get stolen by the others.
+      MEM_ALOGW("failed to start marking thread: %s", strerror(errno));
+      workers.pop_back();
+      break;
+    }
+  }
+
+  MarkThread(&state, 0);
+
+  for (auto& worker : workers) {
+    worker.Join();
+  }
+}
+
+int HeapWalker::MarkThreadMain(void* arg) {
+  auto args = reinterpret_cast<std::pair<MarkState*, size_t>*>(arg);
+  args->first->walker->MarkThread(args->first, args->second);
+  return 0;
+}
+
+void HeapWalker::MarkThread(MarkState* state, size_t thread) {
+  Range* walking_range = &walking_ranges_[thread];
+
+  for (;;) {
+    Range range;
+    bool found = false;
+    for (size_t i = 0; !found && i < state->num_threads; i++) {
+      found = state->stacks[(thread + i) % state->num_threads]->Pop(&range);
+    }
+    if (!found) {
+      if (state->pending.load(std::memory_order_acquire) == 0) {
+        return;
+      }
+      sched_yield();
+      continue;
+    }
+
+    ScanRange(range, walking_range, [&](Range& ref_range, AllocationInfo* ref_info) {
+      if (!__atomic_exchange_n(&ref_info->referenced_from_root, true, __ATOMIC_RELAXED)) {
+        state->Push(thread, ref_range);
       }
     });
+    state->pending.fetch_sub(1, std::memory_order_release);
   }
 }
 
@@ -102,16 +334,15 @@ size_t HeapWalker::AllocationBytes() {
 }
 
 bool HeapWalker::DetectLeaks() {
-  // Recursively walk pointers from roots to mark referenced allocations
-  for (auto it = roots_.begin(); it != roots_.end(); it++) {
-    RecurseRoot(*it);
-  }
+  // Walk pointers from roots to mark referenced allocations
+  allocator::vector<Range> roots(roots_);
 
   Range vals;
   vals.begin = reinterpret_cast<uintptr_t>(root_vals_.data());
   vals.end = vals.begin + root_vals_.size() * sizeof(uintptr_t);
+  roots.push_back(vals);
 
-  RecurseRoot(vals);
+  Mark(roots);
 
   return true;
 }
@@ -164,7 +395,8 @@ static bool MapOverPage(void* addr) {
 void HeapWalker::HandleSegFault(ScopedSignalHandler& handler, int signal, siginfo_t* si,
                                 void* /*uctx*/) {
   uintptr_t addr = reinterpret_cast<uintptr_t>(si->si_addr);
-  if (addr != walking_ptr_) {
+  if (std::none_of(std::begin(walking_ranges_), std::end(walking_ranges_),
+                   [addr](const Range& range) { return addr >= range.begin && addr < range.end; })) {
     handler.reset();
     return;
   }
@@ -19,6 +19,9 @@
 
 #include <signal.h>
 
+#include <algorithm>
+#include <atomic>
+
 #include "android-base/macros.h"
 
 #include "Allocator.h"
@@ -46,14 +49,22 @@ struct compare_range {
 
 class HeapWalker {
  public:
-  explicit HeapWalker(Allocator<HeapWalker> allocator)
+  // Allocations are marked on up to num_threads threads, the calling thread included.  If
+  // num_threads is 0 the number of threads is picked from the CPUs online and the heap size.
+  explicit HeapWalker(Allocator<HeapWalker> allocator, size_t num_threads = 0)
       : allocator_(allocator),
         allocations_(allocator),
         allocation_bytes_(0),
         roots_(allocator),
         root_vals_(allocator),
+        index_ranges_(allocator),
+        index_infos_(allocator),
+        index_buckets_(allocator),
+        index_bucket_shift_(0),
+        index_valid_(false),
+        num_threads_(num_threads),
         segv_handler_(allocator),
-        walking_ptr_(0) {
+        walking_ranges_() {
     valid_allocations_range_.end = 0;
     valid_allocations_range_.begin = ~valid_allocations_range_.end;
 
@@ -64,6 +75,11 @@ class HeapWalker {
   }
 
   ~HeapWalker() {}
+
+  // Overrides the number of threads picked when num_threads is 0, as for the HeapWalker of
+  // GetUnreachableMemory.  0 goes back to picking from the CPUs and the heap size.
+  static void SetDefaultMarkingThreads(size_t num_threads) { default_num_threads_ = num_threads; }
+
   bool Allocation(uintptr_t begin, uintptr_t end);
   void Root(uintptr_t begin, uintptr_t end);
   void Root(const allocator::vector<uintptr_t>& vals);
@@ -85,8 +101,19 @@ class HeapWalker {
   };
 
  private:
-  void RecurseRoot(const Range& root);
-  bool WordContainsAllocationPtr(uintptr_t ptr, Range* range, AllocationInfo** info);
+  static constexpr size_t kMaxMarkingThreads = 8;
+
+  struct MarkStack;
+  struct MarkState;
+
+  void BuildIndex();
+  bool WordContainsAllocationPtr(uintptr_t value, Range* range, AllocationInfo** info);
+  template <class F>
+  void ScanRange(const Range& range, Range* walking_range, F&& f);
+  size_t MarkingThreads();
+  void Mark(const allocator::vector<Range>& roots);
+  void MarkThread(MarkState* state, size_t thread);
+  static int MarkThreadMain(void* arg);
   void HandleSegFault(ScopedSignalHandler&, int, siginfo_t*, void*);
 
   DISALLOW_COPY_AND_ASSIGN(HeapWalker);
@@ -99,25 +126,82 @@ class HeapWalker {
   allocator::vector<Range> roots_;
   allocator::vector<uintptr_t> root_vals_;
 
+  // Sorted copy of allocations_ for looking up the allocation a word points into: the address
+  // range of all allocations is split into buckets of 1 << index_bucket_shift_ bytes, and
+  // index_buckets_ holds the first allocation that ends after the start of each bucket, so a
+  // lookup is a binary search over the few allocations of a single bucket.
+  allocator::vector<Range> index_ranges_;
+  allocator::vector<AllocationInfo*> index_infos_;
+  allocator::vector<uint32_t> index_buckets_;
+  size_t index_bucket_shift_;
+  bool index_valid_;
+
+  size_t num_threads_;
+  static std::atomic<size_t> default_num_threads_;
+
   ScopedSignalHandler segv_handler_;
-  uintptr_t walking_ptr_;
+  // The words each marking thread is reading, for HandleSegFault
+  Range walking_ranges_[kMaxMarkingThreads];
 };
 
 template <class F>
-inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
+inline void HeapWalker::ScanRange(const Range& range, Range* walking_range, F&& f) {
+  // Words are read a block at a time and only blocks holding a value within the address range
+  // of all allocations are looked up, which the compiler can turn into vector compares.
+  constexpr size_t kBlockWords = 8;
+  const uintptr_t heap_begin = valid_allocations_range_.begin;
+  const uintptr_t heap_size = valid_allocations_range_.end - heap_begin;
+  if (valid_allocations_range_.end <= heap_begin) {
+    return;
+  }
+
   uintptr_t begin = (range.begin + (sizeof(uintptr_t) - 1)) & ~(sizeof(uintptr_t) - 1);
   // TODO(ccross): we might need to consider a pointer to the end of a buffer
   // to be inside the buffer, which means the common case of a pointer to the
   // beginning of a buffer may keep two ranges live.
-  for (uintptr_t i = begin; i < range.end; i += sizeof(uintptr_t)) {
-    Range ref_range;
-    AllocationInfo* ref_info;
-    if (WordContainsAllocationPtr(i, &ref_range, &ref_info)) {
-      f(ref_range, ref_info);
+  for (uintptr_t i = begin; i < range.end;) {
+    size_t words = std::min<uintptr_t>(kBlockWords, (range.end - i + sizeof(uintptr_t) - 1) /
+                                                        sizeof(uintptr_t));
+    uintptr_t values[kBlockWords];
+    bool any_in_heap = false;
+
+    // These accesses may segfault if the process under test has done something strange,
+    // for example mprotect(PROT_NONE) on a native heap page.  If so, it will be
+    // caught and handled by mmaping a zero page over the faulting page.
+    *walking_range = Range{i, i + words * sizeof(uintptr_t)};
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    if (words == kBlockWords) {
+      for (size_t j = 0; j < kBlockWords; j++) {
+        values[j] = reinterpret_cast<const uintptr_t*>(i)[j];
+        any_in_heap |= values[j] - heap_begin < heap_size;
+      }
+    } else {
+      for (size_t j = 0; j < words; j++) {
+        values[j] = reinterpret_cast<const uintptr_t*>(i)[j];
+        any_in_heap |= values[j] - heap_begin < heap_size;
+      }
+    }
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    *walking_range = Range{0, 0};
+
+    if (any_in_heap) {
+      for (size_t j = 0; j < words; j++) {
+        Range ref_range;
+        AllocationInfo* ref_info;
+        if (WordContainsAllocationPtr(values[j], &ref_range, &ref_info)) {
+          f(ref_range, ref_info);
+        }
+      }
     }
+    i += words * sizeof(uintptr_t);
   }
 }
 
+template <class F>
+inline void HeapWalker::ForEachPtrInRange(const Range& range, F&& f) {
+  ScanRange(range, &walking_ranges_[0], f);
+}
+
 template <class F>
 inline void HeapWalker::ForEachAllocation(F&& f) {
   for (auto& it : allocations_) {
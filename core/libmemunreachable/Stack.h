@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBMEMUNREACHABLE_STACK_H_
+#define LIBMEMUNREACHABLE_STACK_H_
+
+#include <stdint.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "android-base/macros.h"
+
+#include "anon_vma_naming.h"
+
+namespace android {
+
+// Stack for a thread started with a raw clone(), between two guard pages.
+class Stack {
+ public:
+  explicit Stack(size_t size) : size_(size) {
+    int prot = PROT_READ | PROT_WRITE;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    page_size_ = sysconf(_SC_PAGE_SIZE);
+    size_ += page_size_ * 2;  // guard pages
+    base_ = mmap(NULL, size_, prot, flags, -1, 0);
+    if (base_ == MAP_FAILED) {
+      base_ = NULL;
+      size_ = 0;
+      return;
+    }
+    prctl(PR_SET_VMA, PR_SET_VMA_ANON_NAME, base_, size_, "libmemunreachable stack");
+    mprotect(base_, page_size_, PROT_NONE);
+    mprotect(top(), page_size_, PROT_NONE);
+  };
+  ~Stack() {
+    if (base_ != NULL) {
+      munmap(base_, size_);
+    }
+  };
+  // nullptr if the stack could not be mapped
+  void* top() {
+    if (base_ == NULL) {
+      return nullptr;
+    }
+    return reinterpret_cast<void*>(reinterpret_cast<uintptr_t>(base_) + size_ - page_size_);
+  };
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Stack);
+
+  void* base_;
+  size_t size_;
+  size_t page_size_;
+};
+
+}  // namespace android
+
+#endif  // LIBMEMUNREACHABLE_STACK_H_
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sys/mman.h>
+
+#include <random>
+
+#include <benchmark/benchmark.h>
+
+#include "Allocator.h"
+#include "HeapWalker.h"
+
+namespace android {
+
+// A synthetic heap of allocations between 16 and 1024 bytes.  Most words are small integers, one
+// in eight points into a random allocation, and a tenth of the allocations are referenced from
+// the root.
+class SyntheticHeap {
+ public:
+  explicit SyntheticHeap(size_t size) : size_(size), roots_(size / 1024) {
+    heap_ = reinterpret_cast<uintptr_t*>(
+        mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> words(2, 128);
+
+    const size_t heap_words = size_ / sizeof(uintptr_t);
+    for (size_t i = 0; i < heap_words;) {
+      size_t n = std::min(words(rng), heap_words - i);
+      allocations_.emplace_back(i, n);
+      i += n;
+    }
+
+    std::uniform_int_distribution<size_t> allocation(0, allocations_.size() - 1);
+    for (size_t i = 0; i < heap_words; i++) {
+      heap_[i] = i % 8 == 0 ? Address(allocations_[allocation(rng)].first) : i;
+    }
+    for (size_t i = 0; i < roots_.size(); i++) {
+      roots_[i] = Address(allocations_[allocation(rng)].first);
+    }
+  }
+
+  ~SyntheticHeap() { munmap(heap_, size_); }
+
+  void AddTo(HeapWalker* heap_walker) {
+    for (auto& it : allocations_) {
+      heap_walker->Allocation(Address(it.first), Address(it.first + it.second));
+    }
+    heap_walker->Root(reinterpret_cast<uintptr_t>(roots_.data()),
+                      reinterpret_cast<uintptr_t>(roots_.data() + roots_.size()));
+  }
+
+ private:
+  uintptr_t Address(size_t word) { return reinterpret_cast<uintptr_t>(&heap_[word]); }
+
+  size_t size_;
+  uintptr_t* heap_;
+  std::vector<std::pair<size_t, size_t>> allocations_;
+  std::vector<uintptr_t> roots_;
+};
+
+static void BM_DetectLeaks(benchmark::State& state) {
+  SyntheticHeap synthetic_heap(state.range(0) << 20);
+  Heap heap;
+
+  size_t bytes = 0;
+  while (state.KeepRunning()) {
+    HeapWalker heap_walker(heap, state.range(1));
+    synthetic_heap.AddTo(&heap_walker);
+    heap_walker.DetectLeaks();
+
+    allocator::vector<Range> leaked(heap);
+    size_t num_leaks = 0;
+    size_t leaked_bytes = 0;
+    heap_walker.Leaked(leaked, 0, &num_leaks, &leaked_bytes);
+    bytes += heap_walker.AllocationBytes() - leaked_bytes;
+  }
+  // Bytes of reachable allocations, each of which is scanned once
+  state.SetBytesProcessed(bytes);
+}
+
+BENCHMARK(BM_DetectLeaks)
+    ->ArgPair(16, 1)
+    ->ArgPair(16, 2)
+    ->ArgPair(16, 4)
+    ->ArgPair(64, 1)
+    ->ArgPair(64, 4)
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace android
+
+BENCHMARK_MAIN();
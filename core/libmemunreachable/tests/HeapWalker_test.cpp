@@ -178,6 +178,82 @@ TEST_F(HeapWalkerTest, cycle) {
   ASSERT_EQ(2U, leaked.size());
 }
 
+TEST_F(HeapWalkerTest, parallel_chain) {
+  // Each buffer points to the next one, so marking has to follow the chain through every thread's
+  // stack.
+  void* buffers[64][4]{};
+  for (size_t i = 0; i + 1 < 64; i++) {
+    buffers[i][i % 4] = &buffers[i + 1];
+  }
+  void* root = &buffers[0];
+  void* leaked1[4]{};
+  void* leaked2[4]{};
+  leaked1[0] = &leaked2;
+
+  HeapWalker heap_walker(heap_, 4);
+  for (size_t i = 0; i < 64; i++) {
+    heap_walker.Allocation(buffer_begin(buffers[i]), buffer_end(buffers[i]));
+  }
+  heap_walker.Allocation(buffer_begin(leaked1), buffer_end(leaked1));
+  heap_walker.Allocation(buffer_begin(leaked2), buffer_end(leaked2));
+  heap_walker.Root(buffer_begin(&root), buffer_end(&root));
+
+  ASSERT_EQ(true, heap_walker.DetectLeaks());
+
+  allocator::vector<Range> leaked(heap_);
+  size_t num_leaks = 0;
+  size_t leaked_bytes = 0;
+  ASSERT_EQ(true, heap_walker.Leaked(leaked, 100, &num_leaks, &leaked_bytes));
+
+  EXPECT_EQ(2U, num_leaks);
+  EXPECT_EQ(2 * sizeof(leaked1), leaked_bytes);
+  ASSERT_EQ(2U, leaked.size());
+}
+
+TEST_F(HeapWalkerTest, parallel_large_root) {
+  // A root larger than the chunks marking threads split ranges into, with a pointer to every
+  // other allocation.
+  const size_t page_size = sysconf(_SC_PAGE_SIZE);
+  const size_t root_size = 64 * page_size;
+  const size_t num_allocations = 1024;
+  uintptr_t* root = reinterpret_cast<uintptr_t*>(
+      mmap(NULL, root_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+  ASSERT_NE(MAP_FAILED, root);
+  uintptr_t* allocations = reinterpret_cast<uintptr_t*>(
+      mmap(NULL, num_allocations * 4 * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+           MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+  ASSERT_NE(MAP_FAILED, allocations);
+
+  HeapWalker heap_walker(heap_, 4);
+  for (size_t i = 0; i < num_allocations; i++) {
+    uintptr_t begin = reinterpret_cast<uintptr_t>(&allocations[i * 4]);
+    heap_walker.Allocation(begin, begin + 4 * sizeof(uintptr_t));
+    if (i % 2 == 0) {
+      // Spread out over the root, pointing into the middle of the allocation
+      root[i * (root_size / sizeof(uintptr_t) / num_allocations)] = begin + sizeof(uintptr_t);
+    }
+  }
+  heap_walker.Root(reinterpret_cast<uintptr_t>(root), reinterpret_cast<uintptr_t>(root) + root_size);
+
+  ASSERT_EQ(true, heap_walker.DetectLeaks());
+
+  allocator::vector<Range> leaked(heap_);
+  size_t num_leaks = 0;
+  size_t leaked_bytes = 0;
+  ASSERT_EQ(true, heap_walker.Leaked(leaked, num_allocations, &num_leaks, &leaked_bytes));
+
+  EXPECT_EQ(num_allocations / 2, num_leaks);
+  EXPECT_EQ(num_allocations / 2 * 4 * sizeof(uintptr_t), leaked_bytes);
+  ASSERT_EQ(num_allocations / 2, leaked.size());
+  for (auto& range : leaked) {
+    size_t i = (range.begin - reinterpret_cast<uintptr_t>(allocations)) / (4 * sizeof(uintptr_t));
+    EXPECT_EQ(1U, i % 2);
+  }
+
+  munmap(root, root_size);
+  munmap(allocations, num_allocations * 4 * sizeof(uintptr_t));
+}
+
 TEST_F(HeapWalkerTest, segv) {
   const size_t page_size = sysconf(_SC_PAGE_SIZE);
   void* buffer1 = mmap(NULL, page_size, PROT_NONE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
@@ -23,6 +23,7 @@
 
 #include <memunreachable/memunreachable.h>
 
+#include "HeapWalker.h"
 #include "bionic.h"
 
 namespace android {
@@ -60,6 +61,7 @@ class MemunreachableTest : public ::testing::Test {
   virtual void TearDown() {
     CleanStack(8192);
     CleanTcache();
+    HeapWalker::SetDefaultMarkingThreads(0);
   }
 
   // Allocate a buffer on the stack and zero it to make sure there are no
@@ -152,6 +154,45 @@ TEST_F(MemunreachableTest, global) {
   }
 }
 
+void** g_chain;
+
+TEST_F(MemunreachableTest, marking_threads) {
+  // A heap this small is marked on one thread unless told otherwise.
+  HeapWalker::SetDefaultMarkingThreads(4);
+
+  // Reachable only one link at a time, so marking it hands work between the threads.
+  void** prev = nullptr;
+  for (size_t i = 0; i < 1000; i++) {
+    void** link = reinterpret_cast<void**>(malloc(4 * sizeof(void*)));
+    link[0] = prev;
+    prev = link;
+  }
+  g_chain = prev;
+
+  HiddenPointer hidden_ptr;
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info));
+    ASSERT_EQ(1U, info.leaks.size());
+  }
+
+  hidden_ptr.Free();
+  while (g_chain != nullptr) {
+    void** link = g_chain;
+    g_chain = reinterpret_cast<void**>(link[0]);
+    free(link);
+  }
+
+  {
+    UnreachableMemoryInfo info;
+
+    ASSERT_TRUE(GetUnreachableMemory(info));
+    ASSERT_EQ(0U, info.leaks.size());
+  }
+}
+
 TEST_F(MemunreachableTest, tls) {
   HiddenPointer hidden_ptr;
   pthread_key_t key;
@@ -24,6 +24,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -40,7 +41,8 @@
 
 void usage()
 {
-    fprintf(stderr, "Usage: img2simg <raw_image_file> <sparse_image_file> [<block_size>]\n");
+    fprintf(stderr, "Usage: img2simg [-j <threads>] <raw_image_file> <sparse_image_file> [<block_size>]\n");
+    fprintf(stderr, "  -j <threads>  convert on this many threads, and report the throughput\n");
 }
 
 int main(int argc, char *argv[])
@@ -48,9 +50,30 @@ int main(int argc, char *argv[])
 	int in;
 	int out;
 	int ret;
+	int opt;
+	int threads = 0;
 	struct sparse_file *s;
 	unsigned int block_size = 4096;
 	off64_t len;
+	struct timeval start, end;
+	double secs;
+
+	while ((opt = getopt(argc, argv, "j:")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 1) {
+				usage();
+				exit(-1);
+			}
+			break;
+		default:
+			usage();
+			exit(-1);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	if (argc < 3 || argc > 4) {
 		usage();
@@ -86,6 +109,8 @@ int main(int argc, char *argv[])
 		}
 	}
 
+	gettimeofday(&start, NULL);
+
 	len = lseek64(in, 0, SEEK_END);
 	lseek64(in, 0, SEEK_SET);
 
@@ -96,6 +121,9 @@ int main(int argc, char *argv[])
 	}
 
 	sparse_file_verbose(s);
+	if (threads) {
+		sparse_file_set_threads(s, threads);
+	}
 	ret = sparse_file_read(s, in, false, false);
 	if (ret) {
 		fprintf(stderr, "Failed to read file\n");
@@ -111,5 +139,12 @@ int main(int argc, char *argv[])
 	close(in);
 	close(out);
 
+	if (threads) {
+		gettimeofday(&end, NULL);
+		secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		fprintf(stderr, "img2simg: %.1f MB in %.2f s (%.1f MB/s)\n",
+				len / 1e6, secs, secs > 0 ? len / 1e6 / secs : 0);
+	}
+
 	exit(0);
 }
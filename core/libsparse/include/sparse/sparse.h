@@ -294,6 +294,19 @@ int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
  */
 void sparse_file_verbose(struct sparse_file *s);
 
+/**
+ * sparse_file_set_threads - spread the work on a sparse file over threads
+ *
+ * @s - sparse file cookie
+ * @threads - number of threads to use
+ *
+ * Reads of raw images, and writes of the sparse file, use up to threads
+ * threads to look for fill blocks and to read and checksum chunk data.
+ * Chunks are still written in order, so the output is the same as with a
+ * single thread.  Has no effect on Windows.
+ */
+void sparse_file_set_threads(struct sparse_file *s, int threads);
+
 /**
  * sparse_print_verbose - function called to print verbose errors
  *
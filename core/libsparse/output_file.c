@@ -74,6 +74,10 @@ struct sparse_file_ops {
 			uint32_t fill_val);
 	int (*write_skip_chunk)(struct output_file *out, int64_t len);
 	int (*write_end_chunk)(struct output_file *out);
+	int (*write_data_chunk_begin)(struct output_file *out, unsigned int len);
+	int (*write_data_chunk_part)(struct output_file *out, void *data,
+			unsigned int len, uint32_t crc);
+	int (*write_data_chunk_end)(struct output_file *out, unsigned int len);
 };
 
 struct output_file {
@@ -405,16 +409,15 @@ static int write_sparse_fill_chunk(struct output_file *out, unsigned int len,
 	return 0;
 }
 
-static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
-		void *data)
+static int write_sparse_data_chunk_begin(struct output_file *out,
+		unsigned int len)
 {
 	chunk_header_t chunk_header;
-	int rnd_up_len, zero_len;
+	int rnd_up_len;
 	int ret;
 
 	/* Round up the data length to a multiple of the block size */
 	rnd_up_len = ALIGN(len, out->block_size);
-	zero_len = rnd_up_len - len;
 
 	/* Finally we can safely emit a chunk of data */
 	chunk_header.chunk_type = CHUNK_TYPE_RAW;
@@ -422,21 +425,41 @@ static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
 	chunk_header.chunk_sz = rnd_up_len / out->block_size;
 	chunk_header.total_sz = CHUNK_HEADER_LEN + rnd_up_len;
 	ret = out->ops->write(out, &chunk_header, sizeof(chunk_header));
-
 	if (ret < 0)
 		return -1;
+
+	return 0;
+}
+
+static int write_sparse_data_chunk_part(struct output_file *out, void *data,
+		unsigned int len, uint32_t crc)
+{
+	int ret;
+
 	ret = out->ops->write(out, data, len);
 	if (ret < 0)
 		return -1;
+
+	if (out->use_crc)
+		out->crc32 = sparse_crc32_combine(out->crc32, crc, len);
+
+	return 0;
+}
+
+static int write_sparse_data_chunk_end(struct output_file *out,
+		unsigned int len)
+{
+	int rnd_up_len, zero_len;
+	int ret;
+
+	rnd_up_len = ALIGN(len, out->block_size);
+	zero_len = rnd_up_len - len;
+
 	if (zero_len) {
 		ret = out->ops->write(out, out->zero_buf, zero_len);
 		if (ret < 0)
 			return -1;
-	}
-
-	if (out->use_crc) {
-		out->crc32 = sparse_crc32(out->crc32, data, len);
-		if (zero_len)
+		if (out->use_crc)
 			out->crc32 = sparse_crc32(out->crc32, out->zero_buf, zero_len);
 	}
 
@@ -446,6 +469,24 @@ static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
 	return 0;
 }
 
+static int write_sparse_data_chunk(struct output_file *out, unsigned int len,
+		void *data)
+{
+	int ret;
+
+	ret = write_sparse_data_chunk_begin(out, len);
+	if (ret < 0)
+		return -1;
+	ret = out->ops->write(out, data, len);
+	if (ret < 0)
+		return -1;
+
+	if (out->use_crc)
+		out->crc32 = sparse_crc32(out->crc32, data, len);
+
+	return write_sparse_data_chunk_end(out, len);
+}
+
 int write_sparse_end_chunk(struct output_file *out)
 {
 	chunk_header_t chunk_header;
@@ -477,24 +518,47 @@ static struct sparse_file_ops sparse_file_ops = {
 		.write_fill_chunk = write_sparse_fill_chunk,
 		.write_skip_chunk = write_sparse_skip_chunk,
 		.write_end_chunk = write_sparse_end_chunk,
+		.write_data_chunk_begin = write_sparse_data_chunk_begin,
+		.write_data_chunk_part = write_sparse_data_chunk_part,
+		.write_data_chunk_end = write_sparse_data_chunk_end,
 };
 
+static int write_normal_data_chunk_begin(struct output_file *out __unused,
+		unsigned int len __unused)
+{
+	return 0;
+}
+
+static int write_normal_data_chunk_part(struct output_file *out, void *data,
+		unsigned int len, uint32_t crc __unused)
+{
+	return out->ops->write(out, data, len);
+}
+
+static int write_normal_data_chunk_end(struct output_file *out,
+		unsigned int len)
+{
+	int ret = 0;
+	unsigned int rnd_up_len = ALIGN(len, out->block_size);
+
+	if (rnd_up_len > len) {
+		ret = out->ops->skip(out, rnd_up_len - len);
+	}
+
+	return ret;
+}
+
 static int write_normal_data_chunk(struct output_file *out, unsigned int len,
 		void *data)
 {
 	int ret;
-	unsigned int rnd_up_len = ALIGN(len, out->block_size);
 
 	ret = out->ops->write(out, data, len);
 	if (ret < 0) {
 		return ret;
 	}
 
-	if (rnd_up_len > len) {
-		ret = out->ops->skip(out, rnd_up_len - len);
-	}
-
-	return ret;
+	return write_normal_data_chunk_end(out, len);
 }
 
 static int write_normal_fill_chunk(struct output_file *out, unsigned int len,
@@ -537,6 +601,9 @@ static struct sparse_file_ops normal_file_ops = {
 		.write_fill_chunk = write_normal_fill_chunk,
 		.write_skip_chunk = write_normal_skip_chunk,
 		.write_end_chunk = write_normal_end_chunk,
+		.write_data_chunk_begin = write_normal_data_chunk_begin,
+		.write_data_chunk_part = write_normal_data_chunk_part,
+		.write_data_chunk_end = write_normal_data_chunk_end,
 };
 
 void output_file_close(struct output_file *out)
@@ -692,6 +759,27 @@ int write_data_chunk(struct output_file *out, unsigned int len, void *data)
 	return out->sparse_ops->write_data_chunk(out, len, data);
 }
 
+/*
+ * Write a contiguous region of data blocks in parts, for writers that read
+ * and checksum the data elsewhere.  The parts must add up to len, and crc
+ * is sparse_crc32(0, data, part_len) for each.
+ */
+int write_data_chunk_begin(struct output_file *out, unsigned int len)
+{
+	return out->sparse_ops->write_data_chunk_begin(out, len);
+}
+
+int write_data_chunk_part(struct output_file *out, void *data,
+		unsigned int len, uint32_t crc)
+{
+	return out->sparse_ops->write_data_chunk_part(out, data, len, crc);
+}
+
+int write_data_chunk_end(struct output_file *out, unsigned int len)
+{
+	return out->sparse_ops->write_data_chunk_end(out, len);
+}
+
 /* Write a contiguous region of data blocks with a fill value */
 int write_fill_chunk(struct output_file *out, unsigned int len,
 		uint32_t fill_val)
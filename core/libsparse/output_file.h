@@ -31,6 +31,10 @@ struct output_file *output_file_open_callback(int (*write)(void *, const void *,
 		void *priv, unsigned int block_size, int64_t len, int gz, int sparse,
 		int chunks, int crc);
 int write_data_chunk(struct output_file *out, unsigned int len, void *data);
+int write_data_chunk_begin(struct output_file *out, unsigned int len);
+int write_data_chunk_part(struct output_file *out, void *data,
+		unsigned int len, uint32_t crc);
+int write_data_chunk_end(struct output_file *out, unsigned int len);
 int write_fill_chunk(struct output_file *out, unsigned int len,
 		uint32_t fill_val);
 int write_file_chunk(struct output_file *out, unsigned int len,
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -32,7 +33,8 @@
 
 void usage()
 {
-  fprintf(stderr, "Usage: simg2img <sparse_image_files> <raw_image_file>\n");
+  fprintf(stderr, "Usage: simg2img [-j <threads>] <sparse_image_files> <raw_image_file>\n");
+  fprintf(stderr, "  -j <threads>  convert on this many threads, and report the throughput\n");
 }
 
 int main(int argc, char *argv[])
@@ -40,7 +42,29 @@ int main(int argc, char *argv[])
 	int in;
 	int out;
 	int i;
+	int opt;
+	int threads = 0;
 	struct sparse_file *s;
+	struct timeval start, end;
+	struct stat st;
+	double secs;
+
+	while ((opt = getopt(argc, argv, "j:")) != -1) {
+		switch (opt) {
+		case 'j':
+			threads = atoi(optarg);
+			if (threads < 1) {
+				usage();
+				exit(-1);
+			}
+			break;
+		default:
+			usage();
+			exit(-1);
+		}
+	}
+	argc -= optind - 1;
+	argv += optind - 1;
 
 	if (argc < 3) {
 		usage();
@@ -53,6 +77,8 @@ int main(int argc, char *argv[])
 		exit(-1);
 	}
 
+	gettimeofday(&start, NULL);
+
 	for (i = 1; i < argc - 1; i++) {
 		if (strcmp(argv[i], "-") == 0) {
 			in = STDIN_FILENO;
@@ -70,6 +96,10 @@ int main(int argc, char *argv[])
 			exit(-1);
 		}
 
+		if (threads) {
+			sparse_file_set_threads(s, threads);
+		}
+
 		if (lseek(out, 0, SEEK_SET) == -1) {
 			perror("lseek failed");
 			exit(EXIT_FAILURE);
@@ -83,6 +113,13 @@ int main(int argc, char *argv[])
 		close(in);
 	}
 
+	if (threads && fstat(out, &st) == 0) {
+		gettimeofday(&end, NULL);
+		secs = (end.tv_sec - start.tv_sec) + (end.tv_usec - start.tv_usec) / 1e6;
+		fprintf(stderr, "simg2img: %.1f MB in %.2f s (%.1f MB/s)\n",
+				st.st_size / 1e6, secs, secs > 0 ? st.st_size / 1e6 / secs : 0);
+	}
+
 	close(out);
 
 	exit(0);
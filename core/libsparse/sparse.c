@@ -14,8 +14,18 @@
  * limitations under the License.
  */
 
+#define _FILE_OFFSET_BITS 64
+#define _LARGEFILE64_SOURCE 1
+
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include <sparse/sparse.h>
 
@@ -24,6 +34,7 @@
 
 #include "output_file.h"
 #include "backed_block.h"
+#include "sparse_crc32.h"
 #include "sparse_defs.h"
 #include "sparse_format.h"
 
@@ -158,6 +169,273 @@ static int write_all_blocks(struct sparse_file *s, struct output_file *out)
 	return 0;
 }
 
+#ifndef _WIN32
+/* Chunk data is read and checksummed by the worker threads in parts this big */
+#define WRITE_PART_SIZE (1024 * 1024)
+
+struct write_part {
+	struct backed_block *bb;
+	unsigned int offset;
+	unsigned int len;
+	char *data;
+	char *buf;
+	uint32_t crc;
+	int ret;
+	bool ready;
+};
+
+struct parallel_write {
+	struct write_part *parts;
+	unsigned int count;
+	unsigned int next_read;
+	unsigned int next_write;
+	/* how far the workers may read ahead of the writer, in parts */
+	unsigned int window;
+	bool crc;
+	bool stop;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+};
+
+static int pread_all(int fd, void *buf, size_t len, int64_t offset)
+{
+	char *ptr = buf;
+	ssize_t ret;
+
+	while (len > 0) {
+		ret = pread(fd, ptr, len, offset);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return -errno;
+		}
+		if (ret == 0)
+			return -EINVAL;
+		ptr += ret;
+		len -= ret;
+		offset += ret;
+	}
+
+	return 0;
+}
+
+static int read_write_part(struct write_part *part, bool crc)
+{
+	struct backed_block *bb = part->bb;
+	int fd;
+	int ret = 0;
+
+	switch (backed_block_type(bb)) {
+	case BACKED_BLOCK_DATA:
+		part->data = (char *)backed_block_data(bb) + part->offset;
+		break;
+	case BACKED_BLOCK_FILE:
+	case BACKED_BLOCK_FD:
+		part->buf = malloc(part->len);
+		if (!part->buf)
+			return -ENOMEM;
+		part->data = part->buf;
+
+		if (backed_block_type(bb) == BACKED_BLOCK_FILE) {
+			fd = open(backed_block_filename(bb), O_RDONLY);
+			if (fd < 0)
+				return -errno;
+		} else {
+			fd = backed_block_fd(bb);
+		}
+		ret = pread_all(fd, part->buf, part->len,
+				backed_block_file_offset(bb) + part->offset);
+		if (backed_block_type(bb) == BACKED_BLOCK_FILE)
+			close(fd);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!ret && crc)
+		part->crc = sparse_crc32(0, part->data, part->len);
+
+	return ret;
+}
+
+static void *write_worker(void *priv)
+{
+	struct parallel_write *pw = priv;
+	struct write_part *part;
+
+	pthread_mutex_lock(&pw->lock);
+	while (!pw->stop && pw->next_read < pw->count) {
+		if (pw->next_read >= pw->next_write + pw->window) {
+			pthread_cond_wait(&pw->cond, &pw->lock);
+			continue;
+		}
+		part = &pw->parts[pw->next_read++];
+		pthread_mutex_unlock(&pw->lock);
+
+		part->ret = read_write_part(part, pw->crc);
+
+		pthread_mutex_lock(&pw->lock);
+		part->ready = true;
+		pthread_cond_broadcast(&pw->cond);
+	}
+	pthread_mutex_unlock(&pw->lock);
+
+	return NULL;
+}
+
+/* Writes the data chunk for bb from the parts the workers have read */
+static int write_parts(struct parallel_write *pw, struct output_file *out,
+		struct backed_block *bb)
+{
+	unsigned int len = backed_block_len(bb);
+	unsigned int done;
+	struct write_part *part;
+	int ret;
+
+	ret = write_data_chunk_begin(out, len);
+	if (ret < 0)
+		return ret;
+
+	for (done = 0; done < len; done += part->len) {
+		part = &pw->parts[pw->next_write];
+
+		pthread_mutex_lock(&pw->lock);
+		while (!part->ready)
+			pthread_cond_wait(&pw->cond, &pw->lock);
+		pthread_mutex_unlock(&pw->lock);
+
+		ret = part->ret;
+		if (!ret)
+			ret = write_data_chunk_part(out, part->data, part->len, part->crc);
+		free(part->buf);
+		part->buf = NULL;
+		if (ret < 0)
+			return ret;
+
+		pthread_mutex_lock(&pw->lock);
+		pw->next_write++;
+		pthread_cond_broadcast(&pw->cond);
+		pthread_mutex_unlock(&pw->lock);
+	}
+
+	return write_data_chunk_end(out, len);
+}
+
+/*
+ * Like write_all_blocks, but the data chunks are read and checksummed by
+ * worker threads, in parts so that large chunks are spread over them too.
+ * The chunks are written in order, and the checksums of the parts are
+ * combined, so the output is the same.
+ */
+static int write_all_blocks_threaded(struct sparse_file *s,
+		struct output_file *out, bool crc)
+{
+	struct parallel_write pw;
+	struct backed_block *bb;
+	pthread_t *threads;
+	unsigned int last_block = 0;
+	unsigned int offset;
+	unsigned int i;
+	int nthreads;
+	int64_t pad;
+	int ret = 0;
+
+	if (s->threads <= 1)
+		return write_all_blocks(s, out);
+
+	memset(&pw, 0, sizeof(pw));
+	for (bb = backed_block_iter_new(s->backed_block_list); bb;
+			bb = backed_block_iter_next(bb)) {
+		if (backed_block_type(bb) != BACKED_BLOCK_FILL)
+			pw.count += DIV_ROUND_UP(backed_block_len(bb), WRITE_PART_SIZE);
+	}
+
+	pw.parts = calloc(pw.count + 1, sizeof(struct write_part));
+	threads = calloc(s->threads, sizeof(pthread_t));
+	if (!pw.parts || !threads) {
+		free(pw.parts);
+		free(threads);
+		return -ENOMEM;
+	}
+
+	i = 0;
+	for (bb = backed_block_iter_new(s->backed_block_list); bb;
+			bb = backed_block_iter_next(bb)) {
+		if (backed_block_type(bb) == BACKED_BLOCK_FILL)
+			continue;
+		for (offset = 0; offset < backed_block_len(bb); offset += WRITE_PART_SIZE) {
+			pw.parts[i].bb = bb;
+			pw.parts[i].offset = offset;
+			pw.parts[i].len = backed_block_len(bb) - offset;
+			if (pw.parts[i].len > WRITE_PART_SIZE)
+				pw.parts[i].len = WRITE_PART_SIZE;
+			i++;
+		}
+	}
+
+	pw.window = s->threads * 4;
+	pw.crc = crc;
+	pthread_mutex_init(&pw.lock, NULL);
+	pthread_cond_init(&pw.cond, NULL);
+
+	for (nthreads = 0; nthreads < s->threads; nthreads++) {
+		if (pthread_create(&threads[nthreads], NULL, write_worker, &pw))
+			break;
+	}
+	if (nthreads == 0) {
+		ret = write_all_blocks(s, out);
+		goto out;
+	}
+
+	for (bb = backed_block_iter_new(s->backed_block_list); bb;
+			bb = backed_block_iter_next(bb)) {
+		if (backed_block_block(bb) > last_block) {
+			unsigned int blocks = backed_block_block(bb) - last_block;
+			write_skip_chunk(out, (int64_t)blocks * s->block_size);
+		}
+		if (backed_block_type(bb) == BACKED_BLOCK_FILL) {
+			ret = write_fill_chunk(out, backed_block_len(bb),
+					       backed_block_fill_val(bb));
+		} else {
+			ret = write_parts(&pw, out, bb);
+		}
+		if (ret)
+			goto out;
+		last_block = backed_block_block(bb) +
+				DIV_ROUND_UP(backed_block_len(bb), s->block_size);
+	}
+
+	pad = s->len - (int64_t)last_block * s->block_size;
+	assert(pad >= 0);
+	if (pad > 0) {
+		write_skip_chunk(out, pad);
+	}
+
+out:
+	pthread_mutex_lock(&pw.lock);
+	pw.stop = true;
+	pthread_cond_broadcast(&pw.cond);
+	pthread_mutex_unlock(&pw.lock);
+	while (nthreads--)
+		pthread_join(threads[nthreads], NULL);
+
+	for (i = 0; i < pw.count; i++)
+		free(pw.parts[i].buf);
+	pthread_cond_destroy(&pw.cond);
+	pthread_mutex_destroy(&pw.lock);
+	free(pw.parts);
+	free(threads);
+
+	return ret;
+}
+#else
+static int write_all_blocks_threaded(struct sparse_file *s,
+		struct output_file *out, bool crc __unused)
+{
+	return write_all_blocks(s, out);
+}
+#endif
+
 int sparse_file_write(struct sparse_file *s, int fd, bool gz, bool sparse,
 		bool crc)
 {
@@ -171,7 +449,7 @@ int sparse_file_write(struct sparse_file *s, int fd, bool gz, bool sparse,
 	if (!out)
 		return -ENOMEM;
 
-	ret = write_all_blocks(s, out);
+	ret = write_all_blocks_threaded(s, out, crc);
 
 	output_file_close(out);
 
@@ -192,7 +470,7 @@ int sparse_file_callback(struct sparse_file *s, bool sparse, bool crc,
 	if (!out)
 		return -ENOMEM;
 
-	ret = write_all_blocks(s, out);
+	ret = write_all_blocks_threaded(s, out, crc);
 
 	output_file_close(out);
 
@@ -393,3 +671,8 @@ void sparse_file_verbose(struct sparse_file *s)
 {
 	s->verbose = true;
 }
+
+void sparse_file_set_threads(struct sparse_file *s, int threads)
+{
+	s->threads = threads;
+}
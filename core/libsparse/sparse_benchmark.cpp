@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sparse_crc32.h"
+#include "sparse_fill.h"
+
+static std::vector<uint32_t> RandomBlock(size_t size) {
+  std::mt19937 rng(1);
+  std::vector<uint32_t> data(size / sizeof(uint32_t));
+  for (auto& word : data) {
+    word = rng();
+  }
+  return data;
+}
+
+static void BM_sparse_crc32(benchmark::State& state) {
+  std::vector<uint32_t> data = RandomBlock(state.range(0));
+  uint32_t crc = 0;
+  while (state.KeepRunning()) {
+    crc = sparse_crc32(crc, data.data(), state.range(0));
+  }
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sparse_crc32)->Arg(4096)->Arg(1024 * 1024);
+
+// A fill block has to be compared to the end.
+static void BM_sparse_fill_block_fill(benchmark::State& state) {
+  std::vector<uint32_t> data(state.range(0) / sizeof(uint32_t), 0x12345678);
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(sparse_fill_block(data.data(), state.range(0)));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sparse_fill_block_fill)->Arg(4096);
+
+// A data block that only differs in its last word.
+static void BM_sparse_fill_block_late_miss(benchmark::State& state) {
+  std::vector<uint32_t> data(state.range(0) / sizeof(uint32_t), 0x12345678);
+  data.back() = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(sparse_fill_block(data.data(), state.range(0)));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sparse_fill_block_late_miss)->Arg(4096);
+
+static void BM_sparse_fill_block_data(benchmark::State& state) {
+  std::vector<uint32_t> data = RandomBlock(state.range(0));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(sparse_fill_block(data.data(), state.range(0)));
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_sparse_fill_block_data)->Arg(4096);
+
+BENCHMARK_MAIN();
@@ -24,6 +24,7 @@ extern "C" {
 #endif
 
 uint32_t sparse_crc32(uint32_t crc, const void *buf, size_t size);
+uint32_t sparse_crc32_combine(uint32_t crc1, uint32_t crc2, int64_t len2);
 
 #ifdef __cplusplus
 }
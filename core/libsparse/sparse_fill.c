@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "sparse_fill.h"
+
+/*
+ * SSE2 and NEON are part of the x86_64 and arm64 baselines, so they are
+ * picked at build time.  The data is compared 64 bytes at a time, which
+ * still gives up after the first few bytes of a typical data block.
+ */
+bool sparse_fill_block(const uint32_t *buf, size_t len)
+{
+	size_t words = len / sizeof(uint32_t);
+	uint32_t val = buf[0];
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i fill = _mm_set1_epi32(val);
+	const __m128i *p = (const __m128i *)buf;
+
+	for (; i + 16 <= words; i += 16, p += 4) {
+		__m128i diff = _mm_or_si128(
+				_mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p), fill),
+						_mm_xor_si128(_mm_loadu_si128(p + 1), fill)),
+				_mm_or_si128(_mm_xor_si128(_mm_loadu_si128(p + 2), fill),
+						_mm_xor_si128(_mm_loadu_si128(p + 3), fill)));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xffff)
+			return false;
+	}
+#elif defined(__ARM_NEON)
+	const uint32x4_t fill = vdupq_n_u32(val);
+
+	for (; i + 16 <= words; i += 16) {
+		uint32x4_t diff = vorrq_u32(
+				vorrq_u32(veorq_u32(vld1q_u32(buf + i), fill),
+						veorq_u32(vld1q_u32(buf + i + 4), fill)),
+				vorrq_u32(veorq_u32(vld1q_u32(buf + i + 8), fill),
+						veorq_u32(vld1q_u32(buf + i + 12), fill)));
+		uint64x2_t diff64 = vreinterpretq_u64_u32(diff);
+		if (vgetq_lane_u64(diff64, 0) | vgetq_lane_u64(diff64, 1))
+			return false;
+	}
+#endif
+
+	for (; i < words; i++) {
+		if (buf[i] != val)
+			return false;
+	}
+
+	return true;
+}
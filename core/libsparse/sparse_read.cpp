@@ -18,6 +18,7 @@
 #define _LARGEFILE64_SOURCE 1
 
 #include <algorithm>
+#include <atomic>
 #include <inttypes.h>
 #include <fcntl.h>
 #include <stdarg.h>
@@ -26,7 +27,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <string>
+#include <thread>
 #include <unistd.h>
+#include <vector>
 
 #include <sparse/sparse.h>
 
@@ -35,6 +38,7 @@
 #include "output_file.h"
 #include "sparse_crc32.h"
 #include "sparse_file.h"
+#include "sparse_fill.h"
 #include "sparse_format.h"
 
 
@@ -329,17 +333,107 @@ static int sparse_file_read_sparse(struct sparse_file *s, int fd, bool crc)
 	return 0;
 }
 
+#ifndef _WIN32
+/*
+ * Like sparse_file_read_normal, with the blocks checked for fill values on
+ * s->threads threads.  The image is taken a batch at a time, the threads
+ * reading COPY_BUF_SIZE pieces of it, and the blocks are then added in order.
+ */
+static int sparse_file_read_normal_threaded(struct sparse_file *s, int fd)
+{
+	unsigned int piece_blocks = std::max(COPY_BUF_SIZE / s->block_size, (int64_t)1);
+	int64_t batch_size = (int64_t)piece_blocks * s->block_size * 256;
+	std::vector<uint32_t> fill_vals;
+	std::vector<uint8_t> fill_blocks;
+	int64_t offset;
+
+	for (offset = 0; offset < s->len; offset += batch_size) {
+		int64_t batch_len = std::min(s->len - offset, batch_size);
+		unsigned int blocks = DIV_ROUND_UP(batch_len, s->block_size);
+		unsigned int first_block = offset / s->block_size;
+		std::atomic<unsigned int> next_piece(0);
+		std::atomic<int> read_error(0);
+
+		fill_vals.resize(blocks);
+		fill_blocks.assign(blocks, false);
+
+		auto worker = [&]() {
+			std::vector<uint32_t> buf(piece_blocks * s->block_size / sizeof(uint32_t));
+			for (;;) {
+				unsigned int block = next_piece++ * piece_blocks;
+				if (block >= blocks || read_error) {
+					break;
+				}
+				int64_t pos = (int64_t)block * s->block_size;
+				int64_t len = std::min(batch_len - pos, (int64_t)piece_blocks * s->block_size);
+				char *ptr = reinterpret_cast<char *>(buf.data());
+				for (int64_t done = 0; done < len;) {
+					ssize_t ret = pread(fd, ptr + done, len - done, offset + pos + done);
+					if (ret < 0 && errno == EINTR) {
+						continue;
+					}
+					if (ret <= 0) {
+						read_error = ret < 0 ? -errno : -EINVAL;
+						return;
+					}
+					done += ret;
+				}
+				for (int64_t i = 0; i + s->block_size <= len; i += s->block_size) {
+					const uint32_t *b = reinterpret_cast<const uint32_t *>(ptr + i);
+					if (sparse_fill_block(b, s->block_size)) {
+						fill_vals[block + i / s->block_size] = b[0];
+						fill_blocks[block + i / s->block_size] = true;
+					}
+				}
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (int i = 1; i < s->threads; i++) {
+			threads.emplace_back(worker);
+		}
+		worker();
+		for (auto& thread : threads) {
+			thread.join();
+		}
+		if (read_error) {
+			error("failed to read sparse file");
+			return read_error;
+		}
+
+		for (unsigned int i = 0; i < blocks; i++) {
+			unsigned int len = std::min(batch_len - (int64_t)i * s->block_size,
+					(int64_t)s->block_size);
+			if (fill_blocks[i]) {
+				sparse_file_add_fill(s, fill_vals[i], len, first_block + i);
+			} else {
+				sparse_file_add_fd(s, fd, offset + (int64_t)i * s->block_size, len,
+						first_block + i);
+			}
+		}
+	}
+
+	return 0;
+}
+#endif
+
 static int sparse_file_read_normal(struct sparse_file *s, int fd)
 {
 	int ret;
-	uint32_t *buf = (uint32_t *)malloc(s->block_size);
+	uint32_t *buf;
 	unsigned int block = 0;
 	int64_t remain = s->len;
 	int64_t offset = 0;
 	unsigned int to_read;
-	unsigned int i;
 	bool sparse_block;
 
+#ifndef _WIN32
+	if (s->threads > 1) {
+		return sparse_file_read_normal_threaded(s, fd);
+	}
+#endif
+
+	buf = (uint32_t *)malloc(s->block_size);
 	if (!buf) {
 		return -ENOMEM;
 	}
@@ -354,13 +448,7 @@ static int sparse_file_read_normal(struct sparse_file *s, int fd)
 		}
 
 		if (to_read == s->block_size) {
-			sparse_block = true;
-			for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-				if (buf[0] != buf[i]) {
-					sparse_block = false;
-					break;
-				}
-			}
+			sparse_block = sparse_fill_block(buf, s->block_size);
 		} else {
 			sparse_block = false;
 		}
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/test_utils.h>
+#include <gtest/gtest.h>
+#include <sparse/sparse.h>
+#include <zlib.h>
+
+#include "sparse_crc32.h"
+#include "sparse_fill.h"
+
+// The byte at a time crc that sparse_crc32 used to be.
+static uint32_t ReferenceCrc32(uint32_t crc, const uint8_t* p, size_t size) {
+  static uint32_t table[256];
+  if (table[1] == 0) {
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t c = i;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? (c >> 1) ^ 0xedb88320 : c >> 1;
+      }
+      table[i] = c;
+    }
+  }
+  crc = ~crc;
+  while (size--) {
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static std::vector<uint8_t> RandomData(size_t size, unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<uint8_t> data(size);
+  for (auto& byte : data) {
+    byte = rng();
+  }
+  return data;
+}
+
+TEST(sparse_crc32, matches_reference) {
+  std::vector<uint8_t> data = RandomData(4096 + 64, 1);
+  // Every small length at every alignment, to cover the head and tail loops.
+  for (size_t offset = 0; offset < 8; offset++) {
+    for (size_t size = 0; size < 200; size++) {
+      ASSERT_EQ(ReferenceCrc32(0, &data[offset], size), sparse_crc32(0, &data[offset], size))
+          << "offset " << offset << " size " << size;
+    }
+  }
+  ASSERT_EQ(ReferenceCrc32(0, data.data(), 4096), sparse_crc32(0, data.data(), 4096));
+  ASSERT_EQ(ReferenceCrc32(0x12345678, &data[3], 4093), sparse_crc32(0x12345678, &data[3], 4093));
+}
+
+TEST(sparse_crc32, matches_zlib) {
+  std::vector<uint8_t> data = RandomData(1024 * 1024 + 13, 2);
+  ASSERT_EQ(crc32(0, data.data(), data.size()), sparse_crc32(0, data.data(), data.size()));
+
+  std::vector<uint8_t> zeros(4096);
+  ASSERT_EQ(crc32(0, zeros.data(), zeros.size()), sparse_crc32(0, zeros.data(), zeros.size()));
+}
+
+TEST(sparse_crc32, chained) {
+  std::vector<uint8_t> data = RandomData(10000, 3);
+  uint32_t crc = 0;
+  for (size_t done = 0, step = 1; done < data.size(); done += step, step = step * 3 + 1) {
+    step = std::min(step, data.size() - done);
+    crc = sparse_crc32(crc, &data[done], step);
+  }
+  ASSERT_EQ(ReferenceCrc32(0, data.data(), data.size()), crc);
+}
+
+TEST(sparse_crc32, combine) {
+  std::vector<uint8_t> data = RandomData(70000, 4);
+  uint32_t expected = ReferenceCrc32(0, data.data(), data.size());
+  for (size_t split : {size_t(0), size_t(1), size_t(7), size_t(4096), size_t(65536), data.size()}) {
+    uint32_t crc1 = sparse_crc32(0, data.data(), split);
+    uint32_t crc2 = sparse_crc32(0, &data[split], data.size() - split);
+    ASSERT_EQ(expected, sparse_crc32_combine(crc1, crc2, data.size() - split)) << "split " << split;
+  }
+}
+
+TEST(sparse_fill_block, fill) {
+  std::vector<uint32_t> block(1024, 0xdeadbeef);
+  ASSERT_TRUE(sparse_fill_block(block.data(), 4096));
+  std::fill(block.begin(), block.end(), 0);
+  ASSERT_TRUE(sparse_fill_block(block.data(), 4096));
+}
+
+TEST(sparse_fill_block, any_word_differs) {
+  std::vector<uint32_t> block(1024, 0x01020304);
+  for (size_t i = 1; i < block.size(); i++) {
+    block[i] = 0x01020305;
+    ASSERT_FALSE(sparse_fill_block(block.data(), 4096)) << "word " << i;
+    block[i] = 0x01020304;
+  }
+}
+
+TEST(sparse_fill_block, lengths) {
+  // Lengths that end inside and after a 64 byte stride, with the odd word
+  // in the scalar tail.
+  for (size_t words = 1; words < 40; words++) {
+    std::vector<uint32_t> block(words, 7);
+    ASSERT_TRUE(sparse_fill_block(block.data(), words * 4)) << "words " << words;
+    if (words > 1) {
+      block.back() = 8;
+      ASSERT_FALSE(sparse_fill_block(block.data(), words * 4)) << "words " << words;
+    }
+  }
+}
+
+TEST(sparse_fill_block, unaligned) {
+  std::vector<uint8_t> buffer(4096 + 8, 0xaa);
+  for (size_t offset = 0; offset < 8; offset += 4) {
+    const uint32_t* block = reinterpret_cast<const uint32_t*>(&buffer[offset]);
+    ASSERT_TRUE(sparse_fill_block(block, 4096));
+    buffer[offset + 4095] = 0xab;
+    ASSERT_FALSE(sparse_fill_block(block, 4096));
+    buffer[offset + 4095] = 0xaa;
+  }
+}
+
+// An image with every kind of chunk, the data carrying ones split over
+// several of the parts the threaded writer hands out, one of them not a
+// whole number of blocks.
+class SparseWriteThreadsTest : public ::testing::Test {
+ protected:
+  static constexpr unsigned int kBlockSize = 4096;
+  static constexpr unsigned int kPartSize = 1024 * 1024;
+
+  void SetUp() override {
+    data_ = RandomData(2 * kPartSize + kPartSize / 2, 5);
+    small_data_ = RandomData(5000, 6);
+    std::vector<uint8_t> contents = RandomData(kBlockSize + kPartSize + 2 * kBlockSize, 7);
+    ASSERT_TRUE(android::base::WriteFully(file_.fd, contents.data(), contents.size()));
+    contents = RandomData(3 * kPartSize, 8);
+    ASSERT_TRUE(android::base::WriteFully(fd_.fd, contents.data(), contents.size()));
+  }
+
+  struct sparse_file* NewImage(int threads) {
+    struct sparse_file* s = sparse_file_new(kBlockSize, 2200 * kBlockSize);
+    EXPECT_EQ(0, sparse_file_add_data(s, data_.data(), data_.size(), 0));
+    EXPECT_EQ(0, sparse_file_add_fill(s, 0xdeadbeef, 16 * kBlockSize, 700));
+    EXPECT_EQ(0, sparse_file_add_file(s, file_.path, kBlockSize, kPartSize + 2 * kBlockSize, 720));
+    EXPECT_EQ(0, sparse_file_add_fd(s, fd_.fd, 0, 3 * kPartSize, 1100));
+    EXPECT_EQ(0, sparse_file_add_data(s, small_data_.data(), small_data_.size(), 2000));
+    sparse_file_set_threads(s, threads);
+    return s;
+  }
+
+  std::string Write(int threads, bool gz, bool sparse, bool crc) {
+    struct sparse_file* s = NewImage(threads);
+    TemporaryFile out;
+    EXPECT_EQ(0, sparse_file_write(s, out.fd, gz, sparse, crc));
+    sparse_file_destroy(s);
+    std::string image;
+    EXPECT_TRUE(android::base::ReadFileToString(out.path, &image));
+    return image;
+  }
+
+  std::vector<uint8_t> data_;
+  std::vector<uint8_t> small_data_;
+  TemporaryFile file_;
+  TemporaryFile fd_;
+};
+
+TEST_F(SparseWriteThreadsTest, same_output) {
+  for (int gz = 0; gz < 2; gz++) {
+    for (int sparse = 0; sparse < 2; sparse++) {
+      for (int crc = 0; crc < 2; crc++) {
+        SCOPED_TRACE(::testing::Message() << "gz " << gz << " sparse " << sparse << " crc " << crc);
+        std::string expected = Write(1, gz, sparse, crc);
+        ASSERT_FALSE(expected.empty());
+        for (int threads : {2, 3, 8}) {
+          ASSERT_TRUE(expected == Write(threads, gz, sparse, crc)) << "threads " << threads;
+        }
+      }
+    }
+  }
+}
+
+TEST_F(SparseWriteThreadsTest, same_callback_output) {
+  auto append = [](void* priv, const void* data, int len) {
+    if (data == nullptr) {
+      reinterpret_cast<std::string*>(priv)->append(len, '\0');
+    } else {
+      reinterpret_cast<std::string*>(priv)->append(reinterpret_cast<const char*>(data), len);
+    }
+    return 0;
+  };
+  for (int crc = 0; crc < 2; crc++) {
+    std::string expected;
+    struct sparse_file* s = NewImage(1);
+    ASSERT_EQ(0, sparse_file_callback(s, true, crc, append, &expected));
+    sparse_file_destroy(s);
+
+    std::string image;
+    s = NewImage(4);
+    ASSERT_EQ(0, sparse_file_callback(s, true, crc, append, &image));
+    sparse_file_destroy(s);
+    ASSERT_TRUE(expected == image) << "crc " << crc;
+  }
+}
+
+TEST_F(SparseWriteThreadsTest, read_error) {
+  // The fd ends half way into the middle part of its chunk, the parts
+  // after it may or may not have been read by then. The single threaded
+  // writer maps the file and would fault instead.
+  ASSERT_EQ(0, ftruncate(fd_.fd, kPartSize + kPartSize / 2));
+  for (int threads : {2, 8}) {
+    struct sparse_file* s = NewImage(threads);
+    TemporaryFile out;
+    ASSERT_GT(0, sparse_file_write(s, out.fd, false, true, true)) << "threads " << threads;
+    sparse_file_destroy(s);
+  }
+}
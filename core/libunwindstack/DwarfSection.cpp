@@ -15,6 +15,9 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
@@ -119,6 +122,10 @@ struct EvalInfo {
   AddressType cfa;
   bool return_address_undefined = false;
   RegsInfo<AddressType> regs_info;
+  // The registers saved around the cfa, if they could be read at once.
+  const uint8_t* save_area = nullptr;
+  int64_t save_start = 0;
+  int64_t save_end = 0;
 };
 
 template <typename AddressType>
@@ -127,13 +134,20 @@ bool DwarfSectionImpl<AddressType>::EvalRegister(const DwarfLocation* loc, uint3
   EvalInfo<AddressType>* eval_info = reinterpret_cast<EvalInfo<AddressType>*>(info);
   Memory* regular_memory = eval_info->regular_memory;
   switch (loc->type) {
-    case DWARF_LOCATION_OFFSET:
+    case DWARF_LOCATION_OFFSET: {
+      int64_t offset = static_cast<int64_t>(loc->values[0]);
+      if (eval_info->save_area != nullptr && offset >= eval_info->save_start &&
+          offset + static_cast<int64_t>(sizeof(AddressType)) <= eval_info->save_end) {
+        memcpy(reg_ptr, &eval_info->save_area[offset - eval_info->save_start], sizeof(AddressType));
+        break;
+      }
       if (!regular_memory->ReadFully(eval_info->cfa + loc->values[0], reg_ptr, sizeof(AddressType))) {
         last_error_.code = DWARF_ERROR_MEMORY_INVALID;
         last_error_.address = eval_info->cfa + loc->values[0];
         return false;
       }
       break;
+    }
     case DWARF_LOCATION_VAL_OFFSET:
       *reg_ptr = eval_info->cfa + loc->values[0];
       break;
@@ -227,6 +241,18 @@ bool DwarfSectionImpl<AddressType>::Eval(const DwarfCie* cie, Memory* regular_me
       return false;
   }
 
+  // Fetch all the saved registers with one read. If that fails, one of
+  // them may still be readable, so fall back to reading them one by one.
+  uint8_t save_area[kMaxSaveAreaRegs * sizeof(AddressType)];
+  if (loc_regs.save_end > loc_regs.save_start &&
+      loc_regs.save_end - loc_regs.save_start <= static_cast<int64_t>(sizeof(save_area)) &&
+      regular_memory->ReadFully(eval_info.cfa + static_cast<uint64_t>(loc_regs.save_start),
+                                save_area, loc_regs.save_end - loc_regs.save_start)) {
+    eval_info.save_area = save_area;
+    eval_info.save_start = loc_regs.save_start;
+    eval_info.save_end = loc_regs.save_end;
+  }
+
   for (const auto& entry : loc_regs) {
     uint32_t reg = entry.first;
     // Already handled the CFA register.
@@ -578,9 +604,33 @@ bool DwarfSectionImpl<AddressType>::GetCfaLocationInfo(uint64_t pc, const DwarfF
     last_error_ = cfa.last_error();
     return false;
   }
+  SetSaveArea(loc_regs);
   return true;
 }
 
+template <typename AddressType>
+void DwarfSectionImpl<AddressType>::SetSaveArea(dwarf_loc_regs_t* loc_regs) {
+  int64_t start = INT64_MAX;
+  int64_t end = INT64_MIN;
+  for (const auto& entry : *loc_regs) {
+    if (entry.first == CFA_REG || entry.second.type != DWARF_LOCATION_OFFSET) {
+      continue;
+    }
+    int64_t offset = static_cast<int64_t>(entry.second.values[0]);
+    start = std::min(start, offset);
+    end = std::max(end, offset + static_cast<int64_t>(sizeof(AddressType)));
+  }
+
+  // Registers spread far apart are read individually.
+  if (start < end && end - start <= static_cast<int64_t>(kMaxSaveAreaRegs * sizeof(AddressType))) {
+    loc_regs->save_start = start;
+    loc_regs->save_end = end;
+  } else {
+    loc_regs->save_start = 0;
+    loc_regs->save_end = 0;
+  }
+}
+
 template <typename AddressType>
 bool DwarfSectionImpl<AddressType>::Log(uint8_t indent, uint64_t pc, uint64_t load_bias,
                                         const DwarfFde* fde) {
@@ -174,6 +174,13 @@ std::shared_ptr<Memory> Memory::CreateProcessMemory(pid_t pid) {
   return std::shared_ptr<Memory>(new MemoryRemote(pid));
 }
 
+std::shared_ptr<MemoryCache> Memory::CreateProcessMemoryCached(pid_t pid) {
+  if (pid == getpid()) {
+    return std::shared_ptr<MemoryCache>(new MemoryCache(new MemoryLocal(), false));
+  }
+  return std::shared_ptr<MemoryCache>(new MemoryCache(new MemoryRemote(pid)));
+}
+
 size_t MemoryBuffer::Read(uint64_t addr, void* dst, size_t size) {
   if (addr >= raw_.size()) {
     return 0;
@@ -289,6 +296,66 @@ size_t MemoryRemote::Read(uint64_t addr, void* dst, size_t size) {
   }
 }
 
+// Copies size bytes at offset into the page, reading it in first if need
+// be. Pages are only touched under the lock, so that Clear() can free them.
+bool MemoryCache::CopyFromPage(uint64_t page, size_t offset, uint8_t* dst, size_t size) {
+  {
+    std::lock_guard<std::mutex> guard(lock_);
+    auto entry = pages_.find(page);
+    if (entry != pages_.end()) {
+      memcpy(dst, &entry->second[offset], size);
+      return true;
+    }
+    if (bad_pages_.count(page) != 0) {
+      return false;
+    }
+  }
+
+  // Don't hold the lock over the read, other threads may be hitting the cache.
+  std::unique_ptr<uint8_t[]> data(new uint8_t[kPageSize]);
+  bool read = impl_->ReadFully(page << kPageBits, data.get(), kPageSize);
+
+  std::lock_guard<std::mutex> guard(lock_);
+  if (!read) {
+    bad_pages_.insert(page);
+    return false;
+  }
+  // Another thread may have read the same page meanwhile, keep the first.
+  auto entry = pages_.emplace(page, std::move(data));
+  memcpy(dst, &entry.first->second[offset], size);
+  return true;
+}
+
+size_t MemoryCache::Read(uint64_t addr, void* dst, size_t size) {
+  // Large reads gain nothing from the cache either.
+  if (!cached_ || size > kPageSize) {
+    return impl_->Read(addr, dst, size);
+  }
+
+  uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+  size_t bytes_read = 0;
+  while (bytes_read < size) {
+    uint64_t cur;
+    if (__builtin_add_overflow(addr, bytes_read, &cur)) {
+      break;
+    }
+    size_t offset = cur & kPageMask;
+    size_t len = std::min(kPageSize - offset, size - bytes_read);
+    if (!CopyFromPage(cur >> kPageBits, offset, &out[bytes_read], len)) {
+      // Part of the page may still be readable.
+      return bytes_read + impl_->Read(cur, &out[bytes_read], size - bytes_read);
+    }
+    bytes_read += len;
+  }
+  return bytes_read;
+}
+
+void MemoryCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  pages_.clear();
+  bad_pages_.clear();
+}
+
 size_t MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
   return ProcessVmRead(getpid(), addr, dst, size);
 }
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/ptrace.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <android-base/parseint.h>
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+constexpr size_t kTargetThreads = 16;
+constexpr size_t kTargetDepth = 24;
+
+// Counts the reads that reach the process, each is at least one syscall.
+class MemoryCounting : public Memory {
+ public:
+  MemoryCounting(Memory* memory) : impl_(memory) {}
+  virtual ~MemoryCounting() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    reads_++;
+    return impl_->Read(addr, dst, size);
+  }
+
+  uint64_t reads() { return reads_; }
+
+ private:
+  std::unique_ptr<Memory> impl_;
+  std::atomic_uint64_t reads_{0};
+};
+
+extern "C" __attribute__((noinline)) void TargetRecurse(size_t depth) {
+  if (depth == 0) {
+    while (true) {
+    }
+  }
+  TargetRecurse(depth - 1);
+  // Keep the call from being turned into a jump.
+  asm volatile("" ::: "memory");
+}
+
+static bool AttachAll(pid_t pid, std::vector<pid_t>* tids) {
+  // Wait for the threads to have started, then attach to each.
+  for (size_t i = 0; i < 5000; i++) {
+    DIR* dir = opendir(("/proc/" + std::to_string(pid) + "/task").c_str());
+    if (dir == nullptr) {
+      return false;
+    }
+    tids->clear();
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+      pid_t tid;
+      if (android::base::ParseInt(entry->d_name, &tid)) {
+        tids->push_back(tid);
+      }
+    }
+    closedir(dir);
+    if (tids->size() == kTargetThreads + 1) {
+      break;
+    }
+    usleep(1000);
+  }
+  // Give the threads time to reach the bottom of their stacks.
+  usleep(100000);
+
+  for (pid_t tid : *tids) {
+    if (ptrace(PTRACE_ATTACH, tid, 0, 0) == -1 || waitpid(tid, nullptr, __WALL) != tid) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Unwinds all threads of a process blocked kTargetDepth frames deep.
+// Args are whether the process memory goes through a MemoryCache, and the
+// number of threads to unwind with, all sharing the process memory.
+static void BM_remote_unwind_all_threads(benchmark::State& state) {
+  const bool cached = state.range(0) != 0;
+  const size_t unwinders = state.range(1);
+
+  pid_t pid = fork();
+  if (pid == 0) {
+    for (size_t i = 0; i < kTargetThreads; i++) {
+      std::thread([]() { TargetRecurse(kTargetDepth); }).detach();
+    }
+    TargetRecurse(kTargetDepth);
+    _exit(1);
+  }
+
+  std::vector<pid_t> tids;
+  if (!AttachAll(pid, &tids)) {
+    state.SkipWithError("Failed to attach to all threads.");
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    return;
+  }
+
+  RemoteMaps maps(pid);
+  maps.Parse();
+  MemoryCounting* counting = new MemoryCounting(new MemoryRemote(pid));
+  MemoryCache* cache = nullptr;
+  std::shared_ptr<Memory> process_memory;
+  if (cached) {
+    cache = new MemoryCache(counting);
+    process_memory.reset(cache);
+  } else {
+    process_memory.reset(counting);
+  }
+
+  // Registers can only be fetched by the tracing thread.
+  std::vector<std::unique_ptr<Regs>> regs;
+  for (pid_t tid : tids) {
+    regs.emplace_back(Regs::RemoteGet(tid));
+  }
+
+  std::atomic_bool truncated(false);
+  auto unwind = [&](size_t first, size_t stride) {
+    for (size_t i = first; i < regs.size(); i += stride) {
+      std::unique_ptr<Regs> thread_regs(regs[i]->Clone());
+      Unwinder unwinder(64, &maps, thread_regs.get(), process_memory);
+      unwinder.Unwind();
+      if (unwinder.NumFrames() < kTargetDepth) {
+        truncated = true;
+      }
+    }
+  };
+
+  // Unwind once to load every Elf, so that only the unwinds are measured.
+  unwind(0, 1);
+  uint64_t reads_before = counting->reads();
+  while (state.KeepRunning()) {
+    // A new unwind session, the process is stopped throughout.
+    if (cache != nullptr) {
+      cache->Clear();
+    }
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < unwinders; i++) {
+      threads.emplace_back(unwind, i, unwinders);
+    }
+    unwind(0, unwinders);
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  if (truncated) {
+    state.SkipWithError("Unwind was truncated.");
+  }
+  state.counters["syscalls_per_unwind"] =
+      static_cast<double>(counting->reads() - reads_before) / (state.iterations() * regs.size());
+
+  for (pid_t tid : tids) {
+    ptrace(PTRACE_DETACH, tid, 0, 0);
+  }
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+}
+BENCHMARK(BM_remote_unwind_all_threads)
+    ->Args({0, 1})
+    ->Args({1, 1})
+    ->Args({0, 4})
+    ->Args({1, 4})
+    ->UseRealTime();
+
+}  // namespace unwindstack
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <memory>
+
+#include <benchmark/benchmark.h>
+
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/Regs.h>
+#include <unwindstack/RegsGetLocal.h>
+#include <unwindstack/Unwinder.h>
+
+namespace unwindstack {
+
+// Unwinds the same stack over and over, as a sampling profiler sees the
+// same hot PCs again and again. Items processed are unwinds.
+static void UnwindRepeatedly(benchmark::State& state) {
+  LocalMaps maps;
+  if (!maps.Parse()) {
+    state.SkipWithError("Failed to parse local maps.");
+    return;
+  }
+  std::shared_ptr<Memory> process_memory(new MemoryLocal());
+  std::unique_ptr<Regs> regs(Regs::CreateFromLocal());
+
+  size_t frames = 0;
+  while (state.KeepRunning()) {
+    RegsGetLocal(regs.get());
+    Unwinder unwinder(128, &maps, regs.get(), process_memory);
+    unwinder.Unwind();
+    frames += unwinder.NumFrames();
+  }
+  state.SetItemsProcessed(state.iterations());
+  state.counters["frames"] = state.iterations() ? frames / state.iterations() : 0;
+}
+
+extern "C" __attribute__((noinline)) void UnwindAtDepth(benchmark::State& state, size_t depth) {
+  if (depth == 0) {
+    UnwindRepeatedly(state);
+  } else {
+    UnwindAtDepth(state, depth - 1);
+  }
+  // Keep the call from being turned into a jump.
+  asm volatile("" ::: "memory");
+}
+
+static void BM_local_unwind(benchmark::State& state) {
+  UnwindAtDepth(state, state.range(0));
+}
+BENCHMARK(BM_local_unwind)->Arg(8)->Arg(32)->Arg(96);
+
+}  // namespace unwindstack
+
+BENCHMARK_MAIN();
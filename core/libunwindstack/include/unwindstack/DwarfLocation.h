@@ -45,6 +45,11 @@ struct DwarfLocations : public std::unordered_map<uint32_t, DwarfLocation> {
   // The range of PCs where the locations are valid (end is exclusive).
   uint64_t pc_start = 0;
   uint64_t pc_end = 0;
+  // The range of CFA offsets holding the registers saved by
+  // DWARF_LOCATION_OFFSET rules (end is exclusive), so that they can all
+  // be read at once. Empty unless filled in by GetCfaLocationInfo.
+  int64_t save_start = 0;
+  int64_t save_end = 0;
 };
 typedef DwarfLocations dwarf_loc_regs_t;
 
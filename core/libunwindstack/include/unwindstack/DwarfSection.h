@@ -152,10 +152,15 @@ class DwarfSectionImpl : public DwarfSection {
 
   bool Log(uint8_t indent, uint64_t pc, uint64_t load_bias, const DwarfFde* fde) override;
 
+  // The largest save area read in one go, in registers.
+  static constexpr size_t kMaxSaveAreaRegs = 32;
+
  protected:
   bool EvalExpression(const DwarfLocation& loc, Memory* regular_memory, AddressType* value,
                       RegsInfo<AddressType>* regs_info, bool* is_dex_pc);
 
+  void SetSaveArea(dwarf_loc_regs_t* loc_regs);
+
   bool GetCieInfo(uint8_t* segment_size, uint8_t* encoding);
 
   bool AddFdeInfo(uint64_t entry_offset, uint8_t segment_size, uint8_t encoding);
@@ -23,17 +23,27 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace unwindstack {
 
+class MemoryCache;
+
 class Memory {
  public:
   Memory() = default;
   virtual ~Memory() = default;
 
   static std::shared_ptr<Memory> CreateProcessMemory(pid_t pid);
+  // As CreateProcessMemory, wrapped in a MemoryCache. The caller must Clear()
+  // it whenever the process may have run since the last unwind. The memory
+  // of the calling process changes under the unwinder, for it the cache
+  // reads straight through and Clear() does nothing.
+  static std::shared_ptr<MemoryCache> CreateProcessMemoryCached(pid_t pid);
 
   virtual bool ReadString(uint64_t addr, std::string* string, uint64_t max_read = UINT64_MAX);
 
@@ -112,6 +122,37 @@ class MemoryRemote : public Memory {
   std::atomic_uintptr_t read_redirect_func_;
 };
 
+// MemoryCache keeps the pages read through another Memory, so that the
+// many small reads of an unwind cost one read of each page touched. It is
+// safe to share between threads, for example to unwind all the threads of
+// a stopped process. Nothing is ever invalidated implicitly, Clear() must
+// be called before the memory of the process is read again after it ran.
+// Clear() may race with reads, which then see either old or new contents.
+// A MemoryCache constructed with cached false only reads through.
+class MemoryCache : public Memory {
+ public:
+  explicit MemoryCache(Memory* memory, bool cached = true) : impl_(memory), cached_(cached) {}
+  virtual ~MemoryCache() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override;
+
+  void Clear();
+
+ private:
+  static constexpr size_t kPageBits = 12;
+  static constexpr size_t kPageSize = 1 << kPageBits;
+  static constexpr size_t kPageMask = kPageSize - 1;
+
+  bool CopyFromPage(uint64_t page, size_t offset, uint8_t* dst, size_t size);
+
+  std::unique_ptr<Memory> impl_;
+  const bool cached_;
+  std::mutex lock_;
+  std::unordered_map<uint64_t, std::unique_ptr<uint8_t[]>> pages_;
+  // Pages that could not be read whole, read through every time.
+  std::unordered_set<uint64_t> bad_pages_;
+};
+
 class MemoryLocal : public Memory {
  public:
   MemoryLocal() = default;
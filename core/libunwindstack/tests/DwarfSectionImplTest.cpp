@@ -487,6 +487,56 @@ TYPED_TEST_P(DwarfSectionImplTest, Eval_reg_val_expr) {
   EXPECT_EQ(0x80000000U, regs.pc());
 }
 
+TYPED_TEST_P(DwarfSectionImplTest, Eval_save_area) {
+  DwarfCie cie{.version = 3, .return_address_register = 5};
+  RegsImplFake<TypeParam> regs(10);
+  dwarf_loc_regs_t loc_regs;
+
+  regs.set_pc(0x100);
+  regs.set_sp(0x2000);
+  regs[8] = 0x3000;
+  TypeParam saved[3] = {0x10, 0x20, 0x30};
+  this->memory_.SetMemory(0x3000 - sizeof(saved), saved, sizeof(saved));
+  loc_regs[CFA_REG] = DwarfLocation{DWARF_LOCATION_REGISTER, {8, 0}};
+  loc_regs[1] = DwarfLocation{DWARF_LOCATION_OFFSET, {static_cast<uint64_t>(-3 * sizeof(TypeParam)), 0}};
+  loc_regs[2] = DwarfLocation{DWARF_LOCATION_OFFSET, {static_cast<uint64_t>(-2 * sizeof(TypeParam)), 0}};
+  loc_regs[5] = DwarfLocation{DWARF_LOCATION_OFFSET, {static_cast<uint64_t>(-1 * sizeof(TypeParam)), 0}};
+  loc_regs.save_start = -3 * static_cast<int64_t>(sizeof(TypeParam));
+  loc_regs.save_end = 0;
+  bool finished;
+  ASSERT_TRUE(this->section_->Eval(&cie, &this->memory_, loc_regs, &regs, &finished));
+  EXPECT_FALSE(finished);
+  EXPECT_EQ(0x3000U, regs.sp());
+  EXPECT_EQ(0x10U, regs[1]);
+  EXPECT_EQ(0x20U, regs[2]);
+  EXPECT_EQ(0x30U, regs.pc());
+}
+
+TYPED_TEST_P(DwarfSectionImplTest, Eval_save_area_unreadable) {
+  DwarfCie cie{.version = 3, .return_address_register = 5};
+  RegsImplFake<TypeParam> regs(10);
+  dwarf_loc_regs_t loc_regs;
+
+  regs.set_pc(0x100);
+  regs.set_sp(0x2000);
+  regs[8] = 0x3000;
+  // Only the saved registers are readable, not the memory between them.
+  TypeParam value = 0x10;
+  this->memory_.SetMemory(0x3000, &value, sizeof(value));
+  value = 0x30;
+  this->memory_.SetMemory(0x3000 + 4 * sizeof(TypeParam), &value, sizeof(value));
+  loc_regs[CFA_REG] = DwarfLocation{DWARF_LOCATION_REGISTER, {8, 0}};
+  loc_regs[1] = DwarfLocation{DWARF_LOCATION_OFFSET, {0, 0}};
+  loc_regs[5] = DwarfLocation{DWARF_LOCATION_OFFSET, {4 * sizeof(TypeParam), 0}};
+  loc_regs.save_start = 0;
+  loc_regs.save_end = 5 * sizeof(TypeParam);
+  bool finished;
+  ASSERT_TRUE(this->section_->Eval(&cie, &this->memory_, loc_regs, &regs, &finished));
+  EXPECT_FALSE(finished);
+  EXPECT_EQ(0x10U, regs[1]);
+  EXPECT_EQ(0x30U, regs.pc());
+}
+
 TYPED_TEST_P(DwarfSectionImplTest, GetCie_fail_should_not_cache) {
   ASSERT_TRUE(this->section_->GetCie(0x4000) == nullptr);
   EXPECT_EQ(DWARF_ERROR_MEMORY_INVALID, this->section_->LastErrorCode());
@@ -873,6 +923,36 @@ TYPED_TEST_P(DwarfSectionImplTest, GetCfaLocationInfo_cie_cached) {
   ASSERT_EQ(3U, entry->second.values[0]);
 }
 
+TYPED_TEST_P(DwarfSectionImplTest, GetCfaLocationInfo_save_area) {
+  DwarfCie cie{};
+  cie.cfa_instructions_offset = 0x3000;
+  cie.cfa_instructions_end = 0x3000;
+  cie.data_alignment_factor = -static_cast<int64_t>(sizeof(TypeParam));
+  DwarfFde fde{};
+  fde.cie = &cie;
+  fde.cie_offset = 0x8000;
+  fde.cfa_instructions_offset = 0x6000;
+  fde.cfa_instructions_end = 0x6007;
+
+  // DW_CFA_def_cfa r7 + 16, DW_CFA_offset r2 at cfa-2, DW_CFA_offset r5 at cfa-4.
+  this->memory_.SetMemory(0x6000, std::vector<uint8_t>{0x0c, 0x07, 0x10, 0x82, 0x02, 0x85, 0x04});
+
+  dwarf_loc_regs_t loc_regs;
+  ASSERT_TRUE(this->section_->GetCfaLocationInfo(0x100, &fde, &loc_regs));
+  ASSERT_EQ(3U, loc_regs.size());
+  EXPECT_EQ(-4 * static_cast<int64_t>(sizeof(TypeParam)), loc_regs.save_start);
+  EXPECT_EQ(-1 * static_cast<int64_t>(sizeof(TypeParam)), loc_regs.save_end);
+
+  // Registers saved too far apart are read one by one.
+  fde.cfa_instructions_end = 0x6008;
+  this->memory_.SetMemory(0x6000, std::vector<uint8_t>{0x0c, 0x07, 0x10, 0x82, 0x02, 0x85, 0x80, 0x02});
+  loc_regs.clear();
+  ASSERT_TRUE(this->section_->GetCfaLocationInfo(0x100, &fde, &loc_regs));
+  ASSERT_EQ(3U, loc_regs.size());
+  EXPECT_EQ(0, loc_regs.save_start);
+  EXPECT_EQ(0, loc_regs.save_end);
+}
+
 TYPED_TEST_P(DwarfSectionImplTest, Log) {
   DwarfCie cie{};
   cie.cfa_instructions_offset = 0x5000;
@@ -901,12 +981,13 @@ REGISTER_TYPED_TEST_CASE_P(
     Eval_cfa_bad, Eval_cfa_register_prev, Eval_cfa_register_from_value, Eval_double_indirection,
     Eval_register_reference_chain, Eval_dex_pc, Eval_invalid_register, Eval_different_reg_locations,
     Eval_return_address_undefined, Eval_pc_zero, Eval_return_address, Eval_ignore_large_reg_loc,
-    Eval_reg_expr, Eval_reg_val_expr, GetCie_fail_should_not_cache, GetCie_32_version_check,
+    Eval_reg_expr, Eval_reg_val_expr, Eval_save_area, Eval_save_area_unreadable,
+    GetCie_fail_should_not_cache, GetCie_32_version_check,
     GetCie_negative_data_alignment_factor, GetCie_64_no_augment, GetCie_augment, GetCie_version_3,
     GetCie_version_4, GetFdeFromOffset_fail_should_not_cache, GetFdeFromOffset_32_no_augment,
     GetFdeFromOffset_32_no_augment_non_zero_segment_size, GetFdeFromOffset_32_augment,
     GetFdeFromOffset_64_no_augment, GetFdeFromOffset_cached, GetCfaLocationInfo_cie_not_cached,
-    GetCfaLocationInfo_cie_cached, Log);
+    GetCfaLocationInfo_cie_cached, GetCfaLocationInfo_save_area, Log);
 
 typedef ::testing::Types<uint32_t, uint64_t> DwarfSectionImplTestTypes;
 INSTANTIATE_TYPED_TEST_CASE_P(, DwarfSectionImplTest, DwarfSectionImplTestTypes);
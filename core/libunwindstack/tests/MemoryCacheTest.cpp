@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/Memory.h>
+
+#include "MemoryFake.h"
+
+namespace unwindstack {
+
+class MemoryCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    memory_ = new MemoryFake;
+    memory_cache_.reset(new MemoryCache(memory_));
+
+    std::vector<uint8_t> page(4096);
+    memset(page.data(), 0x4c, page.size());
+    memory_->SetMemory(0x10000, page);
+    memset(page.data(), 0x5d, page.size());
+    memory_->SetMemory(0x11000, page);
+  }
+
+  MemoryFake* memory_;
+  std::unique_ptr<MemoryCache> memory_cache_;
+};
+
+TEST_F(MemoryCacheTest, read) {
+  uint32_t value;
+  ASSERT_TRUE(memory_cache_->Read32(0x10100, &value));
+  ASSERT_EQ(0x4c4c4c4cU, value);
+
+  // The whole page was cached, later changes are not seen.
+  memory_->SetData32(0x10100, 0x12345678);
+  memory_->SetData32(0x10200, 0x12345678);
+  ASSERT_TRUE(memory_cache_->Read32(0x10100, &value));
+  ASSERT_EQ(0x4c4c4c4cU, value);
+  ASSERT_TRUE(memory_cache_->Read32(0x10200, &value));
+  ASSERT_EQ(0x4c4c4c4cU, value);
+
+  memory_cache_->Clear();
+  ASSERT_TRUE(memory_cache_->Read32(0x10100, &value));
+  ASSERT_EQ(0x12345678U, value);
+}
+
+TEST_F(MemoryCacheTest, read_across_pages) {
+  std::vector<uint8_t> dst(16);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x10ff8, dst.data(), dst.size()));
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(0x4cU, dst[i]) << "Failed at byte " << i;
+  }
+  for (size_t i = 8; i < 16; i++) {
+    ASSERT_EQ(0x5dU, dst[i]) << "Failed at byte " << i;
+  }
+}
+
+TEST_F(MemoryCacheTest, read_partial_page) {
+  // Only part of the page is readable, it can't be cached but the readable
+  // bytes must still be returned.
+  memory_->SetData32(0x20000, 0x12345678);
+  memory_->SetData32(0x20004, 0x9abcdef0);
+  uint64_t value;
+  ASSERT_TRUE(memory_cache_->Read64(0x20000, &value));
+  ASSERT_EQ(0x9abcdef012345678ULL, value);
+
+  std::vector<uint8_t> dst(16);
+  ASSERT_EQ(8U, memory_cache_->Read(0x20000, dst.data(), dst.size()));
+
+  // Running off the end of a cached page into an unreadable one.
+  ASSERT_EQ(8U, memory_cache_->Read(0x11ff8, dst.data(), dst.size()));
+  for (size_t i = 0; i < 8; i++) {
+    ASSERT_EQ(0x5dU, dst[i]) << "Failed at byte " << i;
+  }
+  ASSERT_FALSE(memory_cache_->Read32(0x30000, reinterpret_cast<uint32_t*>(&value)));
+}
+
+TEST_F(MemoryCacheTest, read_large) {
+  // Reads larger than a page bypass the cache.
+  std::vector<uint8_t> dst(8192);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x10000, dst.data(), dst.size()));
+  memory_->SetData8(0x10000, 0x11);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x10000, dst.data(), dst.size()));
+  ASSERT_EQ(0x11U, dst[0]);
+  ASSERT_EQ(0x5dU, dst[8191]);
+}
+
+TEST_F(MemoryCacheTest, read_overflow) {
+  std::vector<uint8_t> dst(16);
+  ASSERT_EQ(0U, memory_cache_->Read(UINT64_MAX - 4, dst.data(), dst.size()));
+}
+
+TEST_F(MemoryCacheTest, clear_while_reading) {
+  std::vector<std::thread> readers;
+  for (size_t i = 0; i < 4; i++) {
+    readers.emplace_back([this]() {
+      for (size_t j = 0; j < 10000; j++) {
+        uint64_t value;
+        ASSERT_TRUE(memory_cache_->Read64(0x10ffc, &value));
+        ASSERT_EQ(0x5d5d5d5d4c4c4c4cULL, value);
+      }
+    });
+  }
+  for (size_t i = 0; i < 10000; i++) {
+    memory_cache_->Clear();
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+TEST(MemoryCacheCreateTest, local_not_cached) {
+  std::shared_ptr<MemoryCache> memory = Memory::CreateProcessMemoryCached(getpid());
+  ASSERT_TRUE(memory != nullptr);
+
+  volatile uint64_t value = 0x1234;
+  uint64_t read_value;
+  ASSERT_TRUE(memory->Read64(reinterpret_cast<uint64_t>(&value), &read_value));
+  ASSERT_EQ(0x1234U, read_value);
+
+  // Seen without a Clear().
+  value = 0x5678;
+  ASSERT_TRUE(memory->Read64(reinterpret_cast<uint64_t>(&value), &read_value));
+  ASSERT_EQ(0x5678U, read_value);
+  memory->Clear();
+}
+
+}  // namespace unwindstack
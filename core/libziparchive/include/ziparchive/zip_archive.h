@@ -135,6 +135,22 @@ int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle);
 int32_t OpenArchiveFd(const int fd, const char* debugFileName, ZipArchiveHandle* handle,
                       bool assume_ownership = true);
 
+/*
+ * Like OpenArchive, but keeps the table of entries in the file named by
+ * "indexFileName" so that later opens of the same archive need not scan
+ * the central directory again. An index that is missing, stale or written
+ * by an incompatible process is rebuilt; failing to write it is not an
+ * error. The index is mapped rather than read, so concurrent users of an
+ * archive share its pages.
+ *
+ * The caller must own the index location, it is replaced by rename.
+ * On Windows the index is not used.
+ *
+ * Returns 0 on success, and negative values on failure.
+ */
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle);
+
 int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debugFileName,
                               ZipArchiveHandle* handle);
 /*
@@ -228,6 +244,30 @@ typedef bool (*ProcessZipEntryFunction)(const uint8_t* buf, size_t buf_size, voi
  */
 int32_t ProcessZipEntryContents(ZipArchiveHandle handle, ZipEntry* entry,
                                 ProcessZipEntryFunction func, void* cookie);
+
+/*
+ * One entry for ExtractEntries. The entry is written to |fd| as by
+ * ExtractEntryToFile, or if |fd| is -1, to |buffer|, which must hold
+ * |entry->uncompressed_length| bytes. |result| is set to the outcome.
+ */
+struct ZipEntryExtraction {
+  ZipEntry* entry;
+  int fd;
+  uint8_t* buffer;
+  int32_t result;
+};
+
+/*
+ * Extract |count| entries on up to |num_threads| threads, the caller's
+ * included. Each entry is inflated straight into its destination and
+ * stored entries are copied file to file by the kernel where possible.
+ * Every extraction needs its own file descriptor.
+ *
+ * Returns 0 if all entries were extracted, otherwise the first failed
+ * |result| in the order given.
+ */
+int32_t ExtractEntries(ZipArchiveHandle handle, ZipEntryExtraction* extractions, size_t count,
+                       size_t num_threads);
 #endif
 
 namespace zip_archive {
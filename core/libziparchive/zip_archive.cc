@@ -27,16 +27,27 @@
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>  // TEMP_FAILURE_RETRY may or may not be in unistd
 #include <android-base/memory.h>
+#include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 #include <log/log.h>
 #include <utils/Compat.h>
 #include <utils/FileMap.h>
@@ -117,18 +128,32 @@ static uint32_t ComputeHash(const ZipString& name) {
 #endif
 }
 
+/*
+ * Check that a hash table slot refers to a name within the central
+ * directory. Slots read back from an index file are not otherwise trusted.
+ */
+static bool IsValidSlot(const ZipStringOffset& slot, const size_t cd_length) {
+  return static_cast<size_t>(slot.name_offset) + slot.name_length <= cd_length;
+}
+
 /*
  * Convert a ZipEntry to a hash table index, verifying that it's in a
  * valid range.
  */
-static int64_t EntryToIndex(const ZipString* hash_table, const uint32_t hash_table_size,
-                            const ZipString& name) {
+static int64_t EntryToIndex(const ZipStringOffset* hash_table, const uint32_t hash_table_size,
+                            const ZipString& name, const uint8_t* start, const size_t cd_length) {
   const uint32_t hash = ComputeHash(name);
 
   // NOTE: (hash_table_size - 1) is guaranteed to be non-negative.
   uint32_t ent = hash & (hash_table_size - 1);
-  while (hash_table[ent].name != NULL) {
-    if (hash_table[ent] == name) {
+  // Bounded, an index file need not have left an empty slot to stop at.
+  for (uint32_t probes = 0; probes < hash_table_size && hash_table[ent].name_offset != 0;
+       ++probes) {
+    if (!IsValidSlot(hash_table[ent], cd_length)) {
+      ALOGW("Zip: Invalid hash table entry %" PRIu32, ent);
+      return kInvalidOffset;
+    }
+    if (hash_table[ent].GetZipString(start) == name) {
       return ent;
     }
 
@@ -142,8 +167,8 @@ static int64_t EntryToIndex(const ZipString* hash_table, const uint32_t hash_tab
 /*
  * Add a new entry to the hash table.
  */
-static int32_t AddToHash(ZipString* hash_table, const uint64_t hash_table_size,
-                         const ZipString& name) {
+static int32_t AddToHash(ZipStringOffset* hash_table, const uint64_t hash_table_size,
+                         const ZipString& name, const uint8_t* start) {
   const uint64_t hash = ComputeHash(name);
   uint32_t ent = hash & (hash_table_size - 1);
 
@@ -151,8 +176,8 @@ static int32_t AddToHash(ZipString* hash_table, const uint64_t hash_table_size,
    * We over-allocated the table, so we're guaranteed to find an empty slot.
    * Further, we guarantee that the hashtable size is not 0.
    */
-  while (hash_table[ent].name != NULL) {
-    if (hash_table[ent] == name) {
+  while (hash_table[ent].name_offset != 0) {
+    if (hash_table[ent].GetZipString(start) == name) {
       // We've found a duplicate entry. We don't accept it
       ALOGW("Zip: Found duplicate entry %.*s", name.name_length, name.name);
       return kDuplicateEntry;
@@ -160,7 +185,7 @@ static int32_t AddToHash(ZipString* hash_table, const uint64_t hash_table_size,
     ent = (ent + 1) & (hash_table_size - 1);
   }
 
-  hash_table[ent].name = name.name;
+  hash_table[ent].name_offset = static_cast<uint32_t>(name.name - start);
   hash_table[ent].name_length = name.name_length;
   return 0;
 }
@@ -318,11 +343,11 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
    * least one unused entry to avoid an infinite loop during creation.
    */
   archive->hash_table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
-  archive->hash_table =
-      reinterpret_cast<ZipString*>(calloc(archive->hash_table_size, sizeof(ZipString)));
+  archive->hash_table = reinterpret_cast<ZipStringOffset*>(
+      calloc(archive->hash_table_size, sizeof(ZipStringOffset)));
   if (archive->hash_table == nullptr) {
     ALOGW("Zip: unable to allocate the %u-entry hash_table, entry size: %zu",
-          archive->hash_table_size, sizeof(ZipString));
+          archive->hash_table_size, sizeof(ZipStringOffset));
     return -1;
   }
 
@@ -375,7 +400,8 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
     ZipString entry_name;
     entry_name.name = file_name;
     entry_name.name_length = file_name_length;
-    const int add_result = AddToHash(archive->hash_table, archive->hash_table_size, entry_name);
+    const int add_result =
+        AddToHash(archive->hash_table, archive->hash_table_size, entry_name, cd_ptr);
     if (add_result != 0) {
       ALOGW("Zip: Error adding entry to hash table %d", add_result);
       return add_result;
@@ -388,6 +414,17 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
     }
   }
 
+  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
+
+  return 0;
+}
+
+/*
+ * Checks that the archive starts with a local file header.
+ *
+ * Returns 0 on success.
+ */
+static int32_t CheckFirstEntry(ZipArchive* archive) {
   uint32_t lfh_start_bytes;
   if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
                                         sizeof(uint32_t), 0)) {
@@ -403,21 +440,164 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
     return -1;
   }
 
-  ALOGV("+++ zip good scan %" PRIu16 " entries", num_entries);
-
   return 0;
 }
 
-static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name) {
+#if !defined(_WIN32)
+/*
+ * On-disk form of the hash table, see OpenArchiveWithIndex. The header is
+ * followed by hash_table_size ZipStringOffset slots, in host byte order.
+ *
+ * An index is tied to the archive by the identity of its file and by the
+ * central directory location and size recorded in the EOCD. It is also only
+ * good for the hash function of whoever wrote it, which differs for example
+ * between 32 and 64 bit processes, so a hash of a fixed name is kept too.
+ */
+struct IndexHeader {
+  static const uint32_t kMagic = 0x5844495a;  // ZIDX
+  static const uint32_t kVersion = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t hash_check;
+  uint32_t hash_table_size;
+  uint64_t file_dev;
+  uint64_t file_ino;
+  uint64_t file_size;
+  int64_t file_mtime_sec;
+  int64_t file_mtime_nsec;
+  uint32_t cd_offset;
+  uint32_t cd_size;
+  uint32_t num_entries;
+  uint32_t reserved;
+
+  void Initialize(const ZipArchive* archive, const struct stat& st) {
+    memset(this, 0, sizeof(*this));
+    magic = kMagic;
+    version = kVersion;
+    hash_check = ComputeHash(ZipString("ziparchive-index"));
+    hash_table_size = archive->hash_table_size;
+    file_dev = st.st_dev;
+    file_ino = st.st_ino;
+    file_size = st.st_size;
+    file_mtime_sec = st.st_mtime;
+#if defined(__APPLE__)
+    file_mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+    file_mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    cd_offset = static_cast<uint32_t>(archive->directory_offset);
+    cd_size = static_cast<uint32_t>(archive->central_directory.GetMapLength());
+    num_entries = archive->num_entries;
+  }
+};
+
+static bool StatArchive(const ZipArchive* archive, struct stat* st) {
+  return archive->mapped_zip.HasFd() && fstat(archive->mapped_zip.GetFileDescriptor(), st) == 0;
+}
+
+/*
+ * Maps the hash table from index_file_name if it was written for this very
+ * archive. Returns false, leaving the archive untouched, otherwise.
+ */
+static bool MapIndex(ZipArchive* archive, const char* index_file_name) {
+  struct stat st;
+  if (!StatArchive(archive, &st)) {
+    return false;
+  }
+
+  android::base::unique_fd fd(open(index_file_name, O_RDONLY | O_CLOEXEC | O_BINARY));
+  struct stat index_st;
+  if (fd == -1 || fstat(fd, &index_st) != 0 ||
+      index_st.st_size < static_cast<off64_t>(sizeof(IndexHeader))) {
+    return false;
+  }
+
+  std::unique_ptr<android::FileMap> map(new android::FileMap());
+  if (!map->create(index_file_name, fd, 0, index_st.st_size, true)) {
+    return false;
+  }
+
+  IndexHeader expected;
+  archive->hash_table_size = RoundUpPower2(1 + (archive->num_entries * 4) / 3);
+  expected.Initialize(archive, st);
+  const uint8_t* const data = static_cast<const uint8_t*>(map->getDataPtr());
+  const size_t table_length = expected.hash_table_size * sizeof(ZipStringOffset);
+  if (memcmp(data, &expected, sizeof(expected)) != 0 ||
+      map->getDataLength() != sizeof(IndexHeader) + table_length) {
+    ALOGV("Zip: index %s is stale", index_file_name);
+    archive->hash_table_size = 0;
+    return false;
+  }
+
+  archive->hash_table =
+      reinterpret_cast<ZipStringOffset*>(const_cast<uint8_t*>(data + sizeof(IndexHeader)));
+  archive->index_map = std::move(map);
+  return true;
+}
+
+/*
+ * Saves the hash table to index_file_name for MapIndex. The index is
+ * written aside and renamed into place, so readers never see it partial.
+ * Failure is not an error, the archive is merely indexed again next time.
+ */
+static void WriteIndex(const ZipArchive* archive, const char* index_file_name) {
+  struct stat st;
+  if (!StatArchive(archive, &st)) {
+    return;
+  }
+
+  IndexHeader header;
+  header.Initialize(archive, st);
+
+  const std::string temp_name =
+      android::base::StringPrintf("%s.%d.tmp", index_file_name, getpid());
+  android::base::unique_fd fd(
+      open(temp_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_BINARY, 0644));
+  if (fd == -1) {
+    ALOGV("Zip: unable to create index %s: %s", temp_name.c_str(), strerror(errno));
+    return;
+  }
+
+  if (!android::base::WriteFully(fd, &header, sizeof(header)) ||
+      !android::base::WriteFully(fd, archive->hash_table,
+                                 archive->hash_table_size * sizeof(ZipStringOffset)) ||
+      rename(temp_name.c_str(), index_file_name) != 0) {
+    ALOGW("Zip: unable to write index %s: %s", index_file_name, strerror(errno));
+    unlink(temp_name.c_str());
+  }
+}
+#endif  // !defined(_WIN32)
+
+static int32_t OpenArchiveInternal(ZipArchive* archive, const char* debug_file_name,
+                                   const char* index_file_name = nullptr) {
   int32_t result = -1;
   if ((result = MapCentralDirectory(debug_file_name, archive)) != 0) {
     return result;
   }
 
+#if !defined(_WIN32)
+  if (index_file_name != nullptr && MapIndex(archive, index_file_name)) {
+    return CheckFirstEntry(archive);
+  }
+#endif
+
   if ((result = ParseZipArchive(archive))) {
     return result;
   }
 
+  if ((result = CheckFirstEntry(archive))) {
+    return result;
+  }
+
+#if !defined(_WIN32)
+  if (index_file_name != nullptr) {
+    WriteIndex(archive, index_file_name);
+  }
+#else
+  UNUSED(index_file_name);
+#endif
+
   return 0;
 }
 
@@ -441,6 +621,20 @@ int32_t OpenArchive(const char* fileName, ZipArchiveHandle* handle) {
   return OpenArchiveInternal(archive, fileName);
 }
 
+int32_t OpenArchiveWithIndex(const char* fileName, const char* indexFileName,
+                             ZipArchiveHandle* handle) {
+  const int fd = open(fileName, O_RDONLY | O_BINARY, 0);
+  ZipArchive* archive = new ZipArchive(fd, true);
+  *handle = archive;
+
+  if (fd < 0) {
+    ALOGW("Unable to open '%s': %s", fileName, strerror(errno));
+    return kIoError;
+  }
+
+  return OpenArchiveInternal(archive, fileName, indexFileName);
+}
+
 int32_t OpenArchiveFromMemory(void* address, size_t length, const char* debug_file_name,
                               ZipArchiveHandle* handle) {
   ZipArchive* archive = new ZipArchive(address, length);
@@ -492,21 +686,21 @@ static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, ZipEntry* entry
 static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* data) {
   const uint16_t nameLen = archive->hash_table[ent].name_length;
 
-  // Recover the start of the central directory entry from the filename
-  // pointer.  The filename is the first entry past the fixed-size data,
-  // so we can just subtract back from that.
-  const uint8_t* ptr = archive->hash_table[ent].name;
-  ptr -= sizeof(CentralDirectoryRecord);
-
   // This is the base of our mmapped region, we have to sanity check that
-  // the name that's in the hash table is a pointer to a location within
-  // this mapped region.
+  // the name that's in the hash table lies within this mapped region.
   const uint8_t* base_ptr = archive->central_directory.GetBasePtr();
-  if (ptr < base_ptr || ptr > base_ptr + archive->central_directory.GetMapLength()) {
+  const ZipString name = archive->hash_table[ent].GetZipString(base_ptr);
+  if (archive->hash_table[ent].name_offset < sizeof(CentralDirectoryRecord) ||
+      !IsValidSlot(archive->hash_table[ent], archive->central_directory.GetMapLength())) {
     ALOGW("Zip: Invalid entry pointer");
     return kInvalidOffset;
   }
 
+  // Recover the start of the central directory entry from the filename
+  // pointer.  The filename is the first entry past the fixed-size data,
+  // so we can just subtract back from that.
+  const uint8_t* ptr = name.name - sizeof(CentralDirectoryRecord);
+
   const CentralDirectoryRecord* cdr = reinterpret_cast<const CentralDirectoryRecord*>(ptr);
 
   // The offset of the start of the central directory in the zipfile.
@@ -606,7 +800,7 @@ static int32_t FindEntry(const ZipArchive* archive, const int ent, ZipEntry* dat
       return kIoError;
     }
 
-    if (memcmp(archive->hash_table[ent].name, name_buf.data(), nameLen)) {
+    if (memcmp(name.name, name_buf.data(), nameLen)) {
       return kInconsistentInformation;
     }
 
@@ -704,7 +898,10 @@ int32_t FindEntry(const ZipArchiveHandle handle, const ZipString& entryName, Zip
     return kInvalidEntryName;
   }
 
-  const int64_t ent = EntryToIndex(archive->hash_table, archive->hash_table_size, entryName);
+  const int64_t ent =
+      EntryToIndex(archive->hash_table, archive->hash_table_size, entryName,
+                   archive->central_directory.GetBasePtr(),
+                   archive->central_directory.GetMapLength());
 
   if (ent < 0) {
     ALOGV("Zip: Could not find entry %.*s", entryName.name_length, entryName.name);
@@ -728,17 +925,26 @@ int32_t Next(void* cookie, ZipEntry* data, ZipString* name) {
 
   const uint32_t currentOffset = handle->position;
   const uint32_t hash_table_length = archive->hash_table_size;
-  const ZipString* hash_table = archive->hash_table;
+  const ZipStringOffset* hash_table = archive->hash_table;
+  const uint8_t* start = archive->central_directory.GetBasePtr();
+  const size_t cd_length = archive->central_directory.GetMapLength();
 
   for (uint32_t i = currentOffset; i < hash_table_length; ++i) {
-    if (hash_table[i].name != NULL &&
-        (handle->prefix.name_length == 0 || hash_table[i].StartsWith(handle->prefix)) &&
-        (handle->suffix.name_length == 0 || hash_table[i].EndsWith(handle->suffix))) {
+    if (hash_table[i].name_offset == 0) {
+      continue;
+    }
+    if (!IsValidSlot(hash_table[i], cd_length)) {
+      handle->position = (i + 1);
+      ALOGW("Zip: Invalid hash table entry %" PRIu32, i);
+      return kInvalidOffset;
+    }
+    const ZipString entry_name = hash_table[i].GetZipString(start);
+    if ((handle->prefix.name_length == 0 || entry_name.StartsWith(handle->prefix)) &&
+        (handle->suffix.name_length == 0 || entry_name.EndsWith(handle->suffix))) {
       handle->position = (i + 1);
       const int error = FindEntry(archive, i, data);
       if (!error) {
-        name->name = hash_table[i].name;
-        name->name_length = hash_table[i].name_length;
+        *name = entry_name;
       }
 
       return error;
@@ -1090,6 +1296,254 @@ int32_t ExtractEntryToFile(ZipArchiveHandle handle, ZipEntry* entry, int fd) {
   return ExtractToWriter(handle, entry, &writer);
 }
 
+#if !defined(_WIN32)
+// Maps |length| bytes of the archive at |offset|, or points into the archive
+// directly if it is held in memory. |map| keeps the mapping alive.
+static const uint8_t* MapArchiveRange(const MappedZipFile& mapped_zip, off64_t offset,
+                                      size_t length, std::unique_ptr<android::FileMap>* map) {
+  if (!mapped_zip.HasFd()) {
+    if (offset < 0 || offset + static_cast<off64_t>(length) > mapped_zip.GetFileLength()) {
+      ALOGW("Zip: entry data out of range at offset %" PRId64, static_cast<int64_t>(offset));
+      return nullptr;
+    }
+    return static_cast<const uint8_t*>(mapped_zip.GetBasePtr()) + offset;
+  }
+
+  map->reset(new android::FileMap());
+  if (!(*map)->create(nullptr, mapped_zip.GetFileDescriptor(), offset, length, true)) {
+    return nullptr;
+  }
+  return static_cast<const uint8_t*>((*map)->getDataPtr());
+}
+
+// Maps |length| bytes of |fd| at |offset| for writing. Returns nullptr if
+// |fd| can't be written through a mapping, the caller falls back to write().
+static uint8_t* MapOutputRange(int fd, off64_t offset, size_t length,
+                               std::unique_ptr<android::FileMap>* map) {
+#if defined(__linux__)
+  struct stat sb;
+  if ((fcntl(fd, F_GETFL) & O_ACCMODE) != O_RDWR || fstat(fd, &sb) == -1 ||
+      !S_ISREG(sb.st_mode)) {
+    return nullptr;
+  }
+
+  // A store to a mapped hole that the volume can't back raises SIGBUS, so
+  // only go ahead if the blocks are allocated up front.
+  if (TEMP_FAILURE_RETRY(fallocate(fd, 0, offset, length)) == -1) {
+    return nullptr;
+  }
+
+  map->reset(new android::FileMap());
+  if (!(*map)->create(nullptr, fd, offset, length, false)) {
+    return nullptr;
+  }
+  return static_cast<uint8_t*>((*map)->getDataPtr());
+#else
+  UNUSED(fd, offset, length, map);
+  return nullptr;
+#endif
+}
+
+// Inflates a whole entry in one call, from memory to memory.
+static int32_t InflateToBuffer(const uint8_t* in, const uint32_t compressed_length, uint8_t* out,
+                               const uint32_t uncompressed_length) {
+  z_stream zstream;
+  memset(&zstream, 0, sizeof(zstream));
+  zstream.next_in = in;
+  zstream.avail_in = compressed_length;
+  zstream.next_out = out;
+  zstream.avail_out = uncompressed_length;
+  zstream.data_type = Z_UNKNOWN;
+
+  int zerr = zlib_inflateInit2(&zstream, -MAX_WBITS);
+  if (zerr != Z_OK) {
+    ALOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
+    return kZlibError;
+  }
+
+  zerr = inflate(&zstream, Z_FINISH);
+  const uLong total_out = zstream.total_out;
+  inflateEnd(&zstream);
+
+  if (zerr == Z_BUF_ERROR || (zerr == Z_STREAM_END && total_out != uncompressed_length)) {
+    ALOGW("Zip: size mismatch on inflated file (%lu vs %" PRIu32 ")", total_out,
+          uncompressed_length);
+    return kInconsistentInformation;
+  }
+  if (zerr != Z_STREAM_END) {
+    ALOGW("Zip: inflate zerr=%d", zerr);
+    return kZlibError;
+  }
+
+  return 0;
+}
+
+// Copies the |length| bytes at |data|, which is the archive at |offset|, to
+// |fd| at |out_offset|. The kernel copies file to file where it can, leaving
+// |fd| positioned at the end of the data either way.
+static bool CopyArchiveRange(const MappedZipFile& mapped_zip, const uint8_t* data, off64_t offset,
+                             int fd, off64_t out_offset, size_t length) {
+  size_t copied = 0;
+#if defined(__linux__)
+  if (mapped_zip.HasFd()) {
+    const int in_fd = mapped_zip.GetFileDescriptor();
+#if defined(__NR_copy_file_range)
+    loff_t in_off = offset;
+    loff_t out_off = out_offset;
+    while (copied < length) {
+      const ssize_t n = TEMP_FAILURE_RETRY(
+          syscall(__NR_copy_file_range, in_fd, &in_off, fd, &out_off, length - copied, 0));
+      if (n <= 0) {
+        break;
+      }
+      copied += n;
+    }
+#endif
+    // sendfile() writes at the file position and needs no file system support.
+    if (copied < length && lseek64(fd, out_offset + copied, SEEK_SET) != -1) {
+      off64_t send_off = offset + copied;
+      while (copied < length) {
+        const ssize_t n = TEMP_FAILURE_RETRY(sendfile64(fd, in_fd, &send_off, length - copied));
+        if (n <= 0) {
+          break;
+        }
+        copied += n;
+      }
+    }
+  }
+#else
+  UNUSED(mapped_zip, offset);
+#endif
+
+  if (lseek64(fd, out_offset + copied, SEEK_SET) == -1) {
+    return false;
+  }
+  return android::base::WriteFully(fd, data + copied, length - copied);
+}
+
+// Checks the data descriptor, if any, and the CRC of an extracted entry.
+static int32_t ValidateExtractedEntry(MappedZipFile& mapped_zip, ZipEntry* entry, uint64_t crc) {
+  if (entry->has_data_descriptor) {
+    const int32_t result = ValidateDataDescriptor(mapped_zip, entry);
+    if (result) {
+      return result;
+    }
+  }
+
+  if (kCrcChecksEnabled && (entry->crc32 != static_cast<uint32_t>(crc))) {
+    ALOGW("Zip: crc mismatch: expected %" PRIu32 ", was %" PRIu64, entry->crc32, crc);
+    return kInconsistentInformation;
+  }
+
+  return 0;
+}
+
+// Extracts |entry| to |fd|, or to |buf| if |fd| is -1. The archive is read
+// through a mapping and the data lands in its destination directly, rather
+// than being staged through the buffers of ExtractToWriter.
+static int32_t ExtractEntryDirect(ZipArchiveHandle handle, ZipEntry* entry, int fd, uint8_t* buf) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle);
+  const uint32_t length = entry->uncompressed_length;
+  const bool stored = entry->method == kCompressStored;
+  if ((!stored && entry->method != kCompressDeflated) || length == 0 ||
+      entry->compressed_length == 0) {
+    return (fd != -1) ? ExtractEntryToFile(handle, entry, fd)
+                      : ExtractToMemory(handle, entry, buf, length);
+  }
+
+  const size_t in_length = stored ? length : entry->compressed_length;
+  std::unique_ptr<android::FileMap> in_map;
+  const uint8_t* in = MapArchiveRange(archive->mapped_zip, entry->offset, in_length, &in_map);
+  if (in == nullptr) {
+    return kIoError;
+  }
+
+  int32_t result = 0;
+  uint64_t crc = 0;
+  if (fd == -1) {
+    if (stored) {
+      memcpy(buf, in, length);
+    } else {
+      result = InflateToBuffer(in, in_length, buf, length);
+    }
+    if (!result && kCrcChecksEnabled) {
+      crc = crc32(0, buf, length);
+    }
+  } else {
+    const off64_t out_offset = lseek64(fd, 0, SEEK_CUR);
+    auto writer = FileWriter::Create(fd, entry);
+    if (!writer.IsValid()) {
+      return kIoError;
+    }
+
+    if (stored) {
+      if (kCrcChecksEnabled) {
+        crc = crc32(0, in, length);
+      }
+      if (!CopyArchiveRange(archive->mapped_zip, in, entry->offset, fd, out_offset, length)) {
+        ALOGW("Zip: unable to copy %" PRIu32 " bytes to fd %d: %s", length, fd, strerror(errno));
+        return kIoError;
+      }
+    } else {
+      std::unique_ptr<android::FileMap> out_map;
+      uint8_t* out = MapOutputRange(fd, out_offset, length, &out_map);
+      if (out == nullptr) {
+        return ExtractToWriter(handle, entry, &writer);
+      }
+      result = InflateToBuffer(in, in_length, out, length);
+      if (!result && kCrcChecksEnabled) {
+        crc = crc32(0, out, length);
+      }
+      if (lseek64(fd, out_offset + length, SEEK_SET) == -1) {
+        return kIoError;
+      }
+    }
+  }
+
+  if (result) {
+    return result;
+  }
+  return ValidateExtractedEntry(archive->mapped_zip, entry, crc);
+}
+
+int32_t ExtractEntries(ZipArchiveHandle handle, ZipEntryExtraction* extractions, size_t count,
+                       size_t num_threads) {
+  // Largest first, so that no worker is left with a big entry at the end.
+  std::vector<size_t> order(count);
+  for (size_t i = 0; i < count; ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [extractions](size_t a, size_t b) {
+    return extractions[a].entry->uncompressed_length > extractions[b].entry->uncompressed_length;
+  });
+
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < count;) {
+      ZipEntryExtraction& extraction = extractions[order[i]];
+      extraction.result =
+          ExtractEntryDirect(handle, extraction.entry, extraction.fd, extraction.buffer);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < std::min(num_threads, count); ++i) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (extractions[i].result) {
+      return extractions[i].result;
+    }
+  }
+  return 0;
+}
+#endif  // !defined(_WIN32)
+
 const char* ErrorCodeString(int32_t error_code) {
   // Make sure that the number of entries in kErrorMessages and ErrorCodes
   // match.
@@ -20,6 +20,8 @@
 #include <iostream>
 #include <string>
 #include <tuple>
+
+#include <unistd.h>
 #include <vector>
 
 #include <android-base/test_utils.h>
@@ -84,4 +86,145 @@ static void Iterate_all_files(benchmark::State& state) {
 }
 BENCHMARK(Iterate_all_files);
 
+// An archive shaped like a large APK: many entries with short names, where
+// building the table of entries dominates opening it.
+static TemporaryFile* CreateWideZip() {
+  TemporaryFile* result = new TemporaryFile;
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  for (size_t i = 0; i < 20000; i++) {
+    std::string name = "res/drawable/icon" + std::to_string(i) + ".png";
+    writer.StartEntry(name.c_str(), 0);
+    writer.WriteBytes("helo", 4);
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+static void OpenArchive_wide(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateWideZip());
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  ZipString name("res/drawable/icon12345.png");
+
+  while (state.KeepRunning()) {
+    OpenArchive(temp_file->path, &handle);
+    FindEntry(handle, name, &data);
+    CloseArchive(handle);
+  }
+}
+BENCHMARK(OpenArchive_wide);
+
+// Every open has to build and write the index.
+static void OpenArchiveWithIndex_cold(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateWideZip());
+  std::string index_path = std::string(temp_file->path) + ".idx";
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  ZipString name("res/drawable/icon12345.png");
+
+  while (state.KeepRunning()) {
+    state.PauseTiming();
+    unlink(index_path.c_str());
+    state.ResumeTiming();
+    OpenArchiveWithIndex(temp_file->path, index_path.c_str(), &handle);
+    FindEntry(handle, name, &data);
+    CloseArchive(handle);
+  }
+  unlink(index_path.c_str());
+}
+BENCHMARK(OpenArchiveWithIndex_cold);
+
+static void OpenArchiveWithIndex_warm(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateWideZip());
+  std::string index_path = std::string(temp_file->path) + ".idx";
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  ZipString name("res/drawable/icon12345.png");
+
+  OpenArchiveWithIndex(temp_file->path, index_path.c_str(), &handle);
+  CloseArchive(handle);
+  while (state.KeepRunning()) {
+    OpenArchiveWithIndex(temp_file->path, index_path.c_str(), &handle);
+    FindEntry(handle, name, &data);
+    CloseArchive(handle);
+  }
+  unlink(index_path.c_str());
+}
+BENCHMARK(OpenArchiveWithIndex_warm);
+
+#if !defined(_WIN32)
+// An archive of |entries| deflated entries of 64KiB each, like a set of
+// native libraries.
+static TemporaryFile* CreateLibraryZip(size_t entries) {
+  TemporaryFile* result = new TemporaryFile;
+  FILE* fp = fdopen(result->fd, "w");
+
+  std::vector<uint8_t> data(64 * 1024);
+  ZipWriter writer(fp);
+  for (size_t i = 0; i < entries; i++) {
+    for (size_t j = 0; j < data.size(); j++) {
+      data[j] = static_cast<uint8_t>((i * 7 + j * j) >> 5);
+    }
+    std::string name = "lib/arm64-v8a/lib" + std::to_string(i) + ".so";
+    writer.StartEntry(name.c_str(), ZipWriter::kCompress);
+    writer.WriteBytes(data.data(), data.size());
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+
+  return result;
+}
+
+// Args are the entry count and the number of threads, 0 for ExtractToMemory
+// one entry at a time. Reports MB/s of uncompressed data.
+static void ExtractEntries_memory(benchmark::State& state) {
+  const size_t count = state.range(0);
+  const size_t threads = state.range(1);
+  std::unique_ptr<TemporaryFile> temp_file(CreateLibraryZip(count));
+  ZipArchiveHandle handle;
+  OpenArchive(temp_file->path, &handle);
+
+  std::vector<ZipEntry> entries(count);
+  std::vector<ZipEntryExtraction> extractions(count);
+  std::vector<std::vector<uint8_t>> buffers(count);
+  size_t total = 0;
+  for (size_t i = 0; i < count; i++) {
+    std::string name = "lib/arm64-v8a/lib" + std::to_string(i) + ".so";
+    FindEntry(handle, ZipString(name.c_str()), &entries[i]);
+    buffers[i].resize(entries[i].uncompressed_length);
+    extractions[i] = {&entries[i], -1, buffers[i].data(), 0};
+    total += entries[i].uncompressed_length;
+  }
+
+  while (state.KeepRunning()) {
+    if (threads == 0) {
+      for (size_t i = 0; i < count; i++) {
+        ExtractToMemory(handle, &entries[i], buffers[i].data(), buffers[i].size());
+      }
+    } else {
+      ExtractEntries(handle, extractions.data(), count, threads);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * total);
+  CloseArchive(handle);
+}
+BENCHMARK(ExtractEntries_memory)
+    ->Args({16, 0})
+    ->Args({16, 1})
+    ->Args({16, 4})
+    ->Args({256, 0})
+    ->Args({256, 1})
+    ->Args({256, 4})
+    ->Args({1024, 0})
+    ->Args({1024, 4})
+    ->Args({1024, 8})
+    ->UseRealTime();
+#endif  // !defined(_WIN32)
+
 BENCHMARK_MAIN();
@@ -121,6 +121,22 @@ class MappedZipFile {
   const off64_t data_length_;
 };
 
+// A hash table slot. The entry name is kept as an offset from the start of
+// the central directory rather than a pointer, so the table does not depend
+// on where the directory happens to be mapped and can be stored in an index
+// file as is. No name can start at offset zero, which marks an empty slot.
+struct ZipStringOffset {
+  uint32_t name_offset;
+  uint16_t name_length;
+
+  const ZipString GetZipString(const uint8_t* const start) const {
+    ZipString zip_string;
+    zip_string.name = start + name_offset;
+    zip_string.name_length = name_length;
+    return zip_string;
+  }
+};
+
 class CentralDirectory {
  public:
   CentralDirectory(void) : base_ptr_(nullptr), length_(0) {}
@@ -154,7 +170,9 @@ struct ZipArchive {
   // allocate so the maximum number entries can never be higher than
   // ((4 * UINT16_MAX) / 3 + 1) which can safely fit into a uint32_t.
   uint32_t hash_table_size;
-  ZipString* hash_table;
+  ZipStringOffset* hash_table;
+  // Set if hash_table lives in a mapped index file rather than the heap.
+  std::unique_ptr<android::FileMap> index_map;
 
   ZipArchive(const int fd, bool assume_ownership)
       : mapped_zip(fd),
@@ -181,7 +199,9 @@ struct ZipArchive {
       close(mapped_zip.GetFileDescriptor());
     }
 
-    free(hash_table);
+    if (!index_map) {
+      free(hash_table);
+    }
   }
 
   bool InitializeCentralDirectory(const char* debug_file_name, off64_t cd_start_offset,
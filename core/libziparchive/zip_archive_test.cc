@@ -21,12 +21,16 @@
 #include <getopt.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/macros.h>
 #include <android-base/test_utils.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
@@ -408,6 +412,268 @@ TEST(ziparchive, ExtractToFile) {
 }
 
 #if !defined(_WIN32)
+TEST(ziparchive, ExtractEntries) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kValidZip, &handle));
+
+  // a.txt is deflated and b.txt stored, extract each to memory and to a file.
+  ZipEntry entries[4];
+  ZipString a_name;
+  SetZipString(&a_name, kATxtName);
+  ZipString b_name;
+  SetZipString(&b_name, kBTxtName);
+  ASSERT_EQ(0, FindEntry(handle, a_name, &entries[0]));
+  ASSERT_EQ(0, FindEntry(handle, b_name, &entries[1]));
+  entries[2] = entries[0];
+  entries[3] = entries[1];
+
+  std::vector<uint8_t> a_buffer(kATxtContents.size());
+  std::vector<uint8_t> b_buffer(kBTxtContents.size());
+  TemporaryFile a_file;
+  TemporaryFile b_file;
+  ZipEntryExtraction extractions[] = {
+      {&entries[0], -1, a_buffer.data(), -1},
+      {&entries[1], -1, b_buffer.data(), -1},
+      {&entries[2], a_file.fd, nullptr, -1},
+      {&entries[3], b_file.fd, nullptr, -1},
+  };
+  ASSERT_EQ(0, ExtractEntries(handle, extractions, arraysize(extractions), 4));
+  for (const auto& extraction : extractions) {
+    ASSERT_EQ(0, extraction.result);
+  }
+  ASSERT_EQ(kATxtContents, a_buffer);
+  ASSERT_EQ(kBTxtContents, b_buffer);
+
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(a_file.path, &contents));
+  ASSERT_EQ(std::string(kATxtContents.begin(), kATxtContents.end()), contents);
+  ASSERT_TRUE(android::base::ReadFileToString(b_file.path, &contents));
+  ASSERT_EQ(std::string(kBTxtContents.begin(), kBTxtContents.end()), contents);
+
+  // A declared length that doesn't match the data fails only that entry.
+  entries[0].uncompressed_length -= 1;
+  ASSERT_NE(0, ExtractEntries(handle, extractions, arraysize(extractions), 2));
+  ASSERT_NE(0, extractions[0].result);
+  ASSERT_EQ(0, extractions[1].result);
+
+  CloseArchive(handle);
+}
+
+// Copies a test archive to path, replacing whatever was there.
+static void CopyTestArchive(const std::string& name, const std::string& path) {
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(test_data_dir + "/" + name, &contents));
+  unlink(path.c_str());
+  ASSERT_TRUE(android::base::WriteStringToFile(contents, path));
+}
+
+static ino_t IndexInode(const std::string& index_path) {
+  struct stat st;
+  return stat(index_path.c_str(), &st) == 0 ? st.st_ino : 0;
+}
+
+static void AssertSameEntry(const ZipEntry& expected, const ZipEntry& actual) {
+  ASSERT_EQ(expected.method, actual.method);
+  ASSERT_EQ(expected.crc32, actual.crc32);
+  ASSERT_EQ(expected.compressed_length, actual.compressed_length);
+  ASSERT_EQ(expected.uncompressed_length, actual.uncompressed_length);
+  ASSERT_EQ(expected.offset, actual.offset);
+}
+
+// Asserts that an archive opened with an index finds and iterates exactly
+// what OpenArchive does.
+static void AssertSameAsUnindexed(const std::string& zip_path, ZipArchiveHandle indexed) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchive(zip_path.c_str(), &handle));
+
+  void* cookie;
+  ASSERT_EQ(0, StartIteration(handle, &cookie, nullptr, nullptr));
+  void* indexed_cookie;
+  ASSERT_EQ(0, StartIteration(indexed, &indexed_cookie, nullptr, nullptr));
+
+  ZipEntry data;
+  ZipString name;
+  ZipEntry indexed_data;
+  ZipString indexed_name;
+  size_t entries = 0;
+  int32_t result;
+  while ((result = Next(cookie, &data, &name)) == 0) {
+    ASSERT_EQ(0, Next(indexed_cookie, &indexed_data, &indexed_name));
+    ASSERT_TRUE(name == indexed_name);
+    AssertSameEntry(data, indexed_data);
+
+    ASSERT_EQ(0, FindEntry(indexed, name, &indexed_data));
+    AssertSameEntry(data, indexed_data);
+    ++entries;
+  }
+  ASSERT_EQ(-1, result);
+  ASSERT_EQ(-1, Next(indexed_cookie, &indexed_data, &indexed_name));
+  ASSERT_NE(0u, entries);
+  EndIteration(cookie);
+  EndIteration(indexed_cookie);
+
+  ZipString missing;
+  SetZipString(&missing, kNonexistentTxtName);
+  ASSERT_EQ(FindEntry(handle, missing, &data), FindEntry(indexed, missing, &indexed_data));
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, OpenWithIndex) {
+  TemporaryDir tmp_dir;
+  const std::string zip_path = std::string(tmp_dir.path) + "/" + kValidZip;
+  const std::string index_path = zip_path + ".idx";
+  CopyTestArchive(kValidZip, zip_path);
+
+  // Cold, the index is built and saved.
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  AssertSameAsUnindexed(zip_path, handle);
+  CloseArchive(handle);
+  const ino_t cold_inode = IndexInode(index_path);
+  ASSERT_NE(0u, cold_inode);
+
+  // Warm, the index is mapped as is.
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  ASSERT_TRUE(reinterpret_cast<ZipArchive*>(handle)->index_map != nullptr);
+  AssertSameAsUnindexed(zip_path, handle);
+
+  // Prefix and suffix matching works through the mapped table too.
+  void* iteration_cookie;
+  ZipString prefix("b/");
+  ZipString suffix(".txt");
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, &prefix, &suffix));
+  ZipEntry data;
+  ZipString name;
+  std::vector<std::string> names;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    names.push_back(std::string(reinterpret_cast<const char*>(name.name), name.name_length));
+  }
+  EndIteration(iteration_cookie);
+  std::sort(names.begin(), names.end());
+  ASSERT_EQ(std::vector<std::string>({"b/c.txt", "b/d.txt"}), names);
+  CloseArchive(handle);
+  ASSERT_EQ(cold_inode, IndexInode(index_path));
+}
+
+TEST(ziparchive, OpenWithStaleIndex) {
+  TemporaryDir tmp_dir;
+  const std::string zip_path = std::string(tmp_dir.path) + "/archive.zip";
+  const std::string index_path = zip_path + ".idx";
+  CopyTestArchive(kValidZip, zip_path);
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  CloseArchive(handle);
+  const ino_t valid_inode = IndexInode(index_path);
+
+  // Another archive in its place, the index of the first must not be used.
+  CopyTestArchive(kLargeZip, zip_path);
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  ASSERT_TRUE(reinterpret_cast<ZipArchive*>(handle)->index_map == nullptr);
+  AssertSameAsUnindexed(zip_path, handle);
+  CloseArchive(handle);
+  const ino_t large_inode = IndexInode(index_path);
+  ASSERT_NE(valid_inode, large_inode);
+
+  // Only the modification time changes, the index is rebuilt all the same.
+  struct stat st;
+  ASSERT_EQ(0, stat(zip_path.c_str(), &st));
+  struct timeval times[2] = {{st.st_atime, 0}, {st.st_mtime - 10, 0}};
+  ASSERT_EQ(0, utimes(zip_path.c_str(), times));
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  ASSERT_TRUE(reinterpret_cast<ZipArchive*>(handle)->index_map == nullptr);
+  AssertSameAsUnindexed(zip_path, handle);
+  CloseArchive(handle);
+  ASSERT_NE(large_inode, IndexInode(index_path));
+}
+
+TEST(ziparchive, OpenWithTruncatedIndex) {
+  TemporaryDir tmp_dir;
+  const std::string zip_path = std::string(tmp_dir.path) + "/" + kValidZip;
+  const std::string index_path = zip_path + ".idx";
+  CopyTestArchive(kValidZip, zip_path);
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  CloseArchive(handle);
+
+  struct stat st;
+  ASSERT_EQ(0, stat(index_path.c_str(), &st));
+  for (off_t length : {static_cast<off_t>(st.st_size - 1), static_cast<off_t>(st.st_size / 2),
+                        static_cast<off_t>(8), static_cast<off_t>(0)}) {
+    ASSERT_EQ(0, truncate(index_path.c_str(), length));
+    ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+    ASSERT_TRUE(reinterpret_cast<ZipArchive*>(handle)->index_map == nullptr);
+    AssertSameAsUnindexed(zip_path, handle);
+    CloseArchive(handle);
+
+    // and rewritten whole
+    struct stat rewritten;
+    ASSERT_EQ(0, stat(index_path.c_str(), &rewritten));
+    ASSERT_EQ(st.st_size, rewritten.st_size);
+  }
+}
+
+TEST(ziparchive, OpenWithCorruptIndex) {
+  TemporaryDir tmp_dir;
+  const std::string zip_path = std::string(tmp_dir.path) + "/" + kLargeZip;
+  const std::string index_path = zip_path + ".idx";
+  CopyTestArchive(kLargeZip, zip_path);
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  const size_t table_length =
+      reinterpret_cast<ZipArchive*>(handle)->hash_table_size * sizeof(ZipStringOffset);
+  CloseArchive(handle);
+
+  std::string index;
+  ASSERT_TRUE(android::base::ReadFileToString(index_path, &index));
+  ASSERT_LT(table_length, index.size());
+  const size_t header_length = index.size() - table_length;
+
+  // A damaged header is caught, the index is rebuilt.
+  std::string corrupt = index;
+  corrupt[0] ^= 0xff;
+  ASSERT_TRUE(android::base::WriteStringToFile(corrupt, index_path));
+  ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+  ASSERT_TRUE(reinterpret_cast<ZipArchive*>(handle)->index_map == nullptr);
+  AssertSameAsUnindexed(zip_path, handle);
+  CloseArchive(handle);
+
+  // Damaged slots behind a good header are not detected up front. Lookups
+  // must then fail or find the right entry, never read out of bounds.
+  for (char fill : {'\xff', '\x5a', '\x01'}) {
+    corrupt = index;
+    std::fill(corrupt.begin() + header_length, corrupt.end(), fill);
+    ASSERT_TRUE(android::base::WriteStringToFile(corrupt, index_path));
+
+    ZipArchiveHandle reference;
+    ASSERT_EQ(0, OpenArchive(zip_path.c_str(), &reference));
+    ASSERT_EQ(0, OpenArchiveWithIndex(zip_path.c_str(), index_path.c_str(), &handle));
+    void* cookie;
+    ASSERT_EQ(0, StartIteration(reference, &cookie, nullptr, nullptr));
+    ZipEntry expected;
+    ZipString name;
+    while (Next(cookie, &expected, &name) == 0) {
+      ZipEntry data;
+      if (FindEntry(handle, name, &data) == 0) {
+        AssertSameEntry(expected, data);
+      }
+    }
+    EndIteration(cookie);
+    void* indexed_cookie;
+    if (StartIteration(handle, &indexed_cookie, nullptr, nullptr) == 0) {
+      ZipEntry data;
+      while (Next(indexed_cookie, &data, &name) == 0) {
+      }
+      EndIteration(indexed_cookie);
+    }
+    CloseArchive(handle);
+    CloseArchive(reference);
+  }
+}
+
 TEST(ziparchive, OpenFromMemory) {
   const std::string zip_path = test_data_dir + "/" + kUpdateZip;
   android::base::unique_fd fd(open(zip_path.c_str(), O_RDONLY | O_BINARY));
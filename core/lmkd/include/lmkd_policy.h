@@ -0,0 +1,200 @@
+/*
+ *  Copyright 2018 Google, Inc
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef _LMKD_POLICY_H_
+#define _LMKD_POLICY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/cdefs.h>
+
+#include <lmkd.h>
+
+__BEGIN_DECLS
+
+/*
+ * Kill decisions of lmkd, kept free of any I/O so that recorded memory
+ * pressure traces can be replayed against them offline (see lmkd_replay).
+ */
+
+/* OOM score values used by both kernel and framework */
+#define OOM_SCORE_ADJ_MIN       (-1000)
+#define OOM_SCORE_ADJ_MAX       1000
+
+/* memory pressure levels */
+enum vmpressure_level {
+    VMPRESS_LEVEL_LOW = 0,
+    VMPRESS_LEVEL_MEDIUM,
+    VMPRESS_LEVEL_CRITICAL,
+    VMPRESS_LEVEL_COUNT
+};
+
+extern const char* const level_name[VMPRESS_LEVEL_COUNT];
+
+/* Fields to parse in /proc/zoneinfo */
+enum zoneinfo_field {
+    ZI_NR_FREE_PAGES = 0,
+    ZI_NR_FILE_PAGES,
+    ZI_NR_SHMEM,
+    ZI_NR_UNEVICTABLE,
+    ZI_WORKINGSET_REFAULT,
+    ZI_HIGH,
+    ZI_FIELD_COUNT
+};
+
+extern const char* const zoneinfo_field_names[ZI_FIELD_COUNT];
+
+union zoneinfo {
+    struct {
+        int64_t nr_free_pages;
+        int64_t nr_file_pages;
+        int64_t nr_shmem;
+        int64_t nr_unevictable;
+        int64_t workingset_refault;
+        int64_t high;
+        /* fields below are calculated rather than read from the file */
+        int64_t totalreserve_pages;
+    } field;
+    int64_t arr[ZI_FIELD_COUNT];
+};
+
+/* Fields to parse in /proc/meminfo */
+enum meminfo_field {
+    MI_NR_FREE_PAGES = 0,
+    MI_CACHED,
+    MI_SWAP_CACHED,
+    MI_BUFFERS,
+    MI_SHMEM,
+    MI_UNEVICTABLE,
+    MI_FREE_SWAP,
+    MI_DIRTY,
+    MI_FIELD_COUNT
+};
+
+extern const char* const meminfo_field_names[MI_FIELD_COUNT];
+
+union meminfo {
+    struct {
+        int64_t nr_free_pages;
+        int64_t cached;
+        int64_t swap_cached;
+        int64_t buffers;
+        int64_t shmem;
+        int64_t unevictable;
+        int64_t free_swap;
+        int64_t dirty;
+        /* fields below are calculated rather than read from the file */
+        int64_t nr_file_pages;
+    } field;
+    int64_t arr[MI_FIELD_COUNT];
+};
+
+/*
+ * Parse the contents of /proc/zoneinfo in a single pass, summing the fields
+ * above over all zones.
+ * Returns 0 on success or -1 if a field value is malformed.
+ */
+int zoneinfo_parse_buf(const char *buf, union zoneinfo *zi);
+
+/*
+ * Parse the contents of /proc/meminfo, converting sizes to pages of
+ * page_k kB. Parsing stops as soon as all the fields above were seen.
+ * Returns 0 on success or -1 if a field value is malformed.
+ */
+int meminfo_parse_buf(const char *buf, long page_k, union meminfo *mi);
+
+/* Kill policy settings, read from the properties described in README.md */
+struct lmk_policy {
+    int level_oomadj[VMPRESS_LEVEL_COUNT];
+    bool debug;
+    bool enable_pressure_upgrade;
+    int64_t upgrade_pressure;
+    int64_t downgrade_pressure;
+    bool low_ram_device;
+    bool use_minfree_levels;
+    bool enhance_batch_kill;
+    bool enable_adaptive_lmk;
+    /* minfree targets, set by ActivityManager through LMK_TARGET */
+    int lowmem_adj[MAX_TARGETS];
+    int lowmem_minfree[MAX_TARGETS];
+    int lowmem_targets_size;
+    /* PAGE_SIZE / 1024 */
+    long page_k;
+};
+
+/* Signatures of property_get_bool() and property_get_int32() */
+typedef int8_t (*lmk_get_bool_fn)(const char *key, int8_t default_value);
+typedef int32_t (*lmk_get_int32_fn)(const char *key, int32_t default_value);
+
+/* Fill in policy settings from properties, using lmkd defaults */
+void lmk_policy_load(struct lmk_policy *policy, lmk_get_bool_fn get_bool,
+                     lmk_get_int32_fn get_int32);
+
+/* Free memory recorded at low pressure, carried from one decision to the next */
+struct lmk_policy_state {
+    int64_t min_nr_free_pages; /* recorded but not used yet */
+    int64_t max_nr_free_pages;
+};
+
+#define LMK_POLICY_STATE_INIT { -1, -1 }
+
+struct lmk_decision {
+    /* pressure level after upgrade or downgrade */
+    enum vmpressure_level level;
+    int min_score_adj;
+    int pages_to_free;
+    /* minfree mode only: the threshold crossed and the memory it was compared to */
+    int minfree;
+    long other_free;
+    long other_file;
+};
+
+/*
+ * Decide whether a memory pressure event at the given level calls for a kill.
+ * get_mem_pressure returns memcg usage as a percentage of memory+swap usage,
+ * or -1 if unknown; it is only called when the decision depends on it.
+ * Returns true and fills in decision if processes should be killed.
+ */
+bool lmk_policy_decide(const struct lmk_policy *policy, struct lmk_policy_state *state,
+                       enum vmpressure_level level, const union meminfo *mi,
+                       const union zoneinfo *zi,
+                       int64_t (*get_mem_pressure)(void *ctx), void *ctx,
+                       struct lmk_decision *decision);
+
+/*
+ * Processes of one oom_score_adj ordered by cached size, heaviest first,
+ * for ro.lmk.kill_heaviest_task. lmkd embeds a node in each process.
+ */
+struct lmk_size_node {
+    struct lmk_size_node *next;
+    struct lmk_size_node *prev;
+    /* rss + swap in pages */
+    int size;
+};
+
+void lmk_size_list_init(struct lmk_size_node *head);
+
+/* Inserts node behind those at least as heavy, so ties stay in order */
+void lmk_size_list_insert(struct lmk_size_node *head, struct lmk_size_node *node);
+
+void lmk_size_list_remove(struct lmk_size_node *node);
+
+/* Returns the heaviest node, or NULL if the list is empty */
+struct lmk_size_node *lmk_size_list_heaviest(struct lmk_size_node *head);
+
+__END_DECLS
+
+#endif /* _LMKD_POLICY_H_ */
@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <sched.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/cdefs.h>
@@ -34,6 +35,7 @@
 #include <cutils/properties.h>
 #include <cutils/sockets.h>
 #include <lmkd.h>
+#include <lmkd_policy.h>
 #include <log/log.h>
 
 #ifdef LMKD_LOG_STATS
@@ -68,6 +70,7 @@
 #define MEMCG_MEMORYSW_USAGE "/dev/memcg/memory.memsw.usage_in_bytes"
 #define ZONEINFO_PATH "/proc/zoneinfo"
 #define MEMINFO_PATH "/proc/meminfo"
+#define PSI_MEMORY_PATH "/proc/pressure/memory"
 #define LINE_MAX 128
 
 #define INKERNEL_MINFREE_PATH "/sys/module/lowmemorykiller/parameters/minfree"
@@ -85,39 +88,19 @@
 static int use_inkernel_interface = 1;
 static bool has_inkernel_module;
 
-/* memory pressure levels */
-enum vmpressure_level {
-    VMPRESS_LEVEL_LOW = 0,
-    VMPRESS_LEVEL_MEDIUM,
-    VMPRESS_LEVEL_CRITICAL,
-    VMPRESS_LEVEL_COUNT
-};
-
-static const char *level_name[] = {
-    "low",
-    "medium",
-    "critical"
-};
+static struct lmk_policy policy;
+static struct lmk_policy_state policy_state = LMK_POLICY_STATE_INIT;
 
-struct {
-    int64_t min_nr_free_pages; /* recorded but not used yet */
-    int64_t max_nr_free_pages;
-} low_pressure_mem = { -1, -1 };
-
-static int level_oomadj[VMPRESS_LEVEL_COUNT];
 static int mpevfd[VMPRESS_LEVEL_COUNT] = { -1, -1, -1 };
-static bool debug_process_killing;
-static bool enable_pressure_upgrade;
-static int64_t upgrade_pressure;
-static int64_t downgrade_pressure;
-static bool low_ram_device;
+static int psi_fd[VMPRESS_LEVEL_COUNT] = { -1, -1, -1 };
 static bool kill_heaviest_task;
 static unsigned long kill_timeout_ms;
-static bool use_minfree_levels;
 static bool per_app_memcg;
-static bool enhance_batch_kill;
-static bool enable_adaptive_lmk;
 static bool enable_userspace_lmk;
+static bool use_psi_monitors;
+static int psi_partial_stall_ms;
+static int psi_complete_stall_ms;
+static int psi_window_ms;
 
 /* data required to handle events */
 struct event_handler_info {
@@ -146,94 +129,6 @@ static struct event_handler_info vmpressure_hinfo[VMPRESS_LEVEL_COUNT];
 static int epollfd;
 static int maxevents;
 
-/* OOM score values used by both kernel and framework */
-#define OOM_SCORE_ADJ_MIN       (-1000)
-#define OOM_SCORE_ADJ_MAX       1000
-
-static int lowmem_adj[MAX_TARGETS];
-static int lowmem_minfree[MAX_TARGETS];
-static int lowmem_targets_size;
-
-/* Fields to parse in /proc/zoneinfo */
-enum zoneinfo_field {
-    ZI_NR_FREE_PAGES = 0,
-    ZI_NR_FILE_PAGES,
-    ZI_NR_SHMEM,
-    ZI_NR_UNEVICTABLE,
-    ZI_WORKINGSET_REFAULT,
-    ZI_HIGH,
-    ZI_FIELD_COUNT
-};
-
-static const char* const zoneinfo_field_names[ZI_FIELD_COUNT] = {
-    "nr_free_pages",
-    "nr_file_pages",
-    "nr_shmem",
-    "nr_unevictable",
-    "workingset_refault",
-    "high",
-};
-
-union zoneinfo {
-    struct {
-        int64_t nr_free_pages;
-        int64_t nr_file_pages;
-        int64_t nr_shmem;
-        int64_t nr_unevictable;
-        int64_t workingset_refault;
-        int64_t high;
-        /* fields below are calculated rather than read from the file */
-        int64_t totalreserve_pages;
-    } field;
-    int64_t arr[ZI_FIELD_COUNT];
-};
-
-/* Fields to parse in /proc/meminfo */
-enum meminfo_field {
-    MI_NR_FREE_PAGES = 0,
-    MI_CACHED,
-    MI_SWAP_CACHED,
-    MI_BUFFERS,
-    MI_SHMEM,
-    MI_UNEVICTABLE,
-    MI_FREE_SWAP,
-    MI_DIRTY,
-    MI_FIELD_COUNT
-};
-
-static const char* const meminfo_field_names[MI_FIELD_COUNT] = {
-    "MemFree:",
-    "Cached:",
-    "SwapCached:",
-    "Buffers:",
-    "Shmem:",
-    "Unevictable:",
-    "SwapFree:",
-    "Dirty:",
-};
-
-union meminfo {
-    struct {
-        int64_t nr_free_pages;
-        int64_t cached;
-        int64_t swap_cached;
-        int64_t buffers;
-        int64_t shmem;
-        int64_t unevictable;
-        int64_t free_swap;
-        int64_t dirty;
-        /* fields below are calculated rather than read from the file */
-        int64_t nr_file_pages;
-    } field;
-    int64_t arr[MI_FIELD_COUNT];
-};
-
-enum field_match_result {
-    NO_MATCH,
-    PARSE_FAIL,
-    PARSE_SUCCESS
-};
-
 struct adjslot_list {
     struct adjslot_list *next;
     struct adjslot_list *prev;
@@ -244,9 +139,14 @@ struct proc {
     int pid;
     uid_t uid;
     int oomadj;
+    /* size refreshed in the background with kill_heaviest_task */
+    struct lmk_size_node size_node;
     struct proc *pidhash_next;
 };
 
+#define size_node_to_proc(n) \
+    ((struct proc *)((char *)(n) - offsetof(struct proc, size_node)))
+
 struct reread_data {
     const char* const filename;
     int fd;
@@ -263,9 +163,16 @@ static struct proc *pidhash[PIDHASH_SZ];
 
 #define ADJTOSLOT(adj) ((adj) + -OOM_SCORE_ADJ_MIN)
 static struct adjslot_list procadjslot_list[ADJTOSLOT(OOM_SCORE_ADJ_MAX) + 1];
+/* the same processes ordered by cached size, heaviest first */
+static struct lmk_size_node procadjslot_size_list[ADJTOSLOT(OOM_SCORE_ADJ_MAX) + 1];
 
-/* PAGE_SIZE / 1024 */
-static long page_k;
+/*
+ * cached process sizes refreshed per mainloop wakeup and how often, for as
+ * long as memory pressure was seen recently
+ */
+#define PROC_SIZE_REFRESH_BATCH 16
+#define PROC_SIZE_REFRESH_PERIOD_MS 1000
+#define PROC_SIZE_REFRESH_ACTIVE_MS 30000
 
 static bool parse_int64(const char* str, int64_t* ret) {
     char* endptr;
@@ -277,22 +184,6 @@ static bool parse_int64(const char* str, int64_t* ret) {
     return true;
 }
 
-static enum field_match_result match_field(const char* cp, const char* ap,
-                                   const char* const field_names[],
-                                   int field_count, int64_t* field,
-                                   int *field_idx) {
-    int64_t val;
-    int i;
-
-    for (i = 0; i < field_count; i++) {
-        if (!strcmp(cp, field_names[i])) {
-            *field_idx = i;
-            return parse_int64(ap, field) ? PARSE_SUCCESS : PARSE_FAIL;
-        }
-    }
-    return NO_MATCH;
-}
-
 /*
  * Read file content from the beginning up to max_len bytes or EOF
  * whichever happens first.
@@ -383,14 +274,21 @@ static struct adjslot_list *adjslot_tail(struct adjslot_list *head) {
     return asl == head ? NULL : asl;
 }
 
+static void proc_size_slot(struct proc *procp) {
+    lmk_size_list_insert(&procadjslot_size_list[ADJTOSLOT(procp->oomadj)],
+                         &procp->size_node);
+}
+
 static void proc_slot(struct proc *procp) {
     int adjslot = ADJTOSLOT(procp->oomadj);
 
     adjslot_insert(&procadjslot_list[adjslot], &procp->asl);
+    proc_size_slot(procp);
 }
 
 static void proc_unslot(struct proc *procp) {
     adjslot_remove(&procp->asl);
+    lmk_size_list_remove(&procp->size_node);
 }
 
 static void proc_insert(struct proc *procp) {
@@ -423,6 +321,106 @@ static int pid_remove(int pid) {
     return 0;
 }
 
+static int proc_get_size(int pid) {
+    char path[PATH_MAX];
+    char line[LINE_MAX];
+    int fd;
+    int rss = 0;
+    int total;
+    ssize_t ret;
+
+    snprintf(path, PATH_MAX, "/proc/%d/statm", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    ret = read_all(fd, line, sizeof(line) - 1);
+    if (ret < 0) {
+        close(fd);
+        return -1;
+    }
+
+    sscanf(line, "%d %d ", &total, &rss);
+    close(fd);
+    return rss;
+}
+
+/* VmSwap of a process in pages */
+static int proc_get_swap(int pid) {
+    char path[PATH_MAX];
+    char buf[PAGE_SIZE];
+    char *cp;
+    int fd;
+    ssize_t ret;
+
+    snprintf(path, PATH_MAX, "/proc/%d/status", pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return 0;
+
+    ret = read_all(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (ret < 0) {
+        return 0;
+    }
+    buf[ret] = '\0';
+
+    cp = strstr(buf, "\nVmSwap:");
+    if (!cp) {
+        return 0;
+    }
+    return strtol(cp + strlen("\nVmSwap:"), NULL, 10) / policy.page_k;
+}
+
+/* Memory freed by killing a process in pages, or -1 if it is gone */
+static int proc_read_size(int pid) {
+    int rss = proc_get_size(pid);
+
+    if (rss <= 0) {
+        return -1;
+    }
+    return rss + proc_get_swap(pid);
+}
+
+/*
+ * Refresh the cached size of a process, which is removed if it died.
+ * WARNING: procp is freed in that case and can't be used!
+ */
+static void proc_refresh_size(struct proc *procp) {
+    int size = proc_read_size(procp->pid);
+
+    if (size < 0) {
+        pid_remove(procp->pid);
+        return;
+    }
+
+    lmk_size_list_remove(&procp->size_node);
+    procp->size_node.size = size;
+    proc_size_slot(procp);
+}
+
+/*
+ * Refresh the sizes of the next few tracked processes, so that victims
+ * can be picked without reading /proc while memory is short.
+ */
+static void proc_refresh_sizes(void) {
+    static int bucket;
+    struct proc *procp;
+    struct proc *next;
+    int refreshed = 0;
+    int scanned;
+
+    for (scanned = 0; scanned < PIDHASH_SZ && refreshed < PROC_SIZE_REFRESH_BATCH;
+         scanned++) {
+        for (procp = pidhash[bucket]; procp; procp = next) {
+            next = procp->pidhash_next;
+            proc_refresh_size(procp);
+            refreshed++;
+        }
+        bucket = (bucket + 1) % PIDHASH_SZ;
+    }
+}
+
 static void writefilestring(const char *path, char *s) {
     int fd = open(path, O_WRONLY | O_CLOEXEC);
     int len = strlen(s);
@@ -465,7 +463,7 @@ static void cmd_procprio(LMKD_CTRL_PACKET packet) {
     if (use_inkernel_interface)
         return;
 
-    if (low_ram_device) {
+    if (policy.low_ram_device) {
         if (params.oomadj >= 900) {
             soft_limit_mult = 0;
         } else if (params.oomadj >= 800) {
@@ -512,8 +510,13 @@ static void cmd_procprio(LMKD_CTRL_PACKET packet) {
             procp->pid = params.pid;
             procp->uid = params.uid;
             procp->oomadj = params.oomadj;
+            procp->size_node.size = kill_heaviest_task ? proc_read_size(params.pid) : 0;
+            if (procp->size_node.size < 0) {
+                procp->size_node.size = 0;
+            }
             proc_insert(procp);
     } else {
+        /* the cached size moves along, the refresher catches up with it */
         proc_unslot(procp);
         procp->oomadj = params.oomadj;
         proc_slot(procp);
@@ -546,6 +549,7 @@ static void cmd_procpurge() {
     for (i = 0; i <= ADJTOSLOT(OOM_SCORE_ADJ_MAX); i++) {
         procadjslot_list[i].next = &procadjslot_list[i];
         procadjslot_list[i].prev = &procadjslot_list[i];
+        lmk_size_list_init(&procadjslot_size_list[i]);
     }
 
     for (i = 0; i < PIDHASH_SZ; i++) {
@@ -563,16 +567,16 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
     int i;
     struct lmk_target target;
 
-    if (ntargets > (int)ARRAY_SIZE(lowmem_adj))
+    if (ntargets > (int)ARRAY_SIZE(policy.lowmem_adj))
         return;
 
     for (i = 0; i < ntargets; i++) {
         lmkd_pack_get_target(packet, i, &target);
-        lowmem_minfree[i] = target.minfree;
-        lowmem_adj[i] = target.oom_adj_score;
+        policy.lowmem_minfree[i] = target.minfree;
+        policy.lowmem_adj[i] = target.oom_adj_score;
     }
 
-    lowmem_targets_size = ntargets;
+    policy.lowmem_targets_size = ntargets;
 
     if (has_inkernel_module) {
         char minfreestr[128];
@@ -581,7 +585,7 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
         minfreestr[0] = '\0';
         killpriostr[0] = '\0';
 
-        for (i = 0; i < lowmem_targets_size; i++) {
+        for (i = 0; i < policy.lowmem_targets_size; i++) {
             char val[40];
 
             if (i) {
@@ -589,9 +593,9 @@ static void cmd_target(int ntargets, LMKD_CTRL_PACKET packet) {
                 strlcat(killpriostr, ",", sizeof(killpriostr));
             }
 
-            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? lowmem_minfree[i] : 0);
+            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? policy.lowmem_minfree[i] : 0);
             strlcat(minfreestr, val, sizeof(minfreestr));
-            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? lowmem_adj[i] : 0);
+            snprintf(val, sizeof(val), "%d", use_inkernel_interface ? policy.lowmem_adj[i] : 0);
             strlcat(killpriostr, val, sizeof(killpriostr));
         }
 
@@ -653,7 +657,7 @@ static void ctrl_command_handler(int dsock_idx) {
     switch(cmd) {
     case LMK_TARGET:
         targets = nargs / 2;
-        if (nargs & 0x1 || targets > (int)ARRAY_SIZE(lowmem_adj))
+        if (nargs & 0x1 || targets > (int)ARRAY_SIZE(policy.lowmem_adj))
             goto wronglen;
         cmd_target(targets, packet);
         break;
@@ -818,167 +822,65 @@ static int memory_stat_from_procfs(struct memory_stat* mem_st, int pid) {
 }
 #endif
 
-/* /prop/zoneinfo parsing routines */
-static int64_t zoneinfo_parse_protection(char *cp) {
-    int64_t max = 0;
-    long long zoneval;
-    char *save_ptr;
-
-    for (cp = strtok_r(cp, "(), ", &save_ptr); cp;
-         cp = strtok_r(NULL, "), ", &save_ptr)) {
-        zoneval = strtoll(cp, &cp, 0);
-        if (zoneval > max) {
-            max = (zoneval > INT64_MAX) ? INT64_MAX : zoneval;
-        }
-    }
-
-    return max;
-}
-
-static bool zoneinfo_parse_line(char *line, union zoneinfo *zi) {
-    char *cp = line;
-    char *ap;
-    char *save_ptr;
-    int64_t val;
-    int field_idx;
-
-    cp = strtok_r(line, " ", &save_ptr);
-    if (!cp) {
-        return true;
-    }
-
-    if (!strcmp(cp, "protection:")) {
-        ap = strtok_r(NULL, ")", &save_ptr);
-    } else {
-        ap = strtok_r(NULL, " ", &save_ptr);
-    }
-
-    if (!ap) {
-        return true;
-    }
-
-    switch (match_field(cp, ap, zoneinfo_field_names,
-                        ZI_FIELD_COUNT, &val, &field_idx)) {
-    case (PARSE_SUCCESS):
-        zi->arr[field_idx] += val;
-        break;
-    case (NO_MATCH):
-        if (!strcmp(cp, "protection:")) {
-            zi->field.totalreserve_pages +=
-                zoneinfo_parse_protection(ap);
-        }
-        break;
-    case (PARSE_FAIL):
-    default:
-        return false;
-    }
-    return true;
-}
-
 static int zoneinfo_parse(union zoneinfo *zi) {
     static struct reread_data file_data = {
         .filename = ZONEINFO_PATH,
         .fd = -1,
     };
     char buf[PAGE_SIZE];
-    char *save_ptr;
-    char *line;
-
-    memset(zi, 0, sizeof(union zoneinfo));
 
     if (reread_file(&file_data, buf, sizeof(buf)) < 0) {
         return -1;
     }
 
-    for (line = strtok_r(buf, "\n", &save_ptr); line;
-         line = strtok_r(NULL, "\n", &save_ptr)) {
-        if (!zoneinfo_parse_line(line, zi)) {
-            ALOGE("%s parse error", file_data.filename);
-            return -1;
-        }
+    if (zoneinfo_parse_buf(buf, zi) < 0) {
+        ALOGE("%s parse error", file_data.filename);
+        return -1;
     }
-    zi->field.totalreserve_pages += zi->field.high;
 
     return 0;
 }
 
-/* /prop/meminfo parsing routines */
-static bool meminfo_parse_line(char *line, union meminfo *mi) {
-    char *cp = line;
-    char *ap;
-    char *save_ptr;
-    int64_t val;
-    int field_idx;
-    enum field_match_result match_res;
-
-    cp = strtok_r(line, " ", &save_ptr);
-    if (!cp) {
-        return false;
-    }
-
-    ap = strtok_r(NULL, " ", &save_ptr);
-    if (!ap) {
-        return false;
-    }
-
-    match_res = match_field(cp, ap, meminfo_field_names, MI_FIELD_COUNT,
-        &val, &field_idx);
-    if (match_res == PARSE_SUCCESS) {
-        mi->arr[field_idx] = val / page_k;
-    }
-    return (match_res != PARSE_FAIL);
-}
-
 static int meminfo_parse(union meminfo *mi) {
     static struct reread_data file_data = {
         .filename = MEMINFO_PATH,
         .fd = -1,
     };
     char buf[PAGE_SIZE];
-    char *save_ptr;
-    char *line;
-
-    memset(mi, 0, sizeof(union meminfo));
 
     if (reread_file(&file_data, buf, sizeof(buf)) < 0) {
         return -1;
     }
 
-    for (line = strtok_r(buf, "\n", &save_ptr); line;
-         line = strtok_r(NULL, "\n", &save_ptr)) {
-        if (!meminfo_parse_line(line, mi)) {
-            ALOGE("%s parse error", file_data.filename);
-            return -1;
-        }
+    if (meminfo_parse_buf(buf, policy.page_k, mi) < 0) {
+        ALOGE("%s parse error", file_data.filename);
+        return -1;
     }
-    mi->field.nr_file_pages = mi->field.cached + mi->field.swap_cached +
-        mi->field.buffers;
 
     return 0;
 }
 
-static int proc_get_size(int pid) {
-    char path[PATH_MAX];
-    char line[LINE_MAX];
-    int fd;
-    int rss = 0;
-    int total;
-    ssize_t ret;
-
-    snprintf(path, PATH_MAX, "/proc/%d/statm", pid);
-    fd = open(path, O_RDONLY | O_CLOEXEC);
-    if (fd == -1)
-        return -1;
+/*
+ * Memory state shared by the pressure events handled in one epoll cycle.
+ * Several levels usually fire together and there is no need to read and
+ * parse /proc again for each of them, unless something was killed since.
+ */
+static struct {
+    bool valid;
+    union meminfo mi;
+    union zoneinfo zi;
+} mem_snapshot;
 
-    ret = read_all(fd, line, sizeof(line) - 1);
-    if (ret < 0) {
-        close(fd);
-        return -1;
+static int get_memory_state(union meminfo *mi, union zoneinfo *zi) {
+    if (!mem_snapshot.valid) {
+        if (meminfo_parse(&mem_snapshot.mi) < 0 || zoneinfo_parse(&mem_snapshot.zi) < 0) {
+            return -1;
+        }
+        mem_snapshot.valid = true;
     }
-
-    sscanf(line, "%d %d ", &total, &rss);
-    close(fd);
-    return rss;
+    *mi = mem_snapshot.mi;
+    *zi = mem_snapshot.zi;
+    return 0;
 }
 
 static char *proc_get_name(int pid) {
@@ -1009,31 +911,21 @@ static struct proc *proc_adj_lru(int oomadj) {
     return (struct proc *)adjslot_tail(&procadjslot_list[ADJTOSLOT(oomadj)]);
 }
 
+/* Heaviest by cached size, the victim will be sized again when killed */
 static struct proc *proc_get_heaviest(int oomadj) {
-    struct adjslot_list *head = &procadjslot_list[ADJTOSLOT(oomadj)];
-    struct adjslot_list *curr = head->next;
-    struct proc *maxprocp = NULL;
-    int maxsize = 0;
-    while (curr != head) {
-        int pid = ((struct proc *)curr)->pid;
-        int tasksize = proc_get_size(pid);
-        if (tasksize <= 0) {
-            struct adjslot_list *next = curr->next;
-            pid_remove(pid);
-            curr = next;
-        } else {
-            if (tasksize > maxsize) {
-                maxsize = tasksize;
-                maxprocp = (struct proc *)curr;
-            }
-            curr = curr->next;
-        }
-    }
-    return maxprocp;
+    struct lmk_size_node *node = lmk_size_list_heaviest(&procadjslot_size_list[ADJTOSLOT(oomadj)]);
+
+    return node ? size_node_to_proc(node) : NULL;
 }
 
 static int last_killed_pid = -1;
 
+/* when handling of the memory pressure event being acted on started */
+static struct timespec last_event_tm;
+
+/* when the last memory pressure event came, for refreshing process sizes */
+static struct timeval last_pressure_tm;
+
 /* Kill one process specified by procp.  Returns the size of the process killed */
 static int kill_one_process(struct proc* procp) {
     int pid = procp->pid;
@@ -1046,6 +938,8 @@ static int kill_one_process(struct proc* procp) {
 #ifdef LMKD_LOG_STATS
     struct memory_stat mem_st = {};
     int memory_stat_parse_result = -1;
+    struct timespec kill_tm;
+    int64_t kill_latency_us;
 #endif
 
     taskname = proc_get_name(pid);
@@ -1073,10 +967,16 @@ static int kill_one_process(struct proc* procp) {
     /* CAP_KILL required */
     r = kill(pid, SIGKILL);
     ALOGI("Kill '%s' (%d), uid %d, oom_adj %d to free %ldkB",
-        taskname, pid, uid, procp->oomadj, tasksize * page_k);
+        taskname, pid, uid, procp->oomadj, tasksize * policy.page_k);
 
     TRACE_KILL_END();
 
+#ifdef LMKD_LOG_STATS
+    clock_gettime(CLOCK_MONOTONIC, &kill_tm);
+    kill_latency_us = (kill_tm.tv_sec - last_event_tm.tv_sec) * 1000000LL +
+        (kill_tm.tv_nsec - last_event_tm.tv_nsec) / 1000;
+#endif
+
     last_killed_pid = pid;
 
     if (r) {
@@ -1087,10 +987,11 @@ static int kill_one_process(struct proc* procp) {
         if (memory_stat_parse_result == 0) {
             stats_write_lmk_kill_occurred(log_ctx, LMK_KILL_OCCURRED, uid, taskname,
                     procp->oomadj, mem_st.pgfault, mem_st.pgmajfault, mem_st.rss_in_bytes,
-                    mem_st.cache_in_bytes, mem_st.swap_in_bytes);
+                    mem_st.cache_in_bytes, mem_st.swap_in_bytes, kill_latency_us);
         } else if (enable_stats_log) {
             stats_write_lmk_kill_occurred(log_ctx, LMK_KILL_OCCURRED, uid, taskname, procp->oomadj,
-                                          -1, -1, tasksize * BYTES_IN_KILOBYTE, -1, -1);
+                                          -1, -1, tasksize * BYTES_IN_KILOBYTE, -1, -1,
+                                          kill_latency_us);
         }
 #endif
         result = tasksize;
@@ -1183,41 +1084,67 @@ static int64_t get_memory_usage(struct reread_data *file_data) {
     return mem_usage;
 }
 
-void record_low_pressure_levels(union meminfo *mi) {
-    if (low_pressure_mem.min_nr_free_pages == -1 ||
-        low_pressure_mem.min_nr_free_pages > mi->field.nr_free_pages) {
-        if (debug_process_killing) {
-            ALOGI("Low pressure min memory update from %" PRId64 " to %" PRId64,
-                low_pressure_mem.min_nr_free_pages, mi->field.nr_free_pages);
-        }
-        low_pressure_mem.min_nr_free_pages = mi->field.nr_free_pages;
+/* Not read yet for the current event */
+#define MEM_PRESSURE_UNKNOWN INT64_MIN
+
+/*
+ * Percentage of memcg memory+swap usage that is memory usage, or -1 if
+ * unavailable. Cached in ctx so it is read at most once per event.
+ */
+static int64_t get_mem_pressure(void *ctx) {
+    int64_t *mem_pressure = (int64_t *)ctx;
+    int64_t mem_usage, memsw_usage;
+    static struct reread_data mem_usage_file_data = {
+        .filename = MEMCG_MEMORY_USAGE,
+        .fd = -1,
+    };
+    static struct reread_data memsw_usage_file_data = {
+        .filename = MEMCG_MEMORYSW_USAGE,
+        .fd = -1,
+    };
+
+    if (*mem_pressure != MEM_PRESSURE_UNKNOWN) {
+        return *mem_pressure;
     }
-    /*
-     * Free memory at low vmpressure events occasionally gets spikes,
-     * possibly a stale low vmpressure event with memory already
-     * freed up (no memory pressure should have been reported).
-     * Ignore large jumps in max_nr_free_pages that would mess up our stats.
-     */
-    if (low_pressure_mem.max_nr_free_pages == -1 ||
-        (low_pressure_mem.max_nr_free_pages < mi->field.nr_free_pages &&
-         mi->field.nr_free_pages - low_pressure_mem.max_nr_free_pages <
-         low_pressure_mem.max_nr_free_pages * 0.1)) {
-        if (debug_process_killing) {
-            ALOGI("Low pressure max memory update from %" PRId64 " to %" PRId64,
-                low_pressure_mem.max_nr_free_pages, mi->field.nr_free_pages);
-        }
-        low_pressure_mem.max_nr_free_pages = mi->field.nr_free_pages;
+
+    if ((mem_usage = get_memory_usage(&mem_usage_file_data)) < 0 ||
+        (memsw_usage = get_memory_usage(&memsw_usage_file_data)) < 0) {
+        *mem_pressure = -1;
+    } else {
+        // Calculate percent for swappinness.
+        *mem_pressure = (mem_usage * 100) / memsw_usage;
     }
+    return *mem_pressure;
 }
 
-enum vmpressure_level upgrade_level(enum vmpressure_level level) {
-    return (enum vmpressure_level)((level < VMPRESS_LEVEL_CRITICAL) ?
-        level + 1 : level);
-}
+/*
+ * Log the inputs of a kill decision as key=value pairs, meminfo and zoneinfo
+ * values in pages. lmkd_replay reads these lines back from logcat.
+ */
+static void log_pressure_sample(struct timeval *tm, enum vmpressure_level level,
+                                union meminfo *mi, union zoneinfo *zi,
+                                int64_t mem_pressure) {
+    char buf[1024];
+    int len;
+    int i;
 
-enum vmpressure_level downgrade_level(enum vmpressure_level level) {
-    return (enum vmpressure_level)((level > VMPRESS_LEVEL_LOW) ?
-        level - 1 : level);
+    len = snprintf(buf, sizeof(buf), "sample t=%lld level=%s page_k=%ld",
+                   (long long)tm->tv_sec * 1000 + tm->tv_usec / 1000,
+                   level_name[level], policy.page_k);
+    for (i = 0; i < MI_FIELD_COUNT; i++) {
+        /* without the trailing colon */
+        len += snprintf(buf + len, sizeof(buf) - len, " %.*s=%" PRId64,
+                        (int)strlen(meminfo_field_names[i]) - 1,
+                        meminfo_field_names[i], mi->arr[i]);
+    }
+    for (i = 0; i < ZI_FIELD_COUNT; i++) {
+        len += snprintf(buf + len, sizeof(buf) - len, " %s=%" PRId64,
+                        zoneinfo_field_names[i], zi->arr[i]);
+    }
+    snprintf(buf + len, sizeof(buf) - len,
+             " totalreserve_pages=%" PRId64 " mem_pressure=%" PRId64,
+             zi->field.totalreserve_pages, mem_pressure);
+    ALOGI("%s", buf);
 }
 
 static inline unsigned long get_time_diff_ms(struct timeval *from,
@@ -1243,10 +1170,8 @@ static bool is_kill_pending(void) {
 }
 
 static void mp_event_common(int data, uint32_t events __unused) {
-    int ret;
     unsigned long long evcount;
-    int64_t mem_usage, memsw_usage;
-    int64_t mem_pressure;
+    int64_t mem_pressure = MEM_PRESSURE_UNKNOWN;
     enum vmpressure_level lvl;
     union meminfo mi;
     union zoneinfo zi;
@@ -1254,23 +1179,15 @@ static void mp_event_common(int data, uint32_t events __unused) {
     static struct timeval last_kill_tm;
     static unsigned long kill_skip_count = 0;
     enum vmpressure_level level = (enum vmpressure_level)data;
-    long other_free = 0, other_file = 0;
-    int min_score_adj;
-    int pages_to_free = 0;
-    int minfree = 0;
-    static struct reread_data mem_usage_file_data = {
-        .filename = MEMCG_MEMORY_USAGE,
-        .fd = -1,
-    };
-    static struct reread_data memsw_usage_file_data = {
-        .filename = MEMCG_MEMORYSW_USAGE,
-        .fd = -1,
-    };
+    struct lmk_decision decision;
+
+    clock_gettime(CLOCK_MONOTONIC, &last_event_tm);
 
     /*
      * Check all event counters from low to critical
      * and upgrade to the highest priority one. By reading
      * eventfd we also reset the event counters.
+     * PSI monitors are not counters and do not need a reset.
      */
     for (lvl = VMPRESS_LEVEL_LOW; lvl < VMPRESS_LEVEL_COUNT; lvl++) {
         if (mpevfd[lvl] != -1 &&
@@ -1282,12 +1199,13 @@ static void mp_event_common(int data, uint32_t events __unused) {
     }
 
     gettimeofday(&curr_tm, NULL);
+    last_pressure_tm = curr_tm;
     if (kill_timeout_ms) {
         // If we're within the timeout, see if there's pending reclaim work
         // from the last killed process. If there is (as evidenced by
         // /proc/<pid> continuing to exist), skip killing for now.
         if ((get_time_diff_ms(&last_kill_tm, &curr_tm) < kill_timeout_ms) &&
-            (low_ram_device || is_kill_pending())) {
+            (policy.low_ram_device || is_kill_pending())) {
             kill_skip_count++;
             return;
         }
@@ -1299,143 +1217,35 @@ static void mp_event_common(int data, uint32_t events __unused) {
         kill_skip_count = 0;
     }
 
-    if (meminfo_parse(&mi) < 0 || zoneinfo_parse(&zi) < 0) {
+    if (get_memory_state(&mi, &zi) < 0) {
         ALOGE("Failed to get free memory!");
         return;
     }
 
-    if (use_minfree_levels) {
-        int i;
-
-        other_free = mi.field.nr_free_pages - zi.field.totalreserve_pages;
-        if (mi.field.nr_file_pages > (mi.field.shmem + mi.field.unevictable + mi.field.swap_cached)) {
-            other_file = (mi.field.nr_file_pages - mi.field.shmem -
-                          mi.field.unevictable - mi.field.swap_cached);
-        } else {
-            other_file = 0;
-        }
-
-        min_score_adj = OOM_SCORE_ADJ_MAX + 1;
-        for (i = 0; i < lowmem_targets_size; i++) {
-            minfree = lowmem_minfree[i];
-            if (other_free < minfree && other_file < minfree) {
-                min_score_adj = lowmem_adj[i];
-                // Adaptive LMK
-                if (enable_adaptive_lmk && level == VMPRESS_LEVEL_CRITICAL &&
-                        i > lowmem_targets_size-4) {
-                    min_score_adj = lowmem_adj[i-1];
-                }
-                break;
-            }
-        }
-
-        if (min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
-            if (debug_process_killing) {
-                ALOGI("Ignore %s memory pressure event "
-                      "(free memory=%ldkB, cache=%ldkB, limit=%ldkB)",
-                      level_name[level], other_free * page_k, other_file * page_k,
-                      (long)lowmem_minfree[lowmem_targets_size - 1] * page_k);
-            }
-            return;
-        }
-
-        if (enhance_batch_kill) {
-            // Kill one process at a time.
-            pages_to_free = 0;
-        } else {
-            /* Original minfree logic */
-            /* Free up enough pages to push over the highest minfree level */
-            pages_to_free = lowmem_minfree[lowmem_targets_size - 1] -
-                ((other_free < other_file) ? other_free : other_file);
-        }
-        goto do_kill;
-    }
-
-    if (level == VMPRESS_LEVEL_LOW) {
-        record_low_pressure_levels(&mi);
+    if (policy.debug) {
+        log_pressure_sample(&curr_tm, level, &mi, &zi, get_mem_pressure(&mem_pressure));
     }
 
-    if (level_oomadj[level] > OOM_SCORE_ADJ_MAX) {
-        /* Do not monitor this pressure level */
+    if (!lmk_policy_decide(&policy, &policy_state, level, &mi, &zi,
+                           get_mem_pressure, &mem_pressure, &decision)) {
         return;
     }
 
-    if ((mem_usage = get_memory_usage(&mem_usage_file_data)) < 0) {
-        goto do_kill;
-    }
-    if ((memsw_usage = get_memory_usage(&memsw_usage_file_data)) < 0) {
-        goto do_kill;
-    }
-
-    // Calculate percent for swappinness.
-    mem_pressure = (mem_usage * 100) / memsw_usage;
-
-    if (enable_pressure_upgrade && level != VMPRESS_LEVEL_CRITICAL) {
-        // We are swapping too much.
-        if (mem_pressure < upgrade_pressure) {
-            level = upgrade_level(level);
-            if (debug_process_killing) {
-                ALOGI("Event upgraded to %s", level_name[level]);
-            }
-        }
-    }
-
-    // If the pressure is larger than downgrade_pressure lmk will not
-    // kill any process, since enough memory is available.
-    if (mem_pressure > downgrade_pressure) {
-        if (debug_process_killing) {
-            ALOGI("Ignore %s memory pressure", level_name[level]);
-        }
-        return;
-    } else if (level == VMPRESS_LEVEL_CRITICAL &&
-               mem_pressure > upgrade_pressure) {
-        if (debug_process_killing) {
-            ALOGI("Downgrade critical memory pressure");
-        }
-        // Downgrade event, since enough memory available.
-        level = downgrade_level(level);
-    }
-
-do_kill:
-    if (low_ram_device) {
+    if (policy.low_ram_device) {
         /* For Go devices kill only one task */
-        if (find_and_kill_processes(level_oomadj[level], 0) == 0) {
-            if (debug_process_killing) {
+        if (find_and_kill_processes(decision.min_score_adj, 0) == 0) {
+            if (policy.debug) {
                 ALOGI("Nothing to kill");
             }
+        } else {
+            mem_snapshot.valid = false;
         }
     } else {
         int pages_freed;
         static struct timeval last_report_tm;
         static unsigned long report_skip_count = 0;
 
-        if (!use_minfree_levels) {
-            /* If pressure level is less than critical and enough free swap then ignore */
-            if (level < VMPRESS_LEVEL_CRITICAL &&
-                mi.field.free_swap > low_pressure_mem.max_nr_free_pages) {
-                if (debug_process_killing) {
-                    ALOGI("Ignoring pressure since %" PRId64
-                          " swap pages are available ",
-                          mi.field.free_swap);
-                }
-                return;
-            }
-            /* Free up enough memory to downgrate the memory pressure to low level */
-            if (mi.field.nr_free_pages < low_pressure_mem.max_nr_free_pages) {
-                pages_to_free = low_pressure_mem.max_nr_free_pages -
-                    mi.field.nr_free_pages;
-            } else {
-                if (debug_process_killing) {
-                    ALOGI("Ignoring pressure since more memory is "
-                        "available (%" PRId64 ") than watermark (%" PRId64 ")",
-                        mi.field.nr_free_pages, low_pressure_mem.max_nr_free_pages);
-                }
-                return;
-            }
-            min_score_adj = level_oomadj[level];
-        }
-
-        pages_freed = find_and_kill_processes(min_score_adj, 0);
+        pages_freed = find_and_kill_processes(decision.min_score_adj, 0);
 
         if (pages_freed == 0) {
             /* Rate limit kill reports when nothing was reclaimed */
@@ -1446,20 +1256,22 @@ do_kill:
         } else {
             /* If we killed anything, update the last killed timestamp. */
             last_kill_tm = curr_tm;
+            mem_snapshot.valid = false;
         }
 
-        if (use_minfree_levels) {
+        if (policy.use_minfree_levels) {
             ALOGI("Killing to reclaim %ldkB, reclaimed %ldkB, cache(%ldkB) and "
                 "free(%" PRId64 "kB)-reserved(%" PRId64 "kB) below min(%ldkB) for oom_adj %d",
-                pages_to_free * page_k, pages_freed * page_k,
-                other_file * page_k, mi.field.nr_free_pages * page_k,
-                zi.field.totalreserve_pages * page_k,
-                minfree * page_k, min_score_adj);
+                decision.pages_to_free * policy.page_k, pages_freed * policy.page_k,
+                decision.other_file * policy.page_k, mi.field.nr_free_pages * policy.page_k,
+                zi.field.totalreserve_pages * policy.page_k,
+                decision.minfree * policy.page_k, decision.min_score_adj);
         } else if (pages_freed == 0) {
             ALOGI("No processes killed");
         } else {
             ALOGI("Killing to reclaim %ldkB, reclaimed %ldkB at oom_adj %d",
-                pages_to_free * page_k, pages_freed * page_k, min_score_adj);
+                decision.pages_to_free * policy.page_k, pages_freed * policy.page_k,
+                decision.min_score_adj);
         }
 
         if (report_skip_count > 0) {
@@ -1537,15 +1349,99 @@ err_open_mpfd:
     return false;
 }
 
+/*
+ * Ask the kernel to signal when tasks were stalled on memory for more than
+ * threshold_ms within window_ms. "some" counts time at least one task was
+ * stalled, "full" time all non-idle tasks were.
+ */
+static bool init_psi_monitor(enum vmpressure_level level, const char *stall_type,
+                             int threshold_ms, int window_ms) {
+    int fd;
+    char buf[256];
+    struct epoll_event epev;
+    int ret;
+    int level_idx = (int)level;
+
+    fd = open(PSI_MEMORY_PATH, O_RDWR | O_CLOEXEC | O_NONBLOCK);
+    if (fd < 0) {
+        ALOGI("No kernel PSI support (errno=%d)", errno);
+        return false;
+    }
+
+    snprintf(buf, sizeof(buf), "%s %d %d", stall_type, threshold_ms * 1000, window_ms * 1000);
+    ret = TEMP_FAILURE_RETRY(write(fd, buf, strlen(buf) + 1));
+    if (ret == -1) {
+        ALOGE("%s write failed for %s stall %dms/%dms; errno=%d", PSI_MEMORY_PATH,
+              stall_type, threshold_ms, window_ms, errno);
+        goto err;
+    }
+
+    epev.events = EPOLLPRI;
+    /* use data to store event level */
+    vmpressure_hinfo[level_idx].data = level_idx;
+    vmpressure_hinfo[level_idx].handler = mp_event_common;
+    epev.data.ptr = (void *)&vmpressure_hinfo[level_idx];
+    ret = epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &epev);
+    if (ret == -1) {
+        ALOGE("epoll_ctl for PSI monitor %s failed; errno=%d", level_name[level_idx], errno);
+        goto err;
+    }
+    maxevents++;
+    psi_fd[level] = fd;
+    return true;
+
+err:
+    close(fd);
+    return false;
+}
+
+static void destroy_psi_monitor(enum vmpressure_level level) {
+    if (psi_fd[level] < 0) {
+        return;
+    }
+    if (epoll_ctl(epollfd, EPOLL_CTL_DEL, psi_fd[level], NULL) == -1) {
+        ALOGW("epoll_ctl for PSI monitor %s failed; errno=%d", level_name[level], errno);
+    }
+    maxevents--;
+    close(psi_fd[level]);
+    psi_fd[level] = -1;
+}
+
+/*
+ * PSI monitors replace medium and critical vmpressure events. Partial stalls
+ * map to medium pressure and complete stalls to critical pressure.
+ * Unless kills are sized by minfree levels, they need the free memory seen
+ * at low pressure: low vmpressure events still provide it, or failing that
+ * partial stalls of half the medium threshold.
+ */
+static bool init_psi_monitors(void) {
+    if (!init_psi_monitor(VMPRESS_LEVEL_MEDIUM, "some", psi_partial_stall_ms, psi_window_ms)) {
+        return false;
+    }
+    if (!init_psi_monitor(VMPRESS_LEVEL_CRITICAL, "full", psi_complete_stall_ms,
+                          psi_window_ms)) {
+        destroy_psi_monitor(VMPRESS_LEVEL_MEDIUM);
+        return false;
+    }
+    if (!init_mp_common(VMPRESS_LEVEL_LOW) && !policy.use_minfree_levels &&
+        !init_psi_monitor(VMPRESS_LEVEL_LOW, "some", (psi_partial_stall_ms + 1) / 2,
+                          psi_window_ms)) {
+        destroy_psi_monitor(VMPRESS_LEVEL_CRITICAL);
+        destroy_psi_monitor(VMPRESS_LEVEL_MEDIUM);
+        return false;
+    }
+    return true;
+}
+
 static int init(void) {
     struct epoll_event epev;
     int i;
     int ret;
 
-    page_k = sysconf(_SC_PAGESIZE);
-    if (page_k == -1)
-        page_k = PAGE_SIZE;
-    page_k /= 1024;
+    policy.page_k = sysconf(_SC_PAGESIZE);
+    if (policy.page_k == -1)
+        policy.page_k = PAGE_SIZE;
+    policy.page_k /= 1024;
 
     epollfd = epoll_create(MAX_EPOLL_EVENTS);
     if (epollfd == -1) {
@@ -1584,6 +1480,8 @@ static int init(void) {
 
     if (use_inkernel_interface) {
         ALOGI("Using in-kernel low memory killer interface");
+    } else if (use_psi_monitors && init_psi_monitors()) {
+        ALOGI("Using PSI monitors for medium and critical memory pressure");
     } else {
         if (!init_mp_common(VMPRESS_LEVEL_LOW) ||
             !init_mp_common(VMPRESS_LEVEL_MEDIUM) ||
@@ -1596,6 +1494,7 @@ static int init(void) {
     for (i = 0; i <= ADJTOSLOT(OOM_SCORE_ADJ_MAX); i++) {
         procadjslot_list[i].next = &procadjslot_list[i];
         procadjslot_list[i].prev = &procadjslot_list[i];
+        lmk_size_list_init(&procadjslot_size_list[i]);
     }
 
     return 0;
@@ -1604,13 +1503,37 @@ static int init(void) {
 static void mainloop(void) {
     struct event_handler_info* handler_info;
     struct epoll_event *evt;
+    struct timeval curr_tm;
+    struct timeval last_refresh_tm = { 0, 0 };
 
     while (1) {
         struct epoll_event events[maxevents];
         int nevents;
         int i;
+        int timeout = -1;
 
-        nevents = epoll_wait(epollfd, events, maxevents, -1);
+        /*
+         * Keep process sizes fresh for picking the heaviest victim while
+         * under memory pressure. Otherwise they are only read as processes
+         * register, commands are not held up by /proc, and an idle lmkd
+         * sleeps.
+         */
+        if (kill_heaviest_task && timerisset(&last_pressure_tm)) {
+            unsigned long elapsed;
+
+            gettimeofday(&curr_tm, NULL);
+            if (get_time_diff_ms(&last_pressure_tm, &curr_tm) < PROC_SIZE_REFRESH_ACTIVE_MS) {
+                elapsed = get_time_diff_ms(&last_refresh_tm, &curr_tm);
+                if (elapsed >= PROC_SIZE_REFRESH_PERIOD_MS) {
+                    proc_refresh_sizes();
+                    last_refresh_tm = curr_tm;
+                    elapsed = 0;
+                }
+                timeout = PROC_SIZE_REFRESH_PERIOD_MS - elapsed;
+            }
+        }
+
+        nevents = epoll_wait(epollfd, events, maxevents, timeout);
 
         if (nevents == -1) {
             if (errno == EINTR)
@@ -1634,6 +1557,9 @@ static void mainloop(void) {
             }
         }
 
+        /* Memory state is read afresh in every cycle */
+        mem_snapshot.valid = false;
+
         /* Second pass to handle all other events */
         for (i = 0, evt = &events[0]; i < nevents; ++i, evt++) {
             if (evt->events & EPOLLERR)
@@ -1655,36 +1581,19 @@ int main(int argc __unused, char **argv __unused) {
             .sched_priority = 1,
     };
 
-    /* By default disable low level vmpressure events */
-    level_oomadj[VMPRESS_LEVEL_LOW] =
-        property_get_int32("ro.lmk.low", OOM_SCORE_ADJ_MAX + 1);
-    level_oomadj[VMPRESS_LEVEL_MEDIUM] =
-        property_get_int32("ro.lmk.medium", 800);
-    level_oomadj[VMPRESS_LEVEL_CRITICAL] =
-        property_get_int32("ro.lmk.critical", 0);
-    debug_process_killing = property_get_bool("ro.lmk.debug", false);
-
-    /* By default disable upgrade/downgrade logic */
-    enable_pressure_upgrade =
-        property_get_bool("ro.lmk.critical_upgrade", false);
-    upgrade_pressure =
-        (int64_t)property_get_int32("ro.lmk.upgrade_pressure", 100);
-    downgrade_pressure =
-        (int64_t)property_get_int32("ro.lmk.downgrade_pressure", 100);
+    lmk_policy_load(&policy, property_get_bool, property_get_int32);
     kill_heaviest_task =
         property_get_bool("ro.lmk.kill_heaviest_task", false);
-    low_ram_device = property_get_bool("ro.config.low_ram", false);
     kill_timeout_ms =
         (unsigned long)property_get_int32("ro.lmk.kill_timeout_ms", 0);
-    use_minfree_levels =
-        property_get_bool("ro.lmk.use_minfree_levels", false);
-    per_app_memcg = property_get_bool("ro.config.per_app_memcg", low_ram_device);
-    enhance_batch_kill =
-        property_get_bool("ro.lmk.enhance_batch_kill", true);
-    enable_adaptive_lmk =
-        property_get_bool("ro.lmk.enable_adaptive_lmk", false);
+    per_app_memcg = property_get_bool("ro.config.per_app_memcg", policy.low_ram_device);
     enable_userspace_lmk =
         property_get_bool("ro.lmk.enable_userspace_lmk", false);
+    use_psi_monitors = property_get_bool("ro.lmk.use_psi", false);
+    psi_partial_stall_ms = property_get_int32("ro.lmk.psi_partial_stall_ms",
+        policy.low_ram_device ? 200 : 70);
+    psi_complete_stall_ms = property_get_int32("ro.lmk.psi_complete_stall_ms", 700);
+    psi_window_ms = property_get_int32("ro.lmk.psi_window_ms", 1000);
 
 #ifdef LMKD_LOG_STATS
     statslog_init(&log_ctx, &enable_stats_log);
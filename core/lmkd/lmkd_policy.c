@@ -0,0 +1,395 @@
+/*
+ *  Copyright 2018 Google, Inc
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define LOG_TAG "lowmemorykiller"
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <lmkd_policy.h>
+#include <log/log.h>
+
+const char* const level_name[VMPRESS_LEVEL_COUNT] = {
+    "low",
+    "medium",
+    "critical"
+};
+
+const char* const zoneinfo_field_names[ZI_FIELD_COUNT] = {
+    "nr_free_pages",
+    "nr_file_pages",
+    "nr_shmem",
+    "nr_unevictable",
+    "workingset_refault",
+    "high",
+};
+
+const char* const meminfo_field_names[MI_FIELD_COUNT] = {
+    "MemFree:",
+    "Cached:",
+    "SwapCached:",
+    "Buffers:",
+    "Shmem:",
+    "Unevictable:",
+    "SwapFree:",
+    "Dirty:",
+};
+
+static bool parse_int64(const char* str, int64_t* ret) {
+    char* endptr;
+    long long val = strtoll(str, &endptr, 10);
+    if (str == endptr || val > INT64_MAX) {
+        return false;
+    }
+    *ret = (int64_t)val;
+    return true;
+}
+
+/* Index of the field named [name, name + len) or -1 */
+static int find_field(const char* name, size_t len,
+                      const char* const field_names[], int field_count) {
+    int i;
+
+    for (i = 0; i < field_count; i++) {
+        if (strlen(field_names[i]) == len && !memcmp(name, field_names[i], len)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static const char* next_line(const char* line) {
+    const char* eol = strchr(line, '\n');
+
+    return eol ? eol + 1 : line + strlen(line);
+}
+
+/* /prop/zoneinfo parsing routines */
+static int64_t zoneinfo_parse_protection(const char *cp, const char *end) {
+    int64_t max = 0;
+    long long zoneval;
+    char *endptr;
+
+    while (cp < end) {
+        if (*cp < '0' || *cp > '9') {
+            cp++;
+            continue;
+        }
+        zoneval = strtoll(cp, &endptr, 0);
+        if (zoneval > max) {
+            max = (zoneval > INT64_MAX) ? INT64_MAX : zoneval;
+        }
+        cp = endptr;
+    }
+
+    return max;
+}
+
+int zoneinfo_parse_buf(const char *buf, union zoneinfo *zi) {
+    const char *line;
+    const char *name;
+    const char *eol;
+    size_t len;
+    int64_t val;
+    int field_idx;
+
+    memset(zi, 0, sizeof(union zoneinfo));
+
+    for (line = buf; *line; line = next_line(line)) {
+        name = line + strspn(line, " ");
+        len = strcspn(name, " \n");
+        if (len == 0 || name[len] != ' ') {
+            continue;
+        }
+
+        field_idx = find_field(name, len, zoneinfo_field_names, ZI_FIELD_COUNT);
+        if (field_idx >= 0) {
+            if (!parse_int64(name + len, &val)) {
+                return -1;
+            }
+            zi->arr[field_idx] += val;
+        } else if (len == strlen("protection:") && !memcmp(name, "protection:", len)) {
+            eol = next_line(name);
+            zi->field.totalreserve_pages += zoneinfo_parse_protection(name + len, eol);
+        }
+    }
+    zi->field.totalreserve_pages += zi->field.high;
+
+    return 0;
+}
+
+/* /prop/meminfo parsing routines */
+int meminfo_parse_buf(const char *buf, long page_k, union meminfo *mi) {
+    const char *line;
+    size_t len;
+    int64_t val;
+    int field_idx;
+    int remaining = MI_FIELD_COUNT;
+
+    memset(mi, 0, sizeof(union meminfo));
+
+    /* fields come first in the file, most of it needs no looking at */
+    for (line = buf; *line && remaining > 0; line = next_line(line)) {
+        len = strcspn(line, ":\n");
+        if (line[len] != ':') {
+            continue;
+        }
+        field_idx = find_field(line, len + 1, meminfo_field_names, MI_FIELD_COUNT);
+        if (field_idx < 0) {
+            continue;
+        }
+        if (!parse_int64(line + len + 1, &val)) {
+            return -1;
+        }
+        mi->arr[field_idx] = val / page_k;
+        remaining--;
+    }
+    mi->field.nr_file_pages = mi->field.cached + mi->field.swap_cached +
+        mi->field.buffers;
+
+    return 0;
+}
+
+void lmk_policy_load(struct lmk_policy *policy, lmk_get_bool_fn get_bool,
+                     lmk_get_int32_fn get_int32) {
+    /* By default disable low level vmpressure events */
+    policy->level_oomadj[VMPRESS_LEVEL_LOW] =
+        get_int32("ro.lmk.low", OOM_SCORE_ADJ_MAX + 1);
+    policy->level_oomadj[VMPRESS_LEVEL_MEDIUM] =
+        get_int32("ro.lmk.medium", 800);
+    policy->level_oomadj[VMPRESS_LEVEL_CRITICAL] =
+        get_int32("ro.lmk.critical", 0);
+    policy->debug = get_bool("ro.lmk.debug", false);
+
+    /* By default disable upgrade/downgrade logic */
+    policy->enable_pressure_upgrade =
+        get_bool("ro.lmk.critical_upgrade", false);
+    policy->upgrade_pressure =
+        (int64_t)get_int32("ro.lmk.upgrade_pressure", 100);
+    policy->downgrade_pressure =
+        (int64_t)get_int32("ro.lmk.downgrade_pressure", 100);
+    policy->low_ram_device = get_bool("ro.config.low_ram", false);
+    policy->use_minfree_levels =
+        get_bool("ro.lmk.use_minfree_levels", false);
+    policy->enhance_batch_kill =
+        get_bool("ro.lmk.enhance_batch_kill", true);
+    policy->enable_adaptive_lmk =
+        get_bool("ro.lmk.enable_adaptive_lmk", false);
+}
+
+static void record_low_pressure_levels(const struct lmk_policy *policy,
+                                       struct lmk_policy_state *state,
+                                       const union meminfo *mi) {
+    if (state->min_nr_free_pages == -1 ||
+        state->min_nr_free_pages > mi->field.nr_free_pages) {
+        if (policy->debug) {
+            ALOGI("Low pressure min memory update from %" PRId64 " to %" PRId64,
+                state->min_nr_free_pages, mi->field.nr_free_pages);
+        }
+        state->min_nr_free_pages = mi->field.nr_free_pages;
+    }
+    /*
+     * Free memory at low vmpressure events occasionally gets spikes,
+     * possibly a stale low vmpressure event with memory already
+     * freed up (no memory pressure should have been reported).
+     * Ignore large jumps in max_nr_free_pages that would mess up our stats.
+     */
+    if (state->max_nr_free_pages == -1 ||
+        (state->max_nr_free_pages < mi->field.nr_free_pages &&
+         mi->field.nr_free_pages - state->max_nr_free_pages <
+         state->max_nr_free_pages * 0.1)) {
+        if (policy->debug) {
+            ALOGI("Low pressure max memory update from %" PRId64 " to %" PRId64,
+                state->max_nr_free_pages, mi->field.nr_free_pages);
+        }
+        state->max_nr_free_pages = mi->field.nr_free_pages;
+    }
+}
+
+static enum vmpressure_level upgrade_level(enum vmpressure_level level) {
+    return (enum vmpressure_level)((level < VMPRESS_LEVEL_CRITICAL) ?
+        level + 1 : level);
+}
+
+static enum vmpressure_level downgrade_level(enum vmpressure_level level) {
+    return (enum vmpressure_level)((level > VMPRESS_LEVEL_LOW) ?
+        level - 1 : level);
+}
+
+bool lmk_policy_decide(const struct lmk_policy *policy, struct lmk_policy_state *state,
+                       enum vmpressure_level level, const union meminfo *mi,
+                       const union zoneinfo *zi,
+                       int64_t (*get_mem_pressure)(void *ctx), void *ctx,
+                       struct lmk_decision *decision) {
+    int64_t mem_pressure;
+    long other_free = 0, other_file = 0;
+    int min_score_adj = OOM_SCORE_ADJ_MAX + 1;
+    int pages_to_free = 0;
+    int minfree = 0;
+
+    if (policy->use_minfree_levels) {
+        int i;
+
+        other_free = mi->field.nr_free_pages - zi->field.totalreserve_pages;
+        if (mi->field.nr_file_pages > (mi->field.shmem + mi->field.unevictable + mi->field.swap_cached)) {
+            other_file = (mi->field.nr_file_pages - mi->field.shmem -
+                          mi->field.unevictable - mi->field.swap_cached);
+        } else {
+            other_file = 0;
+        }
+
+        for (i = 0; i < policy->lowmem_targets_size; i++) {
+            minfree = policy->lowmem_minfree[i];
+            if (other_free < minfree && other_file < minfree) {
+                min_score_adj = policy->lowmem_adj[i];
+                // Adaptive LMK
+                if (policy->enable_adaptive_lmk && level == VMPRESS_LEVEL_CRITICAL &&
+                        i > policy->lowmem_targets_size-4) {
+                    min_score_adj = policy->lowmem_adj[i-1];
+                }
+                break;
+            }
+        }
+
+        if (min_score_adj == OOM_SCORE_ADJ_MAX + 1) {
+            if (policy->debug) {
+                ALOGI("Ignore %s memory pressure event "
+                      "(free memory=%ldkB, cache=%ldkB, limit=%ldkB)",
+                      level_name[level], other_free * policy->page_k,
+                      other_file * policy->page_k,
+                      (long)policy->lowmem_minfree[policy->lowmem_targets_size - 1] *
+                      policy->page_k);
+            }
+            return false;
+        }
+
+        if (policy->enhance_batch_kill) {
+            // Kill one process at a time.
+            pages_to_free = 0;
+        } else {
+            /* Original minfree logic */
+            /* Free up enough pages to push over the highest minfree level */
+            pages_to_free = policy->lowmem_minfree[policy->lowmem_targets_size - 1] -
+                ((other_free < other_file) ? other_free : other_file);
+        }
+        goto do_kill;
+    }
+
+    if (level == VMPRESS_LEVEL_LOW) {
+        record_low_pressure_levels(policy, state, mi);
+    }
+
+    if (policy->level_oomadj[level] > OOM_SCORE_ADJ_MAX) {
+        /* Do not monitor this pressure level */
+        return false;
+    }
+
+    if ((mem_pressure = get_mem_pressure(ctx)) < 0) {
+        goto do_kill;
+    }
+
+    if (policy->enable_pressure_upgrade && level != VMPRESS_LEVEL_CRITICAL) {
+        // We are swapping too much.
+        if (mem_pressure < policy->upgrade_pressure) {
+            level = upgrade_level(level);
+            if (policy->debug) {
+                ALOGI("Event upgraded to %s", level_name[level]);
+            }
+        }
+    }
+
+    // If the pressure is larger than downgrade_pressure lmk will not
+    // kill any process, since enough memory is available.
+    if (mem_pressure > policy->downgrade_pressure) {
+        if (policy->debug) {
+            ALOGI("Ignore %s memory pressure", level_name[level]);
+        }
+        return false;
+    } else if (level == VMPRESS_LEVEL_CRITICAL &&
+               mem_pressure > policy->upgrade_pressure) {
+        if (policy->debug) {
+            ALOGI("Downgrade critical memory pressure");
+        }
+        // Downgrade event, since enough memory available.
+        level = downgrade_level(level);
+    }
+
+do_kill:
+    if (policy->low_ram_device) {
+        /* For Go devices kill only one task */
+        min_score_adj = policy->level_oomadj[level];
+        pages_to_free = 0;
+    } else if (!policy->use_minfree_levels) {
+        /* If pressure level is less than critical and enough free swap then ignore */
+        if (level < VMPRESS_LEVEL_CRITICAL &&
+            mi->field.free_swap > state->max_nr_free_pages) {
+            if (policy->debug) {
+                ALOGI("Ignoring pressure since %" PRId64
+                      " swap pages are available ",
+                      mi->field.free_swap);
+            }
+            return false;
+        }
+        /* Free up enough memory to downgrate the memory pressure to low level */
+        if (mi->field.nr_free_pages < state->max_nr_free_pages) {
+            pages_to_free = state->max_nr_free_pages -
+                mi->field.nr_free_pages;
+        } else {
+            if (policy->debug) {
+                ALOGI("Ignoring pressure since more memory is "
+                    "available (%" PRId64 ") than watermark (%" PRId64 ")",
+                    mi->field.nr_free_pages, state->max_nr_free_pages);
+            }
+            return false;
+        }
+        min_score_adj = policy->level_oomadj[level];
+    }
+
+    decision->level = level;
+    decision->min_score_adj = min_score_adj;
+    decision->pages_to_free = pages_to_free;
+    decision->minfree = minfree;
+    decision->other_free = other_free;
+    decision->other_file = other_file;
+    return true;
+}
+
+void lmk_size_list_init(struct lmk_size_node *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+void lmk_size_list_insert(struct lmk_size_node *head, struct lmk_size_node *node) {
+    struct lmk_size_node *curr;
+
+    for (curr = head->next; curr != head && curr->size >= node->size; curr = curr->next)
+            ;
+
+    node->prev = curr->prev;
+    node->next = curr;
+    curr->prev->next = node;
+    curr->prev = node;
+}
+
+void lmk_size_list_remove(struct lmk_size_node *node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+struct lmk_size_node *lmk_size_list_heaviest(struct lmk_size_node *head) {
+    return head->next == head ? NULL : head->next;
+}
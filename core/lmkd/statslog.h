@@ -81,13 +81,14 @@ stats_write_lmk_state_changed(android_log_context ctx, int32_t code, int32_t sta
 
 /**
  * Logs the event when LMKD kills a process to reduce memory pressure.
+ * kill_latency_us is the time from the memory pressure event to the kill.
  * Code: LMK_KILL_OCCURRED = 51
  */
 int
 stats_write_lmk_kill_occurred(android_log_context ctx, int32_t code, int32_t uid,
                               char const* process_name, int32_t oom_score, int64_t pgfault,
                               int64_t pgmajfault, int64_t rss_in_bytes, int64_t cache_in_bytes,
-                              int64_t swap_in_bytes);
+                              int64_t swap_in_bytes, int64_t kill_latency_us);
 
 __END_DECLS
 
@@ -0,0 +1,192 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <lmkd_policy.h>
+
+// Two zones of one node, trimmed from a 4.14 kernel.
+static const char kZoneinfo[] =
+    "Node 0, zone      DMA\n"
+    "  per-node stats\n"
+    "      nr_inactive_anon 25012\n"
+    "      nr_file_pages 207460\n"
+    "      nr_shmem     1706\n"
+    "      nr_unevictable 52\n"
+    "      workingset_refault 4127\n"
+    "      workingset_refault_file 99\n"
+    "  pages free     3975\n"
+    "        min      32\n"
+    "        low      40\n"
+    "        high     48\n"
+    "        spanned  4095\n"
+    "        present  3998\n"
+    "        managed  3977\n"
+    "        protection: (0, 2991, 31910, 31910)\n"
+    "      nr_free_pages 3975\n"
+    "      nr_free_pages_highatomic 12\n"
+    "Node 0, zone   Normal\n"
+    "  pages free     100000\n"
+    "        min      4000\n"
+    "        low      4500\n"
+    "        high     5000\n"
+    "        protection: (0, 0, 0, 0)\n"
+    "      nr_free_pages 100000";
+
+TEST(lmkd_policy, zoneinfo_parse_buf) {
+    union zoneinfo zi;
+    ASSERT_EQ(0, zoneinfo_parse_buf(kZoneinfo, &zi));
+
+    // summed over the zones
+    EXPECT_EQ(103975, zi.field.nr_free_pages);
+    EXPECT_EQ(5048, zi.field.high);
+    // once per node
+    EXPECT_EQ(207460, zi.field.nr_file_pages);
+    EXPECT_EQ(1706, zi.field.nr_shmem);
+    EXPECT_EQ(52, zi.field.nr_unevictable);
+    EXPECT_EQ(4127, zi.field.workingset_refault);
+    // the largest protection of each zone, plus the high watermarks
+    EXPECT_EQ(31910 + 0 + 5048, zi.field.totalreserve_pages);
+}
+
+TEST(lmkd_policy, zoneinfo_parse_buf_malformed) {
+    union zoneinfo zi;
+    ASSERT_EQ(-1, zoneinfo_parse_buf("Node 0, zone   Normal\n"
+                                     "      nr_free_pages many\n", &zi));
+
+    ASSERT_EQ(0, zoneinfo_parse_buf("", &zi));
+    EXPECT_EQ(0, zi.field.nr_free_pages);
+    EXPECT_EQ(0, zi.field.totalreserve_pages);
+}
+
+static const char kMeminfo[] =
+    "MemTotal:        3903436 kB\n"
+    "MemFree:          121456 kB\n"
+    "MemAvailable:    1500000 kB\n"
+    "Buffers:           10240 kB\n"
+    "Cached:          1000000 kB\n"
+    "SwapCached:         4096 kB\n"
+    "Active:          1200000 kB\n"
+    "Unevictable:        2048 kB\n"
+    "Mlocked:            2048 kB\n"
+    "SwapTotal:       1048572 kB\n"
+    "SwapFree:         512000 kB\n"
+    "Dirty:               400 kB\n"
+    "Writeback:             0 kB\n"
+    "Shmem:              8192 kB\n"
+    "MemFree:               4 kB\n"
+    "Slab:              bogus kB\n";
+
+TEST(lmkd_policy, meminfo_parse_buf) {
+    union meminfo mi;
+    // Parsing stops at Shmem:, the last field wanted.
+    ASSERT_EQ(0, meminfo_parse_buf(kMeminfo, 4, &mi));
+
+    EXPECT_EQ(30364, mi.field.nr_free_pages);
+    EXPECT_EQ(250000, mi.field.cached);
+    EXPECT_EQ(1024, mi.field.swap_cached);
+    EXPECT_EQ(2560, mi.field.buffers);
+    EXPECT_EQ(2048, mi.field.shmem);
+    EXPECT_EQ(512, mi.field.unevictable);
+    EXPECT_EQ(128000, mi.field.free_swap);
+    EXPECT_EQ(100, mi.field.dirty);
+    EXPECT_EQ(250000 + 1024 + 2560, mi.field.nr_file_pages);
+}
+
+TEST(lmkd_policy, meminfo_parse_buf_missing_fields) {
+    union meminfo mi;
+    ASSERT_EQ(0, meminfo_parse_buf("MemFreeSoon:  4096 kB\n"
+                                   "MemFree:      8192 kB\n"
+                                   "Cached:       4096 kB", 4, &mi));
+
+    EXPECT_EQ(2048, mi.field.nr_free_pages);
+    EXPECT_EQ(1024, mi.field.cached);
+    EXPECT_EQ(0, mi.field.free_swap);
+    EXPECT_EQ(1024, mi.field.nr_file_pages);
+}
+
+TEST(lmkd_policy, meminfo_parse_buf_malformed) {
+    union meminfo mi;
+    ASSERT_EQ(-1, meminfo_parse_buf("MemFree:  lots kB\n", 4, &mi));
+}
+
+// Kills as find_and_kill_processes does with kill_heaviest_task, heaviest
+// first, each victim leaving the list, and returns the sizes in kill order.
+static std::vector<int> kill_order(struct lmk_size_node *head) {
+    std::vector<int> order;
+    struct lmk_size_node *node;
+    while ((node = lmk_size_list_heaviest(head)) != nullptr) {
+        order.push_back(node->size);
+        lmk_size_list_remove(node);
+    }
+    return order;
+}
+
+TEST(lmkd_policy, size_list_heaviest_first) {
+    struct lmk_size_node head;
+    lmk_size_list_init(&head);
+    EXPECT_EQ(nullptr, lmk_size_list_heaviest(&head));
+
+    struct lmk_size_node nodes[6];
+    const int sizes[] = { 300, 100, 500, 0, 200, 400 };
+    for (size_t i = 0; i < 6; i++) {
+        nodes[i].size = sizes[i];
+        lmk_size_list_insert(&head, &nodes[i]);
+    }
+    EXPECT_EQ(std::vector<int>({ 500, 400, 300, 200, 100, 0 }), kill_order(&head));
+    EXPECT_EQ(nullptr, lmk_size_list_heaviest(&head));
+}
+
+TEST(lmkd_policy, size_list_ties_in_order) {
+    struct lmk_size_node head;
+    lmk_size_list_init(&head);
+
+    struct lmk_size_node first = { nullptr, nullptr, 100 };
+    struct lmk_size_node second = { nullptr, nullptr, 100 };
+    struct lmk_size_node lighter = { nullptr, nullptr, 50 };
+    lmk_size_list_insert(&head, &first);
+    lmk_size_list_insert(&head, &lighter);
+    lmk_size_list_insert(&head, &second);
+
+    EXPECT_EQ(&first, lmk_size_list_heaviest(&head));
+    lmk_size_list_remove(&first);
+    EXPECT_EQ(&second, lmk_size_list_heaviest(&head));
+    lmk_size_list_remove(&second);
+    EXPECT_EQ(&lighter, lmk_size_list_heaviest(&head));
+}
+
+TEST(lmkd_policy, size_list_refresh) {
+    struct lmk_size_node head;
+    lmk_size_list_init(&head);
+
+    struct lmk_size_node nodes[4];
+    for (size_t i = 0; i < 4; i++) {
+        nodes[i].size = (i + 1) * 100;
+        lmk_size_list_insert(&head, &nodes[i]);
+    }
+
+    // As proc_refresh_size does, the lightest grew and the heaviest shrank.
+    lmk_size_list_remove(&nodes[0]);
+    nodes[0].size = 350;
+    lmk_size_list_insert(&head, &nodes[0]);
+    lmk_size_list_remove(&nodes[3]);
+    nodes[3].size = 150;
+    lmk_size_list_insert(&head, &nodes[3]);
+
+    EXPECT_EQ(&nodes[0], lmk_size_list_heaviest(&head));
+    EXPECT_EQ(std::vector<int>({ 350, 300, 200, 150 }), kill_order(&head));
+}
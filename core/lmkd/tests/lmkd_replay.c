@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays memory pressure samples logged by lmkd (with ro.lmk.debug set)
+ * against the lmkd kill policy, so that policy settings can be tuned offline:
+ *
+ *   adb logcat -d -s lowmemorykiller > trace.txt
+ *   lmkd_replay -p ro.lmk.use_minfree_levels=true \
+ *       -t 18432:0,23040:100,27648:200,32256:250,55296:900,80640:950 trace.txt
+ *
+ * Each kill decision is printed with the time since the pressure episode
+ * started, followed by a summary with the CPU time the decisions took.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <lmkd_policy.h>
+
+/* pressure events further apart than this start a new episode */
+#define EPISODE_GAP_MS 1000
+
+#define MAX_PROPS 32
+
+static struct {
+    const char *name;
+    const char *value;
+} props[MAX_PROPS];
+static int nprops;
+
+static const char *prop_find(const char *key) {
+    int i;
+
+    for (i = 0; i < nprops; i++) {
+        if (!strcmp(props[i].name, key)) {
+            return props[i].value;
+        }
+    }
+    return NULL;
+}
+
+static int8_t prop_get_bool(const char *key, int8_t default_value) {
+    const char *value = prop_find(key);
+
+    if (!value) {
+        return default_value;
+    }
+    if (!strcmp(value, "1") || !strcmp(value, "true") || !strcmp(value, "y") ||
+        !strcmp(value, "yes") || !strcmp(value, "on")) {
+        return true;
+    }
+    if (!strcmp(value, "0") || !strcmp(value, "false") || !strcmp(value, "n") ||
+        !strcmp(value, "no") || !strcmp(value, "off")) {
+        return false;
+    }
+    return default_value;
+}
+
+static int32_t prop_get_int32(const char *key, int32_t default_value) {
+    const char *value = prop_find(key);
+    char *end;
+    long val;
+
+    if (!value) {
+        return default_value;
+    }
+    val = strtol(value, &end, 0);
+    return (end == value || *end) ? default_value : (int32_t)val;
+}
+
+static bool parse_targets(char *arg, struct lmk_policy *policy) {
+    char *save_ptr;
+    char *target;
+    int n = 0;
+
+    for (target = strtok_r(arg, ",", &save_ptr); target;
+         target = strtok_r(NULL, ",", &save_ptr)) {
+        if (n == MAX_TARGETS ||
+            sscanf(target, "%d:%d", &policy->lowmem_minfree[n], &policy->lowmem_adj[n]) != 2) {
+            return false;
+        }
+        n++;
+    }
+    policy->lowmem_targets_size = n;
+    return n > 0;
+}
+
+struct sample {
+    long long t;
+    enum vmpressure_level level;
+    union meminfo mi;
+    union zoneinfo zi;
+    int64_t mem_pressure;
+};
+
+static int64_t sample_mem_pressure(void *ctx) {
+    return ((struct sample *)ctx)->mem_pressure;
+}
+
+static bool set_sample_field(struct sample *sample, const char *key, const char *value,
+                             long *page_k) {
+    char *end;
+    long long val = strtoll(value, &end, 10);
+    int i;
+
+    if (!strcmp(key, "level")) {
+        for (i = 0; i < VMPRESS_LEVEL_COUNT; i++) {
+            if (!strcmp(value, level_name[i])) {
+                sample->level = (enum vmpressure_level)i;
+                return true;
+            }
+        }
+        return false;
+    }
+    if (end == value) {
+        return false;
+    }
+    if (!strcmp(key, "t")) {
+        sample->t = val;
+    } else if (!strcmp(key, "page_k")) {
+        *page_k = val;
+    } else if (!strcmp(key, "totalreserve_pages")) {
+        sample->zi.field.totalreserve_pages = val;
+    } else if (!strcmp(key, "mem_pressure")) {
+        sample->mem_pressure = val;
+    } else {
+        for (i = 0; i < MI_FIELD_COUNT; i++) {
+            /* logged without the trailing colon */
+            size_t len = strlen(meminfo_field_names[i]) - 1;
+            if (strlen(key) == len && !strncmp(key, meminfo_field_names[i], len)) {
+                sample->mi.arr[i] = val;
+                return true;
+            }
+        }
+        for (i = 0; i < ZI_FIELD_COUNT; i++) {
+            if (!strcmp(key, zoneinfo_field_names[i])) {
+                sample->zi.arr[i] = val;
+                return true;
+            }
+        }
+    }
+    return true;
+}
+
+/* Returns true if line holds a sample, other log lines are skipped */
+static bool parse_sample(char *line, struct sample *sample, long *page_k) {
+    char *save_ptr;
+    char *token;
+    char *value;
+    bool has_t = false;
+    bool has_level = false;
+
+    memset(sample, 0, sizeof(*sample));
+    sample->mem_pressure = -1;
+
+    for (token = strtok_r(line, " \t\r\n", &save_ptr); token;
+         token = strtok_r(NULL, " \t\r\n", &save_ptr)) {
+        value = strchr(token, '=');
+        if (!value) {
+            continue;
+        }
+        *value++ = '\0';
+        if (!set_sample_field(sample, token, value, page_k)) {
+            return false;
+        }
+        has_t |= !strcmp(token, "t");
+        has_level |= !strcmp(token, "level");
+    }
+    sample->mi.field.nr_file_pages = sample->mi.field.cached +
+        sample->mi.field.swap_cached + sample->mi.field.buffers;
+    return has_t && has_level;
+}
+
+static long long now_ns(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr,
+            "usage: %s [-q] [-p PROPERTY=VALUE]... [-t MINFREE:ADJ[,...]] TRACE\n"
+            "  -p  set an lmkd property, e.g. ro.lmk.use_minfree_levels=true or\n"
+            "      ro.lmk.kill_timeout_ms=100. Unset properties take lmkd defaults\n"
+            "  -t  minfree targets in pages, as ActivityManager sets them\n"
+            "  -q  print only the summary\n"
+            "TRACE holds lmkd 'sample' log lines, '-' reads standard input\n",
+            name);
+}
+
+int main(int argc, char **argv) {
+    struct lmk_policy policy;
+    struct lmk_policy_state state = LMK_POLICY_STATE_INIT;
+    struct lmk_decision decision;
+    struct sample sample;
+    char *targets = NULL;
+    bool quiet = false;
+    bool kill;
+    FILE *trace;
+    char *line = NULL;
+    size_t line_size = 0;
+    unsigned long kill_timeout_ms;
+    long long episode_start = -1, last_t = -1, last_kill_t = -1;
+    long long decision_ns, total_decision_ns = 0, max_decision_ns = 0;
+    long long reaction_ms, total_reaction_ms = 0, max_reaction_ms = 0;
+    unsigned long events = 0, kills = 0, skipped = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:t:q")) != -1) {
+        switch (opt) {
+        case 'p':
+            if (nprops == MAX_PROPS || !strchr(optarg, '=')) {
+                usage(argv[0]);
+                return 1;
+            }
+            props[nprops].name = optarg;
+            props[nprops].value = strchr(optarg, '=') + 1;
+            *strchr(optarg, '=') = '\0';
+            nprops++;
+            break;
+        case 't':
+            targets = optarg;
+            break;
+        case 'q':
+            quiet = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    memset(&policy, 0, sizeof(policy));
+    lmk_policy_load(&policy, prop_get_bool, prop_get_int32);
+    kill_timeout_ms = (unsigned long)prop_get_int32("ro.lmk.kill_timeout_ms", 0);
+    policy.page_k = 4;
+    if (targets && !parse_targets(targets, &policy)) {
+        fprintf(stderr, "invalid targets '%s'\n", targets);
+        return 1;
+    }
+    if (policy.use_minfree_levels && !policy.lowmem_targets_size) {
+        fprintf(stderr, "ro.lmk.use_minfree_levels needs targets (-t)\n");
+        return 1;
+    }
+
+    trace = strcmp(argv[optind], "-") ? fopen(argv[optind], "r") : stdin;
+    if (!trace) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    while (getline(&line, &line_size, trace) != -1) {
+        if (!parse_sample(line, &sample, &policy.page_k)) {
+            continue;
+        }
+        events++;
+
+        /* as if the last victim was still exiting, see is_kill_pending() */
+        if (kill_timeout_ms && last_kill_t >= 0 &&
+            sample.t - last_kill_t < (long long)kill_timeout_ms) {
+            skipped++;
+            continue;
+        }
+
+        if (episode_start < 0 || sample.t - last_t > EPISODE_GAP_MS) {
+            episode_start = sample.t;
+        }
+        last_t = sample.t;
+
+        decision_ns = now_ns();
+        kill = lmk_policy_decide(&policy, &state, sample.level, &sample.mi, &sample.zi,
+                                 sample_mem_pressure, &sample, &decision);
+        decision_ns = now_ns() - decision_ns;
+        total_decision_ns += decision_ns;
+        if (decision_ns > max_decision_ns) {
+            max_decision_ns = decision_ns;
+        }
+        if (!kill) {
+            continue;
+        }
+
+        kills++;
+        reaction_ms = sample.t - episode_start;
+        total_reaction_ms += reaction_ms;
+        if (reaction_ms > max_reaction_ms) {
+            max_reaction_ms = reaction_ms;
+        }
+        if (!quiet) {
+            printf("t=%lld level=%s kill_level=%s min_score_adj=%d to_free=%ldkB "
+                   "free=%" PRId64 "kB reaction=%lldms\n",
+                   sample.t, level_name[sample.level], level_name[decision.level],
+                   decision.min_score_adj, decision.pages_to_free * policy.page_k,
+                   sample.mi.field.nr_free_pages * policy.page_k, reaction_ms);
+        }
+        last_kill_t = sample.t;
+        /* memory freed by the kill ends the episode */
+        episode_start = -1;
+    }
+    free(line);
+    if (trace != stdin) {
+        fclose(trace);
+    }
+
+    printf("%lu events, %lu kills, %lu skipped within kill timeout\n", events, kills, skipped);
+    if (kills) {
+        printf("reaction: mean %lldms max %lldms\n", total_reaction_ms / (long long)kills,
+               max_reaction_ms);
+    }
+    if (events > skipped) {
+        printf("decision: mean %.2fus max %.2fus\n",
+               total_decision_ns / 1000.0 / (events - skipped), max_decision_ns / 1000.0);
+    }
+    return 0;
+}
@@ -41,7 +41,7 @@ LOCAL_MODULE := $(test_module_prefix)benchmarks
 LOCAL_MODULE_TAGS := $(test_tags)
 LOCAL_CFLAGS += $(test_c_flags)
 LOCAL_SRC_FILES := $(benchmark_src_files)
-LOCAL_SHARED_LIBRARIES := libbase liblogcat
+LOCAL_SHARED_LIBRARIES := libbase liblog liblogcat
 include $(BUILD_NATIVE_BENCHMARK)
 
 # -----------------------------------------------------------------------------
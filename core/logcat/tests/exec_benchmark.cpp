@@ -14,10 +14,16 @@
  * limitations under the License.
  */
 
+#include <fcntl.h>
 #include <stdio.h>
+#include <unistd.h>
+
+#include <string>
 
 #include <android-base/file.h>
 #include <benchmark/benchmark.h>
+#include <log/log.h>
+#include <log/log_transport.h>
 #include <log/logcat.h>
 
 // Dump the statistics and report results
@@ -94,3 +100,47 @@ static void BM_logcat_dump_system_liblogcat(benchmark::State& state) {
     logcat_system_liblogcat(state, "logcat -b all -d >/dev/null 2>/dev/null");
 }
 BENCHMARK(BM_logcat_dump_system_liblogcat);
+
+// Dump a synthetic buffer of a million entries with --threads=<N>, 1 being
+// the single threaded path. The entries are held in-process by the local
+// logger, so only reading, filtering and formatting are measured.
+
+static const size_t synthetic_entries = 1000000;
+
+static void fill_local_buffer() {
+    android_set_log_transport(LOGGER_LOCAL);
+    // The local buffer is set up by the first write, then made to fit
+    __android_log_buf_write(LOG_ID_MAIN, ANDROID_LOG_INFO, "logcat", "start");
+    struct logger_list* logger_list =
+        android_logger_list_alloc(ANDROID_LOG_RDONLY, 0, 0);
+    android_logger_set_log_size(android_logger_open(logger_list, LOG_ID_MAIN),
+                                256 * 1024 * 1024);
+    android_logger_list_free(logger_list);
+
+    for (size_t i = 1; i < synthetic_entries; ++i) {
+        __android_log_buf_print(LOG_ID_MAIN, ANDROID_LOG_DEBUG + (i % 4),
+                                "synthetic", "entry %zu of a typical length %s",
+                                i, (i % 100) ? "" : "\nand a second line");
+    }
+}
+
+static void BM_logcat_dump_synthetic(benchmark::State& state) {
+    fill_local_buffer();
+
+    std::string threads = "--threads=" + std::to_string(state.range(0));
+    const char* argv[] = { "logcat", "-b", "main", "-d", "-v", "threadtime",
+                           threads.c_str() };
+    while (state.KeepRunning()) {
+        android_logcat_context ctx = create_android_logcat();
+        // The local logger reports the end of the buffer as an error
+        int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+        android_logcat_run_command(ctx, fd, dup(fd),
+                                   sizeof(argv) / sizeof(argv[0]),
+                                   const_cast<char* const*>(argv), nullptr);
+        android_logcat_destroy(&ctx);
+    }
+    state.SetItemsProcessed(state.iterations() * synthetic_entries);
+
+    android_set_log_transport(LOGGER_DEFAULT);
+}
+BENCHMARK(BM_logcat_dump_synthetic)->Arg(1)->Arg(2)->Arg(4)->Arg(8);
@@ -44,7 +44,7 @@
     '<', '0' + LOG_MAKEPRI(LOG_AUTH, LOG_PRI(PRI)) / 10, \
         '0' + LOG_MAKEPRI(LOG_AUTH, LOG_PRI(PRI)) % 10, '>'
 
-LogAudit::LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg)
+LogAudit::LogAudit(LogBufferInterface* buf, LogReader* reader, int fdDmesg)
     : SocketListener(getLogSocket(), false),
       logbuf(buf),
       reader(reader),
@@ -26,7 +26,7 @@
 class LogReader;
 
 class LogAudit : public SocketListener {
-    LogBuffer* logbuf;
+    LogBufferInterface* logbuf;
     LogReader* reader;
     int fdDmesg;  // fdDmesg >= 0 is functionally bool dmesg
     bool main;
@@ -34,7 +34,7 @@ class LogAudit : public SocketListener {
     bool initialized;
 
    public:
-    LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg);
+    LogAudit(LogBufferInterface* buf, LogReader* reader, int fdDmesg);
     int log(char* buf, size_t len);
     bool isMonotonic() {
         return logbuf->isMonotonic();
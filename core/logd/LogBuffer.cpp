@@ -26,7 +26,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <cutils/properties.h>
 #include <private/android_logger.h>
@@ -70,9 +73,10 @@ void LogBuffer::init() {
         //  --------- beginning of kernel
         //       0.000000     0     0 I         : Initializing cgroup subsys
         // as the act of mounting /data would trigger persist.logd.timestamp to
-        // be corrected. 1/30 corner case YMMV.
+        // be corrected. 1/30 corner case YMMV. The index is keyed by the
+        // old timestamps, so it is rebuilt under the write lock.
         //
-        rdlock();
+        wrlock();
         LogBufferElementCollection::iterator it = mLogElements.begin();
         while ((it != mLogElements.end())) {
             LogBufferElement* e = *it;
@@ -93,6 +97,7 @@ void LogBuffer::init() {
             }
             ++it;
         }
+        reindex();
         unlock();
     }
 
@@ -116,7 +121,11 @@ void LogBuffer::init() {
 }
 
 LogBuffer::LogBuffer(LastLogTimes* times)
-    : monotonic(android_log_clockid() == CLOCK_MONOTONIC), mTimes(*times) {
+    : LogBufferInterface(times),
+      mIndexFirst(0),
+      mIndexSorted(0),
+      mIndexPending(0),
+      monotonic(android_log_clockid() == CLOCK_MONOTONIC) {
     pthread_rwlock_init(&mLogElementsLock, nullptr);
 
     log_id_for_each(i) {
@@ -211,32 +220,81 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
 
     LogBufferElement* elem =
         new LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
-    if (log_id != LOG_ID_SECURITY) {
-        int prio = ANDROID_LOG_INFO;
-        const char* tag = nullptr;
-        size_t tag_len = 0;
-        if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS) {
-            tag = tagToName(elem->getTag());
-            if (tag) {
-                tag_len = strlen(tag);
-            }
-        } else {
-            prio = *msg;
-            tag = msg + 1;
-            tag_len = strnlen(tag, len - 1);
-        }
-        if (!__android_log_is_loggable_len(prio, tag, tag_len,
-                                           ANDROID_LOG_VERBOSE)) {
-            // Log traffic received to total
-            wrlock();
-            stats.addTotal(elem);
-            unlock();
-            delete elem;
-            return -EACCES;
+    bool loggable = isLoggable(elem);
+
+    wrlock();
+    int ret = logLocked(elem, loggable);
+    unlock();
+
+    return ret;
+}
+
+log_mask_t LogBuffer::logBatch(const LogBatchEntry* entries, size_t count) {
+    std::vector<std::pair<LogBufferElement*, bool>> elems;
+    elems.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const LogBatchEntry& entry = entries[i];
+        if (entry.id >= LOG_ID_MAX) {
+            continue;
         }
+        log_time realtime = entry.realtime;
+        if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
+        LogBufferElement* elem =
+            new LogBufferElement(entry.id, realtime, entry.uid, entry.pid,
+                                 entry.tid, entry.msg, entry.len);
+        elems.emplace_back(elem, isLoggable(elem));
     }
 
+    log_mask_t logMask = 0;
     wrlock();
+    for (auto& elem : elems) {
+        log_id_t log_id = elem.first->getLogId();
+        if (logLocked(elem.first, elem.second) > 0) {
+            logMask |= 1 << log_id;
+        }
+    }
+    unlock();
+
+    return logMask;
+}
+
+// Whether the priority and tag of elem pass the loggable properties.
+bool LogBuffer::isLoggable(const LogBufferElement* elem) {
+    log_id_t log_id = elem->getLogId();
+    if (log_id == LOG_ID_SECURITY) {
+        return true;
+    }
+
+    const char* msg = elem->getMsg();
+    unsigned short len = elem->getMsgLen();
+    int prio = ANDROID_LOG_INFO;
+    const char* tag = nullptr;
+    size_t tag_len = 0;
+    if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS) {
+        tag = tagToName(elem->getTag());
+        if (tag) {
+            tag_len = strlen(tag);
+        }
+    } else {
+        prio = *msg;
+        tag = msg + 1;
+        tag_len = strnlen(tag, len - 1);
+    }
+    return __android_log_is_loggable_len(prio, tag, tag_len,
+                                         ANDROID_LOG_VERBOSE);
+}
+
+// assumes LogBuffer::wrlock() held, owns elem
+int LogBuffer::logLocked(LogBufferElement* elem, bool loggable) {
+    if (!loggable) {
+        // Log traffic received to total
+        stats.addTotal(elem);
+        delete elem;
+        return -EACCES;
+    }
+
+    log_id_t log_id = elem->getLogId();
+    unsigned short len = elem->getMsgLen();
     LogBufferElement* currentLast = lastLoggedElements[log_id];
     if (currentLast) {
         LogBufferElement* dropped = droppedElements[log_id];
@@ -337,14 +395,12 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     // check for overflow
                     if (total >= UINT32_MAX) {
                         log(currentLast);
-                        unlock();
                         return len;
                     }
                     stats.addTotal(currentLast);
                     delete currentLast;
                     swab = total;
                     event->payload.data = htole32(swab);
-                    unlock();
                     return len;
                 }
                 if (count == USHRT_MAX) {
@@ -361,7 +417,6 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
             }
             droppedElements[log_id] = currentLast;
             lastLoggedElements[log_id] = elem;
-            unlock();
             return len;
         }
         if (dropped) {         // State 1 or 2
@@ -379,7 +434,6 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
     lastLoggedElements[log_id] = new LogBufferElement(*elem);
 
     log(elem);
-    unlock();
 
     return len;
 }
@@ -400,6 +454,7 @@ void LogBuffer::log(LogBufferElement* elem) {
                         (elem->getLogId() != LOG_ID_KERNEL) &&
                         ((*it)->getLogId() != LOG_ID_KERNEL))) {
         mLogElements.push_back(elem);
+        indexAppend(--mLogElements.end());
     } else {
         log_time end = log_time::EPOCH;
         bool end_set = false;
@@ -426,6 +481,7 @@ void LogBuffer::log(LogBufferElement* elem) {
 
         if (end_always || (end_set && (end > (*it)->getRealTime()))) {
             mLogElements.push_back(elem);
+            indexAppend(--mLogElements.end());
         } else {
             // should be short as timestamps are localized near end()
             do {
@@ -436,7 +492,7 @@ void LogBuffer::log(LogBufferElement* elem) {
                 --it;
             } while (((*it)->getRealTime() > elem->getRealTime()) &&
                      (!end_set || (end <= (*it)->getRealTime())));
-            mLogElements.insert(last, elem);
+            indexInsert(mLogElements.insert(last, elem));
         }
         LogTimeEntry::unlock();
     }
@@ -510,6 +566,7 @@ LogBufferElementCollection::iterator LogBuffer::erase(
                   ? element->getTag()
                   : element->getUid();
 #endif
+    indexErase(it);
     it = mLogElements.erase(it);
     if (doSetLast) {
         log_id_for_each(i) {
@@ -554,6 +611,176 @@ LogBufferElementCollection::iterator LogBuffer::erase(
     return it;
 }
 
+// assumes LogBuffer::wrlock() held, it is the element just pushed back
+void LogBuffer::indexAppend(LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    log_mask_t mask = 1 << element->getLogId();
+    if (!mIndex.empty() && (++mIndexPending < indexInterval)) {
+        mIndex.back().mask |= mask;
+        return;
+    }
+
+    uint64_t sequence = mIndexFirst + mIndex.size();
+    if (!mIndex.empty() && (element->getRealTime() < mIndex.back().key)) {
+        mIndexSorted = sequence;
+    }
+    mIndex.push_back({element->getRealTime(), it, mask});
+    mIndexed[element] = sequence;
+    mIndexPending = 0;
+}
+
+// assumes LogBuffer::wrlock() held, it is an element inserted out of order
+void LogBuffer::indexInsert(LogBufferElementCollection::iterator it) {
+    // Walk back to it, passing the entries that lie beyond, to find the
+    // run it landed in. Should be short, it was placed near the end.
+    size_t index = mIndex.size();
+    LogBufferElementCollection::iterator pos = mLogElements.end();
+    while (index && (--pos != it)) {
+        if (pos == mIndex[index - 1].it) {
+            --index;
+        }
+        // dead entries are where the next live one is
+        while (index && (mIndex[index - 1].it == mLogElements.end())) {
+            --index;
+        }
+    }
+    if (index) {
+        mIndex[index - 1].mask |= 1 << (*it)->getLogId();
+    }
+}
+
+// assumes LogBuffer::wrlock() held, it is about to be erased
+void LogBuffer::indexErase(LogBufferElementCollection::iterator it) {
+    if (mIndex.empty()) {
+        return;
+    }
+    uint64_t sequence = mIndexFirst;
+    if (mIndex.front().it != it) {
+        auto found = mIndexed.find(*it);
+        if (found == mIndexed.end()) {
+            return;
+        }
+        sequence = found->second;
+    }
+    mIndexed.erase(*it);
+
+    // Hand the entry on to the next element of its run, if there is one
+    size_t index = sequence - mIndexFirst;
+    uint64_t following = indexNext(sequence);
+    LogBufferElementCollection::iterator next = std::next(it);
+    if (next == mLogElements.end()) {
+        mIndex.erase(mIndex.begin() + index, mIndex.end());
+        mIndexPending = indexInterval;
+    } else if ((following < (mIndexFirst + mIndex.size())) &&
+               (next == mIndex[following - mIndexFirst].it)) {
+        mIndex[index].it = mLogElements.end();
+        mIndex[index].key = mIndex[following - mIndexFirst].key;
+    } else {
+        IndexEntry& entry = mIndex[index];
+        entry.key = (*next)->getRealTime();
+        entry.it = next;
+        mIndexed[*next] = sequence;
+        if ((index && (entry.key < mIndex[index - 1].key)) ||
+            (((index + 1) < mIndex.size()) &&
+             (mIndex[index + 1].key < entry.key))) {
+            mIndexSorted = std::max(mIndexSorted, sequence + 1);
+        }
+    }
+
+    while (!mIndex.empty() && (mIndex.front().it == mLogElements.end())) {
+        mIndex.pop_front();
+        ++mIndexFirst;
+    }
+    mIndexSorted = std::min(std::max(mIndexSorted, mIndexFirst),
+                            mIndexFirst + mIndex.size());
+}
+
+// assumes LogBuffer::wrlock() held
+void LogBuffer::reindex() {
+    mIndexFirst += mIndex.size();
+    mIndexSorted = mIndexFirst;
+    mIndexPending = 0;
+    mIndex.clear();
+    mIndexed.clear();
+    for (auto it = mLogElements.begin(); it != mLogElements.end(); ++it) {
+        indexAppend(it);
+    }
+}
+
+// Sequence number of the first live entry after sequence, or of one past
+// the back if there is none. Requires LogBuffer::rdlock() held.
+uint64_t LogBuffer::indexNext(uint64_t sequence) {
+    uint64_t end = mIndexFirst + mIndex.size();
+    if (sequence < mIndexFirst) {
+        return mIndexFirst;
+    }
+    while ((++sequence < end) &&
+           (mIndex[sequence - mIndexFirst].it == mLogElements.end())) {
+    }
+    return sequence;
+}
+
+// Find where a reader resuming after start should pick up, next is set to
+// the first live entry at or after that point. Requires LogBuffer::rdlock()
+// held.
+LogBufferElementCollection::iterator LogBuffer::seek(const log_time& start,
+                                                     uint64_t& next) {
+    // First entry keyed after start in the part of the index known to be in
+    // order, everything from there on is taken to be newer than start.
+    auto found = std::upper_bound(
+        mIndex.begin() + (mIndexSorted - mIndexFirst), mIndex.end(), start,
+        [](const log_time& start, const IndexEntry& entry) {
+            return start < entry.key;
+        });
+    next = mIndexFirst + (found - mIndex.begin());
+    if ((found != mIndex.end()) && (found->it == mLogElements.end())) {
+        next = indexNext(next);
+    }
+
+    LogBufferElementCollection::iterator it = mLogElements.end();
+    if (next < (mIndexFirst + mIndex.size())) {
+        it = mIndex[next - mIndexFirst].it;
+    }
+
+    // The live entry before next, whose head the scan below may cross
+    uint64_t prev = next;
+    auto findPrev = [this](uint64_t& prev) {
+        while ((prev > mIndexFirst) &&
+               (mIndex[--prev - mIndexFirst].it == mLogElements.end())) {
+        }
+    };
+    findPrev(prev);
+
+    // Cap to 300 iterations we look back for out-of-order entries.
+    size_t count = 300;
+
+    // From here on as LogBuffer::flushTo() used to from the end.
+    LogBufferElementCollection::iterator last = it;
+    uint64_t lastNext = next;
+    while (it != mLogElements.begin()) {
+        uint64_t after = next;
+        --it;
+        if ((prev < next) && (it == mIndex[prev - mIndexFirst].it)) {
+            next = prev;
+            findPrev(prev);
+        }
+        LogBufferElement* element = *it;
+        if (element->getRealTime() > start) {
+            last = it;
+            lastNext = next;
+        } else if (element->getRealTime() == start) {
+            last = ++it;
+            lastNext = after;
+            break;
+        } else if (!--count) {
+            break;
+        }
+    }
+
+    next = lastNext;
+    return last;
+}
+
 // Define a temporary mechanism to report the last LogBufferElement pointer
 // for the specified uid, pid and tid. Used below to help merge-sort when
 // pruning for worst UID.
@@ -1105,36 +1332,20 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                             pid_t* lastTid, bool privileged, bool security,
                             int (*filter)(const LogBufferElement* element,
                                           void* arg),
-                            void* arg) {
+                            void* arg, log_mask_t logMask) {
     LogBufferElementCollection::iterator it;
     uid_t uid = reader->getUid();
+    uint64_t next;  // next index entry we will come across
 
     rdlock();
 
     if (start == log_time::EPOCH) {
         // client wants to start from the beginning
         it = mLogElements.begin();
+        next = mIndexFirst;
     } else {
-        // Cap to 300 iterations we look back for out-of-order entries.
-        size_t count = 300;
-
-        // Client wants to start from some specified time. Chances are
-        // we are better off starting from the end of the time sorted list.
-        LogBufferElementCollection::iterator last;
-        for (last = it = mLogElements.end(); it != mLogElements.begin();
-             /* do nothing */) {
-            --it;
-            LogBufferElement* element = *it;
-            if (element->getRealTime() > start) {
-                last = it;
-            } else if (element->getRealTime() == start) {
-                last = ++it;
-                break;
-            } else if (!--count) {
-                break;
-            }
-        }
-        it = last;
+        // Client wants to start from some specified time.
+        it = seek(start, next);
     }
 
     log_time curr = start;
@@ -1143,6 +1354,23 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
     static const size_t maxSkip = 4194304;    // maximum entries to skip
     size_t skip = maxSkip;
     for (; it != mLogElements.end(); ++it) {
+        // Step over runs holding none of the log ids asked for
+        while ((next >= mIndexFirst) &&
+               (next < (mIndexFirst + mIndex.size())) &&
+               (it == mIndex[next - mIndexFirst].it)) {
+            const IndexEntry& entry = mIndex[next - mIndexFirst];
+            next = indexNext(next);
+            if (entry.mask & logMask) {
+                break;
+            }
+            it = (next < (mIndexFirst + mIndex.size()))
+                     ? mIndex[next - mIndexFirst].it
+                     : mLogElements.end();
+        }
+        if (it == mLogElements.end()) {
+            break;
+        }
+
         LogBufferElement* element = *it;
 
         if (!--skip) {
@@ -19,8 +19,10 @@
 
 #include <sys/types.h>
 
+#include <deque>
 #include <list>
 #include <string>
+#include <unordered_map>
 
 #include <android/log.h>
 #include <private/android_filesystem_config.h>
@@ -76,6 +78,9 @@ static bool isMonotonic(const log_time& mono) {
 typedef std::list<LogBufferElement*> LogBufferElementCollection;
 
 class LogBuffer : public LogBufferInterface {
+    // checks the index against a linear scan of mLogElements
+    friend class LogBufferIndexTest;
+
     LogBufferElementCollection mLogElements;
     pthread_rwlock_t mLogElementsLock;
 
@@ -96,6 +101,22 @@ class LogBuffer : public LogBufferInterface {
 
     unsigned long mMaxSize[LOG_ID_MAX];
 
+    // Sparse index for readers to seek with, an entry heads each run of
+    // about indexInterval elements, keyed by its realtime. mask covers the
+    // log ids in the run up to the next live entry. An entry whose run was
+    // erased is dead (it == end()) until it reaches the front, so that
+    // readers can keep their place by sequence number across unlocks.
+    struct IndexEntry {
+        log_time key;
+        LogBufferElementCollection::iterator it;
+        log_mask_t mask;
+    };
+    std::deque<IndexEntry> mIndex;
+    uint64_t mIndexFirst;   // sequence number of mIndex.front()
+    uint64_t mIndexSorted;  // keys are ascending from here to the back
+    size_t mIndexPending;   // elements appended since the last entry
+    std::unordered_map<const LogBufferElement*, uint64_t> mIndexed;
+
     bool monotonic;
 
     LogTags tags;
@@ -103,60 +124,60 @@ class LogBuffer : public LogBufferInterface {
     LogBufferElement* lastLoggedElements[LOG_ID_MAX];
     LogBufferElement* droppedElements[LOG_ID_MAX];
     void log(LogBufferElement* elem);
+    bool isLoggable(const LogBufferElement* elem);
+    int logLocked(LogBufferElement* elem, bool loggable);
 
    public:
-    LastLogTimes& mTimes;
-
     explicit LogBuffer(LastLogTimes* times);
     ~LogBuffer() override;
-    void init();
-    bool isMonotonic() {
+    void init() override;
+    bool isMonotonic() override {
         return monotonic;
     }
 
     int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
             const char* msg, unsigned short len) override;
-    // lastTid is an optional context to help detect if the last previous
-    // valid message was from the same source so we can differentiate chatty
-    // filter types (identical or expired)
+    log_mask_t logBatch(const LogBatchEntry* entries, size_t count) override;
     log_time flushTo(SocketClient* writer, const log_time& start,
                      pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
                      bool privileged, bool security,
                      int (*filter)(const LogBufferElement* element,
                                    void* arg) = nullptr,
-                     void* arg = nullptr);
+                     void* arg = nullptr,
+                     log_mask_t logMask = logMaskAll) override;
 
-    bool clear(log_id_t id, uid_t uid = AID_ROOT);
-    unsigned long getSize(log_id_t id);
-    int setSize(log_id_t id, unsigned long size);
-    unsigned long getSizeUsed(log_id_t id);
+    bool clear(log_id_t id, uid_t uid = AID_ROOT) override;
+    unsigned long getSize(log_id_t id) override;
+    int setSize(log_id_t id, unsigned long size) override;
+    unsigned long getSizeUsed(log_id_t id) override;
 
-    std::string formatStatistics(uid_t uid, pid_t pid, unsigned int logMask);
+    std::string formatStatistics(uid_t uid, pid_t pid,
+                                 unsigned int logMask) override;
 
-    void enableStatistics() {
+    void enableStatistics() override {
         stats.enableStatistics();
     }
 
-    int initPrune(const char* cp) {
+    int initPrune(const char* cp) override {
         return mPrune.init(cp);
     }
-    std::string formatPrune() {
+    std::string formatPrune() override {
         return mPrune.format();
     }
 
     std::string formatGetEventTag(uid_t uid, const char* name,
-                                  const char* format) {
+                                  const char* format) override {
         return tags.formatGetEventTag(uid, name, format);
     }
-    std::string formatEntry(uint32_t tag, uid_t uid) {
+    std::string formatEntry(uint32_t tag, uid_t uid) override {
         return tags.formatEntry(tag, uid);
     }
-    const char* tagToName(uint32_t tag) {
+    const char* tagToName(uint32_t tag) override {
         return tags.tagToName(tag);
     }
 
     // helper must be protected directly or implicitly by wrlock()/unlock()
-    const char* pidToName(pid_t pid) {
+    const char* pidToName(pid_t pid) override {
         return stats.pidToName(pid);
     }
     virtual uid_t pidToUid(pid_t pid) override {
@@ -165,16 +186,16 @@ class LogBuffer : public LogBufferInterface {
     virtual pid_t tidToPid(pid_t tid) override {
         return stats.tidToPid(tid);
     }
-    const char* uidToName(uid_t uid) {
+    const char* uidToName(uid_t uid) override {
         return stats.uidToName(uid);
     }
-    void wrlock() {
+    void wrlock() override {
         pthread_rwlock_wrlock(&mLogElementsLock);
     }
-    void rdlock() {
+    void rdlock() override {
         pthread_rwlock_rdlock(&mLogElementsLock);
     }
-    void unlock() {
+    void unlock() override {
         pthread_rwlock_unlock(&mLogElementsLock);
     }
 
@@ -190,6 +211,16 @@ class LogBuffer : public LogBufferInterface {
     bool prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
     LogBufferElementCollection::iterator erase(
         LogBufferElementCollection::iterator it, bool coalesce = false);
+
+    static constexpr size_t indexInterval = 128;
+
+    void indexAppend(LogBufferElementCollection::iterator it);
+    void indexInsert(LogBufferElementCollection::iterator it);
+    void indexErase(LogBufferElementCollection::iterator it);
+    void reindex();
+    uint64_t indexNext(uint64_t sequence);
+    LogBufferElementCollection::iterator seek(const log_time& start,
+                                              uint64_t& next);
 };
 
 #endif  // _LOGD_LOG_BUFFER_H__
@@ -0,0 +1,679 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <private/android_logger.h>
+
+#include "LogBuffer.h"  // android::isMonotonic()
+#include "LogBufferChunked.h"
+#include "LogKlog.h"
+#include "LogUtils.h"
+
+// Default
+#define log_buffer_size(id) mMaxSize[id]
+
+const log_time LogBufferChunked::pruneMargin(3, 0);
+
+void LogBufferChunked::init() {
+    mCompress = __android_logger_property_get_bool(
+        "logd.compress", BOOL_DEFAULT_FALSE | BOOL_DEFAULT_FLAG_PERSIST);
+
+    log_id_for_each(i) {
+        if (setSize(i, __android_logger_get_buffer_size(i))) {
+            setSize(i, LOG_BUFFER_MIN_SIZE);
+        }
+    }
+    bool lastMonotonic = monotonic;
+    monotonic = android_log_clockid() == CLOCK_MONOTONIC;
+    if (lastMonotonic != monotonic) {
+        // Fixup all timestamps in place, see LogBuffer::init() for the
+        // gory details on why this is good enough. Compressed chunks are
+        // repacked, which readers must not see half done.
+        wrlock();
+        log_id_for_each(i) {
+            for (LogChunk& chunk : mChunks[i]) {
+                bool packed = chunk.compressed();
+                decompress(i, chunk);
+                chunk.forEach([this](LogBufferElement* e) {
+                    if (monotonic) {
+                        if (!android::isMonotonic(e->mRealTime)) {
+                            LogKlog::convertRealToMonotonic(e->mRealTime);
+                            if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                                e->mRealTime.tv_nsec++;
+                            }
+                        }
+                    } else {
+                        if (android::isMonotonic(e->mRealTime)) {
+                            LogKlog::convertMonotonicToReal(e->mRealTime);
+                            if ((e->mRealTime.tv_nsec % 1000) == 0) {
+                                e->mRealTime.tv_nsec++;
+                            }
+                        }
+                    }
+                });
+                chunk.updateNewest();
+                if (packed) compress(i, chunk);
+            }
+        }
+        unlock();
+    }
+
+    // We may have been triggered by a SIGHUP. Release any sleeping reader
+    // threads to dump their current content.
+    LogTimeEntry::wrlock();
+
+    LastLogTimes::iterator times = mTimes.begin();
+    while (times != mTimes.end()) {
+        LogTimeEntry* entry = (*times);
+        if (entry->owned_Locked()) {
+            entry->triggerReader_Locked();
+        }
+        times++;
+    }
+
+    LogTimeEntry::unlock();
+}
+
+LogBufferChunked::LogBufferChunked(LastLogTimes* times)
+    : LogBufferInterface(times),
+      monotonic(android_log_clockid() == CLOCK_MONOTONIC),
+      mCompress(false) {
+    pthread_rwlock_init(&mLogElementsLock, nullptr);
+
+    log_id_for_each(i) {
+        mFirstChunk[i] = 0;
+        mSizeUsed[i] = 0;
+    }
+
+    init();
+}
+
+LogBufferChunked::~LogBufferChunked() {
+    pthread_rwlock_destroy(&mLogElementsLock);
+}
+
+int LogBufferChunked::log(log_id_t log_id, log_time realtime, uid_t uid,
+                          pid_t pid, pid_t tid, const char* msg,
+                          unsigned short len) {
+    if (log_id >= LOG_ID_MAX) {
+        return -EINVAL;
+    }
+
+    bool loggable = isLoggable(log_id, msg, len);
+
+    wrlock();
+    int ret = logLocked(log_id, realtime, uid, pid, tid, msg, len, loggable);
+    unlock();
+
+    return ret;
+}
+
+log_mask_t LogBufferChunked::logBatch(const LogBatchEntry* entries,
+                                      size_t count) {
+    std::vector<bool> loggable(count);
+    for (size_t i = 0; i < count; ++i) {
+        const LogBatchEntry& entry = entries[i];
+        loggable[i] = (entry.id < LOG_ID_MAX) &&
+                      isLoggable(entry.id, entry.msg, entry.len);
+    }
+
+    log_mask_t logMask = 0;
+    wrlock();
+    for (size_t i = 0; i < count; ++i) {
+        const LogBatchEntry& entry = entries[i];
+        if (entry.id >= LOG_ID_MAX) {
+            continue;
+        }
+        if (logLocked(entry.id, entry.realtime, entry.uid, entry.pid,
+                      entry.tid, entry.msg, entry.len, loggable[i]) > 0) {
+            logMask |= 1 << entry.id;
+        }
+    }
+    unlock();
+
+    return logMask;
+}
+
+// Whether the priority and tag of msg pass the loggable properties.
+bool LogBufferChunked::isLoggable(log_id_t log_id, const char* msg,
+                                  unsigned short len) {
+    if (log_id == LOG_ID_SECURITY) {
+        return true;
+    }
+
+    int prio = ANDROID_LOG_INFO;
+    const char* tag = nullptr;
+    size_t tag_len = 0;
+    if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS) {
+        uint32_t event_tag = 0;
+        if ((log_id == LOG_ID_EVENTS) &&
+            (len >= sizeof(android_event_header_t))) {
+            event_tag =
+                reinterpret_cast<const android_event_header_t*>(msg)->tag;
+        }
+        tag = tagToName(event_tag);
+        if (tag) {
+            tag_len = strlen(tag);
+        }
+    } else {
+        prio = *msg;
+        tag = msg + 1;
+        tag_len = strnlen(tag, len - 1);
+    }
+    return __android_log_is_loggable_len(prio, tag, tag_len,
+                                         ANDROID_LOG_VERBOSE);
+}
+
+// LogBufferChunked::wrlock() must be held when this function is called.
+int LogBufferChunked::logLocked(log_id_t log_id, log_time realtime,
+                                uid_t uid, pid_t pid, pid_t tid,
+                                const char* msg, unsigned short len,
+                                bool loggable) {
+    if (!loggable) {
+        // Log traffic received to total
+        stats.addTotal(log_id, len);
+        return -EACCES;
+    }
+
+    // Slip the time by 1 nsec if the incoming lands on xxxxxx000 ns.
+    // This prevents any chance that an outside source can request an
+    // exact entry with time specified in ms or us precision.
+    if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
+
+    LogBufferElement* elem = append(log_id, realtime, uid, pid, tid, msg, len);
+    stats.add(elem);
+    maybePrune(log_id);
+
+    return len;
+}
+
+// Eight chunks to a buffer keeps the granularity of pruning close to the
+// 10% that LogBuffer aims for.
+size_t LogBufferChunked::chunkSize(log_id_t id, unsigned short len) {
+    size_t size = log_buffer_size(id) / 8;
+    size = std::min(std::max(size, minChunkSize), maxChunkSize);
+    return std::max(size, LogChunk::recordSize(len));
+}
+
+// assumes LogBufferChunked::wrlock() held
+LogBufferElement* LogBufferChunked::append(log_id_t log_id, log_time realtime,
+                                           uid_t uid, pid_t pid, pid_t tid,
+                                           const char* msg,
+                                           unsigned short len) {
+    std::deque<LogChunk>& chunks = mChunks[log_id];
+    LogBufferElement* elem = nullptr;
+    if (!chunks.empty()) {
+        LogChunk& chunk = chunks.back();
+        elem = insertInOrder(log_id, realtime)
+                   ? chunk.insert(log_id, realtime, uid, pid, tid, msg, len)
+                   : chunk.append(log_id, realtime, uid, pid, tid, msg, len);
+    }
+    if (!elem) {
+        chunks.emplace_back(chunkSize(log_id, len));
+        elem = chunks.back().append(log_id, realtime, uid, pid, tid, msg, len);
+        mSizeUsed[log_id] += chunks.back().footprint();
+        compressSealed(log_id);
+    }
+    return elem;
+}
+
+// Whether a record arriving late, as from klogd or pmsg, is to be put in
+// time order within the newest chunk, see LogBuffer::log(). Readers keep
+// offsets into the chunk while the lock is dropped, so unlike LogBuffer
+// this is not done at all while any reader is attached. Records older than
+// the whole newest chunk still land at its start.
+//
+// LogBufferChunked::wrlock() must be held when this function is called.
+bool LogBufferChunked::insertInOrder(log_id_t id, log_time realtime) {
+    // cap on how far back we will sort in-place, otherwise append
+    static const uint32_t too_far_back = 5;  // five seconds
+
+    const log_time& newest = mChunks[id].back().newest();
+    if (__predict_true(newest <= realtime) ||
+        __predict_false(((newest.tv_sec - too_far_back) > realtime.tv_sec) &&
+                        (id != LOG_ID_KERNEL))) {
+        return false;
+    }
+
+    bool attached = false;
+
+    LogTimeEntry::rdlock();
+
+    LastLogTimes::iterator times = mTimes.begin();
+    while (times != mTimes.end()) {
+        if ((*times)->owned_Locked()) {
+            attached = true;
+            break;
+        }
+        times++;
+    }
+
+    LogTimeEntry::unlock();
+
+    return !attached;
+}
+
+// LogBufferChunked::wrlock() must be held when this function is called.
+void LogBufferChunked::compress(log_id_t id, LogChunk& chunk) {
+    if (chunk.compressed()) {
+        return;
+    }
+    size_t size = chunk.size();
+    size_t footprint = chunk.footprint();
+    if (chunk.compress()) {
+        stats.addCompressed(id, size, chunk.footprint());
+        mSizeUsed[id] -= footprint - chunk.footprint();
+    }
+}
+
+// LogBufferChunked::wrlock() must be held when this function is called.
+void LogBufferChunked::decompress(log_id_t id, LogChunk& chunk) {
+    if (!chunk.compressed()) {
+        return;
+    }
+    stats.subtractCompressed(id, chunk.size(), chunk.footprint());
+    mSizeUsed[id] -= chunk.footprint();
+    chunk.decompress();
+    mSizeUsed[id] += chunk.footprint();
+}
+
+// Compress the sealed chunks of "id" that every reader has moved past. A
+// reader with the lock dropped may still be sending a record from the
+// chunk it is in, so those are left for the next time around.
+//
+// LogBufferChunked::wrlock() must be held when this function is called.
+void LogBufferChunked::compressSealed(log_id_t id) {
+    std::deque<LogChunk>& chunks = mChunks[id];
+    if (!mCompress || (chunks.size() < 2)) {
+        return;
+    }
+
+    LogTimeEntry::rdlock();
+
+    log_time watermark;
+    LogTimeEntry* oldest = oldestReader(id, watermark);
+    // the back chunk is still being appended to
+    for (size_t index = 0; (index + 1) < chunks.size(); ++index) {
+        LogChunk& chunk = chunks[index];
+        if (chunk.sealed()) {
+            continue;
+        }
+        if (oldest && (watermark <= chunk.newest())) {
+            break;
+        }
+        compress(id, chunk);
+    }
+
+    LogTimeEntry::unlock();
+}
+
+// LogBufferChunked::wrlock() must be held when this function is called.
+void LogBufferChunked::maybePrune(log_id_t id) {
+    unsigned long maxSize = log_buffer_size(id);
+    if (mSizeUsed[id] > maxSize) {
+        prune(id, (maxSize * 9) / 10);
+    }
+}
+
+// Find the oldest reader watching "id" and the watermark below which it
+// will read no more, see LogBuffer::prune().
+//
+// LogTimeEntry::rdlock() must be held when this function is called.
+LogTimeEntry* LogBufferChunked::oldestReader(log_id_t id,
+                                             log_time& watermark) {
+    LogTimeEntry* oldest = nullptr;
+
+    // Region locked?
+    LastLogTimes::iterator times = mTimes.begin();
+    while (times != mTimes.end()) {
+        LogTimeEntry* entry = (*times);
+        if (entry->owned_Locked() && entry->isWatching(id) &&
+            (!oldest || (oldest->mStart > entry->mStart) ||
+             ((oldest->mStart == entry->mStart) &&
+              (entry->mTimeout.tv_sec || entry->mTimeout.tv_nsec)))) {
+            oldest = entry;
+        }
+        times++;
+    }
+    watermark = log_time(log_time::tv_sec_max, log_time::tv_nsec_max);
+    if (oldest) watermark = oldest->mStart - pruneMargin;
+
+    return oldest;
+}
+
+// Determine if watermark is within pruneMargin + 1s from the newest entry,
+// see LogBuffer::isBusy().
+bool LogBufferChunked::isBusy(log_id_t id, log_time watermark) {
+    if (mChunks[id].empty()) {
+        return false;
+    }
+    return watermark <
+           (mChunks[id].back().newest() - pruneMargin - log_time(1, 0));
+}
+
+// If the selected reader is blocking our pruning progress, decide on
+// what kind of mitigation is necessary to unblock the situation.
+void LogBufferChunked::kickMe(LogTimeEntry* me, log_id_t id) {
+    if (mSizeUsed[id] > (2 * log_buffer_size(id))) {  // +100%
+        // A misbehaving or slow reader has its connection
+        // dropped if we hit too much memory pressure.
+        me->release_Locked();
+    } else if (me->mTimeout.tv_sec || me->mTimeout.tv_nsec) {
+        // Allow a blocked WRAP timeout reader to
+        // trigger and start reporting the log data.
+        me->triggerReader_Locked();
+    } else {
+        // tell slow reader to skip the oldest chunk to catch up
+        me->triggerSkip_Locked(id, mChunks[id].front().count());
+    }
+}
+
+// assumes LogBufferChunked::wrlock() held
+void LogBufferChunked::dropFront(log_id_t id) {
+    LogChunk& chunk = mChunks[id].front();
+    // statistics are kept per element, so they have to be seen once more
+    decompress(id, chunk);
+    chunk.forEach([this](LogBufferElement* element) {
+        stats.subtract(element);
+    });
+    mSizeUsed[id] -= chunk.footprint();
+    mChunks[id].pop_front();
+    ++mFirstChunk[id];
+}
+
+// Expire whole chunks of "id" from the oldest end until no more than
+// "targetSize" bytes remain. A caller_uid other than AID_ROOT instead
+// removes just that uid's entries (unprivileged clear).
+//
+// As with LogBuffer::prune(), the oldest reader watching "id" acts as a
+// backstop, chunks holding anything it may yet read are left alone.
+//
+// LogBufferChunked::wrlock() must be held when this function is called.
+bool LogBufferChunked::prune(log_id_t id, size_t targetSize,
+                             uid_t caller_uid) {
+    bool busy = false;
+
+    LogTimeEntry::rdlock();
+
+    log_time watermark;
+    LogTimeEntry* oldest = oldestReader(id, watermark);
+
+    std::deque<LogChunk>& chunks = mChunks[id];
+
+    if (__predict_false(caller_uid != AID_ROOT)) {  // unlikely
+        // Compacting moves records, so only touch chunks entirely behind
+        // every reader.
+        for (LogChunk& chunk : chunks) {
+            if (oldest && (watermark <= chunk.newest())) {
+                busy = isBusy(id, watermark);
+                if (busy) kickMe(oldest, id);
+                break;
+            }
+            // compacting frees no memory until the chunk is dropped empty
+            bool packed = chunk.compressed();
+            decompress(id, chunk);
+            chunk.erase(caller_uid, [this](LogBufferElement* element) {
+                stats.subtract(element);
+            });
+            if (packed) compress(id, chunk);
+        }
+        while (!chunks.empty() && !chunks.front().count()) {
+            dropFront(id);
+        }
+        LogTimeEntry::unlock();
+        return busy;
+    }
+
+    while (!chunks.empty() && (mSizeUsed[id] > targetSize)) {
+        if (oldest && (watermark <= chunks.front().newest())) {
+            busy = isBusy(id, watermark);
+            if (busy) kickMe(oldest, id);
+            break;
+        }
+        dropFront(id);
+    }
+
+    LogTimeEntry::unlock();
+
+    return (mSizeUsed[id] > targetSize) && busy;
+}
+
+// clear all rows of type "id" from the buffer.
+bool LogBufferChunked::clear(log_id_t id, uid_t uid) {
+    bool busy = true;
+    // If it takes more than 4 tries (seconds) to clear, then kill reader(s)
+    for (int retry = 4;;) {
+        if (retry == 1) {  // last pass
+            // Check if it is still busy after the sleep, we are looking for
+            // the quick side effect of the return value to tell us if we
+            // have a _blocked_ reader.
+            wrlock();
+            busy = (uid == AID_ROOT) ? prune(id, mSizeUsed[id] - 1)
+                                     : prune(id, 0, uid);
+            unlock();
+            // It is still busy, blocked reader(s), lets kill them all!
+            if (busy) {
+                LogTimeEntry::wrlock();
+                LastLogTimes::iterator times = mTimes.begin();
+                while (times != mTimes.end()) {
+                    LogTimeEntry* entry = (*times);
+                    // Killer punch
+                    if (entry->owned_Locked() && entry->isWatching(id)) {
+                        entry->release_Locked();
+                    }
+                    times++;
+                }
+                LogTimeEntry::unlock();
+            }
+        }
+        wrlock();
+        busy = prune(id, 0, uid);
+        unlock();
+        if (!busy || !--retry) {
+            break;
+        }
+        sleep(1);  // Let reader(s) catch up after notification
+    }
+    return busy;
+}
+
+// get the used space associated with "id".
+unsigned long LogBufferChunked::getSizeUsed(log_id_t id) {
+    rdlock();
+    size_t retval = mSizeUsed[id];
+    unlock();
+    return retval;
+}
+
+// set the total space allocated to "id"
+int LogBufferChunked::setSize(log_id_t id, unsigned long size) {
+    // Reasonable limits ...
+    if (!__android_logger_valid_buffer_size(size)) {
+        return -1;
+    }
+    wrlock();
+    log_buffer_size(id) = size;
+    unlock();
+    return 0;
+}
+
+// get the total space allocated to "id"
+unsigned long LogBufferChunked::getSize(log_id_t id) {
+    rdlock();
+    size_t retval = log_buffer_size(id);
+    unlock();
+    return retval;
+}
+
+// Position a reader at the first chunk of "id" that holds anything newer
+// than start. Readers mostly resume near the end, so look from there.
+void LogBufferChunked::seek(log_id_t id, const log_time& start,
+                            Position& position) {
+    size_t index = 0;
+    if (start != log_time::EPOCH) {
+        for (index = mChunks[id].size(); index > 0; --index) {
+            if (mChunks[id][index - 1].newest() <= start) {
+                break;
+            }
+        }
+    }
+    position.chunk = mFirstChunk[id] + index;
+    position.offset = 0;
+    position.expanded.reset();
+}
+
+// Return the next element of "id" at or after position that is newer than
+// start, or nullptr if there is none (yet). Holding a lock is required.
+LogBufferElement* LogBufferChunked::peek(log_id_t id, const log_time& start,
+                                         Position& position) {
+    std::deque<LogChunk>& chunks = mChunks[id];
+    if (position.chunk < mFirstChunk[id]) {
+        // pruned while we had the lock dropped, resume at the oldest
+        position.chunk = mFirstChunk[id];
+        position.offset = 0;
+        position.expanded.reset();
+    }
+    for (;;) {
+        size_t index = position.chunk - mFirstChunk[id];
+        if (index >= chunks.size()) {
+            return nullptr;
+        }
+        const LogChunk* chunk = &chunks[index];
+        if (position.offset >= chunk->size()) {
+            // stay put at the end of the newest chunk to pick up appends
+            if ((index + 1) >= chunks.size()) {
+                return nullptr;
+            }
+            ++position.chunk;
+            position.offset = 0;
+            position.expanded.reset();
+            continue;
+        }
+        if (chunk->compressed()) {
+            // private to this reader, so it outlives dropping the lock
+            if (!position.expanded) {
+                position.expanded = chunk->expand();
+            }
+            chunk = position.expanded.get();
+            if (position.offset >= chunk->size()) {  // corrupt
+                ++position.chunk;
+                position.offset = 0;
+                position.expanded.reset();
+                continue;
+            }
+        }
+        LogBufferElement* element = chunk->at(position.offset);
+        if ((start != log_time::EPOCH) && (element->getRealTime() <= start)) {
+            position.offset = chunk->next(position.offset);
+            continue;
+        }
+        return element;
+    }
+}
+
+log_time LogBufferChunked::flushTo(
+    SocketClient* reader, const log_time& start, pid_t* lastTid,
+    bool privileged, bool security,
+    int (*filter)(const LogBufferElement* element, void* arg), void* arg,
+    log_mask_t logMask) {
+    Position position[LOG_ID_MAX];
+    uid_t uid = reader->getUid();
+
+    rdlock();
+
+    log_id_for_each(i) {
+        seek(i, start, position[i]);
+    }
+
+    log_time curr = start;
+
+    for (;;) {
+        // Merge the rings by timestamp
+        LogBufferElement* element = nullptr;
+        log_id_t id = LOG_ID_MAX;
+        log_id_for_each(i) {
+            if (!(logMask & (1 << i))) {
+                continue;
+            }
+            LogBufferElement* e = peek(i, start, position[i]);
+            if (e &&
+                (!element || (e->getRealTime() < element->getRealTime()))) {
+                element = e;
+                id = i;
+            }
+        }
+        if (!element) {
+            break;
+        }
+        position[id].offset += LogChunk::recordSize(element->getMsgLen());
+
+        if (!privileged && (element->getUid() != uid)) {
+            continue;
+        }
+
+        if (!security && (id == LOG_ID_SECURITY)) {
+            continue;
+        }
+
+        // NB: calling out to another object with rdlock() held (safe)
+        if (filter) {
+            int ret = (*filter)(element, arg);
+            if (ret == false) {
+                continue;
+            }
+            if (ret != true) {
+                break;
+            }
+        }
+
+        bool sameTid = false;
+        if (lastTid) {
+            sameTid = lastTid[id] == element->getTid();
+            lastTid[id] = element->getTid();
+        }
+
+        unlock();
+
+        // range locking in LastLogTimes looks after us
+        curr = element->flushTo(reader, this, privileged, sameTid);
+
+        if (curr == element->FLUSH_ERROR) {
+            return curr;
+        }
+
+        rdlock();
+    }
+    unlock();
+
+    return curr;
+}
+
+std::string LogBufferChunked::formatStatistics(uid_t uid, pid_t pid,
+                                               unsigned int logMask) {
+    wrlock();
+
+    std::string ret = stats.format(uid, pid, logMask);
+
+    unlock();
+
+    return ret;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_BUFFER_CHUNKED_H__
+#define _LOGD_LOG_BUFFER_CHUNKED_H__
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <deque>
+#include <memory>
+#include <string>
+
+#include <android/log.h>
+#include <private/android_filesystem_config.h>
+#include <sysutils/SocketClient.h>
+
+#include "LogBufferElement.h"
+#include "LogBufferInterface.h"
+#include "LogChunk.h"
+#include "LogStatistics.h"
+#include "LogTags.h"
+#include "LogTimes.h"
+#include "LogWhiteBlackList.h"
+
+// Alternative to LogBuffer that keeps each log id in a ring of LogChunk
+// slabs instead of one list of individually allocated elements. Pruning
+// releases whole chunks from the oldest end, and readers merge the per log
+// id rings by timestamp. There is no chatty squashing of identical messages
+// and no worst offender pruning, the prune list is kept for logcat -P but
+// not acted upon.
+//
+// With logd.compress set, chunks that readers have moved past are kept
+// compressed and only their compressed size counts against setSize().
+// Readers expand them into a private copy as they get to them.
+class LogBufferChunked : public LogBufferInterface {
+    // Oldest chunk first, records are appended to the back.
+    std::deque<LogChunk> mChunks[LOG_ID_MAX];
+    // Sequence number of mChunks[id].front(). Readers remember their place
+    // by chunk sequence so that they notice if it got pruned under them.
+    uint64_t mFirstChunk[LOG_ID_MAX];
+    // Bytes allocated to the chunks, whether filled or not.
+    size_t mSizeUsed[LOG_ID_MAX];
+    unsigned long mMaxSize[LOG_ID_MAX];
+    pthread_rwlock_t mLogElementsLock;
+
+    LogStatistics stats;
+
+    PruneList mPrune;
+
+    bool monotonic;
+    bool mCompress;
+
+    LogTags tags;
+
+    struct Position {
+        uint64_t chunk;
+        size_t offset;
+        // copy of chunk if it is compressed
+        std::unique_ptr<LogChunk> expanded;
+    };
+
+   public:
+    explicit LogBufferChunked(LastLogTimes* times);
+    ~LogBufferChunked() override;
+    void init() override;
+    bool isMonotonic() override {
+        return monotonic;
+    }
+
+    int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
+            const char* msg, unsigned short len) override;
+    log_mask_t logBatch(const LogBatchEntry* entries, size_t count) override;
+    log_time flushTo(SocketClient* writer, const log_time& start,
+                     pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
+                     bool privileged, bool security,
+                     int (*filter)(const LogBufferElement* element,
+                                   void* arg) = nullptr,
+                     void* arg = nullptr,
+                     log_mask_t logMask = logMaskAll) override;
+
+    bool clear(log_id_t id, uid_t uid = AID_ROOT) override;
+    unsigned long getSize(log_id_t id) override;
+    int setSize(log_id_t id, unsigned long size) override;
+    unsigned long getSizeUsed(log_id_t id) override;
+
+    std::string formatStatistics(uid_t uid, pid_t pid,
+                                 unsigned int logMask) override;
+
+    void enableStatistics() override {
+        stats.enableStatistics();
+    }
+    // As if logd.compress were set, until the next init().
+    void enableCompression() {
+        wrlock();
+        mCompress = true;
+        unlock();
+    }
+
+    int initPrune(const char* cp) override {
+        return mPrune.init(cp);
+    }
+    std::string formatPrune() override {
+        return mPrune.format();
+    }
+
+    std::string formatGetEventTag(uid_t uid, const char* name,
+                                  const char* format) override {
+        return tags.formatGetEventTag(uid, name, format);
+    }
+    std::string formatEntry(uint32_t tag, uid_t uid) override {
+        return tags.formatEntry(tag, uid);
+    }
+    const char* tagToName(uint32_t tag) override {
+        return tags.tagToName(tag);
+    }
+
+    // helper must be protected directly or implicitly by wrlock()/unlock()
+    const char* pidToName(pid_t pid) override {
+        return stats.pidToName(pid);
+    }
+    uid_t pidToUid(pid_t pid) override {
+        return stats.pidToUid(pid);
+    }
+    pid_t tidToPid(pid_t tid) override {
+        return stats.tidToPid(tid);
+    }
+    const char* uidToName(uid_t uid) override {
+        return stats.uidToName(uid);
+    }
+    void wrlock() override {
+        pthread_rwlock_wrlock(&mLogElementsLock);
+    }
+    void rdlock() override {
+        pthread_rwlock_rdlock(&mLogElementsLock);
+    }
+    void unlock() override {
+        pthread_rwlock_unlock(&mLogElementsLock);
+    }
+
+   private:
+    static constexpr size_t minChunkSize = 16 * 1024;
+    static constexpr size_t maxChunkSize = 1024 * 1024;
+    static const log_time pruneMargin;
+
+    bool isLoggable(log_id_t log_id, const char* msg, unsigned short len);
+    int logLocked(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+                  pid_t tid, const char* msg, unsigned short len,
+                  bool loggable);
+
+    size_t chunkSize(log_id_t id, unsigned short len);
+    LogBufferElement* append(log_id_t log_id, log_time realtime, uid_t uid,
+                             pid_t pid, pid_t tid, const char* msg,
+                             unsigned short len);
+
+    bool insertInOrder(log_id_t id, log_time realtime);
+
+    void seek(log_id_t id, const log_time& start, Position& position);
+    LogBufferElement* peek(log_id_t id, const log_time& start,
+                           Position& position);
+
+    void compressSealed(log_id_t id);
+    void compress(log_id_t id, LogChunk& chunk);
+    void decompress(log_id_t id, LogChunk& chunk);
+
+    void maybePrune(log_id_t id);
+    LogTimeEntry* oldestReader(log_id_t id, log_time& watermark);
+    bool isBusy(log_id_t id, log_time watermark);
+    void kickMe(LogTimeEntry* me, log_id_t id);
+    bool prune(log_id_t id, size_t targetSize, uid_t uid = AID_ROOT);
+    void dropFront(log_id_t id);
+};
+
+#endif  // _LOGD_LOG_BUFFER_CHUNKED_H__
@@ -47,6 +47,19 @@ LogBufferElement::LogBufferElement(log_id_t log_id, log_time realtime,
     memcpy(mMsg, msg, len);
 }
 
+LogBufferElement::LogBufferElement(char* msg, log_id_t log_id,
+                                   log_time realtime, uid_t uid, pid_t pid,
+                                   pid_t tid, unsigned short len)
+    : mUid(uid),
+      mPid(pid),
+      mTid(tid),
+      mRealTime(realtime),
+      mMsg(msg),
+      mMsgLen(len),
+      mLogId(log_id),
+      mDropped(false) {
+}
+
 LogBufferElement::LogBufferElement(const LogBufferElement& elem)
     : mUid(elem.mUid),
       mPid(elem.mPid),
@@ -135,7 +148,8 @@ char* android::tidToName(pid_t tid) {
 }
 
 // assumption: mMsg == NULL
-size_t LogBufferElement::populateDroppedMessage(char*& buffer, LogBuffer* parent,
+size_t LogBufferElement::populateDroppedMessage(char*& buffer,
+                                                LogBufferInterface* parent,
                                                 bool lastSame) {
     static const char tag[] = "chatty";
 
@@ -228,8 +242,9 @@ size_t LogBufferElement::populateDroppedMessage(char*& buffer, LogBuffer* parent
     return retval;
 }
 
-log_time LogBufferElement::flushTo(SocketClient* reader, LogBuffer* parent,
-                                   bool privileged, bool lastSame) {
+log_time LogBufferElement::flushTo(SocketClient* reader,
+                                   LogBufferInterface* parent, bool privileged,
+                                   bool lastSame) {
     struct logger_entry_v4 entry;
 
     memset(&entry, 0, sizeof(struct logger_entry_v4));
@@ -25,6 +25,9 @@
 #include <sysutils/SocketClient.h>
 
 class LogBuffer;
+class LogBufferChunked;
+class LogBufferInterface;
+class LogChunk;
 
 #define EXPIRE_HOUR_THRESHOLD 24  // Only expire chatty UID logs to preserve
                                   // non-chatty UIDs less than this age in hours
@@ -34,6 +37,8 @@ class LogBuffer;
 
 class __attribute__((packed)) LogBufferElement {
     friend LogBuffer;
+    friend LogBufferChunked;
+    friend LogChunk;
 
     // sized to match reality of incoming log packets
     const uint32_t mUid;
@@ -50,8 +55,14 @@ class __attribute__((packed)) LogBufferElement {
 
     static atomic_int_fast64_t sequence;
 
+    // In-place construction at the head of a LogChunk record, msg is the
+    // payload that directly follows and belongs to the chunk. Such elements
+    // are never destroyed nor setDropped(), the chunk is freed as a whole.
+    LogBufferElement(char* msg, log_id_t log_id, log_time realtime, uid_t uid,
+                     pid_t pid, pid_t tid, unsigned short len);
+
     // assumption: mDropped == true
-    size_t populateDroppedMessage(char*& buffer, LogBuffer* parent,
+    size_t populateDroppedMessage(char*& buffer, LogBufferInterface* parent,
                                   bool lastSame);
 
    public:
@@ -92,8 +103,8 @@ class __attribute__((packed)) LogBufferElement {
     }
 
     static const log_time FLUSH_ERROR;
-    log_time flushTo(SocketClient* writer, LogBuffer* parent, bool privileged,
-                     bool lastSame);
+    log_time flushTo(SocketClient* writer, LogBufferInterface* parent,
+                     bool privileged, bool lastSame);
 };
 
 #endif
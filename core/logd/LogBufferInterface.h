@@ -19,23 +19,92 @@
 
 #include <sys/types.h>
 
+#include <string>
+
 #include <android-base/macros.h>
 #include <log/log_id.h>
 #include <log/log_time.h>
+#include <private/android_filesystem_config.h>
+#include <sysutils/SocketClient.h>
+
+#include "LogTimes.h"
 
-// Abstract interface that handles log when log available.
+class LogBufferElement;
+
+// A message handed to LogBufferInterface::logBatch(), msg is borrowed for
+// the duration of the call.
+struct LogBatchEntry {
+    log_id_t id;
+    log_time realtime;
+    uid_t uid;
+    pid_t pid;
+    pid_t tid;
+    const char* msg;
+    unsigned short len;
+};
+
+// Abstract interface that handles log when log available, and that the
+// readers and administrative commands use to get at the stored content.
+// LogBuffer is the list based implementation, LogBufferChunked keeps each
+// log id in a ring of contiguous chunks.
 class LogBufferInterface {
    public:
-    LogBufferInterface();
+    LastLogTimes& mTimes;
+
+    explicit LogBufferInterface(LastLogTimes* times);
     virtual ~LogBufferInterface();
     // Handles a log entry when available in LogListener.
     // Returns the size of the handled log message.
     virtual int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     pid_t tid, const char* msg, unsigned short len) = 0;
+    // Handles count log entries taking the buffer lock only once.
+    // Returns the mask of the log ids that took any of them.
+    virtual log_mask_t logBatch(const LogBatchEntry* entries,
+                                size_t count) = 0;
 
     virtual uid_t pidToUid(pid_t pid);
     virtual pid_t tidToPid(pid_t tid);
 
+    virtual void init() = 0;
+    virtual bool isMonotonic() = 0;
+
+    // lastTid is an optional context to help detect if the last previous
+    // valid message was from the same source so we can differentiate chatty
+    // filter types (identical or expired). logMask is a hint, log ids
+    // outside of it may or may not be passed to filter.
+    virtual log_time flushTo(SocketClient* writer, const log_time& start,
+                             pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
+                             bool privileged, bool security,
+                             int (*filter)(const LogBufferElement* element,
+                                           void* arg) = nullptr,
+                             void* arg = nullptr,
+                             log_mask_t logMask = logMaskAll) = 0;
+
+    virtual bool clear(log_id_t id, uid_t uid = AID_ROOT) = 0;
+    virtual unsigned long getSize(log_id_t id) = 0;
+    virtual int setSize(log_id_t id, unsigned long size) = 0;
+    virtual unsigned long getSizeUsed(log_id_t id) = 0;
+
+    virtual std::string formatStatistics(uid_t uid, pid_t pid,
+                                         unsigned int logMask) = 0;
+    virtual void enableStatistics() = 0;
+
+    virtual int initPrune(const char* cp) = 0;
+    virtual std::string formatPrune() = 0;
+
+    virtual std::string formatGetEventTag(uid_t uid, const char* name,
+                                          const char* format) = 0;
+    virtual std::string formatEntry(uint32_t tag, uid_t uid) = 0;
+    virtual const char* tagToName(uint32_t tag) = 0;
+
+    // helpers must be protected directly or implicitly by wrlock()/unlock()
+    virtual const char* pidToName(pid_t pid) = 0;
+    virtual const char* uidToName(uid_t uid) = 0;
+
+    virtual void wrlock() = 0;
+    virtual void rdlock() = 0;
+    virtual void unlock() = 0;
+
    private:
     DISALLOW_COPY_AND_ASSIGN(LogBufferInterface);
 };
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <new>
+
+#include <lz4.h>
+#include <private/android_logger.h>
+
+#include "LogChunk.h"
+#include "LogUtils.h"
+
+LogChunk::LogChunk(size_t capacity)
+    : mData(new char[capacity]),
+      mCapacity(capacity),
+      mSize(0),
+      mCompressedSize(0),
+      mCount(0),
+      mNewest(log_time::EPOCH),
+      mSealed(false) {
+}
+
+LogBufferElement* LogChunk::append(log_id_t log_id, log_time realtime,
+                                   uid_t uid, pid_t pid, pid_t tid,
+                                   const char* msg, unsigned short len) {
+    size_t size = recordSize(len);
+    if (size > (mCapacity - mSize)) {
+        return nullptr;
+    }
+
+    char* record = mData.get() + mSize;
+    char* payload = record + sizeof(LogBufferElement);
+    memcpy(payload, msg, len);
+    LogBufferElement* element = new (record)
+        LogBufferElement(payload, log_id, realtime, uid, pid, tid, len);
+
+    mSize += size;
+    ++mCount;
+    if (mNewest < realtime) {
+        mNewest = realtime;
+    }
+    return element;
+}
+
+LogBufferElement* LogChunk::insert(log_id_t log_id, log_time realtime,
+                                   uid_t uid, pid_t pid, pid_t tid,
+                                   const char* msg, unsigned short len) {
+    size_t size = recordSize(len);
+    if (size > (mCapacity - mSize)) {
+        return nullptr;
+    }
+
+    size_t offset = 0;
+    while ((offset < mSize) && (at(offset)->getRealTime() <= realtime)) {
+        offset = next(offset);
+    }
+    if (offset == mSize) {
+        return append(log_id, realtime, uid, pid, tid, msg, len);
+    }
+
+    char* record = mData.get() + offset;
+    memmove(record + size, record, mSize - offset);
+    fixup(record + size, mSize - offset);
+
+    char* payload = record + sizeof(LogBufferElement);
+    memcpy(payload, msg, len);
+    LogBufferElement* element = new (record)
+        LogBufferElement(payload, log_id, realtime, uid, pid, tid, len);
+
+    mSize += size;
+    ++mCount;
+    return element;
+}
+
+void LogChunk::updateNewest() {
+    mNewest = log_time::EPOCH;
+    forEach([this](const LogBufferElement* element) {
+        if (mNewest < element->getRealTime()) {
+            mNewest = element->getRealTime();
+        }
+    });
+}
+
+// Point each record back at its own payload after the slab moved.
+void LogChunk::fixup(char* data, size_t size) {
+    for (size_t offset = 0; offset < size;) {
+        LogBufferElement* element =
+            reinterpret_cast<LogBufferElement*>(data + offset);
+        element->mMsg = data + offset + sizeof(LogBufferElement);
+        offset += recordSize(element->mMsgLen);
+    }
+}
+
+bool LogChunk::inflate(char* data) const {
+    int size = LZ4_decompress_safe(mCompressed.get(), data, mCompressedSize,
+                                   mSize);
+    if ((size < 0) || (static_cast<size_t>(size) != mSize)) {
+        android::prdebug("corrupt log chunk, %zu bytes of records lost",
+                         mSize);
+        return false;
+    }
+    fixup(data, mSize);
+    return true;
+}
+
+bool LogChunk::compress() {
+    mSealed = true;
+    if (compressed() || !mSize) {
+        return compressed();
+    }
+
+    // Anything that does not shrink is not worth expanding for readers.
+    std::unique_ptr<char[]> buffer(new char[mSize]);
+    int size = LZ4_compress_default(mData.get(), buffer.get(), mSize,
+                                    mSize - 1);
+    if (size <= 0) {
+        return false;
+    }
+
+    mCompressed.reset(new char[size]);
+    memcpy(mCompressed.get(), buffer.get(), size);
+    mCompressedSize = size;
+    mData.reset();
+    mCapacity = 0;
+    return true;
+}
+
+void LogChunk::decompress() {
+    if (!compressed()) {
+        return;
+    }
+    mData.reset(new char[mSize]);
+    mCapacity = mSize;
+    if (!inflate(mData.get())) {
+        mSize = 0;
+        mCount = 0;
+        mNewest = log_time::EPOCH;
+    }
+    mCompressed.reset();
+    mCompressedSize = 0;
+}
+
+std::unique_ptr<LogChunk> LogChunk::expand() const {
+    std::unique_ptr<LogChunk> copy(new LogChunk(mSize));
+    if (inflate(copy->mData.get())) {
+        copy->mSize = mSize;
+        copy->mCount = mCount;
+        copy->mNewest = mNewest;
+    }
+    copy->mSealed = true;
+    return copy;
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_CHUNK_H__
+#define _LOGD_LOG_CHUNK_H__
+
+#include <string.h>
+#include <sys/types.h>
+
+#include <memory>
+
+#include <log/log.h>
+
+#include "LogBufferElement.h"
+
+// A contiguous slab of log records for a single log id. Each record is a
+// LogBufferElement header immediately followed by its payload, so appending
+// costs no allocation and walking the chunk is pointer arithmetic. Records
+// are kept in arrival order unless insert()ed, offsets are stable until
+// insert() or erase().
+//
+// Once no longer appended to, a chunk may be sealed and compressed. The
+// records are then unreachable through at(), next(), forEach() and erase()
+// until the chunk is decompressed again, or have to be read through an
+// expand()ed copy. Offsets are the same in either form.
+class LogChunk {
+    std::unique_ptr<char[]> mData;
+    std::unique_ptr<char[]> mCompressed;
+    size_t mCapacity;
+    size_t mSize;
+    size_t mCompressedSize;  // zero unless compressed
+    size_t mCount;
+    log_time mNewest;  // latest timestamp held, not necessarily the last
+    bool mSealed;
+
+    static void fixup(char* data, size_t size);
+    bool inflate(char* data) const;
+
+   public:
+    explicit LogChunk(size_t capacity);
+
+    static size_t recordSize(unsigned short len) {
+        return sizeof(LogBufferElement) + len;
+    }
+
+    // Returns nullptr if the record does not fit.
+    LogBufferElement* append(log_id_t log_id, log_time realtime, uid_t uid,
+                             pid_t pid, pid_t tid, const char* msg,
+                             unsigned short len);
+    // As append(), but places the record in time order after any record no
+    // newer than it, moving the later records up.
+    LogBufferElement* insert(log_id_t log_id, log_time realtime, uid_t uid,
+                             pid_t pid, pid_t tid, const char* msg,
+                             unsigned short len);
+
+    LogBufferElement* at(size_t offset) const {
+        return reinterpret_cast<LogBufferElement*>(mData.get() + offset);
+    }
+    size_t next(size_t offset) const {
+        return offset + recordSize(at(offset)->mMsgLen);
+    }
+
+    // Removes all records of uid, compacting the rest in place. The caller
+    // is handed each record before it goes, returns the bytes released.
+    template <typename TFunc>
+    size_t erase(uid_t uid, TFunc&& erased) {
+        size_t out = 0;
+        size_t released = 0;
+        for (size_t in = 0; in < mSize;) {
+            LogBufferElement* element = at(in);
+            size_t len = recordSize(element->mMsgLen);
+            if (element->getUid() == uid) {
+                erased(element);
+                released += len;
+                --mCount;
+            } else {
+                if (out != in) {
+                    memmove(mData.get() + out, element, len);
+                    at(out)->mMsg =
+                        mData.get() + out + sizeof(LogBufferElement);
+                }
+                out += len;
+            }
+            in += len;
+        }
+        mSize = out;
+        updateNewest();
+        return released;
+    }
+
+    template <typename TFunc>
+    void forEach(TFunc&& func) const {
+        for (size_t offset = 0; offset < mSize; offset = next(offset)) {
+            func(at(offset));
+        }
+    }
+
+    // Must be called if timestamps were altered through forEach().
+    void updateNewest();
+
+    // Seals the chunk and compresses it. Returns false, leaving the records
+    // in place, if they would not shrink.
+    bool compress();
+    void decompress();
+    // Uncompressed copy of a compressed chunk, for a reader to walk while
+    // the buffer lock is dropped.
+    std::unique_ptr<LogChunk> expand() const;
+
+    bool compressed() const {
+        return mCompressedSize != 0;
+    }
+    bool sealed() const {
+        return mSealed;
+    }
+    // Bytes allocated, as charged against the buffer size.
+    size_t footprint() const {
+        return compressed() ? mCompressedSize : mCapacity;
+    }
+    // Bytes of records held, compressed or not.
+    size_t size() const {
+        return mSize;
+    }
+    size_t capacity() const {
+        return mCapacity;
+    }
+    size_t count() const {
+        return mCount;
+    }
+    const log_time& newest() const {
+        return mNewest;
+    }
+};
+
+#endif  // _LOGD_LOG_CHUNK_H__
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#include "LogIngestQueue.h"
+#include "LogReader.h"
+
+LogIngestQueue::LogIngestQueue(LogBufferInterface* buf, LogReader* reader)
+    : mTail(0),
+      mHead(0),
+      mPending(0),
+      mStalledOn(0),
+      mFullWaiters(0),
+      mLogbuf(buf),
+      mReader(reader) {
+    for (size_t i = 0; i < slots; ++i) {
+        mSlots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    sem_init(&mWakeup, 0, 0);
+    pthread_mutex_init(&mFullLock, nullptr);
+    pthread_cond_init(&mSpace, nullptr);
+}
+
+bool LogIngestQueue::startCommitter() {
+    pthread_attr_t attr;
+    if (pthread_attr_init(&attr)) {
+        return false;
+    }
+    bool started = !pthread_attr_setdetachstate(&attr,
+                                                PTHREAD_CREATE_DETACHED) &&
+                   !pthread_create(&mThread, &attr, threadStart, this);
+    pthread_attr_destroy(&attr);
+    return started;
+}
+
+int LogIngestQueue::log(log_id_t log_id, log_time realtime, uid_t uid,
+                        pid_t pid, pid_t tid, const char* msg,
+                        unsigned short len) {
+    if (log_id >= LOG_ID_MAX) {
+        return -EINVAL;
+    }
+    if (len > LOGGER_ENTRY_MAX_PAYLOAD) {
+        len = LOGGER_ENTRY_MAX_PAYLOAD;
+    }
+
+    // Claim the slot at the tail
+    Slot* slot;
+    size_t pos = mTail.load(std::memory_order_relaxed);
+    for (;;) {
+        slot = &mSlots[pos & (slots - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        intptr_t diff = static_cast<intptr_t>(sequence) -
+                        static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (mTail.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+                break;
+            }
+        } else {
+            if (diff < 0) {
+                // Full, sleep until the committer releases this slot
+                pthread_mutex_lock(&mFullLock);
+                mFullWaiters.fetch_add(1, std::memory_order_seq_cst);
+                while (static_cast<intptr_t>(
+                           slot->sequence.load(std::memory_order_seq_cst) -
+                           pos) < 0) {
+                    pthread_cond_wait(&mSpace, &mFullLock);
+                }
+                mFullWaiters.fetch_sub(1, std::memory_order_relaxed);
+                pthread_mutex_unlock(&mFullLock);
+            }
+            pos = mTail.load(std::memory_order_relaxed);
+        }
+    }
+
+    Entry& entry = slot->entry;
+    entry.realtime = realtime;
+    entry.uid = uid;
+    entry.pid = pid;
+    entry.tid = tid;
+    entry.len = len;
+    entry.id = log_id;
+    memcpy(entry.msg, msg, len);
+    slot->sequence.store(pos + 1, std::memory_order_seq_cst);
+
+    // Only the transition from empty needs to wake up the committer, unless
+    // it is stalled waiting for this very slot.
+    if ((mPending.fetch_add(1, std::memory_order_acq_rel) == 0) ||
+        (mStalledOn.load(std::memory_order_seq_cst) == (pos + 1))) {
+        sem_post(&mWakeup);
+    }
+    return len;
+}
+
+// Sleep until the producer that claimed pos has published it. Slots are
+// claimed in order, but that producer could still be copying in while
+// later ones are published.
+void LogIngestQueue::waitForPublish(size_t pos) {
+    Slot& slot = mSlots[pos & (slots - 1)];
+    mStalledOn.store(pos + 1, std::memory_order_seq_cst);
+    while (slot.sequence.load(std::memory_order_seq_cst) != (pos + 1)) {
+        sem_wait(&mWakeup);
+    }
+    mStalledOn.store(0, std::memory_order_relaxed);
+}
+
+// Wake up any producer that found the ring full, the caller has just
+// released slots.
+void LogIngestQueue::wakeProducers() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (mFullWaiters.load(std::memory_order_relaxed)) {
+        pthread_mutex_lock(&mFullLock);
+        pthread_cond_broadcast(&mSpace);
+        pthread_mutex_unlock(&mFullLock);
+    }
+}
+
+// Commit everything pending into the LogBuffer, one buffer lock and one
+// reader notification per batch.
+void LogIngestQueue::commit() {
+    size_t pending = mPending.load(std::memory_order_acquire);
+    while (pending) {
+        // Take the published run at the head
+        LogBatchEntry batch[slots];
+        size_t count = 0;
+        size_t limit = (pending < slots) ? pending : slots;
+        while (count < limit) {
+            size_t pos = mHead + count;
+            Slot& slot = mSlots[pos & (slots - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != (pos + 1)) {
+                break;
+            }
+            Entry& entry = slot.entry;
+            batch[count++] = {entry.id,  entry.realtime, entry.uid, entry.pid,
+                              entry.tid, entry.msg,      entry.len};
+        }
+        if (!count) {
+            waitForPublish(mHead);
+            continue;
+        }
+
+        log_mask_t logMask = mLogbuf->logBatch(batch, count);
+
+        for (size_t i = 0; i < count; ++i, ++mHead) {
+            mSlots[mHead & (slots - 1)].sequence.store(
+                mHead + slots, std::memory_order_release);
+        }
+        wakeProducers();
+
+        if (logMask && mReader) {
+            mReader->notifyNewLog(logMask);
+        }
+        pending = mPending.fetch_sub(count, std::memory_order_acq_rel) -
+                  count;
+    }
+}
+
+void* LogIngestQueue::threadStart(void* obj) {
+    prctl(PR_SET_NAME, "logd.ingest");
+
+    LogIngestQueue* me = reinterpret_cast<LogIngestQueue*>(obj);
+
+    for (;;) {
+        if (sem_wait(&me->mWakeup)) {
+            continue;  // EINTR
+        }
+        me->commit();
+    }
+
+    return nullptr;
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LOGD_LOG_INGEST_QUEUE_H__
+#define _LOGD_LOG_INGEST_QUEUE_H__
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include <android-base/macros.h>
+#include <log/log.h>
+
+#include "LogBufferInterface.h"
+#include "LogTimes.h"
+
+class LogReader;
+
+// Lock-free staging area between the listeners and the LogBuffer. Any
+// number of threads may log(), a single "logd.ingest" thread commits what
+// has been staged in batches, taking the buffer lock and notifying the
+// readers once per batch rather than once per message, so writers never
+// wait on the buffer lock held by readers or pruning.
+class LogIngestQueue {
+    struct Entry {
+        log_time realtime;
+        uid_t uid;
+        pid_t pid;
+        pid_t tid;
+        unsigned short len;
+        log_id_t id;
+        char msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    };
+
+    // Bounded multi-producer ring, each slot carries the sequence number
+    // of the position it is ready for (enqueue) or holds (dequeue).
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Entry entry;
+    };
+
+    static constexpr size_t slots = 64;  // power of two
+    Slot mSlots[slots];
+    std::atomic<size_t> mTail;
+    size_t mHead;  // consumer only
+    // Entries published and not yet committed, the consumer sleeps on
+    // mWakeup when it drops to zero and producers post on the way up.
+    std::atomic<size_t> mPending;
+    sem_t mWakeup;
+    // Position + 1 of a claimed slot the consumer sleeps on until its
+    // producer has published it, 0 if none.
+    std::atomic<size_t> mStalledOn;
+    // Producers blocked on a full ring wait on mSpace for the consumer to
+    // release slots.
+    std::atomic<int> mFullWaiters;
+    pthread_mutex_t mFullLock;
+    pthread_cond_t mSpace;
+
+    LogBufferInterface* mLogbuf;
+    LogReader* mReader;
+    pthread_t mThread;
+
+    static void* threadStart(void* me);
+    void waitForPublish(size_t pos);
+    void wakeProducers();
+    void commit();
+
+   public:
+    LogIngestQueue(LogBufferInterface* buf, LogReader* reader /* nullable */);
+
+    // Spawns the committer thread, which runs for the life of logd; the
+    // queue must not be destroyed once this has succeeded.
+    bool startCommitter();
+
+    // Returns len, or a negative errno if the entry was refused. Blocks
+    // only if the ring is full.
+    int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
+            const char* msg, unsigned short len);
+
+    DISALLOW_COPY_AND_ASSIGN(LogIngestQueue);
+};
+
+#endif  // _LOGD_LOG_INGEST_QUEUE_H__
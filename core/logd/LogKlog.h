@@ -20,11 +20,11 @@
 #include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
 
-class LogBuffer;
+class LogBufferInterface;
 class LogReader;
 
 class LogKlog : public SocketListener {
-    LogBuffer* logbuf;
+    LogBufferInterface* logbuf;
     LogReader* reader;
     const log_time signature;
     // Set once thread is started, separates KLOG_ACTION_READ_ALL
@@ -39,8 +39,8 @@ class LogKlog : public SocketListener {
     static log_time correction;
 
    public:
-    LogKlog(LogBuffer* buf, LogReader* reader, int fdWrite, int fdRead,
-            bool auditd);
+    LogKlog(LogBufferInterface* buf, LogReader* reader, int fdWrite,
+            int fdRead, bool auditd);
     int log(const char* buf, ssize_t len);
     void synchronize(const char* buf, ssize_t len);
 
@@ -32,8 +32,12 @@
 #include "LogListener.h"
 #include "LogUtils.h"
 
-LogListener::LogListener(LogBufferInterface* buf, LogReader* reader)
-    : SocketListener(getLogSocket(), false), logbuf(buf), reader(reader) {
+LogListener::LogListener(LogBufferInterface* buf, LogReader* reader,
+                         LogIngestQueue* queue)
+    : SocketListener(getLogSocket(), false),
+      logbuf(buf),
+      reader(reader),
+      queue(queue) {
 }
 
 bool LogListener::onDataAvailable(SocketClient* cli) {
@@ -133,10 +137,16 @@ bool LogListener::onDataAvailable(SocketClient* cli) {
     // NB: hdr.msg_flags & MSG_TRUNC is not tested, silently passing a
     // truncated message to the logs.
 
-    if (logbuf != nullptr) {
-        int res = logbuf->log(
-            logId, header->realtime, cred->uid, cred->pid, header->tid, msg,
-            ((size_t)n <= USHRT_MAX) ? (unsigned short)n : USHRT_MAX);
+    unsigned short len =
+        ((size_t)n <= USHRT_MAX) ? (unsigned short)n : USHRT_MAX;
+
+    if (queue != nullptr) {
+        // committer looks after notifying the readers
+        queue->log(logId, header->realtime, cred->uid, cred->pid, header->tid,
+                   msg, len);
+    } else if (logbuf != nullptr) {
+        int res = logbuf->log(logId, header->realtime, cred->uid, cred->pid,
+                              header->tid, msg, len);
         if (res > 0 && reader != nullptr) {
             reader->notifyNewLog(static_cast<log_mask_t>(1 << logId));
         }
@@ -18,6 +18,7 @@
 #define _LOGD_LOG_LISTENER_H__
 
 #include <sysutils/SocketListener.h>
+#include "LogIngestQueue.h"
 #include "LogReader.h"
 
 // DEFAULT_OVERFLOWUID is defined in linux/highuid.h, which is not part of
@@ -33,9 +34,11 @@
 class LogListener : public SocketListener {
     LogBufferInterface* logbuf;
     LogReader* reader;
+    LogIngestQueue* queue;
 
    public:
-    LogListener(LogBufferInterface* buf, LogReader* reader /* nullable */);
+    LogListener(LogBufferInterface* buf, LogReader* reader /* nullable */,
+                LogIngestQueue* queue = nullptr);
 
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
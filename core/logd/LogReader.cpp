@@ -30,7 +30,7 @@
 #include "LogReader.h"
 #include "LogUtils.h"
 
-LogReader::LogReader(LogBuffer* logbuf)
+LogReader::LogReader(LogBufferInterface* logbuf)
     : SocketListener(getLogSocket(), true), mLogbuf(*logbuf) {
 }
 
@@ -185,7 +185,7 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
         logbuf().flushTo(cli, sequence, nullptr, FlushCommand::hasReadLogs(cli),
                          FlushCommand::hasSecurityLogs(cli),
-                         logFindStart.callback, &logFindStart);
+                         logFindStart.callback, &logFindStart, logMask);
 
         if (!logFindStart.found()) {
             doSocketDelete(cli);
@@ -23,16 +23,16 @@
 
 #define LOGD_SNDTIMEO 32
 
-class LogBuffer;
+class LogBufferInterface;
 
 class LogReader : public SocketListener {
-    LogBuffer& mLogbuf;
+    LogBufferInterface& mLogbuf;
 
    public:
-    explicit LogReader(LogBuffer* logbuf);
+    explicit LogReader(LogBufferInterface* logbuf);
     void notifyNewLog(log_mask_t logMask);
 
-    LogBuffer& logbuf(void) const {
+    LogBufferInterface& logbuf(void) const {
         return mLogbuf;
     }
 
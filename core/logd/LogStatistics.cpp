@@ -45,6 +45,8 @@ LogStatistics::LogStatistics() : enable(false) {
         mOldest[id] = now;
         mNewest[id] = now;
         mNewestDropped[id] = now;
+        mCompressedIn[id] = 0;
+        mCompressedOut[id] = 0;
     }
 }
 
@@ -82,8 +84,10 @@ char* pidToName(pid_t pid) {
 void LogStatistics::addTotal(LogBufferElement* element) {
     if (element->getDropped()) return;
 
-    log_id_t log_id = element->getLogId();
-    unsigned short size = element->getMsgLen();
+    addTotal(element->getLogId(), element->getMsgLen());
+}
+
+void LogStatistics::addTotal(log_id_t log_id, unsigned short size) {
     mSizesTotal[log_id] += size;
     SizesTotal += size;
     ++mElementsTotal[log_id];
@@ -769,6 +773,39 @@ std::string LogStatistics::format(uid_t uid, pid_t pid,
     if (spaces < 0) spaces = 0;
     output += android::base::StringPrintf("%*s%zu", spaces, "", totalSize);
 
+    // Compression ratio of the records held compressed, if any are
+    size_t totalIn = 0;
+    size_t totalOut = 0;
+    log_id_for_each(id) {
+        if (!(logMask & (1 << id))) continue;
+        totalIn += mCompressedIn[id];
+        totalOut += mCompressedOut[id];
+    }
+    if (totalOut) {
+        static const char CompressStr[] = "\nCompress";
+        spaces = 10 - strlen(CompressStr);
+        output += CompressStr;
+
+        log_id_for_each(id) {
+            if (!(logMask & (1 << id))) continue;
+
+            size_t out = mCompressedOut[id];
+            if (out) {
+                oldLength = output.length();
+                if (spaces < 0) spaces = 0;
+                size_t ratio = (mCompressedIn[id] * 100 + out / 2) / out;
+                output += android::base::StringPrintf(
+                    "%*s%zu.%02zux", spaces, "", ratio / 100, ratio % 100);
+                spaces -= output.length() - oldLength;
+            }
+            spaces += spaces_total;
+        }
+        if (spaces < 0) spaces = 0;
+        size_t ratio = (totalIn * 100 + totalOut / 2) / totalOut;
+        output += android::base::StringPrintf("%*s%zu.%02zux", spaces, "",
+                                              ratio / 100, ratio % 100);
+    }
+
     // Report on Chattiest
 
     std::string name;
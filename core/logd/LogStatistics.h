@@ -677,6 +677,9 @@ class LogStatistics {
     log_time mOldest[LOG_ID_MAX];
     log_time mNewest[LOG_ID_MAX];
     log_time mNewestDropped[LOG_ID_MAX];
+    // records held compressed, and what they compressed to
+    size_t mCompressedIn[LOG_ID_MAX];
+    size_t mCompressedOut[LOG_ID_MAX];
     static size_t SizesTotal;
     bool enable;
 
@@ -740,10 +743,21 @@ class LogStatistics {
     }
 
     void addTotal(LogBufferElement* entry);
+    // traffic received for log_id that never made it into an element
+    void addTotal(log_id_t log_id, unsigned short size);
     void add(LogBufferElement* entry);
     void subtract(LogBufferElement* entry);
     // entry->setDropped(1) must follow this call
     void drop(LogBufferElement* entry);
+    // Compressed chunks of records, in and out are the raw and packed sizes
+    void addCompressed(log_id_t log_id, size_t in, size_t out) {
+        mCompressedIn[log_id] += in;
+        mCompressedOut[log_id] += out;
+    }
+    void subtractCompressed(log_id_t log_id, size_t in, size_t out) {
+        mCompressedIn[log_id] -= in;
+        mCompressedOut[log_id] -= out;
+    }
     // Correct for coalescing two entries referencing dropped content
     void erase(LogBufferElement* element) {
         log_id_t log_id = element->getLogId();
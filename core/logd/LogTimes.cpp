@@ -126,7 +126,7 @@ void* LogTimeEntry::threadStart(void* obj) {
         return nullptr;
     }
 
-    LogBuffer& logbuf = me->mReader.logbuf();
+    LogBufferInterface& logbuf = me->mReader.logbuf();
 
     bool privileged = FlushCommand::hasReadLogs(client);
     bool security = FlushCommand::hasSecurityLogs(client);
@@ -153,11 +153,11 @@ void* LogTimeEntry::threadStart(void* obj) {
 
         if (me->mTail) {
             logbuf.flushTo(client, start, nullptr, privileged, security,
-                           FilterFirstPass, me);
+                           FilterFirstPass, me, me->mLogMask);
             me->leadingDropped = true;
         }
         start = logbuf.flushTo(client, start, me->mLastTid, privileged,
-                               security, FilterSecondPass, me);
+                               security, FilterSecondPass, me, me->mLogMask);
 
         wrlock();
 
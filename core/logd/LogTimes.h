@@ -27,6 +27,7 @@
 #include <sysutils/SocketClient.h>
 
 typedef unsigned int log_mask_t;
+static const log_mask_t logMaskAll = ~0U;
 
 class LogReader;
 class LogBufferElement;
@@ -50,6 +50,7 @@
 #include "CommandListener.h"
 #include "LogAudit.h"
 #include "LogBuffer.h"
+#include "LogBufferChunked.h"
 #include "LogKlog.h"
 #include "LogListener.h"
 #include "LogUtils.h"
@@ -221,7 +222,7 @@ static char* name;
 
 static sem_t reinit;
 static bool reinit_running = false;
-static LogBuffer* logBuf = nullptr;
+static LogBufferInterface* logBuf = nullptr;
 
 static bool package_list_parser_cb(pkg_info* info, void* /* userdata */) {
     bool rc = true;
@@ -484,9 +485,16 @@ int main(int argc, char* argv[]) {
     LastLogTimes* times = new LastLogTimes();
 
     // LogBuffer is the object which is responsible for holding all
-    // log entries.
+    // log entries, LogBufferChunked an alternative that packs them into
+    // per log id chunks.
 
-    logBuf = new LogBuffer(times);
+    if (__android_logger_property_get_bool("logd.chunked",
+                                           BOOL_DEFAULT_FALSE |
+                                               BOOL_DEFAULT_FLAG_PERSIST)) {
+        logBuf = new LogBufferChunked(times);
+    } else {
+        logBuf = new LogBuffer(times);
+    }
 
     signal(SIGHUP, reinit_signal_handler);
 
@@ -506,10 +514,22 @@ int main(int argc, char* argv[]) {
     }
 
     // LogListener listens on /dev/socket/logdw for client
-    // initiated log messages. New log entries are added to LogBuffer
+    // initiated log messages. New log entries are added to LogBuffer,
+    // optionally staged through LogIngestQueue to be added in batches,
     // and LogReader is notified to send updates to connected clients.
 
-    LogListener* swl = new LogListener(logBuf, reader);
+    LogIngestQueue* queue = nullptr;
+    if (__android_logger_property_get_bool("logd.ingest_queue",
+                                           BOOL_DEFAULT_FALSE |
+                                               BOOL_DEFAULT_FLAG_PERSIST)) {
+        queue = new LogIngestQueue(logBuf, reader);
+        if (!queue->startCommitter()) {
+            delete queue;
+            queue = nullptr;
+        }
+    }
+
+    LogListener* swl = new LogListener(logBuf, reader, queue);
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
     if (swl->startListener(600)) {
         exit(1);
@@ -23,6 +23,39 @@ LOCAL_PATH := $(call my-dir)
 test_module_prefix := logd-
 test_tags := tests
 
+benchmark_c_flags := \
+    -Wall \
+    -Wextra \
+    -Werror \
+    -fno-builtin \
+
+benchmark_src_files := \
+    logd_buffer_benchmark.cpp
+
+# Build benchmarks for the device. Run with:
+#   adb shell /data/benchmarktest/logd-benchmarks/logd-benchmarks
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)benchmarks
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_CFLAGS += $(benchmark_c_flags)
+LOCAL_STATIC_LIBRARIES := liblogd liblz4
+LOCAL_SHARED_LIBRARIES := libbase libcutils liblog libsysutils
+LOCAL_SRC_FILES := $(benchmark_src_files)
+include $(BUILD_NATIVE_BENCHMARK)
+
+# Ingest stress harness, reports messages/sec and p99 log() latency under
+# concurrent readers. Run with:
+#   adb shell /data/nativetest/logd-ingest-stress/logd-ingest-stress -q
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)ingest-stress
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_CFLAGS += $(benchmark_c_flags)
+LOCAL_STATIC_LIBRARIES := liblogd liblz4
+LOCAL_SHARED_LIBRARIES := libbase libcutils liblog libsysutils
+LOCAL_SRC_FILES := logd_ingest_stress.cpp
+LOCAL_MODULE_PATH := $(TARGET_OUT_DATA)/nativetest/$(LOCAL_MODULE)
+include $(BUILD_EXECUTABLE)
+
 # -----------------------------------------------------------------------------
 # Unit tests.
 # -----------------------------------------------------------------------------
@@ -50,6 +83,17 @@ LOCAL_SHARED_LIBRARIES := libbase libcutils liblog libselinux
 LOCAL_SRC_FILES := $(test_src_files)
 include $(BUILD_NATIVE_TEST)
 
+# Build unit tests of the log buffers, linked with logd proper. Run with:
+#   adb shell /data/nativetest/logd-buffer-tests/logd-buffer-tests
+include $(CLEAR_VARS)
+LOCAL_MODULE := $(test_module_prefix)buffer-tests
+LOCAL_MODULE_TAGS := $(test_tags)
+LOCAL_CFLAGS += $(test_c_flags)
+LOCAL_STATIC_LIBRARIES := liblogd liblz4
+LOCAL_SHARED_LIBRARIES := libbase libcutils liblog libsysutils
+LOCAL_SRC_FILES := logd_buffer_test.cpp
+include $(BUILD_NATIVE_TEST)
+
 cts_executable := CtsLogdTestCases
 
 include $(CLEAR_VARS)
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <benchmark/benchmark.h>
+#include <private/android_logger.h>
+#include <sysutils/SocketClient.h>
+
+#include "../LogBuffer.h"
+#include "../LogBufferChunked.h"
+
+// Furnished by main.cpp in logd proper
+char* android::uidToName(uid_t) {
+    return nullptr;
+}
+
+void android::prdebug(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+// A typical ALOGx record: priority, tag and a message of some length.
+static size_t fillMessage(char* buffer, size_t len, unsigned i) {
+    buffer[0] = ANDROID_LOG_INFO;
+    size_t n = 1 + snprintf(buffer + 1, len - 1, "logd_benchmark") + 1;
+    n += snprintf(buffer + n, len - n,
+                  "message number %u with a bit of padding to be typical", i);
+    return n + 1;
+}
+
+template <typename TLogBuffer>
+static void BM_log(benchmark::State& state) {
+    LastLogTimes times;
+    TLogBuffer buffer(&times);
+    buffer.setSize(LOG_ID_MAIN, state.range(0));
+
+    char msg[256];
+    unsigned i = 0;
+    log_time now(CLOCK_REALTIME);
+    while (state.KeepRunning()) {
+        size_t len = fillMessage(msg, sizeof(msg), i++);
+        now += log_time(0, 1000);
+        buffer.log(LOG_ID_MAIN, now, AID_SYSTEM, 1000 + (i % 7),
+                   1000 + (i % 13), msg, len);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK_TEMPLATE(BM_log, LogBuffer)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_log, LogBufferChunked)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+
+// Dump a full buffer to a sink, as logcat -d would.
+template <typename TLogBuffer>
+static void BM_flushTo(benchmark::State& state) {
+    LastLogTimes times;
+    TLogBuffer buffer(&times);
+    buffer.setSize(LOG_ID_MAIN, state.range(0));
+
+    char msg[256];
+    log_time now(CLOCK_REALTIME);
+    unsigned entries = 0;
+    unsigned long fill = state.range(0) * 8 / 10;
+    while (buffer.getSizeUsed(LOG_ID_MAIN) < fill) {
+        size_t len = fillMessage(msg, sizeof(msg), entries);
+        now += log_time(0, 1000);
+        buffer.log(LOG_ID_MAIN, now, AID_SYSTEM, 1000 + (entries % 7),
+                   1000 + (entries % 13), msg, len);
+        ++entries;
+    }
+
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    SocketClient client(fd, false);
+    while (state.KeepRunning()) {
+        buffer.flushTo(&client, log_time::EPOCH, nullptr, true, true);
+    }
+    close(fd);
+    state.SetItemsProcessed(state.iterations() * entries);
+}
+BENCHMARK_TEMPLATE(BM_flushTo, LogBuffer)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_flushTo, LogBufferChunked)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+
+// Resume near the end of a full buffer, as a reconnecting logcat -T does,
+// for a reader watching only the sparse crash log.
+template <typename TLogBuffer>
+static void BM_flushTo_resume(benchmark::State& state) {
+    LastLogTimes times;
+    TLogBuffer buffer(&times);
+    buffer.setSize(LOG_ID_MAIN, state.range(0));
+
+    char msg[256];
+    log_time now(CLOCK_REALTIME);
+    unsigned entries = 0;
+    unsigned long fill = state.range(0) * 8 / 10;
+    while (buffer.getSizeUsed(LOG_ID_MAIN) < fill) {
+        size_t len = fillMessage(msg, sizeof(msg), entries);
+        now += log_time(0, 1000);
+        buffer.log((entries % 1000) ? LOG_ID_MAIN : LOG_ID_CRASH, now,
+                   AID_SYSTEM, 1000 + (entries % 7), 1000 + (entries % 13),
+                   msg, len);
+        ++entries;
+    }
+    log_time start = now - log_time(0, 100 * 1000);
+
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    SocketClient client(fd, false);
+    while (state.KeepRunning()) {
+        buffer.flushTo(&client, start, nullptr, true, true, nullptr, nullptr,
+                       1 << LOG_ID_CRASH);
+    }
+    close(fd);
+}
+BENCHMARK_TEMPLATE(BM_flushTo_resume, LogBuffer)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+BENCHMARK_TEMPLATE(BM_flushTo_resume, LogBufferChunked)
+    ->Arg(256 * 1024)
+    ->Arg(16 * 1024 * 1024);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,704 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <private/android_logger.h>
+#include <sysutils/SocketClient.h>
+
+#include "../LogBuffer.h"
+#include "../LogBufferChunked.h"
+#include "../LogChunk.h"
+
+// Furnished by main.cpp in logd proper
+char* android::uidToName(uid_t) {
+    return nullptr;
+}
+
+void android::prdebug(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+// A typical ALOGx record: priority, tag and a message of some length.
+static std::string makeMessage(unsigned i) {
+    char buffer[256];
+    buffer[0] = ANDROID_LOG_INFO;
+    size_t n = 1 + snprintf(buffer + 1, sizeof(buffer) - 1,
+                            "logd_buffer_test") + 1;
+    n += snprintf(buffer + n, sizeof(buffer) - n,
+                  "message number %u with a bit of padding to be typical", i);
+    return std::string(buffer, n + 1);
+}
+
+// Timestamps never on a microsecond, which the buffers would slip.
+static log_time timeOf(unsigned i) {
+    return log_time(1500000000, 1) + log_time(i / 1000, (i % 1000) * 1000000);
+}
+
+struct Record {
+    log_id_t id;
+    log_time realtime;
+    uid_t uid;
+    pid_t pid;
+    pid_t tid;
+    std::string msg;
+
+    Record(log_id_t id, log_time realtime, uid_t uid, pid_t pid, pid_t tid,
+           const std::string& msg)
+        : id(id), realtime(realtime), uid(uid), pid(pid), tid(tid), msg(msg) {
+    }
+    explicit Record(const LogBufferElement* element)
+        : id(element->getLogId()),
+          realtime(element->getRealTime()),
+          uid(element->getUid()),
+          pid(element->getPid()),
+          tid(element->getTid()),
+          msg(element->getMsg(), element->getMsgLen()) {
+    }
+};
+
+static void expectSame(const Record& expected, const Record& actual) {
+    EXPECT_EQ(expected.id, actual.id);
+    EXPECT_EQ(expected.realtime, actual.realtime);
+    EXPECT_EQ(expected.uid, actual.uid);
+    EXPECT_EQ(expected.pid, actual.pid);
+    EXPECT_EQ(expected.tid, actual.tid);
+    EXPECT_EQ(expected.msg, actual.msg);
+}
+
+static void expectSame(const std::vector<Record>& expected,
+                       const std::vector<Record>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        SCOPED_TRACE(i);
+        expectSame(expected[i], actual[i]);
+    }
+}
+
+static Record makeRecord(log_id_t id, unsigned i) {
+    return Record(id, timeOf(i), AID_SYSTEM + (i % 3), 1000 + (i % 7),
+                  1000 + (i % 13), makeMessage(i));
+}
+
+static LogBufferElement* append(LogChunk& chunk, const Record& record) {
+    return chunk.append(record.id, record.realtime, record.uid, record.pid,
+                        record.tid, record.msg.data(), record.msg.size());
+}
+
+static LogBufferElement* insert(LogChunk& chunk, const Record& record) {
+    return chunk.insert(record.id, record.realtime, record.uid, record.pid,
+                        record.tid, record.msg.data(), record.msg.size());
+}
+
+static std::vector<Record> contents(const LogChunk& chunk) {
+    std::vector<Record> records;
+    chunk.forEach([&records](const LogBufferElement* element) {
+        // each payload directly follows its header
+        EXPECT_EQ(reinterpret_cast<const char*>(element) +
+                      sizeof(LogBufferElement),
+                  element->getMsg());
+        records.emplace_back(element);
+    });
+    return records;
+}
+
+TEST(LogChunk, append_until_full) {
+    LogChunk chunk(4096);
+    std::vector<Record> records;
+    for (unsigned i = 0;; ++i) {
+        Record record = makeRecord(LOG_ID_MAIN, i);
+        if (!append(chunk, record)) {
+            EXPECT_LT(chunk.capacity() - chunk.size(),
+                      LogChunk::recordSize(record.msg.size()));
+            break;
+        }
+        records.push_back(record);
+    }
+
+    ASSERT_LT(1u, records.size());
+    EXPECT_EQ(records.size(), chunk.count());
+    EXPECT_EQ(4096u, chunk.footprint());
+    EXPECT_EQ(records.back().realtime, chunk.newest());
+    EXPECT_FALSE(chunk.sealed());
+    expectSame(records, contents(chunk));
+}
+
+TEST(LogChunk, insert_in_time_order) {
+    LogChunk chunk(4096);
+    std::vector<Record> records;
+    for (unsigned i : {10, 20, 30}) {
+        records.push_back(makeRecord(LOG_ID_KERNEL, i));
+        ASSERT_NE(nullptr, append(chunk, records.back()));
+    }
+
+    Record early = makeRecord(LOG_ID_KERNEL, 5);
+    Record middle = makeRecord(LOG_ID_KERNEL, 15);
+    // same time as the newest, goes after it
+    Record last = makeRecord(LOG_ID_KERNEL, 30);
+    last.pid = 42;
+    ASSERT_NE(nullptr, insert(chunk, middle));
+    ASSERT_NE(nullptr, insert(chunk, early));
+    ASSERT_NE(nullptr, insert(chunk, last));
+
+    records.insert(records.begin() + 1, middle);
+    records.insert(records.begin(), early);
+    records.push_back(last);
+    EXPECT_EQ(records.size(), chunk.count());
+    EXPECT_EQ(timeOf(30), chunk.newest());
+    // the records moved up still point at their own payloads
+    expectSame(records, contents(chunk));
+}
+
+TEST(LogChunk, insert_full) {
+    LogChunk chunk(LogChunk::recordSize(makeMessage(1).size()) * 2);
+    ASSERT_NE(nullptr, append(chunk, makeRecord(LOG_ID_MAIN, 1)));
+    ASSERT_NE(nullptr, append(chunk, makeRecord(LOG_ID_MAIN, 3)));
+    EXPECT_EQ(nullptr, insert(chunk, makeRecord(LOG_ID_MAIN, 2)));
+    EXPECT_EQ(2u, chunk.count());
+}
+
+TEST(LogChunk, erase) {
+    LogChunk chunk(16 * 1024);
+    std::vector<Record> records;
+    size_t erasedSize = 0;
+    for (unsigned i = 0; i < 30; ++i) {
+        Record record = makeRecord(LOG_ID_MAIN, i);
+        ASSERT_NE(nullptr, append(chunk, record));
+        if (record.uid != AID_SYSTEM + 2) {
+            records.push_back(record);
+        } else {
+            erasedSize += LogChunk::recordSize(record.msg.size());
+        }
+    }
+    // the newest record is one of those erased
+    ASSERT_EQ(AID_SYSTEM + 2, makeRecord(LOG_ID_MAIN, 29).uid);
+
+    size_t erased = 0;
+    size_t released = chunk.erase(AID_SYSTEM + 2,
+                                  [&erased](LogBufferElement* element) {
+                                      EXPECT_EQ(AID_SYSTEM + 2,
+                                                element->getUid());
+                                      ++erased;
+                                  });
+    EXPECT_EQ(10u, erased);
+    EXPECT_EQ(erasedSize, released);
+    EXPECT_EQ(records.size(), chunk.count());
+    EXPECT_EQ(timeOf(28), chunk.newest());
+    expectSame(records, contents(chunk));
+}
+
+TEST(LogChunk, compress_round_trip) {
+    LogChunk chunk(64 * 1024);
+    std::vector<Record> records;
+    for (unsigned i = 0;; ++i) {
+        Record record = makeRecord(i % 2 ? LOG_ID_MAIN : LOG_ID_SYSTEM, i);
+        if (!append(chunk, record)) {
+            break;
+        }
+        records.push_back(record);
+    }
+    size_t size = chunk.size();
+    log_time newest = chunk.newest();
+
+    ASSERT_TRUE(chunk.compress());
+    EXPECT_TRUE(chunk.sealed());
+    EXPECT_TRUE(chunk.compressed());
+    EXPECT_LT(chunk.footprint(), size / 2);
+    EXPECT_EQ(size, chunk.size());
+    EXPECT_EQ(records.size(), chunk.count());
+    EXPECT_EQ(newest, chunk.newest());
+    // sealing twice is harmless
+    EXPECT_TRUE(chunk.compress());
+
+    std::unique_ptr<LogChunk> copy = chunk.expand();
+    ASSERT_NE(nullptr, copy);
+    EXPECT_TRUE(copy->sealed());
+    EXPECT_FALSE(copy->compressed());
+    EXPECT_EQ(records.size(), copy->count());
+    EXPECT_EQ(newest, copy->newest());
+    expectSame(records, contents(*copy));
+    // the original is left compressed
+    EXPECT_TRUE(chunk.compressed());
+
+    chunk.decompress();
+    EXPECT_TRUE(chunk.sealed());
+    EXPECT_FALSE(chunk.compressed());
+    EXPECT_EQ(size, chunk.footprint());
+    EXPECT_EQ(records.size(), chunk.count());
+    expectSame(records, contents(chunk));
+}
+
+TEST(LogChunk, compress_incompressible) {
+    LogChunk empty(4096);
+    EXPECT_FALSE(empty.compress());
+    EXPECT_TRUE(empty.sealed());
+    EXPECT_FALSE(empty.compressed());
+
+    // a single record of noise, which the headers cannot make up for
+    LogChunk chunk(4096);
+    std::string noise(4096 - sizeof(LogBufferElement), '\0');
+    srand(1);
+    for (char& c : noise) c = rand();
+    std::vector<Record> records;
+    records.emplace_back(LOG_ID_EVENTS, timeOf(0), AID_SYSTEM, 1000, 1000,
+                         noise);
+    ASSERT_NE(nullptr, append(chunk, records.back()));
+
+    EXPECT_FALSE(chunk.compress());
+    EXPECT_TRUE(chunk.sealed());
+    EXPECT_FALSE(chunk.compressed());
+    EXPECT_EQ(4096u, chunk.footprint());
+    expectSame(records, contents(chunk));
+}
+
+static int collect(const LogBufferElement* element, void* arg) {
+    static_cast<std::vector<Record>*>(arg)->emplace_back(element);
+    return false;  // nothing to send
+}
+
+// Everything a privileged reader starting after start would be sent.
+static std::vector<Record> dump(LogBufferInterface& buffer,
+                                const log_time& start,
+                                log_mask_t logMask = logMaskAll) {
+    std::vector<Record> records;
+    int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    SocketClient client(fd, false);
+    buffer.flushTo(&client, start, nullptr, true, true, collect, &records,
+                   logMask);
+    close(fd);
+    return records;
+}
+
+static void log(LogBufferInterface& buffer, const Record& record) {
+    ASSERT_LT(0, buffer.log(record.id, record.realtime, record.uid,
+                            record.pid, record.tid, record.msg.data(),
+                            record.msg.size()));
+}
+
+TEST(LogBufferChunked, size_used_counts_capacity) {
+    LastLogTimes times;
+    LogBufferChunked buffer(&times);
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_MAIN, 256 * 1024));
+    EXPECT_EQ(0u, buffer.getSizeUsed(LOG_ID_MAIN));
+
+    // eight chunks to a buffer
+    log(buffer, makeRecord(LOG_ID_MAIN, 0));
+    EXPECT_EQ(32 * 1024u, buffer.getSizeUsed(LOG_ID_MAIN));
+    log(buffer, makeRecord(LOG_ID_MAIN, 1));
+    EXPECT_EQ(32 * 1024u, buffer.getSizeUsed(LOG_ID_MAIN));
+}
+
+TEST(LogBufferChunked, late_records_in_time_order) {
+    LastLogTimes times;
+    LogBufferChunked buffer(&times);
+
+    std::vector<Record> records;
+    for (unsigned i = 0; i < 100; ++i) {
+        records.push_back(makeRecord(LOG_ID_MAIN, i * 10));
+        log(buffer, records.back());
+    }
+    records.push_back(makeRecord(LOG_ID_KERNEL, 505));
+    log(buffer, records.back());
+    // a second late, and a kernel record from well before anything else
+    records.push_back(makeRecord(LOG_ID_MAIN, 985));
+    log(buffer, records.back());
+    records.push_back(makeRecord(LOG_ID_KERNEL, 0));
+    records.back().realtime = timeOf(0) - log_time(60, 0);
+    log(buffer, records.back());
+
+    std::stable_sort(records.begin(), records.end(),
+                     [](const Record& a, const Record& b) {
+                         return a.realtime < b.realtime;
+                     });
+    expectSame(records, dump(buffer, log_time::EPOCH));
+}
+
+TEST(LogBufferChunked, read_across_sealed_and_open_chunks) {
+    LastLogTimes times;
+    LogBufferChunked buffer(&times);
+    buffer.enableCompression();
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_MAIN, 1024 * 1024));
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_SYSTEM, 1024 * 1024));
+
+    // some four chunks of main, sealed and compressed but for the last
+    std::vector<Record> records;
+    for (unsigned i = 0; i < 4000; ++i) {
+        records.push_back(makeRecord(i % 5 ? LOG_ID_MAIN : LOG_ID_SYSTEM, i));
+        log(buffer, records.back());
+    }
+    size_t uncompressed = 4 * 128 * 1024;
+    EXPECT_GT(uncompressed, buffer.getSizeUsed(LOG_ID_MAIN));
+
+    expectSame(records, dump(buffer, log_time::EPOCH));
+
+    // resume within each chunk, up to the end of the open one
+    for (size_t i = 0; i < records.size(); i += 97) {
+        SCOPED_TRACE(i);
+        std::vector<Record> tail(records.begin() + i + 1, records.end());
+        expectSame(tail, dump(buffer, records[i].realtime));
+    }
+
+    std::vector<Record> system;
+    for (const Record& record : records) {
+        if (record.id == LOG_ID_SYSTEM) system.push_back(record);
+    }
+    expectSame(system, dump(buffer, log_time::EPOCH, 1 << LOG_ID_SYSTEM));
+}
+
+TEST(LogBufferChunked, prune_compressed) {
+    LastLogTimes times;
+    LogBufferChunked buffer(&times);
+    buffer.enableCompression();
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_MAIN, 256 * 1024));
+
+    std::vector<Record> records;
+    for (unsigned i = 0; i < 40000; ++i) {
+        records.push_back(makeRecord(LOG_ID_MAIN, i));
+        log(buffer, records.back());
+    }
+    EXPECT_GE(256 * 1024u, buffer.getSizeUsed(LOG_ID_MAIN));
+
+    // what is left is the newest records, all of them
+    std::vector<Record> left = dump(buffer, log_time::EPOCH);
+    ASSERT_LT(0u, left.size());
+    ASSERT_GT(records.size(), left.size());
+    std::vector<Record> tail(records.end() - left.size(), records.end());
+    expectSame(tail, left);
+}
+
+// LogBuffer::seek() is checked against the scan back from the end that
+// LogBuffer::flushTo() did before there was an index, and the index itself
+// against the list it indexes.
+class LogBufferIndexTest : public ::testing::Test {
+   protected:
+    LastLogTimes lastLogTimes;
+    LogBuffer buffer;
+
+    LogBufferIndexTest() : buffer(&lastLogTimes) {
+    }
+
+    void log(log_id_t id, const log_time& realtime, uid_t uid, unsigned i) {
+        std::string msg = makeMessage(i);
+        ASSERT_LT(0, buffer.log(id, realtime, uid, 1000 + (i % 7),
+                                1000 + (i % 13), msg.data(), msg.size()));
+    }
+
+    void reindex() {
+        buffer.wrlock();
+        buffer.reindex();
+        buffer.unlock();
+    }
+
+    size_t liveEntries() {
+        buffer.rdlock();
+        size_t live = buffer.mIndexed.size();
+        buffer.unlock();
+        return live;
+    }
+
+    size_t deadEntries() {
+        buffer.rdlock();
+        size_t dead = buffer.mIndex.size() - buffer.mIndexed.size();
+        buffer.unlock();
+        return dead;
+    }
+
+    // Each live entry heads a run in list order, keyed by the time of its
+    // element and with a mask covering every element up to the next one.
+    void checkIndex() {
+        buffer.rdlock();
+        const LogBufferElementCollection& elements = buffer.mLogElements;
+        std::vector<const LogBufferElement*> list(elements.begin(),
+                                                  elements.end());
+        std::unordered_map<const LogBufferElement*, size_t> position;
+        for (size_t i = 0; i < list.size(); ++i) position[list[i]] = i;
+
+        auto checkRun = [&list](size_t begin, size_t end, log_mask_t mask) {
+            for (size_t i = begin; i < end; ++i) {
+                EXPECT_TRUE(mask & (1 << list[i]->getLogId())) << i;
+            }
+        };
+
+        const std::deque<LogBuffer::IndexEntry>& index = buffer.mIndex;
+        ASSERT_LE(buffer.mIndexFirst, buffer.mIndexSorted);
+        ASSERT_LE(buffer.mIndexSorted, buffer.mIndexFirst + index.size());
+        if (!index.empty()) {
+            EXPECT_NE(elements.end(), index.front().it);
+        }
+        size_t live = 0;
+        const LogBuffer::IndexEntry* previous = nullptr;
+        for (size_t i = 0; i < index.size(); ++i) {
+            const LogBuffer::IndexEntry& entry = index[i];
+            uint64_t sequence = buffer.mIndexFirst + i;
+            if (sequence > buffer.mIndexSorted) {
+                EXPECT_LE(index[i - 1].key, entry.key) << sequence;
+            }
+            if (entry.it == elements.end()) {
+                continue;
+            }
+            ++live;
+            EXPECT_EQ((*entry.it)->getRealTime(), entry.key) << sequence;
+            auto indexed = buffer.mIndexed.find(*entry.it);
+            ASSERT_NE(buffer.mIndexed.end(), indexed) << sequence;
+            EXPECT_EQ(sequence, indexed->second);
+            if (previous) {
+                ASSERT_LT(position[*previous->it], position[*entry.it]);
+                checkRun(position[*previous->it], position[*entry.it],
+                         previous->mask);
+            }
+            previous = &entry;
+        }
+        if (previous) {
+            checkRun(position[*previous->it], list.size(), previous->mask);
+        }
+        EXPECT_EQ(live, buffer.mIndexed.size());
+        buffer.unlock();
+    }
+
+    // seek() to each time held, just before and after it, and to before
+    // and after everything.
+    void checkSeek() {
+        buffer.rdlock();
+        const LogBufferElementCollection& elements = buffer.mLogElements;
+        std::vector<const LogBufferElement*> list(elements.begin(),
+                                                  elements.end());
+        std::unordered_map<const LogBufferElement*, size_t> position;
+        for (size_t i = 0; i < list.size(); ++i) position[list[i]] = i;
+        position[nullptr] = list.size();
+        auto positionOf = [&](LogBufferElementCollection::iterator it) {
+            return position[(it == elements.end()) ? nullptr : *it];
+        };
+
+        std::vector<log_time> starts;
+        for (const LogBufferElement* element : list) {
+            starts.push_back(element->getRealTime());
+            starts.push_back(element->getRealTime() - log_time(0, 1));
+            starts.push_back(element->getRealTime() + log_time(0, 1));
+        }
+        starts.push_back(log_time(1, 0));
+        starts.push_back(log_time(log_time::tv_sec_max, 0));
+
+        const std::deque<LogBuffer::IndexEntry>& index = buffer.mIndex;
+        for (const log_time& start : starts) {
+            SCOPED_TRACE(testing::Message() << start.tv_sec << "."
+                                            << start.tv_nsec);
+            uint64_t next;
+            size_t found = positionOf(buffer.seek(start, next));
+            ASSERT_EQ(linearSeek(list, start), found);
+
+            // next is the first live entry at or after where seek() landed
+            ASSERT_GE(next, buffer.mIndexFirst);
+            for (uint64_t i = buffer.mIndexFirst;
+                 i < std::min(next, buffer.mIndexFirst + index.size()); ++i) {
+                const LogBuffer::IndexEntry& entry =
+                    index[i - buffer.mIndexFirst];
+                if (entry.it != elements.end()) {
+                    ASSERT_LT(positionOf(entry.it), found) << i;
+                }
+            }
+            if (next < (buffer.mIndexFirst + index.size())) {
+                const LogBuffer::IndexEntry& entry =
+                    index[next - buffer.mIndexFirst];
+                ASSERT_NE(elements.end(), entry.it);
+                ASSERT_GE(positionOf(entry.it), found);
+            }
+        }
+        buffer.unlock();
+    }
+
+    // Where a reader resumes, as found before there was an index.
+    static size_t linearSeek(const std::vector<const LogBufferElement*>& list,
+                             const log_time& start) {
+        size_t count = 300;
+        size_t last = list.size();
+        for (size_t i = list.size(); i > 0; --i) {
+            const log_time& realtime = list[i - 1]->getRealTime();
+            if (realtime > start) {
+                last = i - 1;
+            } else if (realtime == start) {
+                last = i;
+                break;
+            } else if (!--count) {
+                break;
+            }
+        }
+        return last;
+    }
+
+    // What flushTo() sends of logMask from start, against the unindexed
+    // list from where the linear scan lands. The mask only lets flushTo()
+    // step over whole runs, the reader filters the rest.
+    void checkFlushTo(const log_time& start, log_mask_t logMask) {
+        std::vector<Record> all = dump(buffer, log_time::EPOCH);
+        buffer.rdlock();
+        std::vector<const LogBufferElement*> list(buffer.mLogElements.begin(),
+                                                  buffer.mLogElements.end());
+        buffer.unlock();
+        std::vector<Record> expected;
+        for (size_t i = linearSeek(list, start); i < all.size(); ++i) {
+            if (logMask & (1 << all[i].id)) expected.push_back(all[i]);
+        }
+        std::vector<Record> actual;
+        for (const Record& record : dump(buffer, start, logMask)) {
+            if (logMask & (1 << record.id)) actual.push_back(record);
+        }
+        expectSame(expected, actual);
+    }
+
+    void check() {
+        checkIndex();
+        checkSeek();
+    }
+};
+
+TEST_F(LogBufferIndexTest, empty) {
+    check();
+    checkFlushTo(log_time(1, 0), logMaskAll);
+}
+
+TEST_F(LogBufferIndexTest, append) {
+    for (unsigned i = 0; i < 3000; ++i) {
+        log_id_t id = (i % 5) ? LOG_ID_MAIN : LOG_ID_SYSTEM;
+        // the crash log only shows up in a few runs
+        if ((i > 1000) && !(i % 499)) id = LOG_ID_CRASH;
+        log(id, timeOf(i), AID_SYSTEM, i);
+    }
+    EXPECT_LT(20u, liveEntries());
+    check();
+
+    for (unsigned i : {0, 1, 127, 128, 129, 1500, 2997, 2998, 2999}) {
+        SCOPED_TRACE(i);
+        checkFlushTo(timeOf(i), logMaskAll);
+        checkFlushTo(timeOf(i), 1 << LOG_ID_CRASH);
+        checkFlushTo(timeOf(i), (1 << LOG_ID_SYSTEM) | (1 << LOG_ID_CRASH));
+    }
+}
+
+TEST_F(LogBufferIndexTest, insert_out_of_order) {
+    for (unsigned i = 0; i < 3000; ++i) {
+        log(LOG_ID_MAIN, timeOf(i), AID_SYSTEM, i);
+        // late kernel records land a few runs back, onto and around the
+        // heads of runs
+        if (!(i % 50) && (i > 1000)) {
+            log(LOG_ID_KERNEL, timeOf(i - 300) - log_time(0, 500000),
+                AID_ROOT, i);
+            log(LOG_ID_KERNEL, timeOf(i - 256), AID_ROOT, i);
+        }
+        // and one from before anything else
+        if (i == 2000) {
+            log(LOG_ID_KERNEL, timeOf(0) - log_time(60, 0), AID_ROOT, i);
+        }
+    }
+    check();
+
+    for (unsigned i : {0, 255, 256, 744, 745, 1500, 2999}) {
+        SCOPED_TRACE(i);
+        checkFlushTo(timeOf(i), logMaskAll);
+        checkFlushTo(timeOf(i), 1 << LOG_ID_KERNEL);
+        checkFlushTo(timeOf(i), 1 << LOG_ID_MAIN);
+    }
+}
+
+TEST_F(LogBufferIndexTest, erase) {
+    static const uid_t cleared = AID_APP_START;
+    for (unsigned i = 0; i < 3000; ++i) {
+        // the heads of runs, the element after some, and whole runs
+        bool run = (i >= 1000) && (i < 1400);
+        bool clear = !(i % 128) || ((i % 384) == 1) || run;
+        log(LOG_ID_MAIN, timeOf(i), clear ? cleared : AID_SYSTEM, i);
+        if (!(i % 10) && !run) {
+            log(LOG_ID_SYSTEM, timeOf(i) + log_time(0, 500000), cleared, i);
+        }
+    }
+    check();
+
+    // as an unprivileged logcat -c
+    EXPECT_FALSE(buffer.clear(LOG_ID_MAIN, cleared));
+    EXPECT_LT(0u, deadEntries());
+    check();
+    checkFlushTo(timeOf(1200), logMaskAll);
+    checkFlushTo(timeOf(1200), 1 << LOG_ID_SYSTEM);
+
+    EXPECT_FALSE(buffer.clear(LOG_ID_SYSTEM, cleared));
+    check();
+    checkFlushTo(timeOf(900), 1 << LOG_ID_SYSTEM);
+
+    for (unsigned i = 3000; i < 3500; ++i) {
+        log(LOG_ID_MAIN, timeOf(i), AID_SYSTEM, i);
+    }
+    check();
+    checkFlushTo(timeOf(2999), logMaskAll);
+}
+
+TEST_F(LogBufferIndexTest, prune) {
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_MAIN, 64 * 1024));
+    for (unsigned i = 0; i < 20000; ++i) {
+        log((i % 3) ? LOG_ID_MAIN : LOG_ID_RADIO, timeOf(i),
+            AID_APP_START + (i % 4), i);
+        if (!(i % 2500)) checkIndex();
+    }
+    check();
+    checkFlushTo(timeOf(19000), logMaskAll);
+    checkFlushTo(timeOf(19000), 1 << LOG_ID_RADIO);
+
+    // and when pruning the worst uid
+    buffer.enableStatistics();
+    for (unsigned i = 20000; i < 30000; ++i) {
+        log(LOG_ID_MAIN, timeOf(i), AID_APP_START + ((i % 5) ? 1 : 2), i);
+    }
+    check();
+    checkFlushTo(timeOf(29500), logMaskAll);
+
+    EXPECT_FALSE(buffer.clear(LOG_ID_MAIN));
+    check();
+    checkFlushTo(timeOf(19000), logMaskAll);
+}
+
+TEST_F(LogBufferIndexTest, reindex) {
+    ASSERT_EQ(0, buffer.setSize(LOG_ID_MAIN, 64 * 1024));
+    for (unsigned i = 0; i < 5000; ++i) {
+        log(LOG_ID_MAIN, timeOf(i), AID_APP_START + (i % 3), i);
+        if (!(i % 100)) log(LOG_ID_CRASH, timeOf(i) + log_time(0, 1000),
+                            AID_SYSTEM, i);
+    }
+    EXPECT_FALSE(buffer.clear(LOG_ID_MAIN, AID_APP_START));
+
+    // as after a change of clock
+    reindex();
+    EXPECT_EQ(0u, deadEntries());
+    check();
+    checkFlushTo(timeOf(4900), logMaskAll);
+    checkFlushTo(timeOf(4500), 1 << LOG_ID_CRASH);
+
+    for (unsigned i = 5000; i < 6000; ++i) {
+        log(LOG_ID_MAIN, timeOf(i), AID_APP_START, i);
+    }
+    check();
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Hammer a LogBuffer from several writer threads while readers dump it
+// continuously, and report the ingest rate and the p99 latency of log().
+//
+//   logd-ingest-stress [-w writers] [-r readers] [-n messages] [-q] [-c]
+//
+// -q stages the writes through LogIngestQueue, -c uses LogBufferChunked.
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <private/android_logger.h>
+#include <sysutils/SocketClient.h>
+
+#include "../LogBuffer.h"
+#include "../LogBufferChunked.h"
+#include "../LogIngestQueue.h"
+
+// Furnished by main.cpp in logd proper
+char* android::uidToName(uid_t) {
+    return nullptr;
+}
+
+void android::prdebug(const char* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+static uint64_t nanotime() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * NS_PER_SEC + ts.tv_nsec;
+}
+
+int main(int argc, char* argv[]) {
+    unsigned writers = 4;
+    unsigned readers = 2;
+    unsigned messages = 100000;
+    bool useQueue = false;
+    bool chunked = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "w:r:n:qc")) != -1) {
+        switch (opt) {
+            case 'w':
+                writers = atoi(optarg);
+                break;
+            case 'r':
+                readers = atoi(optarg);
+                break;
+            case 'n':
+                messages = atoi(optarg);
+                break;
+            case 'q':
+                useQueue = true;
+                break;
+            case 'c':
+                chunked = true;
+                break;
+            default:
+                fprintf(stderr,
+                        "usage: %s [-w writers] [-r readers] [-n messages] "
+                        "[-q] [-c]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    LastLogTimes times;
+    LogBufferInterface* logbuf;
+    if (chunked) {
+        logbuf = new LogBufferChunked(&times);
+    } else {
+        logbuf = new LogBuffer(&times);
+    }
+    LogIngestQueue* queue = nullptr;
+    if (useQueue) {
+        // Never deleted, the committer thread lives on until exit
+        queue = new LogIngestQueue(logbuf, nullptr);
+        if (!queue->startCommitter()) {
+            fprintf(stderr, "failed to start committer\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::atomic<bool> done(false);
+    std::vector<std::thread> readerThreads;
+    for (unsigned i = 0; i < readers; ++i) {
+        readerThreads.emplace_back([logbuf, &done]() {
+            int fd = open("/dev/null", O_WRONLY | O_CLOEXEC);
+            SocketClient client(fd, false);
+            while (!done) {
+                logbuf->flushTo(&client, log_time::EPOCH, nullptr, true, true);
+            }
+            close(fd);
+        });
+    }
+
+    std::vector<std::vector<uint64_t>> latencies(writers);
+    std::vector<std::thread> writerThreads;
+    uint64_t start = nanotime();
+    for (unsigned i = 0; i < writers; ++i) {
+        writerThreads.emplace_back([=, &latencies]() {
+            std::vector<uint64_t>& latency = latencies[i];
+            latency.reserve(messages);
+            char msg[128];
+            msg[0] = ANDROID_LOG_INFO;
+            size_t tagLen = snprintf(msg + 1, sizeof(msg) - 1, "stress%u", i);
+            char* text = msg + 1 + tagLen + 1;
+            size_t room = sizeof(msg) - 1 - tagLen - 1;
+            for (unsigned n = 0; n < messages; ++n) {
+                size_t textLen =
+                    snprintf(text, room, "writer %u message %u", i, n);
+                size_t len = 1 + tagLen + 1 + textLen + 1;
+                log_time now(CLOCK_REALTIME);
+                uint64_t begin = nanotime();
+                if (queue) {
+                    queue->log(LOG_ID_MAIN, now, AID_SYSTEM, 1000 + i, 1000 + i,
+                               msg, len);
+                } else {
+                    logbuf->log(LOG_ID_MAIN, now, AID_SYSTEM, 1000 + i,
+                                1000 + i, msg, len);
+                }
+                latency.push_back(nanotime() - begin);
+            }
+        });
+    }
+    for (auto& thread : writerThreads) {
+        thread.join();
+    }
+    uint64_t elapsed = nanotime() - start;
+    done = true;
+    for (auto& thread : readerThreads) {
+        thread.join();
+    }
+
+    std::vector<uint64_t> all;
+    for (auto& latency : latencies) {
+        all.insert(all.end(), latency.begin(), latency.end());
+    }
+    std::sort(all.begin(), all.end());
+    uint64_t total = all.size();
+    uint64_t p50 = total ? all[total / 2] : 0;
+    uint64_t p99 = total ? all[(total * 99) / 100] : 0;
+
+    printf("%s%s: %u writers, %u readers, %" PRIu64 " messages\n",
+           chunked ? "chunked" : "list", useQueue ? "+queue" : "", writers,
+           readers, total);
+    printf("%.0f messages/sec, log() p50 %" PRIu64 "ns p99 %" PRIu64 "ns\n",
+           elapsed ? (total * double(NS_PER_SEC)) / elapsed : 0.0, p50, p99);
+
+    return EXIT_SUCCESS;
+}